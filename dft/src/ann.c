@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define CATALOG_IMPL
+#include "catalog.h"
+
+#define MFCC_IMPL
+#include "mfcc.h"
+
+#define ANN_IMPL
+#include "ann.h"
+
+// cc src/ann.c -o ann.exe -I. -O2 -lm -lpthread && ./ann.exe build ../corpus.mfc ../corpus.ann
+
+#define ANN_DEFAULT_HITS   10
+#define ANN_DEFAULT_PROBES 8
+
+static f64
+ann_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s build [-l lists] [-p 0|1] [-t threads] <features.mfc> <out.ann>\n", program);
+    fprintf(stderr, "       %s query [-k hits] [-n probes] <catalog.cat> <features.mfc> <index.ann> <word id>\n", program);
+}
+
+static i32
+ann_tool_build(i32 argc, char **argv)
+{
+    u32 list_count   = 0;
+    b32 pq           = true;
+    u32 thread_count = par_thread_count();
+
+    i32 arg = 0;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'l': list_count   = atoi(argv[arg + 1]); break;
+            case 'p': pq           = atoi(argv[arg + 1]); break;
+            case 't': thread_count = atoi(argv[arg + 1]); break;
+
+            default: {
+                fprintf(stderr, "Unknown option '%s'!\n", argv[arg]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 2 != argc) {
+        fprintf(stderr, "Expected the features and the output file!\n");
+        return 1;
+    }
+
+    mfcc_store_t store;
+
+    if (!mfcc_store_open(&store, argv[arg]))
+        return 1;
+
+    // Words without audio have no features.
+    u32 *ids = malloc(store.word_count * sizeof(u32) + 1);
+
+    if (!ids) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    u32 count = 0;
+
+    for (u32 i = 0; i < store.word_count; ++i) {
+        if (store.frames[i]) {
+            ids[count++] = i;
+        }
+    }
+
+    if (count == 0) {
+        fprintf(stderr, "'%s' has no words with features!\n", argv[arg]);
+        free(ids);
+        mfcc_store_close(&store);
+        return 1;
+    }
+
+    if (list_count == 0) {
+        list_count = (u32)sqrt((f64)count);
+    }
+
+    const f32 *columns[MFCC_FEATURES];
+
+    for (u32 f = 0; f < MFCC_FEATURES; ++f) {
+        columns[f] = mfcc_store_column(&store, f);
+    }
+
+    f64 start = ann_seconds();
+
+    b32 ok = ann_build(argv[arg + 1], columns, MFCC_FEATURES, ids, count, list_count, pq, thread_count ? thread_count : 1);
+
+    printf("%u vectors in %u lists%s, built in %.2fs\n", count, list_count < count ? list_count : count,
+           pq && count >= ANN_PQ_CENTROIDS ? " with product quantization" : "", ann_seconds() - start);
+
+    free(ids);
+    mfcc_store_close(&store);
+
+    return ok ? 0 : 1;
+}
+
+static void
+ann_print_hits(const catalog_t *catalog, const mfcc_store_t *store, const ann_hit_t *hits, u32 count)
+{
+    for (u32 i = 0; i < count; ++i) {
+        u32 id = hits[i].id;
+        u32 entry = mfcc_store_entry(store, id);
+
+        const char *caption_path = entry < catalog->count ? catalog_entry(catalog, entry).caption_path : "?";
+
+        printf("  %8.3f %9u %9.2fs %s\n", hits[i].distance, id, store->starts[id], caption_path);
+    }
+}
+
+static i32
+ann_tool_query(i32 argc, char **argv)
+{
+    u32 k      = ANN_DEFAULT_HITS;
+    u32 probes = ANN_DEFAULT_PROBES;
+
+    i32 arg = 0;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'k': k      = atoi(argv[arg + 1]); break;
+            case 'n': probes = atoi(argv[arg + 1]); break;
+
+            default: {
+                fprintf(stderr, "Unknown option '%s'!\n", argv[arg]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 4 != argc) {
+        fprintf(stderr, "Expected the catalog, the features, the index and a word id!\n");
+        return 1;
+    }
+
+    catalog_t catalog;
+    mfcc_store_t store;
+    ann_t ann;
+
+    if (!catalog_open(&catalog, argv[arg]))
+        return 1;
+
+    if (!mfcc_store_open(&store, argv[arg + 1])) {
+        catalog_close(&catalog);
+        return 1;
+    }
+
+    if (!ann_open(&ann, argv[arg + 2])) {
+        mfcc_store_close(&store);
+        catalog_close(&catalog);
+        return 1;
+    }
+
+    i32 res = 1;
+    u32 id = (u32)strtoul(argv[arg + 3], NULL, 10);
+
+    if (ann.feature_count != MFCC_FEATURES) {
+        fprintf(stderr, "Index has %u features instead of %u!\n", ann.feature_count, MFCC_FEATURES);
+    }
+    else if (id >= store.word_count || store.frames[id] == 0) {
+        fprintf(stderr, "Word %u has no features!\n", id);
+    }
+    else {
+        f32 features[MFCC_FEATURES];
+
+        for (u32 f = 0; f < MFCC_FEATURES; ++f) {
+            features[f] = mfcc_store_column(&store, f)[id];
+        }
+
+        k = k ? k : 1;
+
+        f32       *query = malloc(ann.dim * sizeof(f32));
+        ann_hit_t *exact = malloc(k * sizeof(ann_hit_t) + 1);
+        ann_hit_t *hits  = malloc(k * sizeof(ann_hit_t) + 1);
+
+        if (!query || !exact || !hits) {
+            fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+            exit(666);
+        }
+
+        ann_query(&ann, features, query);
+
+        f64 start = ann_seconds();
+        u32 exact_count = ann_search_exact(&ann, query, k, exact);
+        f64 exact_seconds = ann_seconds() - start;
+
+        start = ann_seconds();
+        u32 hit_count = ann_search(&ann, query, k, probes, hits);
+        f64 ivf_seconds = ann_seconds() - start;
+
+        u32 found = 0;
+
+        for (u32 i = 0; i < hit_count; ++i) {
+            for (u32 j = 0; j < exact_count; ++j) {
+                found += hits[i].id == exact[j].id;
+            }
+        }
+
+        printf("exact, %.3fms over %u vectors:\n", exact_seconds * 1000.0, ann.count);
+        ann_print_hits(&catalog, &store, exact, exact_count);
+
+        printf("ivf%s, %.3fms over %u of %u lists, recall %u/%u:\n", ann.pq_count ? "+pq" : "", ivf_seconds * 1000.0,
+               probes < ann.list_count ? probes : ann.list_count, ann.list_count, found, exact_count);
+        ann_print_hits(&catalog, &store, hits, hit_count);
+
+        free(query);
+        free(exact);
+        free(hits);
+
+        res = 0;
+    }
+
+    ann_close(&ann);
+    mfcc_store_close(&store);
+    catalog_close(&catalog);
+
+    return res;
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "build") == 0)
+        return ann_tool_build(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "query") == 0)
+        return ann_tool_query(argc - 2, argv + 2);
+
+    print_usage(argv[0]);
+    return 1;
+}
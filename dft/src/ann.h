@@ -0,0 +1,806 @@
+#ifndef ANN_H_
+#define ANN_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+/* Nearest neighbours of fixed length vectors, for finding words said the
+ * same way. Features are standardized (zero mean, unit variance each) and
+ * padded with zeros to a multiple of four, so distances are squared L2 over
+ * SSE2 lanes.
+ *
+ * Exact search scans every vector. The IVF index clusters the vectors with
+ * k-means into `list_count` lists and a query only scans the lists of the
+ * `probes` centroids nearest to it. With product quantization every vector
+ * of a list is also stored as one byte per `ANN_PQ_DIM` dimensions: the code
+ * of the nearest of `ANN_PQ_CENTROIDS` centroids trained on the residuals
+ * (vector minus its list centroid) of that subspace. A query then sums
+ * distances out of a table per subspace instead of touching the vectors, and
+ * only re-ranks the best `ANN_RERANK` candidates per hit exactly.
+ *
+ * The index is one file, mapped: vectors are stored in list order next to
+ * the word id of each.
+ */
+
+#define ANN_MAGIC   0x314E4E41 // "ANN1"
+#define ANN_VERSION 1
+
+#define ANN_PQ_DIM            4
+#define ANN_PQ_CENTROIDS      256
+#define ANN_KMEANS_ITERATIONS 12
+#define ANN_TRAIN_PER_CLUSTER 64      // Training sample size per centroid,
+#define ANN_TRAIN_MAX         (1 << 16) // up to this many points.
+#define ANN_RERANK            8
+
+typedef struct
+{
+    u32 id;
+    f32 distance;
+} ann_hit_t;
+
+typedef struct
+{
+    u32 magic, version;
+
+    u32 dim;           // `feature_count` rounded up to a multiple of four.
+    u32 feature_count;
+    u32 count;
+    u32 list_count;
+    u32 pq_count;      // Subspaces, zero without product quantization.
+    u32 reserved;
+
+    u64 mean_offset, scale_offset; // Standardization of every feature.
+    u64 centroids_offset;          // `dim` values per list.
+    u64 list_offsets_offset;       // First vector of every list, plus the count at the end.
+    u64 ids_offset;                // Id of every vector.
+    u64 vectors_offset;            // `dim` values per vector.
+    u64 codebooks_offset;          // `ANN_PQ_CENTROIDS * ANN_PQ_DIM` values per subspace.
+    u64 codes_offset;              // `pq_count` bytes per vector.
+    u64 size;
+} ann_header_t;
+
+typedef struct
+{
+    u8 *base;
+    u64 size;
+
+    const ann_header_t *header;
+    u32 dim, feature_count, count, list_count, pq_count;
+
+    const f32 *mean, *scale;
+    const f32 *centroids;
+    const u32 *list_offsets;
+    const u32 *ids;
+    const f32 *vectors;
+    const f32 *codebooks;
+    const u8  *codes;
+} ann_t;
+
+/* Indexes `count` vectors, feature `f` of vector `i` is `columns[f][ids[i]]`.
+ * Product quantization needs at least `ANN_PQ_CENTROIDS` vectors and is left
+ * out with fewer. Fails without any vectors.
+ */
+b32
+ann_build(const char *path, const f32 *const *columns, u32 feature_count, const u32 *ids, u32 count,
+          u32 list_count, b32 pq, u32 thread_count);
+
+b32
+ann_open(ann_t *ann, const char *path);
+
+void
+ann_close(ann_t *ann);
+
+// Standardized and padded query out of `feature_count` raw features, `dim` values.
+void
+ann_query(const ann_t *ann, const f32 *features, f32 *query_o);
+
+// Best `k` hits by distance into `hits`, returns how many there are.
+u32
+ann_search_exact(const ann_t *ann, const f32 *query, u32 k, ann_hit_t *hits);
+
+u32
+ann_search(const ann_t *ann, const f32 *query, u32 k, u32 probes, ann_hit_t *hits);
+
+#endif // ANN_H_
+
+#if defined(ANN_IMPL) && !defined(ANN_IMPL_)
+#define ANN_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define PAR_IMPL
+#include "par.h"
+
+// Squared distance, `dim` is a multiple of four.
+static f32
+ann_l2(const f32 *a, const f32 *b, u32 dim)
+{
+#if defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+
+    for (u32 i = 0; i < dim; i += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+    }
+
+    f32 lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    f32 sum = 0.0f;
+
+    for (u32 i = 0; i < dim; ++i) {
+        f32 d = a[i] - b[i];
+        sum += d * d;
+    }
+
+    return sum;
+#endif
+}
+
+static u32
+ann_nearest(const f32 *centroids, u32 k, u32 dim, const f32 *point)
+{
+    u32 best = 0;
+    f32 best_distance = FLT_MAX;
+
+    for (u32 c = 0; c < k; ++c) {
+        f32 distance = ann_l2(centroids + (u64)c * dim, point, dim);
+
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = c;
+        }
+    }
+
+    return best;
+}
+
+/* Max-heap of the best hits so far, the worst one on top. */
+
+typedef struct
+{
+    ann_hit_t *hits;
+    u32        count, capacity;
+} ann_heap_t;
+
+static void
+ann_heap_push(ann_heap_t *heap, u32 id, f32 distance)
+{
+    ann_hit_t *hits = heap->hits;
+    u32 i;
+
+    if (heap->count < heap->capacity) {
+        i = heap->count++;
+
+        while (i > 0 && hits[(i - 1) / 2].distance < distance) {
+            hits[i] = hits[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    }
+    else if (heap->capacity && distance < hits[0].distance) {
+        i = 0;
+
+        for (;;) {
+            u32 child = i * 2 + 1;
+
+            if (child >= heap->count)
+                break;
+
+            if (child + 1 < heap->count && hits[child + 1].distance > hits[child].distance) {
+                ++child;
+            }
+
+            if (hits[child].distance <= distance)
+                break;
+
+            hits[i] = hits[child];
+            i = child;
+        }
+    }
+    else {
+        return;
+    }
+
+    hits[i] = (ann_hit_t) { .id = id, .distance = distance };
+}
+
+static f32
+ann_heap_worst(const ann_heap_t *heap)
+{
+    return heap->count < heap->capacity || heap->capacity == 0 ? FLT_MAX : heap->hits[0].distance;
+}
+
+static int
+ann_hit_cmp(const void *a, const void *b)
+{
+    const ann_hit_t *ha = a, *hb = b;
+    return (ha->distance > hb->distance) - (ha->distance < hb->distance);
+}
+
+static void
+ann_heap_sort(ann_heap_t *heap)
+{
+    if (heap->count > 1) {
+        qsort(heap->hits, heap->count, sizeof(ann_hit_t), ann_hit_cmp);
+    }
+}
+
+/* K-means */
+
+typedef struct
+{
+    const f32 *points;    // `stride` values per point, the `dim` first are used.
+    u32        count, dim, stride;
+    const f32 *centroids; // `dim` values per centroid.
+    u32        k;
+    u32       *assignments;
+} ann_assign_t;
+
+#define ANN_ASSIGN_BLOCK 1024
+
+static void
+ann_assign_block(void *context, u32 thread, u32 item)
+{
+    (void)thread;
+
+    ann_assign_t *assign = context;
+
+    u32 begin = item * ANN_ASSIGN_BLOCK;
+    u32 end   = begin + ANN_ASSIGN_BLOCK < assign->count ? begin + ANN_ASSIGN_BLOCK : assign->count;
+
+    for (u32 i = begin; i < end; ++i) {
+        assign->assignments[i] = ann_nearest(assign->centroids, assign->k, assign->dim, assign->points + (u64)i * assign->stride);
+    }
+}
+
+static void
+ann_assign(ann_assign_t *assign, u32 thread_count)
+{
+    par_for((assign->count + ANN_ASSIGN_BLOCK - 1) / ANN_ASSIGN_BLOCK, thread_count, ann_assign_block, assign);
+}
+
+/* `k` centroids of `dim` values out of an evenly spread sample of the
+ * points, `count` has to be at least 1. Clusters that run empty restart on a
+ * sample point, so with fewer points than `k` some centroids repeat.
+ */
+static void
+ann_kmeans(const f32 *points, u32 count, u32 dim, u32 stride, u32 k, f32 *centroids, u32 thread_count)
+{
+    u32 sample_count = k * ANN_TRAIN_PER_CLUSTER < ANN_TRAIN_MAX ? k * ANN_TRAIN_PER_CLUSTER : ANN_TRAIN_MAX;
+    sample_count = sample_count > k ? sample_count : k;
+    sample_count = sample_count < count ? sample_count : count;
+
+    f32 *sample      = malloc((u64)sample_count * dim * sizeof(f32) + 1);
+    u32 *assignments = malloc(sample_count * sizeof(u32) + 1);
+    u32 *sizes       = malloc(k * sizeof(u32));
+
+    if (!sample || !assignments || !sizes) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < sample_count; ++i) {
+        u64 point = (u64)i * count / sample_count;
+        memcpy(sample + (u64)i * dim, points + point * stride, dim * sizeof(f32));
+    }
+
+    for (u32 c = 0; c < k; ++c) {
+        u64 point = (u64)c * sample_count / k;
+        memcpy(centroids + (u64)c * dim, sample + point * dim, dim * sizeof(f32));
+    }
+
+    ann_assign_t assign = {
+        .points      = sample,
+        .count       = sample_count,
+        .dim         = dim,
+        .stride      = dim,
+        .centroids   = centroids,
+        .k           = k,
+        .assignments = assignments,
+    };
+
+    u32 reseed = 0;
+
+    for (u32 iteration = 0; iteration < ANN_KMEANS_ITERATIONS; ++iteration) {
+        ann_assign(&assign, thread_count);
+
+        memset(centroids, 0, (u64)k * dim * sizeof(f32));
+        memset(sizes, 0, k * sizeof(u32));
+
+        for (u32 i = 0; i < sample_count; ++i) {
+            f32 *centroid = centroids + (u64)assignments[i] * dim;
+            const f32 *point = sample + (u64)i * dim;
+
+            for (u32 d = 0; d < dim; ++d) {
+                centroid[d] += point[d];
+            }
+
+            sizes[assignments[i]]++;
+        }
+
+        for (u32 c = 0; c < k; ++c) {
+            f32 *centroid = centroids + (u64)c * dim;
+
+            if (sizes[c] == 0) {
+                reseed = (reseed + 7919) % sample_count;
+                memcpy(centroid, sample + (u64)reseed * dim, dim * sizeof(f32));
+                continue;
+            }
+
+            for (u32 d = 0; d < dim; ++d) {
+                centroid[d] /= sizes[c];
+            }
+        }
+    }
+
+    free(sample);
+    free(assignments);
+    free(sizes);
+}
+
+static u64
+ann_align(u64 offset)
+{
+    return (offset + 7) & ~(u64)7;
+}
+
+static b32
+ann_write_section(FILE *file, u64 *offset, const void *data, u64 size)
+{
+    static const u8 zeros[8] = {0};
+
+    u64 aligned = ann_align(*offset);
+
+    if (aligned != *offset && fwrite(zeros, 1, aligned - *offset, file) != aligned - *offset)
+        return false;
+
+    if (size != 0 && fwrite(data, 1, size, file) != size)
+        return false;
+
+    *offset = aligned + size;
+    return true;
+}
+
+// Places a section of `size` bytes behind `offset`.
+static u64
+ann_layout(u64 *offset, u64 size)
+{
+    u64 start = ann_align(*offset);
+    *offset = start + size;
+    return start;
+}
+
+b32
+ann_build(const char *path, const f32 *const *columns, u32 feature_count, const u32 *ids, u32 count,
+          u32 list_count, b32 pq, u32 thread_count)
+{
+    u32 dim = (feature_count + 3) & ~3u;
+
+    if (count == 0) {
+        fprintf(stderr, "No vectors to index into '%s'!\n", path);
+        return false;
+    }
+
+    list_count = list_count < count ? list_count : count;
+    list_count = list_count ? list_count : 1;
+    pq = pq && count >= ANN_PQ_CENTROIDS;
+
+    u32 pq_count = pq ? dim / ANN_PQ_DIM : 0;
+
+    f32 *mean      = malloc(feature_count * sizeof(f32));
+    f32 *scale     = malloc(feature_count * sizeof(f32));
+    f32 *points    = calloc((u64)count * dim + 1, sizeof(f32));
+    f32 *centroids = malloc((u64)list_count * dim * sizeof(f32));
+    u32 *lists     = malloc(count * sizeof(u32) + 1);
+    u32 *offsets   = calloc(list_count + 1, sizeof(u32));
+    u32 *order_ids = malloc(count * sizeof(u32) + 1);
+    f32 *vectors   = malloc((u64)count * dim * sizeof(f32) + 1);
+
+    if (!mean || !scale || !points || !centroids || !lists || !offsets || !order_ids || !vectors) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 f = 0; f < feature_count; ++f) {
+        f64 sum = 0.0, sum_sq = 0.0;
+
+        for (u32 i = 0; i < count; ++i) {
+            f64 value = columns[f][ids[i]];
+            sum    += value;
+            sum_sq += value * value;
+        }
+
+        f64 m   = count ? sum / count : 0.0;
+        f64 var = count ? sum_sq / count - m * m : 0.0;
+
+        mean[f]  = (f32)m;
+        scale[f] = var > 1e-12 ? (f32)(1.0 / sqrt(var)) : 1.0f;
+
+        for (u32 i = 0; i < count; ++i) {
+            points[(u64)i * dim + f] = (columns[f][ids[i]] - mean[f]) * scale[f];
+        }
+    }
+
+    ann_kmeans(points, count, dim, dim, list_count, centroids, thread_count);
+
+    ann_assign_t assign = {
+        .points      = points,
+        .count       = count,
+        .dim         = dim,
+        .stride      = dim,
+        .centroids   = centroids,
+        .k           = list_count,
+        .assignments = lists,
+    };
+
+    ann_assign(&assign, thread_count);
+
+    // Counting sort into list order.
+    for (u32 i = 0; i < count; ++i) {
+        offsets[lists[i] + 1]++;
+    }
+
+    for (u32 l = 0; l < list_count; ++l) {
+        offsets[l + 1] += offsets[l];
+    }
+
+    u32 *fill = malloc(list_count * sizeof(u32));
+
+    if (!fill) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    memcpy(fill, offsets, list_count * sizeof(u32));
+
+    for (u32 i = 0; i < count; ++i) {
+        u32 position = fill[lists[i]]++;
+
+        order_ids[position] = ids[i];
+        memcpy(vectors + (u64)position * dim, points + (u64)i * dim, dim * sizeof(f32));
+    }
+
+    free(fill);
+
+    f32 *codebooks = NULL;
+    u8  *codes     = NULL;
+
+    if (pq) {
+        codebooks = malloc((u64)pq_count * ANN_PQ_CENTROIDS * ANN_PQ_DIM * sizeof(f32));
+        codes     = malloc((u64)count * pq_count);
+
+        u32 *assignments = malloc(count * sizeof(u32));
+
+        if (!codebooks || !codes || !assignments) {
+            fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+            exit(666);
+        }
+
+        // Residuals in list order, reusing the points.
+        for (u32 l = 0; l < list_count; ++l) {
+            for (u32 position = offsets[l]; position < offsets[l + 1]; ++position) {
+                for (u32 d = 0; d < dim; ++d) {
+                    points[(u64)position * dim + d] = vectors[(u64)position * dim + d] - centroids[(u64)l * dim + d];
+                }
+            }
+        }
+
+        for (u32 m = 0; m < pq_count; ++m) {
+            f32 *codebook = codebooks + (u64)m * ANN_PQ_CENTROIDS * ANN_PQ_DIM;
+
+            ann_kmeans(points + m * ANN_PQ_DIM, count, ANN_PQ_DIM, dim, ANN_PQ_CENTROIDS, codebook, thread_count);
+
+            ann_assign_t sub = {
+                .points      = points + m * ANN_PQ_DIM,
+                .count       = count,
+                .dim         = ANN_PQ_DIM,
+                .stride      = dim,
+                .centroids   = codebook,
+                .k           = ANN_PQ_CENTROIDS,
+                .assignments = assignments,
+            };
+
+            ann_assign(&sub, thread_count);
+
+            for (u32 i = 0; i < count; ++i) {
+                codes[(u64)i * pq_count + m] = (u8)assignments[i];
+            }
+        }
+
+        free(assignments);
+    }
+
+    ann_header_t header = {
+        .magic         = ANN_MAGIC,
+        .version       = ANN_VERSION,
+        .dim           = dim,
+        .feature_count = feature_count,
+        .count         = count,
+        .list_count    = list_count,
+        .pq_count      = pq_count,
+    };
+
+    u64 features_size  = feature_count * sizeof(f32);
+    u64 centroids_size = (u64)list_count * dim * sizeof(f32);
+    u64 offsets_size   = (list_count + 1) * sizeof(u32);
+    u64 ids_size       = count * sizeof(u32);
+    u64 vectors_size   = (u64)count * dim * sizeof(f32);
+    u64 codebooks_size = (u64)pq_count * ANN_PQ_CENTROIDS * ANN_PQ_DIM * sizeof(f32);
+    u64 codes_size     = (u64)count * pq_count;
+
+    u64 offset = sizeof(header);
+
+    header.mean_offset         = ann_layout(&offset, features_size);
+    header.scale_offset        = ann_layout(&offset, features_size);
+    header.centroids_offset    = ann_layout(&offset, centroids_size);
+    header.list_offsets_offset = ann_layout(&offset, offsets_size);
+    header.ids_offset          = ann_layout(&offset, ids_size);
+    header.vectors_offset      = ann_layout(&offset, vectors_size);
+    header.codebooks_offset    = ann_layout(&offset, codebooks_size);
+    header.codes_offset        = ann_layout(&offset, codes_size);
+    header.size = offset;
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    b32 ok = false;
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file) {
+        offset = 0;
+
+        ok = ann_write_section(file, &offset, &header, sizeof(header))
+          && ann_write_section(file, &offset, mean, features_size)
+          && ann_write_section(file, &offset, scale, features_size)
+          && ann_write_section(file, &offset, centroids, centroids_size)
+          && ann_write_section(file, &offset, offsets, offsets_size)
+          && ann_write_section(file, &offset, order_ids, ids_size)
+          && ann_write_section(file, &offset, vectors, vectors_size)
+          && ann_write_section(file, &offset, codebooks, codebooks_size)
+          && ann_write_section(file, &offset, codes, codes_size);
+
+        if (fclose(file) != 0) {
+            ok = false;
+        }
+
+        if (ok && rename(tmp_path, path) != 0) {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write index '%s': %s\n", path, strerror(errno));
+        remove(tmp_path);
+    }
+
+    free(mean);
+    free(scale);
+    free(points);
+    free(centroids);
+    free(lists);
+    free(offsets);
+    free(order_ids);
+    free(vectors);
+    free(codebooks);
+    free(codes);
+
+    return ok;
+}
+
+b32
+ann_open(ann_t *ann, const char *path)
+{
+    *ann = (ann_t) {0};
+
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open index '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(ann_header_t)) {
+        fprintf(stderr, "Index '%s' is truncated!\n", path);
+        close(fd);
+        return false;
+    }
+
+    u8 *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map index '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    const ann_header_t *header = (const ann_header_t *)base;
+
+    if (header->magic != ANN_MAGIC || header->version != ANN_VERSION || header->size != (u64)st.st_size
+     || header->dim % 4 != 0 || header->dim < header->feature_count) {
+        fprintf(stderr, "Index '%s' is corrupted!\n", path);
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    ann->base          = base;
+    ann->size          = st.st_size;
+    ann->header        = header;
+    ann->dim           = header->dim;
+    ann->feature_count = header->feature_count;
+    ann->count         = header->count;
+    ann->list_count    = header->list_count;
+    ann->pq_count      = header->pq_count;
+    ann->mean          = (const f32 *)(base + header->mean_offset);
+    ann->scale         = (const f32 *)(base + header->scale_offset);
+    ann->centroids     = (const f32 *)(base + header->centroids_offset);
+    ann->list_offsets  = (const u32 *)(base + header->list_offsets_offset);
+    ann->ids           = (const u32 *)(base + header->ids_offset);
+    ann->vectors       = (const f32 *)(base + header->vectors_offset);
+    ann->codebooks     = (const f32 *)(base + header->codebooks_offset);
+    ann->codes         = (const u8  *)(base + header->codes_offset);
+
+    return true;
+}
+
+void
+ann_close(ann_t *ann)
+{
+    if (ann->base) {
+        munmap(ann->base, ann->size);
+    }
+
+    *ann = (ann_t) {0};
+}
+
+void
+ann_query(const ann_t *ann, const f32 *features, f32 *query_o)
+{
+    for (u32 d = 0; d < ann->dim; ++d) {
+        query_o[d] = d < ann->feature_count ? (features[d] - ann->mean[d]) * ann->scale[d] : 0.0f;
+    }
+}
+
+// Heap positions back to ids, best first.
+static u32
+ann_finish(const ann_t *ann, ann_heap_t *heap)
+{
+    ann_heap_sort(heap);
+
+    for (u32 i = 0; i < heap->count; ++i) {
+        heap->hits[i].id = ann->ids[heap->hits[i].id];
+    }
+
+    return heap->count;
+}
+
+u32
+ann_search_exact(const ann_t *ann, const f32 *query, u32 k, ann_hit_t *hits)
+{
+    ann_heap_t heap = { .hits = hits, .capacity = k };
+
+    for (u32 position = 0; position < ann->count; ++position) {
+        f32 distance = ann_l2(ann->vectors + (u64)position * ann->dim, query, ann->dim);
+
+        if (distance < ann_heap_worst(&heap)) {
+            ann_heap_push(&heap, position, distance);
+        }
+    }
+
+    return ann_finish(ann, &heap);
+}
+
+u32
+ann_search(const ann_t *ann, const f32 *query, u32 k, u32 probes, ann_hit_t *hits)
+{
+    probes = probes < ann->list_count ? probes : ann->list_count;
+    probes = probes ? probes : 1;
+
+    // Nearest lists, the distance to the centroid goes unused.
+    ann_hit_t *lists = malloc(probes * sizeof(ann_hit_t));
+    ann_heap_t list_heap = { .hits = lists, .capacity = probes };
+
+    if (!lists) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 l = 0; l < ann->list_count; ++l) {
+        ann_heap_push(&list_heap, l, ann_l2(ann->centroids + (u64)l * ann->dim, query, ann->dim));
+    }
+
+    ann_heap_sort(&list_heap);
+
+    if (!ann->pq_count) {
+        ann_heap_t heap = { .hits = hits, .capacity = k };
+
+        for (u32 p = 0; p < list_heap.count; ++p) {
+            u32 list = lists[p].id;
+
+            for (u32 position = ann->list_offsets[list]; position < ann->list_offsets[list + 1]; ++position) {
+                f32 distance = ann_l2(ann->vectors + (u64)position * ann->dim, query, ann->dim);
+
+                if (distance < ann_heap_worst(&heap)) {
+                    ann_heap_push(&heap, position, distance);
+                }
+            }
+        }
+
+        free(lists);
+        return ann_finish(ann, &heap);
+    }
+
+    u32 pq_count = ann->pq_count;
+    u32 candidate_count = k * ANN_RERANK;
+
+    f32       *table      = malloc((u64)pq_count * ANN_PQ_CENTROIDS * sizeof(f32));
+    ann_hit_t *candidates = malloc(candidate_count * sizeof(ann_hit_t) + 1);
+
+    if (!table || !candidates) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    ann_heap_t candidate_heap = { .hits = candidates, .capacity = candidate_count };
+
+    for (u32 p = 0; p < list_heap.count; ++p) {
+        u32 list = lists[p].id;
+        const f32 *centroid = ann->centroids + (u64)list * ann->dim;
+
+        // Distance of the query residual to every centroid of every subspace.
+        for (u32 m = 0; m < pq_count; ++m) {
+            f32 residual[ANN_PQ_DIM];
+
+            for (u32 d = 0; d < ANN_PQ_DIM; ++d) {
+                residual[d] = query[m * ANN_PQ_DIM + d] - centroid[m * ANN_PQ_DIM + d];
+            }
+
+            const f32 *codebook = ann->codebooks + (u64)m * ANN_PQ_CENTROIDS * ANN_PQ_DIM;
+
+            for (u32 c = 0; c < ANN_PQ_CENTROIDS; ++c) {
+                table[m * ANN_PQ_CENTROIDS + c] = ann_l2(codebook + c * ANN_PQ_DIM, residual, ANN_PQ_DIM);
+            }
+        }
+
+        for (u32 position = ann->list_offsets[list]; position < ann->list_offsets[list + 1]; ++position) {
+            const u8 *code = ann->codes + (u64)position * pq_count;
+            f32 distance = 0.0f;
+
+            for (u32 m = 0; m < pq_count; ++m) {
+                distance += table[m * ANN_PQ_CENTROIDS + code[m]];
+            }
+
+            if (distance < ann_heap_worst(&candidate_heap)) {
+                ann_heap_push(&candidate_heap, position, distance);
+            }
+        }
+    }
+
+    ann_heap_t heap = { .hits = hits, .capacity = k };
+
+    for (u32 i = 0; i < candidate_heap.count; ++i) {
+        u32 position = candidates[i].id;
+        ann_heap_push(&heap, position, ann_l2(ann->vectors + (u64)position * ann->dim, query, ann->dim));
+    }
+
+    free(lists);
+    free(table);
+    free(candidates);
+
+    return ann_finish(ann, &heap);
+}
+
+#endif // ANN_IMPL
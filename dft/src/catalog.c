@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define CATALOG_IMPL
+#include "catalog.h"
+
+// cc src/catalog.c -o catalog.exe -I. -O2 -lm -lpthread && ./catalog.exe scan ../corpus.cat ../oneyplays
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s scan <catalog.cat> [-t threads] <root folder>\n", program);
+    fprintf(stderr, "       %s list <catalog.cat>\n", program);
+    fprintf(stderr, "       %s stats <catalog.cat>\n", program);
+}
+
+static i32
+catalog_tool_scan(const char *path, i32 argc, char **argv)
+{
+    u32 thread_count = par_thread_count();
+
+    i32 arg = 0;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-t") == 0) {
+        thread_count = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+
+    if (arg + 1 != argc) {
+        fprintf(stderr, "Expected one root folder!\n");
+        return 1;
+    }
+
+    // Entries of the previous scan are taken over when their files didn't change.
+    catalog_t previous = {0};
+    b32 has_previous = access(path, R_OK) == 0 && catalog_open(&previous, path);
+
+    catalog_entries_t entries;
+    catalog_stats_t stats;
+
+    catalog_scan(&entries, argv[arg], has_previous ? &previous : NULL, thread_count, &stats);
+
+    b32 ok = catalog_write(&entries, path);
+
+    printf("%u folders, %u entries, %u unchanged\n", stats.folders, stats.entries, stats.reused);
+
+    catalog_entries_free(&entries);
+    catalog_close(&previous);
+
+    return ok ? 0 : 1;
+}
+
+static i32
+catalog_tool_list(const catalog_t *catalog)
+{
+    for (u32 i = 0; i < catalog->count; ++i) {
+        catalog_entry_t entry = catalog_entry(catalog, i);
+
+        printf("%s\n", entry.caption_path);
+        printf("    audio:   %s\n", entry.audio_path ? entry.audio_path : "-");
+        printf("    length:  %.2fs audio, %.2fs captions, %u words\n", entry.audio_duration, entry.caption_duration, entry.word_count);
+        printf("    size:    "FMT_U64" audio, "FMT_U64" captions\n", entry.audio_size, entry.caption_size);
+        printf("    hash:    %016llx %016llx\n", (unsigned long long)entry.audio_hash, (unsigned long long)entry.caption_hash);
+    }
+
+    return 0;
+}
+
+static i32
+catalog_tool_stats(const catalog_t *catalog)
+{
+    f64 audio_duration = 0, caption_duration = 0;
+    u64 words = 0, bytes = 0;
+    u32 without_audio = 0;
+
+    for (u32 i = 0; i < catalog->count; ++i) {
+        audio_duration   += catalog->audio_duration[i];
+        caption_duration += catalog->caption_duration[i];
+        words            += catalog->word_count[i];
+        bytes            += catalog->audio_size[i] + catalog->caption_size[i];
+        without_audio    += catalog->audio_path[i] == CATALOG_NONE;
+    }
+
+    printf("%u entries, %u without audio\n", catalog->count, without_audio);
+    printf("%.1f hours of audio, %.1f hours of captions\n", audio_duration / 3600.0, caption_duration / 3600.0);
+    printf(""FMT_U64" words, "FMT_U64" bytes\n", words, bytes);
+
+    return 0;
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "scan") == 0)
+        return catalog_tool_scan(argv[2], argc - 3, argv + 3);
+
+    catalog_t catalog;
+
+    if (!catalog_open(&catalog, argv[2]))
+        return 1;
+
+    i32 res = 1;
+
+    if (strcmp(argv[1], "list") == 0) {
+        res = catalog_tool_list(&catalog);
+    }
+    else if (strcmp(argv[1], "stats") == 0) {
+        res = catalog_tool_stats(&catalog);
+    }
+    else {
+        print_usage(argv[0]);
+    }
+
+    catalog_close(&catalog);
+
+    return res;
+}
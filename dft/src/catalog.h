@@ -0,0 +1,924 @@
+#ifndef CATALOG_H_
+#define CATALOG_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+
+/* The corpus as one file: every caption file found under a root folder, the
+ * audio next to it and their metadata (durations, word count, sizes, times
+ * and content hashes). The file stores every field as its own column, so
+ * tools mapping it only touch what they read. Paths are zero terminated in a
+ * string blob and the entries are sorted by caption path.
+ *
+ * Scanning walks the tree one level at a time with every folder of a level
+ * listed in parallel, then probes the pairs in parallel. Files whose size and
+ * modification time match the previous catalog are not read again.
+ *
+ * A caption file pairs with the audio file of the same stem (the name up to
+ * the first dot), or with the only audio file of its folder.
+ */
+
+#define CATALOG_MAGIC   0x31544143 // "CAT1"
+#define CATALOG_VERSION 1
+
+#define CATALOG_NONE       0xFFFFFFFF
+#define CATALOG_HASH_BLOCK (1 << 20)
+
+typedef struct
+{
+    const char *audio_path;   // NULL when there is no audio.
+    const char *caption_path;
+
+    f32 audio_duration;   // Seconds, zero when the format is not known.
+    f32 caption_duration; // End of the last word.
+    u32 word_count;       // Words that aren't just white space.
+
+    u64 audio_size, caption_size;
+    i64 audio_mtime, caption_mtime; // Nanoseconds.
+    u64 audio_hash, caption_hash;
+} catalog_entry_t;
+
+typedef dck_stretchy_t (catalog_entry_t, u32) catalog_entries_t;
+
+typedef struct
+{
+    u32 magic, version;
+
+    u32 entry_count;
+    u32 string_size;
+
+    u64 strings_offset;
+    u64 audio_path_offset, caption_path_offset; // Offsets into the strings, `CATALOG_NONE` for no audio.
+    u64 audio_duration_offset, caption_duration_offset;
+    u64 word_count_offset;
+    u64 audio_size_offset, caption_size_offset;
+    u64 audio_mtime_offset, caption_mtime_offset;
+    u64 audio_hash_offset, caption_hash_offset;
+    u64 size;
+} catalog_header_t;
+
+typedef struct
+{
+    u8 *base;
+    u64 size;
+
+    const catalog_header_t *header;
+    u32 count;
+
+    const char *strings;
+    const u32  *audio_path, *caption_path;
+    const f32  *audio_duration, *caption_duration;
+    const u32  *word_count;
+    const u64  *audio_size, *caption_size;
+    const i64  *audio_mtime, *caption_mtime;
+    const u64  *audio_hash, *caption_hash;
+} catalog_t;
+
+typedef struct
+{
+    u32 folders;
+    u32 entries;
+    u32 reused; // Entries taken over from the previous catalog.
+} catalog_stats_t;
+
+b32
+catalog_open(catalog_t *catalog, const char *path);
+
+void
+catalog_close(catalog_t *catalog);
+
+// The paths point into the mapped file.
+catalog_entry_t
+catalog_entry(const catalog_t *catalog, u32 index);
+
+// Index of the entry of that caption file or `CATALOG_NONE`.
+u32
+catalog_find(const catalog_t *catalog, const char *caption_path);
+
+// Scans the tree under `root`, `previous` may be NULL.
+void
+catalog_scan(catalog_entries_t *entries_o, const char *root, const catalog_t *previous, u32 thread_count, catalog_stats_t *stats_o);
+
+b32
+catalog_write(const catalog_entries_t *entries, const char *path);
+
+void
+catalog_entries_free(catalog_entries_t *entries);
+
+// Duration of an Ogg (Vorbis or Opus) or WAV file from its headers, zero for anything else.
+f32
+catalog_audio_duration(const char *path);
+
+#endif // CATALOG_H_
+
+#if defined(CATALOG_IMPL) && !defined(CATALOG_IMPL_)
+#define CATALOG_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+
+#define PAR_IMPL
+#include "par.h"
+
+#define CATALOG_PATH_MAX 4096
+
+static const char *catalog_audio_extensions[] = { ".ogg", ".opus", ".oga", ".wav" };
+
+typedef dck_stretchy_t (char *, u32) catalog_paths_t;
+
+typedef struct
+{
+    char *audio_path, *caption_path;
+} catalog_pair_t;
+
+typedef struct
+{
+    catalog_paths_t dirs;
+    dck_stretchy_t (catalog_pair_t, u32) pairs;
+    vtt_data_t vtt;
+} catalog_thread_t;
+
+typedef struct
+{
+    catalog_paths_t  level; // Folders listed in this round.
+    catalog_thread_t *threads;
+
+    catalog_pair_t  *pairs;
+    catalog_entry_t *entries;
+    const catalog_t *previous;
+    b32             *reused;
+} catalog_scan_t;
+
+static char *
+catalog_strdup(const char *text)
+{
+    u64 size = strlen(text) + 1;
+    char *copy = malloc(size);
+
+    if (!copy) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    memcpy(copy, text, size);
+    return copy;
+}
+
+static char *
+catalog_join(const char *dir, const char *name)
+{
+    char path[CATALOG_PATH_MAX];
+    u64 size = strlen(dir);
+
+    snprintf(path, sizeof(path), "%s%s%s", dir, size && dir[size - 1] == '/' ? "" : "/", name);
+
+    return catalog_strdup(path);
+}
+
+static b32
+catalog_has_suffix(const char *name, const char *suffix)
+{
+    u64 size        = strlen(name);
+    u64 suffix_size = strlen(suffix);
+
+    return size > suffix_size && strcmp(name + size - suffix_size, suffix) == 0;
+}
+
+static b32
+catalog_is_audio(const char *name)
+{
+    for (u32 i = 0; i < sizeof(catalog_audio_extensions) / sizeof(*catalog_audio_extensions); ++i) {
+        if (catalog_has_suffix(name, catalog_audio_extensions[i]))
+            return true;
+    }
+
+    return false;
+}
+
+static u64
+catalog_stem_size(const char *name)
+{
+    const char *dot = strchr(name, '.');
+    return dot ? (u64)(dot - name) : strlen(name);
+}
+
+static int
+catalog_strcmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int
+catalog_pair_cmp(const void *a, const void *b)
+{
+    return strcmp(((const catalog_pair_t *)a)->caption_path, ((const catalog_pair_t *)b)->caption_path);
+}
+
+// Lists one folder, queues its subfolders and pairs up its files.
+static void
+catalog_list_dir(void *context, u32 thread_index, u32 item)
+{
+    catalog_scan_t *scan = context;
+    catalog_thread_t *thread = scan->threads + thread_index;
+
+    const char *dir_path = scan->level.data[item];
+    DIR *dir = opendir(dir_path);
+
+    if (!dir) {
+        fprintf(stderr, "Failed to open folder '%s': %s\n", dir_path, strerror(errno));
+        return;
+    }
+
+    catalog_paths_t captions = {0};
+    catalog_paths_t audios   = {0};
+
+    struct dirent *ent;
+
+    while ((ent = readdir(dir))) {
+        // Skips `.`, `..` and hidden files.
+        if (ent->d_name[0] == '.')
+            continue;
+
+        b32 is_dir = ent->d_type == DT_DIR;
+
+        if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+            char *path = catalog_join(dir_path, ent->d_name);
+            struct stat st;
+
+            is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+            free(path);
+        }
+
+        if (is_dir) {
+            dck_stretchy_push(thread->dirs, catalog_join(dir_path, ent->d_name));
+        }
+        else if (catalog_has_suffix(ent->d_name, ".vtt")) {
+            dck_stretchy_push(captions, catalog_strdup(ent->d_name));
+        }
+        else if (catalog_is_audio(ent->d_name)) {
+            dck_stretchy_push(audios, catalog_strdup(ent->d_name));
+        }
+    }
+
+    closedir(dir);
+
+    // Sorted, so the pairing doesn't depend on the listing order.
+    if (audios.count > 1) {
+        qsort(audios.data, audios.count, sizeof(char *), catalog_strcmp);
+    }
+
+    for (u32 c = 0; c < captions.count; ++c) {
+        const char *caption = captions.data[c];
+        const char *audio = audios.count == 1 ? audios.data[0] : NULL;
+
+        u64 stem_size = catalog_stem_size(caption);
+
+        for (u32 a = 0; a < audios.count; ++a) {
+            if (catalog_stem_size(audios.data[a]) == stem_size && memcmp(audios.data[a], caption, stem_size) == 0) {
+                audio = audios.data[a];
+                break;
+            }
+        }
+
+        dck_stretchy_push(thread->pairs, ((catalog_pair_t) {
+            .audio_path   = audio ? catalog_join(dir_path, audio) : NULL,
+            .caption_path = catalog_join(dir_path, caption),
+        }));
+    }
+
+    for (u32 i = 0; i < captions.count; ++i) {
+        free(captions.data[i]);
+    }
+
+    for (u32 i = 0; i < audios.count; ++i) {
+        free(audios.data[i]);
+    }
+
+    free(captions.data);
+    free(audios.data);
+}
+
+static b32
+catalog_stat(const char *path, u64 *size_o, i64 *mtime_o)
+{
+    struct stat st;
+
+    if (!path || stat(path, &st) != 0)
+        return false;
+
+    *size_o  = st.st_size;
+    *mtime_o = (i64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// Hash of the whole file, read block by block.
+static u64
+catalog_hash_file(const char *path, u8 *block)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return 0;
+
+    u64 hash = HASH_SEED;
+    u64 read;
+
+    while ((read = fread(block, 1, CATALOG_HASH_BLOCK, file)) != 0) {
+        hash = hash_combine(hash, hash_bytes(block, read));
+    }
+
+    fclose(file);
+    return hash;
+}
+
+static u32
+catalog_read_u32(const u8 *bytes)
+{
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (u32)bytes[3] << 24;
+}
+
+static u64
+catalog_read_u64(const u8 *bytes)
+{
+    return catalog_read_u32(bytes) | (u64)catalog_read_u32(bytes + 4) << 32;
+}
+
+// The granule position of the last Ogg page is the length in samples.
+static f32
+catalog_ogg_duration(FILE *file, u64 size)
+{
+    u8 head[512];
+    u64 head_size = fread(head, 1, sizeof(head), file);
+
+    if (head_size < 27 || memcmp(head, "OggS", 4) != 0)
+        return 0;
+
+    // First packet of the first page, the codec identification header.
+    u32 segments = head[26];
+    u32 packet   = 27 + segments;
+
+    if (packet + 19 > head_size)
+        return 0;
+
+    u32 rate = 0;
+    u64 skip = 0;
+
+    if (memcmp(head + packet, "\x01vorbis", 7) == 0) {
+        rate = catalog_read_u32(head + packet + 12);
+    }
+    else if (memcmp(head + packet, "OpusHead", 8) == 0) {
+        rate = 48000; // Opus granules always count 48 kHz samples.
+        skip = head[packet + 10] | head[packet + 11] << 8;
+    }
+
+    if (rate == 0)
+        return 0;
+
+    // Pages are at most ~64 KiB, so the last one starts in the tail.
+    u64 tail_size = size < 70000 ? size : 70000;
+    u8 *tail = malloc(tail_size);
+
+    if (!tail) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    f32 duration = 0;
+
+    if (fseek(file, size - tail_size, SEEK_SET) == 0 && fread(tail, 1, tail_size, file) == tail_size) {
+        for (u64 i = tail_size >= 27 ? tail_size - 27 + 1 : 0; i-- > 0;) {
+            if (memcmp(tail + i, "OggS", 4) == 0 && tail[i + 4] == 0) {
+                u64 granule = catalog_read_u64(tail + i + 6);
+
+                if (granule != ~0ull && granule > skip) {
+                    duration = (granule - skip) / (f32)rate;
+                }
+
+                break;
+            }
+        }
+    }
+
+    free(tail);
+    return duration;
+}
+
+static f32
+catalog_wav_duration(FILE *file)
+{
+    u8 header[12];
+
+    if (fread(header, 1, 12, file) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+        return 0;
+
+    u32 byte_rate = 0;
+    u8 chunk[16];
+
+    while (fread(chunk, 1, 8, file) == 8) {
+        u32 chunk_size = catalog_read_u32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+            if (fread(chunk, 1, 16, file) != 16)
+                return 0;
+
+            byte_rate = catalog_read_u32(chunk + 8);
+            chunk_size -= 16;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            return byte_rate ? chunk_size / (f32)byte_rate : 0;
+        }
+
+        // Chunks are padded to an even size.
+        if (fseek(file, chunk_size + (chunk_size & 1), SEEK_CUR) != 0)
+            return 0;
+    }
+
+    return 0;
+}
+
+f32
+catalog_audio_duration(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return 0;
+
+    f32 duration = 0;
+
+    if (catalog_has_suffix(path, ".wav")) {
+        duration = catalog_wav_duration(file);
+    }
+    else if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+
+        if (size > 0 && fseek(file, 0, SEEK_SET) == 0) {
+            duration = catalog_ogg_duration(file, size);
+        }
+    }
+
+    fclose(file);
+    return duration;
+}
+
+// Fills in the metadata of one pair, taking it over from the previous catalog when both files are unchanged.
+static void
+catalog_probe_pair(void *context, u32 thread_index, u32 item)
+{
+    catalog_scan_t *scan = context;
+    catalog_thread_t *thread = scan->threads + thread_index;
+
+    catalog_pair_t pair = scan->pairs[item];
+    catalog_entry_t *entry = scan->entries + item;
+
+    *entry = (catalog_entry_t) {
+        .audio_path   = pair.audio_path,
+        .caption_path = pair.caption_path,
+    };
+
+    b32 has_audio   = catalog_stat(pair.audio_path, &entry->audio_size, &entry->audio_mtime);
+    b32 has_caption = catalog_stat(pair.caption_path, &entry->caption_size, &entry->caption_mtime);
+
+    if (!has_caption)
+        return;
+
+    if (scan->previous) {
+        u32 index = catalog_find(scan->previous, pair.caption_path);
+
+        if (index != CATALOG_NONE) {
+            catalog_entry_t old = catalog_entry(scan->previous, index);
+
+            b32 same_audio = !has_audio
+                ? old.audio_path == NULL
+                : old.audio_path && strcmp(old.audio_path, pair.audio_path) == 0
+                  && old.audio_size == entry->audio_size && old.audio_mtime == entry->audio_mtime;
+
+            if (same_audio && old.caption_size == entry->caption_size && old.caption_mtime == entry->caption_mtime) {
+                old.audio_path   = entry->audio_path;
+                old.caption_path = entry->caption_path;
+                *entry = old;
+
+                scan->reused[item] = true;
+                return;
+            }
+        }
+    }
+
+    u8 *block = malloc(CATALOG_HASH_BLOCK);
+
+    if (!block) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    if (has_audio) {
+        entry->audio_duration = catalog_audio_duration(pair.audio_path);
+        entry->audio_hash     = catalog_hash_file(pair.audio_path, block);
+    }
+
+    entry->caption_hash = catalog_hash_file(pair.caption_path, block);
+    free(block);
+
+    thread->vtt.text.count  = 0;
+    thread->vtt.words.count = 0;
+
+    vtt_chunk_t chunk = vtt_parse_file(&thread->vtt, pair.caption_path);
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = thread->vtt.words.data[chunk.word_offset + i];
+
+        if (!vtt_word_blank(&thread->vtt, word)) {
+            entry->word_count++;
+        }
+
+        if (word.time_end > entry->caption_duration) {
+            entry->caption_duration = word.time_end;
+        }
+    }
+}
+
+void
+catalog_scan(catalog_entries_t *entries_o, const char *root, const catalog_t *previous, u32 thread_count, catalog_stats_t *stats_o)
+{
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    catalog_scan_t scan = {
+        .threads  = calloc(thread_count, sizeof(catalog_thread_t)),
+        .previous = previous,
+    };
+
+    if (!scan.threads) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    catalog_stats_t stats = {0};
+
+    dck_stretchy_t (catalog_pair_t, u32) pairs = {0};
+    dck_stretchy_push(scan.level, catalog_strdup(root));
+
+    while (scan.level.count) {
+        stats.folders += scan.level.count;
+
+        par_for(scan.level.count, thread_count, catalog_list_dir, &scan);
+
+        for (u32 i = 0; i < scan.level.count; ++i) {
+            free(scan.level.data[i]);
+        }
+
+        scan.level.count = 0;
+
+        for (u32 t = 0; t < thread_count; ++t) {
+            catalog_thread_t *thread = scan.threads + t;
+
+            for (u32 i = 0; i < thread->dirs.count; ++i) {
+                dck_stretchy_push(scan.level, thread->dirs.data[i]);
+            }
+
+            for (u32 i = 0; i < thread->pairs.count; ++i) {
+                dck_stretchy_push(pairs, thread->pairs.data[i]);
+            }
+
+            thread->dirs.count  = 0;
+            thread->pairs.count = 0;
+        }
+    }
+
+    if (pairs.count > 1) {
+        qsort(pairs.data, pairs.count, sizeof(catalog_pair_t), catalog_pair_cmp);
+    }
+
+    *entries_o = (catalog_entries_t) {0};
+    dck_stretchy_reserve(*entries_o, pairs.count);
+    entries_o->count = pairs.count;
+
+    scan.pairs   = pairs.data;
+    scan.entries = entries_o->data;
+    scan.reused  = calloc(pairs.count + 1, sizeof(b32));
+
+    if (!scan.reused) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    par_for(pairs.count, thread_count, catalog_probe_pair, &scan);
+
+    for (u32 i = 0; i < pairs.count; ++i) {
+        stats.reused += scan.reused[i];
+    }
+
+    stats.entries = pairs.count;
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        catalog_thread_t *thread = scan.threads + t;
+
+        free(thread->dirs.data);
+        free(thread->pairs.data);
+        free(thread->vtt.text.data);
+        free(thread->vtt.words.data);
+    }
+
+    free(scan.threads);
+    free(scan.level.data);
+    free(scan.reused);
+    free(pairs.data);
+
+    if (stats_o) {
+        *stats_o = stats;
+    }
+}
+
+void
+catalog_entries_free(catalog_entries_t *entries)
+{
+    for (u32 i = 0; i < entries->count; ++i) {
+        free((char *)entries->data[i].audio_path);
+        free((char *)entries->data[i].caption_path);
+    }
+
+    free(entries->data);
+    *entries = (catalog_entries_t) {0};
+}
+
+static u64
+catalog_align(u64 offset)
+{
+    return (offset + 7) & ~(u64)7;
+}
+
+static b32
+catalog_write_section(FILE *file, u64 *offset, const void *data, u64 size)
+{
+    static const u8 zeros[8] = {0};
+
+    u64 aligned = catalog_align(*offset);
+
+    if (aligned != *offset && fwrite(zeros, 1, aligned - *offset, file) != aligned - *offset)
+        return false;
+
+    if (size != 0 && fwrite(data, 1, size, file) != size)
+        return false;
+
+    *offset = aligned + size;
+    return true;
+}
+
+// Places a column of `count` values of `size` bytes behind `offset`.
+static u64
+catalog_layout(u64 *offset, u32 count, u64 size)
+{
+    u64 start = catalog_align(*offset);
+    *offset = start + count * size;
+    return start;
+}
+
+b32
+catalog_write(const catalog_entries_t *entries, const char *path)
+{
+    u32 count = entries->count;
+
+    dck_stretchy_t (char, u32) strings = {0};
+
+    u32 *audio_path    = malloc(count * sizeof(u32) + 1);
+    u32 *caption_path  = malloc(count * sizeof(u32) + 1);
+    f32 *audio_dur     = malloc(count * sizeof(f32) + 1);
+    f32 *caption_dur   = malloc(count * sizeof(f32) + 1);
+    u32 *word_count    = malloc(count * sizeof(u32) + 1);
+    u64 *audio_size    = malloc(count * sizeof(u64) + 1);
+    u64 *caption_size  = malloc(count * sizeof(u64) + 1);
+    i64 *audio_mtime   = malloc(count * sizeof(i64) + 1);
+    i64 *caption_mtime = malloc(count * sizeof(i64) + 1);
+    u64 *audio_hash    = malloc(count * sizeof(u64) + 1);
+    u64 *caption_hash  = malloc(count * sizeof(u64) + 1);
+
+    if (!audio_path || !caption_path || !audio_dur || !caption_dur || !word_count || !audio_size
+     || !caption_size || !audio_mtime || !caption_mtime || !audio_hash || !caption_hash) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < count; ++i) {
+        catalog_entry_t entry = entries->data[i];
+
+        audio_path[i] = CATALOG_NONE;
+
+        if (entry.audio_path) {
+            u32 size = strlen(entry.audio_path) + 1;
+
+            audio_path[i] = strings.count;
+            dck_stretchy_reserve(strings, size);
+            memcpy(strings.data + strings.count, entry.audio_path, size);
+            strings.count += size;
+        }
+
+        u32 size = strlen(entry.caption_path) + 1;
+
+        caption_path[i] = strings.count;
+        dck_stretchy_reserve(strings, size);
+        memcpy(strings.data + strings.count, entry.caption_path, size);
+        strings.count += size;
+
+        audio_dur[i]     = entry.audio_duration;
+        caption_dur[i]   = entry.caption_duration;
+        word_count[i]    = entry.word_count;
+        audio_size[i]    = entry.audio_size;
+        caption_size[i]  = entry.caption_size;
+        audio_mtime[i]   = entry.audio_mtime;
+        caption_mtime[i] = entry.caption_mtime;
+        audio_hash[i]    = entry.audio_hash;
+        caption_hash[i]  = entry.caption_hash;
+    }
+
+    catalog_header_t header = {
+        .magic       = CATALOG_MAGIC,
+        .version     = CATALOG_VERSION,
+        .entry_count = count,
+        .string_size = strings.count,
+    };
+
+    u64 offset = sizeof(header);
+
+    header.strings_offset          = catalog_layout(&offset, strings.count, 1);
+    header.audio_path_offset       = catalog_layout(&offset, count, sizeof(u32));
+    header.caption_path_offset     = catalog_layout(&offset, count, sizeof(u32));
+    header.audio_duration_offset   = catalog_layout(&offset, count, sizeof(f32));
+    header.caption_duration_offset = catalog_layout(&offset, count, sizeof(f32));
+    header.word_count_offset       = catalog_layout(&offset, count, sizeof(u32));
+    header.audio_size_offset       = catalog_layout(&offset, count, sizeof(u64));
+    header.caption_size_offset     = catalog_layout(&offset, count, sizeof(u64));
+    header.audio_mtime_offset      = catalog_layout(&offset, count, sizeof(i64));
+    header.caption_mtime_offset    = catalog_layout(&offset, count, sizeof(i64));
+    header.audio_hash_offset       = catalog_layout(&offset, count, sizeof(u64));
+    header.caption_hash_offset     = catalog_layout(&offset, count, sizeof(u64));
+    header.size = offset;
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    b32 ok = false;
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file) {
+        offset = 0;
+
+        ok = catalog_write_section(file, &offset, &header, sizeof(header))
+          && catalog_write_section(file, &offset, strings.data, strings.count)
+          && catalog_write_section(file, &offset, audio_path, count * sizeof(u32))
+          && catalog_write_section(file, &offset, caption_path, count * sizeof(u32))
+          && catalog_write_section(file, &offset, audio_dur, count * sizeof(f32))
+          && catalog_write_section(file, &offset, caption_dur, count * sizeof(f32))
+          && catalog_write_section(file, &offset, word_count, count * sizeof(u32))
+          && catalog_write_section(file, &offset, audio_size, count * sizeof(u64))
+          && catalog_write_section(file, &offset, caption_size, count * sizeof(u64))
+          && catalog_write_section(file, &offset, audio_mtime, count * sizeof(i64))
+          && catalog_write_section(file, &offset, caption_mtime, count * sizeof(i64))
+          && catalog_write_section(file, &offset, audio_hash, count * sizeof(u64))
+          && catalog_write_section(file, &offset, caption_hash, count * sizeof(u64));
+
+        if (fclose(file) != 0) {
+            ok = false;
+        }
+
+        if (ok && rename(tmp_path, path) != 0) {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write catalog '%s': %s\n", path, strerror(errno));
+        remove(tmp_path);
+    }
+
+    free(strings.data);
+    free(audio_path);
+    free(caption_path);
+    free(audio_dur);
+    free(caption_dur);
+    free(word_count);
+    free(audio_size);
+    free(caption_size);
+    free(audio_mtime);
+    free(caption_mtime);
+    free(audio_hash);
+    free(caption_hash);
+
+    return ok;
+}
+
+b32
+catalog_open(catalog_t *catalog, const char *path)
+{
+    *catalog = (catalog_t) {0};
+
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open catalog '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(catalog_header_t)) {
+        fprintf(stderr, "Catalog '%s' is truncated!\n", path);
+        close(fd);
+        return false;
+    }
+
+    u8 *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map catalog '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    const catalog_header_t *header = (const catalog_header_t *)base;
+
+    if (header->magic != CATALOG_MAGIC || header->version != CATALOG_VERSION || header->size != (u64)st.st_size) {
+        fprintf(stderr, "Catalog '%s' is corrupted!\n", path);
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    catalog->base             = base;
+    catalog->size             = st.st_size;
+    catalog->header           = header;
+    catalog->count            = header->entry_count;
+    catalog->strings          = (const char *)(base + header->strings_offset);
+    catalog->audio_path       = (const u32 *)(base + header->audio_path_offset);
+    catalog->caption_path     = (const u32 *)(base + header->caption_path_offset);
+    catalog->audio_duration   = (const f32 *)(base + header->audio_duration_offset);
+    catalog->caption_duration = (const f32 *)(base + header->caption_duration_offset);
+    catalog->word_count       = (const u32 *)(base + header->word_count_offset);
+    catalog->audio_size       = (const u64 *)(base + header->audio_size_offset);
+    catalog->caption_size     = (const u64 *)(base + header->caption_size_offset);
+    catalog->audio_mtime      = (const i64 *)(base + header->audio_mtime_offset);
+    catalog->caption_mtime    = (const i64 *)(base + header->caption_mtime_offset);
+    catalog->audio_hash       = (const u64 *)(base + header->audio_hash_offset);
+    catalog->caption_hash     = (const u64 *)(base + header->caption_hash_offset);
+
+    return true;
+}
+
+void
+catalog_close(catalog_t *catalog)
+{
+    if (catalog->base) {
+        munmap(catalog->base, catalog->size);
+    }
+
+    *catalog = (catalog_t) {0};
+}
+
+catalog_entry_t
+catalog_entry(const catalog_t *catalog, u32 index)
+{
+    return (catalog_entry_t) {
+        .audio_path       = catalog->audio_path[index] != CATALOG_NONE ? catalog->strings + catalog->audio_path[index] : NULL,
+        .caption_path     = catalog->strings + catalog->caption_path[index],
+        .audio_duration   = catalog->audio_duration[index],
+        .caption_duration = catalog->caption_duration[index],
+        .word_count       = catalog->word_count[index],
+        .audio_size       = catalog->audio_size[index],
+        .caption_size     = catalog->caption_size[index],
+        .audio_mtime      = catalog->audio_mtime[index],
+        .caption_mtime    = catalog->caption_mtime[index],
+        .audio_hash       = catalog->audio_hash[index],
+        .caption_hash     = catalog->caption_hash[index],
+    };
+}
+
+u32
+catalog_find(const catalog_t *catalog, const char *caption_path)
+{
+    u32 lo = 0, hi = catalog->count;
+
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        i32 cmp = strcmp(catalog->strings + catalog->caption_path[mid], caption_path);
+
+        if (cmp == 0)
+            return mid;
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return CATALOG_NONE;
+}
+
+#endif // CATALOG_IMPL
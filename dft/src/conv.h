@@ -0,0 +1,332 @@
+#ifndef CONV_H_
+#define CONV_H_
+
+#include "core/utils.h"
+
+#include "fft.h"
+
+/* Streaming FIR filtering by uniformly partitioned overlap-save convolution.
+ * The filter is cut into partitions of `block` taps and the spectrum of each
+ * (zero padded to twice the block) is computed once. Every `block` input
+ * frames, the last two blocks of input are transformed, the spectrum goes
+ * into a ring of the last `partitions` ones, and the output block is the
+ * second half of the inverse transform of the sum of ring spectra times
+ * filter spectra, delayed by one partition each. Long filters cost one
+ * forward and one inverse FFT per block plus one multiply-add per partition.
+ *
+ * The filter is real, so two channels go through one complex FFT as the
+ * real and imaginary parts and come out the same way.
+ *
+ * Output lags input by `block` frames, on top of the filter's own delay
+ * (half its length for the linear phase designs below).
+ */
+
+#define CONV_MAX_CHANNELS 2
+#define CONV_EQ_BANDS     10       // Octaves,
+#define CONV_EQ_LOW       31.25f   // centered from here up.
+#define CONV_VOICE_LOW    300.0f
+#define CONV_VOICE_HIGH   3400.0f
+
+typedef struct
+{
+    u32 block;      // Frames per partition.
+    u32 size;       // FFT size, twice the block.
+    u32 partitions;
+    u32 channels;
+
+    fft_plan_t plan;
+    cn_t      *filter;  // `partitions` spectra.
+    cn_t      *history; // Ring of the last `partitions` input spectra.
+    u32        newest;  // Slot of the newest one.
+    cn_t      *input;   // Last two blocks of input, the channels as real and imaginary parts.
+    cn_t      *sum, *scratch;
+
+    f32 *in_block, *out_block; // Interleaved frames of the current block.
+    u32  fill;
+} conv_t;
+
+// False when `block` isn't a power of two or the channels aren't supported.
+b32
+conv_init(conv_t *conv, const f32 *taps, u32 tap_count, u32 block, u32 channels);
+
+void
+conv_free(conv_t *conv);
+
+// Forgets the input so far, as after `conv_init`.
+void
+conv_reset(conv_t *conv);
+
+// Filters interleaved frames, `out` may be `in`.
+void
+conv_process(conv_t *conv, const f32 *in, f32 *out, u32 frame_count);
+
+// Blackman windowed sinc band pass, `tap_count` should be odd.
+void
+conv_design_bandpass(f32 *taps, u32 tap_count, f32 sample_rate, f32 low, f32 high);
+
+// Linear phase EQ by frequency sampling, `gains_db` of the `CONV_EQ_BANDS` octaves interpolated in between.
+// `tap_count` should be odd too.
+void
+conv_design_eq(f32 *taps, u32 tap_count, f32 sample_rate, const f32 *gains_db);
+
+#endif // CONV_H_
+
+#if defined(CONV_IMPL) && !defined(CONV_IMPL_)
+#define CONV_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FFT_IMPL
+#include "fft.h"
+
+b32
+conv_init(conv_t *conv, const f32 *taps, u32 tap_count, u32 block, u32 channels)
+{
+    *conv = (conv_t) {0};
+
+    if (block == 0 || (block & (block - 1)) != 0 || channels == 0 || channels > CONV_MAX_CHANNELS)
+        return false;
+
+    conv->block      = block;
+    conv->size       = block * 2;
+    conv->partitions = tap_count ? (tap_count + block - 1) / block : 1;
+    conv->channels   = channels;
+
+    fft_plan_init(&conv->plan, conv->size);
+
+    conv->filter    = calloc((u64)conv->partitions * conv->size, sizeof(cn_t));
+    conv->history   = calloc((u64)conv->partitions * conv->size, sizeof(cn_t));
+    conv->input     = calloc(conv->size, sizeof(cn_t));
+    conv->sum       = malloc(conv->size * sizeof(cn_t));
+    conv->scratch   = malloc(conv->size * sizeof(cn_t));
+    conv->in_block  = calloc(block * channels, sizeof(f32));
+    conv->out_block = calloc(block * channels, sizeof(f32));
+
+    if (!conv->filter || !conv->history || !conv->input || !conv->sum || !conv->scratch || !conv->in_block || !conv->out_block) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 p = 0; p < conv->partitions; ++p) {
+        cn_t *spectrum = conv->filter + (u64)p * conv->size;
+
+        for (u32 i = 0; i < block && p * block + i < tap_count; ++i) {
+            spectrum[i].r = taps[p * block + i];
+        }
+
+        fft_forward(&conv->plan, spectrum, conv->scratch);
+    }
+
+    return true;
+}
+
+void
+conv_free(conv_t *conv)
+{
+    fft_plan_free(&conv->plan);
+
+    free(conv->filter);
+    free(conv->history);
+    free(conv->input);
+    free(conv->sum);
+    free(conv->scratch);
+    free(conv->in_block);
+    free(conv->out_block);
+
+    *conv = (conv_t) {0};
+}
+
+void
+conv_reset(conv_t *conv)
+{
+    memset(conv->history,   0, (u64)conv->partitions * conv->size * sizeof(cn_t));
+    memset(conv->input,     0, conv->size * sizeof(cn_t));
+    memset(conv->in_block,  0, conv->block * conv->channels * sizeof(f32));
+    memset(conv->out_block, 0, conv->block * conv->channels * sizeof(f32));
+
+    conv->newest = 0;
+    conv->fill   = 0;
+}
+
+// `sum += a * b` over `count` complex values.
+static void
+conv_multiply_add(cn_t *sum, const cn_t *a, const cn_t *b, u32 count)
+{
+    u32 i = 0;
+
+#if defined(__SSE2__)
+    const __m128 signs = _mm_set_ps(1.0f, -1.0f, 1.0f, -1.0f);
+
+    for (; i + 2 <= count; i += 2) {
+        __m128 va = _mm_loadu_ps((const f32 *)(a + i));
+        __m128 vb = _mm_loadu_ps((const f32 *)(b + i));
+
+        __m128 b_re   = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 b_im   = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 a_swap = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 3, 0, 1));
+
+        // (ar br - ai bi, ai br + ar bi) for both values.
+        __m128 product = _mm_add_ps(_mm_mul_ps(va, b_re), _mm_mul_ps(_mm_mul_ps(a_swap, b_im), signs));
+
+        _mm_storeu_ps((f32 *)(sum + i), _mm_add_ps(_mm_loadu_ps((const f32 *)(sum + i)), product));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        sum[i].r += a[i].r * b[i].r - a[i].i * b[i].i;
+        sum[i].i += a[i].r * b[i].i + a[i].i * b[i].r;
+    }
+}
+
+static void
+conv_block(conv_t *conv)
+{
+    u32 block = conv->block;
+
+    memmove(conv->input, conv->input + block, block * sizeof(cn_t));
+
+    for (u32 i = 0; i < block; ++i) {
+        const f32 *frame = conv->in_block + i * conv->channels;
+
+        conv->input[block + i] = (cn_t) {
+            .r = frame[0],
+            .i = conv->channels > 1 ? frame[1] : 0.0f,
+        };
+    }
+
+    conv->newest = (conv->newest + 1) % conv->partitions;
+
+    cn_t *spectrum = conv->history + (u64)conv->newest * conv->size;
+
+    memcpy(spectrum, conv->input, conv->size * sizeof(cn_t));
+    fft_forward(&conv->plan, spectrum, conv->scratch);
+
+    // Partition `p` of the filter meets the input from `p` blocks ago.
+    memset(conv->sum, 0, conv->size * sizeof(cn_t));
+
+    for (u32 p = 0; p < conv->partitions; ++p) {
+        u32 slot = (conv->newest + conv->partitions - p) % conv->partitions;
+
+        conv_multiply_add(conv->sum, conv->history + (u64)slot * conv->size, conv->filter + (u64)p * conv->size, conv->size);
+    }
+
+    fft_inverse(&conv->plan, conv->sum, conv->scratch);
+
+    // The first half wrapped around, the second one is the linear convolution.
+    for (u32 i = 0; i < block; ++i) {
+        f32 *frame = conv->out_block + i * conv->channels;
+        cn_t value = conv->sum[block + i];
+
+        frame[0] = value.r;
+
+        if (conv->channels > 1) {
+            frame[1] = value.i;
+        }
+    }
+}
+
+void
+conv_process(conv_t *conv, const f32 *in, f32 *out, u32 frame_count)
+{
+    u32 channels = conv->channels;
+
+    for (u32 f = 0; f < frame_count; ++f) {
+        f32 *in_frame  = conv->in_block  + conv->fill * channels;
+        f32 *out_frame = conv->out_block + conv->fill * channels;
+
+        for (u32 c = 0; c < channels; ++c) {
+            in_frame[c] = in[f * channels + c];
+            out[f * channels + c] = out_frame[c];
+        }
+
+        if (++conv->fill == conv->block) {
+            conv_block(conv);
+            conv->fill = 0;
+        }
+    }
+}
+
+void
+conv_design_bandpass(f32 *taps, u32 tap_count, f32 sample_rate, f32 low, f32 high)
+{
+    f64 center = (tap_count - 1) * 0.5;
+    f64 fl = low  / sample_rate;
+    f64 fh = high / sample_rate;
+
+    for (u32 n = 0; n < tap_count; ++n) {
+        f64 m = n - center;
+        f64 ideal = m == 0.0 ? 2.0 * (fh - fl) : (sin(2.0 * M_PI * fh * m) - sin(2.0 * M_PI * fl * m)) / (M_PI * m);
+
+        f64 phase  = tap_count > 1 ? 2.0 * M_PI * n / (tap_count - 1) : 0.0;
+        f64 window = 0.42 - 0.5 * cos(phase) + 0.08 * cos(2.0 * phase);
+
+        taps[n] = (f32)(ideal * window);
+    }
+}
+
+void
+conv_design_eq(f32 *taps, u32 tap_count, f32 sample_rate, const f32 *gains_db)
+{
+    u32 size = 1;
+
+    while (size < tap_count * 4) {
+        size *= 2;
+    }
+
+    fft_plan_t plan;
+    fft_plan_init(&plan, size);
+
+    cn_t *data    = malloc(size * sizeof(cn_t));
+    cn_t *scratch = malloc(size * sizeof(cn_t));
+
+    if (!data || !scratch) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    // Zero phase magnitudes, symmetric so the impulse response is real and centered on zero.
+    for (u32 k = 0; k <= size / 2; ++k) {
+        f32 hz = k * sample_rate / size;
+        f32 band = hz > 0.0f ? log2f(hz / CONV_EQ_LOW) : 0.0f;
+
+        f32 db;
+
+        if (band <= 0.0f) {
+            db = gains_db[0];
+        }
+        else if (band >= CONV_EQ_BANDS - 1) {
+            db = gains_db[CONV_EQ_BANDS - 1];
+        }
+        else {
+            u32 b = (u32)band;
+            db = gains_db[b] + (gains_db[b + 1] - gains_db[b]) * (band - b);
+        }
+
+        f32 gain = powf(10.0f, db / 20.0f);
+
+        data[k] = (cn_t) { .r = gain };
+        data[(size - k) & (size - 1)] = data[k];
+    }
+
+    fft_inverse(&plan, data, scratch);
+
+    for (u32 n = 0; n < tap_count; ++n) {
+        i32 m = (i32)n - (i32)((tap_count - 1) / 2);
+        f64 window = tap_count > 1 ? 0.5 - 0.5 * cos(2.0 * M_PI * n / (tap_count - 1)) : 1.0;
+
+        taps[n] = (f32)(data[(u32)m & (size - 1)].r * window);
+    }
+
+    fft_plan_free(&plan);
+    free(data);
+    free(scratch);
+}
+
+#endif // CONV_IMPL
@@ -0,0 +1,229 @@
+#ifndef CQT_H_
+#define CQT_H_
+
+#include "core/utils.h"
+
+#include "fft.h"
+
+/* Constant-Q spectrum, log spaced bins `bins_per_octave` to the octave with
+ * a bandwidth proportional to their frequency, computed from one FFT frame
+ * (Brown and Puckette's spectral kernel). The temporal kernel of a bin is a
+ * Hann windowed complex sinusoid `Q` periods long, centered in the frame,
+ * and a bin is its inner product with the frame, or, by Parseval, the inner
+ * product of the two spectra over the frame size. Kernel spectra are narrow
+ * around the bin's frequency, so each row keeps the span of bins down to
+ * `CQT_THRESHOLD` of its largest value and a frame costs a few complex
+ * multiply-adds per bin on top of the FFT.
+ *
+ * Low bins whose kernel would be longer than the frame get the whole frame,
+ * so their bandwidth stops shrinking (they overlap rather than leave gaps).
+ * The kernels are analytic, so only the `size / 2 + 1` bins of a real
+ * transform are needed.
+ */
+
+#define CQT_THRESHOLD 0.005f
+
+typedef struct
+{
+    u32 start, count; // Span of FFT bins.
+    u32 offset;       // Of its weights.
+} cqt_row_t;
+
+typedef struct
+{
+    u32 size; // FFT size the kernel applies to.
+    u32 bins;
+    u32 bins_per_octave;
+    f32 sample_rate;
+    f32 min_hz;
+
+    cqt_row_t *rows;
+    cn_t      *weights; // Conjugate kernel spectra divided by the size, row after row.
+} cqt_t;
+
+// False when there are no bins between `min_hz` and the lower of `max_hz` and Nyquist.
+b32
+cqt_init(cqt_t *cqt, u32 size, f32 sample_rate, f32 min_hz, f32 max_hz, u32 bins_per_octave);
+
+void
+cqt_free(cqt_t *cqt);
+
+// Center frequency of bin `k`.
+f32
+cqt_frequency(const cqt_t *cqt, u32 k);
+
+// Magnitudes of the `cqt->bins` bins from `size / 2 + 1` FFT bins, as `fft_real_forward` gives them.
+void
+cqt_apply(const cqt_t *cqt, const cn_t *spectrum, f32 *magnitudes);
+
+#endif // CQT_H_
+
+#if defined(CQT_IMPL) && !defined(CQT_IMPL_)
+#define CQT_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FFT_IMPL
+#include "fft.h"
+
+b32
+cqt_init(cqt_t *cqt, u32 size, f32 sample_rate, f32 min_hz, f32 max_hz, u32 bins_per_octave)
+{
+    *cqt = (cqt_t) {0};
+
+    f32 top = max_hz < sample_rate * 0.5f ? max_hz : sample_rate * 0.5f;
+
+    if (size < 2 || bins_per_octave == 0 || min_hz <= 0.0f || top <= min_hz)
+        return false;
+
+    cqt->size            = size;
+    cqt->bins            = (u32)floorf(bins_per_octave * log2f(top / min_hz)) + 1;
+    cqt->bins_per_octave = bins_per_octave;
+    cqt->sample_rate     = sample_rate;
+    cqt->min_hz          = min_hz;
+
+    fft_plan_t plan;
+    fft_plan_init(&plan, size);
+
+    u32 half = size / 2 + 1;
+
+    cn_t *kernel  = malloc(size * sizeof(cn_t));
+    cn_t *scratch = malloc(plan.scratch_size * sizeof(cn_t));
+
+    cqt->rows    = malloc(cqt->bins * sizeof(cqt_row_t));
+    cqt->weights = malloc((u64)cqt->bins * half * sizeof(cn_t)); // Shrunk once the rows are known.
+
+    if (!kernel || !scratch || !cqt->rows || !cqt->weights) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    f64 q = 1.0 / (pow(2.0, 1.0 / bins_per_octave) - 1.0);
+    u32 weight_count = 0;
+
+    for (u32 k = 0; k < cqt->bins; ++k) {
+        f64 hz = cqt_frequency(cqt, k);
+        u32 length = (u32)ceil(q * sample_rate / hz);
+
+        length = length < size ? length : size;
+
+        memset(kernel, 0, size * sizeof(cn_t));
+
+        u32 start = (size - length) / 2;
+
+        for (u32 n = 0; n < length; ++n) {
+            f64 window = (0.5 - 0.5 * cos(2.0 * M_PI * (n + 0.5) / length)) / length;
+            f64 angle  = 2.0 * M_PI * hz * n / sample_rate;
+
+            kernel[start + n] = (cn_t) {
+                .r = (f32)(window * cos(angle)),
+                .i = (f32)(window * sin(angle)),
+            };
+        }
+
+        fft_forward(&plan, kernel, scratch);
+
+        f32 peak = 0.0f;
+
+        for (u32 j = 0; j < half; ++j) {
+            f32 magnitude = sqrtf(kernel[j].r * kernel[j].r + kernel[j].i * kernel[j].i);
+            peak = magnitude > peak ? magnitude : peak;
+        }
+
+        u32 first = half, last = 0;
+
+        for (u32 j = 0; j < half; ++j) {
+            if (sqrtf(kernel[j].r * kernel[j].r + kernel[j].i * kernel[j].i) >= peak * CQT_THRESHOLD) {
+                first = j < first ? j : first;
+                last  = j;
+            }
+        }
+
+        cqt->rows[k] = (cqt_row_t) {
+            .start  = first,
+            .count  = last + 1 - first,
+            .offset = weight_count,
+        };
+
+        for (u32 j = first; j <= last; ++j) {
+            cqt->weights[weight_count++] = (cn_t) {
+                .r =  kernel[j].r / size,
+                .i = -kernel[j].i / size,
+            };
+        }
+    }
+
+    cn_t *weights = realloc(cqt->weights, weight_count * sizeof(cn_t));
+    cqt->weights = weights ? weights : cqt->weights;
+
+    fft_plan_free(&plan);
+    free(kernel);
+    free(scratch);
+
+    return true;
+}
+
+void
+cqt_free(cqt_t *cqt)
+{
+    free(cqt->rows);
+    free(cqt->weights);
+
+    *cqt = (cqt_t) {0};
+}
+
+f32
+cqt_frequency(const cqt_t *cqt, u32 k)
+{
+    return cqt->min_hz * exp2f((f32)k / cqt->bins_per_octave);
+}
+
+void
+cqt_apply(const cqt_t *cqt, const cn_t *spectrum, f32 *magnitudes)
+{
+    for (u32 k = 0; k < cqt->bins; ++k) {
+        cqt_row_t   row = cqt->rows[k];
+        const cn_t *x   = spectrum + row.start;
+        const cn_t *w   = cqt->weights + row.offset;
+
+        f32 re = 0.0f, im = 0.0f;
+        u32 j  = 0;
+
+#if defined(__SSE2__)
+        // `x w` gives (xr wr, xi wi) pairs and `x` times swapped `w` (xr wi, xi wr) ones, summed up at the end.
+        __m128 direct  = _mm_setzero_ps();
+        __m128 crossed = _mm_setzero_ps();
+
+        for (; j + 2 <= row.count; j += 2) {
+            __m128 vx = _mm_loadu_ps((const f32 *)(x + j));
+            __m128 vw = _mm_loadu_ps((const f32 *)(w + j));
+
+            direct  = _mm_add_ps(direct,  _mm_mul_ps(vx, vw));
+            crossed = _mm_add_ps(crossed, _mm_mul_ps(vx, _mm_shuffle_ps(vw, vw, _MM_SHUFFLE(2, 3, 0, 1))));
+        }
+
+        f32 d[4], c[4];
+        _mm_storeu_ps(d, direct);
+        _mm_storeu_ps(c, crossed);
+
+        re = d[0] - d[1] + d[2] - d[3];
+        im = c[0] + c[1] + c[2] + c[3];
+#endif
+
+        for (; j < row.count; ++j) {
+            re += x[j].r * w[j].r - x[j].i * w[j].i;
+            im += x[j].r * w[j].i + x[j].i * w[j].r;
+        }
+
+        magnitudes[k] = sqrtf(re * re + im * im);
+    }
+}
+
+#endif // CQT_IMPL
@@ -0,0 +1,468 @@
+#include <raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define CATALOG_IMPL
+#include "catalog.h"
+
+#define MFCC_IMPL
+#include "mfcc.h"
+
+#define DTW_IMPL
+#include "dtw.h"
+
+// cc src/dtw.c ../raylib/lib/libraylib.a -o dtw.exe -I. -I../raylib/include -O2 -lm -ldl -lpthread && ./dtw.exe words ../corpus.cat ../corpus.mfc 1000 4
+
+#define DTW_DEFAULT_HITS 10
+#define DTW_SPEC_FRAME   0.032f // Seconds, rounded up to a power of two in samples.
+#define DTW_SPEC_HOP     0.010f
+#define DTW_SPEC_BANDS   32
+#define DTW_SPEC_LOW     50.0f
+#define DTW_SPEC_HIGH    8000.0f
+
+typedef struct
+{
+    catalog_t    catalog;
+    mfcc_store_t store;
+
+    f32 mean[MFCC_FEATURES], scale[MFCC_FEATURES];
+
+    const f32 *query;
+    u32        query_first, query_count;
+    u32        band;
+
+    dtw_t       *threads;
+    dtw_stats_t *stats;
+    dtw_match_t *matches; // Best window of every entry.
+} dtw_words_t;
+
+typedef dck_stretchy_t (f32, u32) dtw_rows_t;
+
+static f64
+dtw_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static f32 *
+dtw_tool_alloc(u64 count)
+{
+    f32 *values = malloc(count * sizeof(f32));
+
+    if (!values) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    return values;
+}
+
+// Standardized feature rows of the words `[first, first + count)`.
+static f32 *
+dtw_word_rows(const dtw_words_t *words, u32 first, u32 count)
+{
+    f32 *rows = dtw_tool_alloc((u64)count * MFCC_FEATURES);
+
+    for (u32 f = 0; f < MFCC_FEATURES; ++f) {
+        const f32 *column = mfcc_store_column(&words->store, f);
+
+        for (u32 i = 0; i < count; ++i) {
+            rows[(u64)i * MFCC_FEATURES + f] = (column[first + i] - words->mean[f]) * words->scale[f];
+        }
+    }
+
+    return rows;
+}
+
+static void
+dtw_words_entry(void *context, u32 thread, u32 item)
+{
+    dtw_words_t *words = context;
+
+    u32 first = words->store.entry_words[item];
+    u32 count = words->store.entry_words[item + 1] - first;
+
+    words->matches[item] = (dtw_match_t) { .distance = INFINITY };
+
+    // Entries without audio have no features.
+    if (count < words->query_count || words->store.frames[first] == 0)
+        return;
+
+    f32 *rows = dtw_word_rows(words, first, count);
+
+    // The query itself doesn't count as a match.
+    u32 skip_begin = 0, skip_end = 0;
+
+    if (words->query_first >= first && words->query_first < first + count) {
+        skip_begin = words->query_first - first;
+        skip_end   = skip_begin + words->query_count;
+    }
+
+    words->matches[item] = dtw_search(words->threads + thread, rows, count, MFCC_FEATURES, INFINITY,
+                                      skip_begin, skip_end, words->stats + thread);
+
+    free(rows);
+}
+
+typedef struct
+{
+    u32         entry;
+    dtw_match_t match;
+} dtw_hit_t;
+
+static int
+dtw_hit_cmp(const void *a, const void *b)
+{
+    f32 da = ((const dtw_hit_t *)a)->match.distance;
+    f32 db = ((const dtw_hit_t *)b)->match.distance;
+
+    return (da > db) - (da < db);
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s words [-b band] [-k hits] [-t threads] <catalog.cat> <features.mfc> <first word id> <word count>\n", program);
+    fprintf(stderr, "       %s audio [-b band] <query audio> <start seconds> <seconds> <audio>\n", program);
+}
+
+static i32
+dtw_tool_words(i32 argc, char **argv)
+{
+    u32 band = 2;
+    u32 k = DTW_DEFAULT_HITS;
+    u32 thread_count = par_thread_count();
+
+    i32 arg = 0;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'b': band         = atoi(argv[arg + 1]); break;
+            case 'k': k            = atoi(argv[arg + 1]); break;
+            case 't': thread_count = atoi(argv[arg + 1]); break;
+
+            default: {
+                fprintf(stderr, "Unknown option '%s'!\n", argv[arg]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 4 != argc) {
+        fprintf(stderr, "Expected the catalog, the features, the first word and the word count!\n");
+        return 1;
+    }
+
+    dtw_words_t words = { .band = band };
+
+    if (!catalog_open(&words.catalog, argv[arg]))
+        return 1;
+
+    if (!mfcc_store_open(&words.store, argv[arg + 1])) {
+        catalog_close(&words.catalog);
+        return 1;
+    }
+
+    words.query_first = (u32)strtoul(argv[arg + 2], NULL, 10);
+    words.query_count = (u32)strtoul(argv[arg + 3], NULL, 10);
+
+    if (words.query_count == 0 || words.query_first >= words.store.word_count
+     || words.query_count > words.store.word_count - words.query_first || words.store.frames[words.query_first] == 0) {
+        fprintf(stderr, "Words %u to %u have no features!\n", words.query_first, words.query_first + words.query_count);
+        mfcc_store_close(&words.store);
+        catalog_close(&words.catalog);
+        return 1;
+    }
+
+    // Same standardization for every feature as the nearest neighbour index.
+    for (u32 f = 0; f < MFCC_FEATURES; ++f) {
+        const f32 *column = mfcc_store_column(&words.store, f);
+        f64 sum = 0.0, sum_sq = 0.0;
+        u32 count = 0;
+
+        for (u32 i = 0; i < words.store.word_count; ++i) {
+            if (words.store.frames[i]) {
+                sum    += column[i];
+                sum_sq += column[i] * column[i];
+                ++count;
+            }
+        }
+
+        f64 mean = count ? sum / count : 0.0;
+        f64 var  = count ? sum_sq / count - mean * mean : 0.0;
+
+        words.mean[f]  = (f32)mean;
+        words.scale[f] = var > 1e-12 ? (f32)(1.0 / sqrt(var)) : 1.0f;
+    }
+
+    thread_count = thread_count ? thread_count : 1;
+
+    f32 *query = dtw_word_rows(&words, words.query_first, words.query_count);
+
+    words.threads = calloc(thread_count, sizeof(dtw_t));
+    words.stats   = calloc(thread_count, sizeof(dtw_stats_t));
+    words.matches = calloc(words.store.entry_count + 1, sizeof(dtw_match_t));
+
+    dtw_hit_t *hits = malloc((words.store.entry_count + 1) * sizeof(dtw_hit_t));
+
+    if (!words.threads || !words.stats || !words.matches || !hits) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        dtw_init(words.threads + t, query, words.query_count, MFCC_FEATURES, MFCC_FEATURES, band);
+    }
+
+    f64 start = dtw_seconds();
+
+    par_for(words.store.entry_count, thread_count, dtw_words_entry, &words);
+
+    f64 seconds = dtw_seconds() - start;
+
+    for (u32 i = 0; i < words.store.entry_count; ++i) {
+        hits[i] = (dtw_hit_t) { .entry = i, .match = words.matches[i] };
+    }
+
+    qsort(hits, words.store.entry_count, sizeof(dtw_hit_t), dtw_hit_cmp);
+
+    dtw_stats_t stats = {0};
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        stats.windows      += words.stats[t].windows;
+        stats.kim_pruned   += words.stats[t].kim_pruned;
+        stats.keogh_pruned += words.stats[t].keogh_pruned;
+        stats.abandoned    += words.stats[t].abandoned;
+    }
+
+    printf("%llu windows in %.2fms: %llu pruned by LB_Kim, %llu by LB_Keogh, %llu abandoned\n",
+           (unsigned long long)stats.windows, seconds * 1000.0, (unsigned long long)stats.kim_pruned,
+           (unsigned long long)stats.keogh_pruned, (unsigned long long)stats.abandoned);
+
+    for (u32 i = 0; i < words.store.entry_count && i < k; ++i) {
+        u32 entry = hits[i].entry;
+        dtw_match_t match = hits[i].match;
+
+        if (match.distance == INFINITY)
+            break;
+
+        u32 id = words.store.entry_words[entry] + match.position;
+        const char *caption_path = entry < words.catalog.count ? catalog_entry(&words.catalog, entry).caption_path : "?";
+
+        printf("  %9.3f %9u %9.2fs %s\n", match.distance, id, words.store.starts[id], caption_path);
+    }
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        dtw_free(words.threads + t);
+    }
+
+    free(query);
+    free(hits);
+    free(words.threads);
+    free(words.stats);
+    free(words.matches);
+    mfcc_store_close(&words.store);
+    catalog_close(&words.catalog);
+
+    return 0;
+}
+
+/* Log band energies of Hann windowed FFT frames, `DTW_SPEC_BANDS` per column. */
+static b32
+dtw_spectrogram(const char *path, dtw_rows_t *columns, u32 *count_o)
+{
+    Wave wave = LoadWave(path);
+
+    if (!IsWaveReady(wave) || wave.frameCount == 0) {
+        fprintf(stderr, "Failed to decode '%s'!\n", path);
+        return false;
+    }
+
+    if (wave.sampleSize != 16) {
+        WaveFormat(&wave, wave.sampleRate, 16, wave.channels);
+    }
+
+    const i16 *samples = wave.data;
+
+    u32 hop  = (u32)(wave.sampleRate * DTW_SPEC_HOP);
+    u32 size = 1;
+
+    while (size < wave.sampleRate * DTW_SPEC_FRAME) {
+        size *= 2;
+    }
+
+    u32 count = wave.frameCount >= size ? (wave.frameCount - size) / hop + 1 : 0;
+
+    fft_plan_t plan;
+    fft_plan_init(&plan, size);
+
+    cn_t *data    = malloc(size * sizeof(cn_t));
+    cn_t *scratch = malloc(size * sizeof(cn_t));
+    f32  *window  = dtw_tool_alloc(size);
+
+    if (!data || !scratch) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < size; ++i) {
+        window[i] = 0.5f - 0.5f * cosf(2.0f * M_PI * i / size);
+    }
+
+    u32 edges[DTW_SPEC_BANDS + 1];
+    f32 high   = DTW_SPEC_HIGH < wave.sampleRate * 0.5f ? DTW_SPEC_HIGH : wave.sampleRate * 0.5f;
+    f32 bin_hz = wave.sampleRate / (f32)size;
+
+    for (u32 b = 0; b <= DTW_SPEC_BANDS; ++b) {
+        u32 bin = (u32)(DTW_SPEC_LOW * powf(high / DTW_SPEC_LOW, b / (f32)DTW_SPEC_BANDS) / bin_hz);
+
+        if (b != 0 && bin <= edges[b - 1]) {
+            bin = edges[b - 1] + 1;
+        }
+
+        edges[b] = bin < size / 2 + 1 ? bin : size / 2 + 1;
+    }
+
+    columns->count = 0;
+    dck_stretchy_reserve(*columns, count * DTW_SPEC_BANDS);
+    columns->count = count * DTW_SPEC_BANDS;
+
+    for (u32 frame = 0; frame < count; ++frame) {
+        for (u32 i = 0; i < size; ++i) {
+            const i16 *sample = samples + ((u64)frame * hop + i) * wave.channels;
+            f32 mono = 0.0f;
+
+            for (u32 c = 0; c < wave.channels; ++c) {
+                mono += sample[c];
+            }
+
+            data[i] = (cn_t) { .r = mono / (wave.channels * 32768.0f) * window[i] };
+        }
+
+        fft_forward(&plan, data, scratch);
+
+        f32 *column = columns->data + (u64)frame * DTW_SPEC_BANDS;
+
+        for (u32 b = 0; b < DTW_SPEC_BANDS; ++b) {
+            f32 energy = 0.0f;
+
+            for (u32 bin = edges[b]; bin < edges[b + 1]; ++bin) {
+                energy += data[bin].r * data[bin].r + data[bin].i * data[bin].i;
+            }
+
+            column[b] = log10f(energy + 1e-10f);
+        }
+    }
+
+    fft_plan_free(&plan);
+    free(data);
+    free(scratch);
+    free(window);
+    UnloadWave(wave);
+
+    *count_o = count;
+    return true;
+}
+
+static i32
+dtw_tool_audio(i32 argc, char **argv)
+{
+    i32 band = -1;
+
+    i32 arg = 0;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'b': band = atoi(argv[arg + 1]); break;
+
+            default: {
+                fprintf(stderr, "Unknown option '%s'!\n", argv[arg]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 4 != argc) {
+        fprintf(stderr, "Expected the query audio, its start and length and the audio to search!\n");
+        return 1;
+    }
+
+    dtw_rows_t query_columns = {0}, columns = {0};
+    u32 query_total, count;
+
+    b32 ok = dtw_spectrogram(argv[arg], &query_columns, &query_total)
+          && dtw_spectrogram(argv[arg + 3], &columns, &count);
+
+    u32 first  = (u32)(atof(argv[arg + 1]) / DTW_SPEC_HOP);
+    u32 length = (u32)(atof(argv[arg + 2]) / DTW_SPEC_HOP);
+
+    if (ok && (length == 0 || first >= query_total || length > query_total - first)) {
+        fprintf(stderr, "The query is outside of '%s'!\n", argv[arg]);
+        ok = false;
+    }
+
+    if (ok) {
+        // A tenth of the query by default.
+        dtw_t dtw;
+        dtw_init(&dtw, query_columns.data + (u64)first * DTW_SPEC_BANDS, length, DTW_SPEC_BANDS, DTW_SPEC_BANDS,
+                 band >= 0 ? (u32)band : length / 10 + 1);
+
+        // Searching the query's own file finds the query itself first.
+        b32 same = strcmp(argv[arg], argv[arg + 3]) == 0;
+
+        dtw_stats_t stats = {0};
+        f64 start = dtw_seconds();
+
+        dtw_match_t match = dtw_search(&dtw, columns.data, count, DTW_SPEC_BANDS, INFINITY,
+                                       same ? first : 0, same ? first + length : 0, &stats);
+
+        f64 seconds = dtw_seconds() - start;
+
+        printf("%llu windows in %.2fms: %llu pruned by LB_Kim, %llu by LB_Keogh, %llu abandoned\n",
+               (unsigned long long)stats.windows, seconds * 1000.0, (unsigned long long)stats.kim_pruned,
+               (unsigned long long)stats.keogh_pruned, (unsigned long long)stats.abandoned);
+
+        if (match.distance != INFINITY) {
+            printf("best match at %.2fs, distance %.3f\n", match.position * DTW_SPEC_HOP, match.distance);
+        }
+
+        dtw_free(&dtw);
+    }
+
+    free(query_columns.data);
+    free(columns.data);
+
+    return ok ? 0 : 1;
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "words") == 0)
+        return dtw_tool_words(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "audio") == 0)
+        return dtw_tool_audio(argc - 2, argv + 2);
+
+    print_usage(argv[0]);
+    return 1;
+}
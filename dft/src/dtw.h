@@ -0,0 +1,395 @@
+#ifndef DTW_H_
+#define DTW_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+/* Dynamic time warping of a query against sequences of feature vectors:
+ * word MFCCs out of the feature store, spectrogram columns, anything with
+ * `dim` values per step. Rows are `stride` values apart so columns can be
+ * read in place. The local cost is the squared L2 distance.
+ *
+ * Warping is limited to a Sakoe-Chiba band: step `i` of the query only
+ * meets steps `j` with `|i - j| <= band`. The cells of one anti-diagonal
+ * (`i + j` constant) only depend on the two diagonals before it, so a whole
+ * diagonal is updated at once, four cells per SSE2 operation. Every path
+ * passes through one of two consecutive diagonals, so once both their minima
+ * are over the limit the rest can't get under it and the pair is abandoned.
+ *
+ * Searching a series slides a window of the query's length over it and
+ * prunes cheap first: LB_Kim (first and last steps), then LB_Keogh (distance
+ * to the envelope of the query within the band), each abandoned as soon as
+ * it is over the best match so far.
+ */
+
+typedef struct
+{
+    u32 length, dim, band;
+    u32 stride;   // Of `query`, `upper` and `lower`: `dim` rounded up to four.
+
+    f32 *query;
+    f32 *upper, *lower; // Envelope of the query within the band.
+
+    f32 *diagonals[3];  // Cumulative costs of three anti-diagonals, by query step.
+    f32 *cost;          // Local costs of the current diagonal.
+} dtw_t;
+
+typedef struct
+{
+    u32 position; // Of the first step of the window.
+    f32 distance; // INFINITY when nothing got under the limit.
+} dtw_match_t;
+
+typedef struct
+{
+    u64 windows;
+    u64 kim_pruned, keogh_pruned, abandoned;
+} dtw_stats_t;
+
+void
+dtw_init(dtw_t *dtw, const f32 *query, u32 length, u32 dim, u32 stride, u32 band);
+
+void
+dtw_free(dtw_t *dtw);
+
+// Warped distance to a candidate of any length, INFINITY once it is sure to be over `limit`.
+f32
+dtw_distance(dtw_t *dtw, const f32 *candidate, u32 length, u32 stride, f32 limit);
+
+// Lower bound for a candidate of the query's length.
+f32
+dtw_lb_keogh(const dtw_t *dtw, const f32 *candidate, u32 stride, f32 limit);
+
+// Best window of the series, `stats_o` may be NULL. Windows overlapping `[skip_begin, skip_end)` are left out.
+dtw_match_t
+dtw_search(dtw_t *dtw, const f32 *series, u32 length, u32 stride, f32 limit, u32 skip_begin, u32 skip_end, dtw_stats_t *stats_o);
+
+#endif // DTW_H_
+
+#if defined(DTW_IMPL) && !defined(DTW_IMPL_)
+#define DTW_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static f32
+dtw_l2(const f32 *a, const f32 *b, u32 dim)
+{
+    f32 sum = 0.0f;
+    u32 k = 0;
+
+#if defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+
+    for (; k + 4 <= dim; k += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k));
+        acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+    }
+
+    f32 lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+    for (; k < dim; ++k) {
+        f32 d = a[k] - b[k];
+        sum += d * d;
+    }
+
+    return sum;
+}
+
+static f32 *
+dtw_alloc(u64 count)
+{
+    f32 *values = malloc(count * sizeof(f32) + 16);
+
+    if (!values) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    return values;
+}
+
+void
+dtw_init(dtw_t *dtw, const f32 *query, u32 length, u32 dim, u32 stride, u32 band)
+{
+    *dtw = (dtw_t) {
+        .length = length,
+        .dim    = dim,
+        .band   = band,
+        .stride = (dim + 3) & ~3u,
+    };
+
+    u64 size = (u64)length * dtw->stride;
+
+    dtw->query = dtw_alloc(size);
+    dtw->upper = dtw_alloc(size);
+    dtw->lower = dtw_alloc(size);
+
+    memset(dtw->query, 0, size * sizeof(f32));
+
+    for (u32 i = 0; i < length; ++i) {
+        memcpy(dtw->query + (u64)i * dtw->stride, query + (u64)i * stride, dim * sizeof(f32));
+    }
+
+    for (u32 i = 0; i < length; ++i) {
+        u32 begin = i > band ? i - band : 0;
+        u32 end   = i + band < length ? i + band + 1 : length;
+
+        f32 *upper = dtw->upper + (u64)i * dtw->stride;
+        f32 *lower = dtw->lower + (u64)i * dtw->stride;
+
+        for (u32 k = 0; k < dtw->stride; ++k) {
+            upper[k] = -INFINITY;
+            lower[k] = INFINITY;
+        }
+
+        for (u32 j = begin; j < end; ++j) {
+            const f32 *row = dtw->query + (u64)j * dtw->stride;
+
+            for (u32 k = 0; k < dtw->stride; ++k) {
+                upper[k] = row[k] > upper[k] ? row[k] : upper[k];
+                lower[k] = row[k] < lower[k] ? row[k] : lower[k];
+            }
+        }
+    }
+
+    // Cell `i` of a diagonal is at `i + 1`, so `-1` and `length` have room for their sentinels.
+    for (u32 d = 0; d < 3; ++d) {
+        dtw->diagonals[d] = dtw_alloc(length + 2);
+    }
+
+    dtw->cost = dtw_alloc(length + 2);
+}
+
+void
+dtw_free(dtw_t *dtw)
+{
+    free(dtw->query);
+    free(dtw->upper);
+    free(dtw->lower);
+    free(dtw->diagonals[0]);
+    free(dtw->diagonals[1]);
+    free(dtw->diagonals[2]);
+    free(dtw->cost);
+
+    *dtw = (dtw_t) {0};
+}
+
+f32
+dtw_distance(dtw_t *dtw, const f32 *candidate, u32 length, u32 stride, f32 limit)
+{
+    u32 n = dtw->length, m = length;
+
+    if (n == 0 || m == 0)
+        return INFINITY;
+
+    // The band has to reach the far corner.
+    u32 band = dtw->band > (n > m ? n - m : m - n) ? dtw->band : (n > m ? n - m : m - n);
+
+    f32 *prev2 = dtw->diagonals[0];
+    f32 *prev1 = dtw->diagonals[1];
+    f32 *cur   = dtw->diagonals[2];
+
+    for (u32 i = 0; i < n + 2; ++i) {
+        prev2[i] = INFINITY;
+        prev1[i] = INFINITY;
+        cur[i]   = INFINITY;
+    }
+
+    // Diagonal -2 holds the start, so the first cell is just its cost.
+    prev2[0] = 0.0f;
+
+    f32 prev1_min = INFINITY;
+
+    for (u32 d = 0; d + 2 <= n + m; ++d) {
+        // `i` in `[lo, hi]`, with `j = d - i` in the candidate and in the band.
+        i64 lo = (i64)d - (m - 1);
+        i64 hi = d < n - 1 ? d : n - 1;
+        i64 band_lo = ((i64)d - band + 1) / 2;
+        i64 band_hi = ((i64)d + band) / 2;
+
+        lo = lo > band_lo ? lo : band_lo;
+        lo = lo > 0 ? lo : 0;
+        hi = hi < band_hi ? hi : band_hi;
+
+        f32 cur_min = INFINITY;
+
+        if (lo <= hi) {
+            for (i64 i = lo; i <= hi; ++i) {
+                dtw->cost[i] = dtw_l2(dtw->query + (u64)i * dtw->stride, candidate + (u64)(d - i) * stride, dtw->dim);
+            }
+
+            i64 i = lo;
+
+#if defined(__SSE2__)
+            __m128 mins = _mm_set1_ps(INFINITY);
+
+            for (; i + 4 <= hi + 1; i += 4) {
+                __m128 up   = _mm_loadu_ps(prev1 + i);     // (i - 1, j)
+                __m128 left = _mm_loadu_ps(prev1 + i + 1); // (i, j - 1)
+                __m128 diag = _mm_loadu_ps(prev2 + i);     // (i - 1, j - 1)
+                __m128 best = _mm_min_ps(_mm_min_ps(up, left), diag);
+                __m128 cell = _mm_add_ps(_mm_loadu_ps(dtw->cost + i), best);
+
+                _mm_storeu_ps(cur + i + 1, cell);
+                mins = _mm_min_ps(mins, cell);
+            }
+
+            f32 lanes[4];
+            _mm_storeu_ps(lanes, mins);
+
+            for (u32 l = 0; l < 4; ++l) {
+                cur_min = lanes[l] < cur_min ? lanes[l] : cur_min;
+            }
+#endif
+
+            for (; i <= hi; ++i) {
+                f32 best = prev1[i] < prev1[i + 1] ? prev1[i] : prev1[i + 1];
+                best = prev2[i] < best ? prev2[i] : best;
+
+                cur[i + 1] = dtw->cost[i] + best;
+                cur_min = cur[i + 1] < cur_min ? cur[i + 1] : cur_min;
+            }
+
+            // Neighbours of the range read by the next two diagonals.
+            cur[lo] = INFINITY;
+
+            if (hi + 2 < n + 2) {
+                cur[hi + 2] = INFINITY;
+            }
+        }
+        else {
+            for (u32 i = 0; i < n + 2; ++i) {
+                cur[i] = INFINITY;
+            }
+        }
+
+        // A diagonal step skips a diagonal, but no path skips two.
+        if (cur_min > limit && prev1_min > limit)
+            return INFINITY;
+
+        prev1_min = cur_min;
+
+        f32 *tmp = prev2;
+        prev2 = prev1;
+        prev1 = cur;
+        cur   = tmp;
+    }
+
+    // The last diagonal holds the far corner.
+    f32 distance = prev1[n];
+    return distance <= limit ? distance : INFINITY;
+}
+
+f32
+dtw_lb_keogh(const dtw_t *dtw, const f32 *candidate, u32 stride, f32 limit)
+{
+    f32 bound = 0.0f;
+
+    for (u32 j = 0; j < dtw->length && bound <= limit; ++j) {
+        const f32 *row   = candidate + (u64)j * stride;
+        const f32 *upper = dtw->upper + (u64)j * dtw->stride;
+        const f32 *lower = dtw->lower + (u64)j * dtw->stride;
+
+        u32 k = 0;
+
+#if defined(__SSE2__)
+        __m128 zero = _mm_setzero_ps();
+        __m128 acc  = zero;
+
+        for (; k + 4 <= dtw->dim; k += 4) {
+            __m128 x = _mm_loadu_ps(row + k);
+            __m128 over  = _mm_max_ps(_mm_sub_ps(x, _mm_loadu_ps(upper + k)), zero);
+            __m128 under = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(lower + k), x), zero);
+            __m128 out   = _mm_add_ps(over, under);
+
+            acc = _mm_add_ps(acc, _mm_mul_ps(out, out));
+        }
+
+        f32 lanes[4];
+        _mm_storeu_ps(lanes, acc);
+        bound += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+        for (; k < dtw->dim; ++k) {
+            f32 x = row[k];
+
+            if (x > upper[k]) {
+                bound += (x - upper[k]) * (x - upper[k]);
+            }
+            else if (x < lower[k]) {
+                bound += (lower[k] - x) * (lower[k] - x);
+            }
+        }
+    }
+
+    return bound;
+}
+
+dtw_match_t
+dtw_search(dtw_t *dtw, const f32 *series, u32 length, u32 stride, f32 limit, u32 skip_begin, u32 skip_end, dtw_stats_t *stats_o)
+{
+    dtw_match_t match = { .distance = INFINITY };
+    dtw_stats_t stats = {0};
+
+    u32 n = dtw->length;
+
+    for (u32 s = 0; n && s + n <= length; ++s) {
+        if (s < skip_end && s + n > skip_begin)
+            continue;
+
+        stats.windows++;
+
+        const f32 *window = series + (u64)s * stride;
+
+        // Both ends are on every path.
+        f32 kim = dtw_l2(dtw->query, window, dtw->dim);
+
+        if (n > 1) {
+            kim += dtw_l2(dtw->query + (u64)(n - 1) * dtw->stride, window + (u64)(n - 1) * stride, dtw->dim);
+        }
+
+        if (kim > limit) {
+            stats.kim_pruned++;
+            continue;
+        }
+
+        if (dtw_lb_keogh(dtw, window, stride, limit) > limit) {
+            stats.keogh_pruned++;
+            continue;
+        }
+
+        f32 distance = dtw_distance(dtw, window, n, stride, limit);
+
+        if (distance == INFINITY) {
+            stats.abandoned++;
+            continue;
+        }
+
+        // Ties keep the first.
+        if (distance < match.distance) {
+            match = (dtw_match_t) { .position = s, .distance = distance };
+            limit = distance;
+        }
+    }
+
+    if (stats_o) {
+        stats_o->windows      += stats.windows;
+        stats_o->kim_pruned   += stats.kim_pruned;
+        stats_o->keogh_pruned += stats.keogh_pruned;
+        stats_o->abandoned    += stats.abandoned;
+    }
+
+    return match;
+}
+
+#endif // DTW_IMPL
@@ -0,0 +1,821 @@
+#ifndef FFT_H_
+#define FFT_H_
+
+#include "core/utils.h"
+
+/* Mixed radix FFT, Stockham autosort so no digit reversal pass is needed.
+ * Sizes made of the factors 2, 3, 5 and 7 take one pass per factor (fours
+ * first, two at a time), so window lengths of whole milliseconds at 44.1kHz
+ * or 48kHz cost about as much as the nearest power of two. Other sizes go
+ * through Bluestein's chirp z-transform, a convolution done with a power of
+ * two transform of at least twice the size. The plan holds the twiddle
+ * factors and is only read while transforming, so one plan can be shared
+ * between threads that each bring their own scratch buffer.
+ *
+ * The inverse conjugates, transforms and conjugates back, dividing by the
+ * size, so it undoes the forward transform exactly. Real transforms pack the
+ * even and odd samples into one complex transform of half the size and
+ * untangle the spectrum afterwards, `size / 2 + 1` bins out of `size`
+ * samples.
+ *
+ * The Q15 transform works on 16 bit PCM as it is, radix 2 and power of two
+ * sizes only. It's block floating point: before every pass the largest
+ * value picks a shift of 0 to 2 bits for the whole block, just enough that
+ * the butterflies can't overflow, and the shifts add up to the exponent of
+ * the result. Quiet input keeps its precision, loud input loses low bits
+ * instead of clipping.
+ */
+
+typedef struct
+{
+    f32 r, i;
+} cn_t;
+
+#define FFT_MAX_FACTORS 32
+
+typedef struct
+{
+    u32 size;
+    u32 scratch_size; // Values the scratch buffer of a transform has to hold, `size` unless it's a Bluestein plan.
+
+    // Passes over `padded` values, a power of two, for Bluestein plans and over `size` for the others.
+    u32   padded;
+    u32   factors[FFT_MAX_FACTORS]; // 4, 2, 3, 5 or 7.
+    u32   factor_count;
+    cn_t *twiddles; // `e^(-2 pi i k / n)` for `k < n` passed over.
+
+    cn_t *chirp;  // `e^(-pi i k^2 / size)` for `k < size`, Bluestein only.
+    cn_t *kernel; // Transform of the conjugate chirp wrapped around `padded`, divided by `padded`.
+} fft_plan_t;
+
+// False when `size` is zero.
+b32
+fft_plan_init(fft_plan_t *plan, u32 size);
+
+void
+fft_plan_free(fft_plan_t *plan);
+
+typedef struct
+{
+    u32        size;
+    fft_plan_t half;
+    cn_t      *twiddles; // `e^(-2 pi i k / size)` for `k <= size / 4`.
+} fft_real_plan_t;
+
+typedef struct
+{
+    i16 r, i;
+} cq15_t;
+
+typedef struct
+{
+    u32     size;
+    cq15_t *twiddles; // `e^(-2 pi i k / size)` for `k < size / 2`, times 32767.
+} fft_q15_plan_t;
+
+// Transforms `data` (`plan->size` values) in place, `scratch` has to hold `plan->scratch_size`.
+void
+fft_forward(const fft_plan_t *plan, cn_t *data, cn_t *scratch);
+
+// Inverse of `fft_forward`, including the `1 / size`.
+void
+fft_inverse(const fft_plan_t *plan, cn_t *data, cn_t *scratch);
+
+// False when `size` isn't even or is below 4.
+b32
+fft_real_plan_init(fft_real_plan_t *plan, u32 size);
+
+void
+fft_real_plan_free(fft_real_plan_t *plan);
+
+// `size / 2 + 1` bins of `size` real samples, `scratch` has to hold `plan->half.scratch_size` values.
+void
+fft_real_forward(const fft_real_plan_t *plan, const f32 *samples, cn_t *bins, cn_t *scratch);
+
+// Samples back from `size / 2 + 1` bins, which get overwritten. The imaginary parts of the first and last bin are ignored.
+void
+fft_real_inverse(const fft_real_plan_t *plan, cn_t *bins, f32 *samples, cn_t *scratch);
+
+// False when `size` isn't a power of two of at least 2.
+b32
+fft_q15_plan_init(fft_q15_plan_t *plan, u32 size);
+
+void
+fft_q15_plan_free(fft_q15_plan_t *plan);
+
+// Transforms `data` (`plan->size` values) in place, `scratch` has to hold as many.
+// Returns the exponent: the spectrum is `data` times `2^exponent`.
+i32
+fft_q15_forward(const fft_q15_plan_t *plan, cq15_t *data, cq15_t *scratch);
+
+#endif // FFT_H_
+
+#if defined(FFT_IMPL) && !defined(FFT_IMPL_)
+#define FFT_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static cn_t *
+fft_twiddles(u32 n)
+{
+    cn_t *twiddles = malloc(n * sizeof(cn_t));
+
+    if (!twiddles) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 k = 0; k < n; ++k) {
+        f64 angle = 2.0 * M_PI * k / n;
+
+        twiddles[k] = (cn_t) {
+            .r =  (f32)cos(angle),
+            .i = -(f32)sin(angle),
+        };
+    }
+
+    return twiddles;
+}
+
+// Returns what's left of `n` after taking out the factors 2, 3, 5 and 7.
+static u32
+fft_factor(fft_plan_t *plan, u32 n)
+{
+    static const u32 radices[] = { 4, 2, 3, 5, 7 };
+
+    plan->factor_count = 0;
+
+    for (u32 r = 0; r < sizeof(radices) / sizeof(radices[0]); ++r) {
+        while (n % radices[r] == 0) {
+            plan->factors[plan->factor_count++] = radices[r];
+            n /= radices[r];
+        }
+    }
+
+    return n;
+}
+
+static void fft_passes(const fft_plan_t *plan, u32 size, cn_t *data, cn_t *scratch);
+
+b32
+fft_plan_init(fft_plan_t *plan, u32 size)
+{
+    *plan = (fft_plan_t) {0};
+
+    if (size == 0)
+        return false;
+
+    plan->size = size;
+
+    if (fft_factor(plan, size) == 1) {
+        plan->scratch_size = size;
+        plan->twiddles     = fft_twiddles(size);
+
+        return true;
+    }
+
+    // x[k] = conj(c[k]) sum x[n] c[n] conj(c[k - n]) for c[n] = e^(-pi i n^2 / size), the sum being a convolution.
+    u32 padded = 1;
+
+    while (padded < size * 2 - 1) {
+        padded *= 2;
+    }
+
+    plan->padded       = padded;
+    plan->scratch_size = padded * 2;
+    plan->twiddles     = fft_twiddles(padded);
+
+    fft_factor(plan, padded);
+
+    plan->chirp  = malloc(size * sizeof(cn_t));
+    plan->kernel = calloc(padded, sizeof(cn_t));
+
+    cn_t *scratch = malloc(padded * sizeof(cn_t));
+
+    if (!plan->chirp || !plan->kernel || !scratch) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 n = 0; n < size; ++n) {
+        // n^2 modulo 2 size keeps the angle exact for big n.
+        f64 angle = M_PI * (f64)(((u64)n * n) % (2 * (u64)size)) / size;
+
+        plan->chirp[n] = (cn_t) {
+            .r =  (f32)cos(angle),
+            .i = -(f32)sin(angle),
+        };
+    }
+
+    f32 scale = 1.0f / padded;
+
+    for (u32 n = 0; n < size; ++n) {
+        cn_t value = { .r = plan->chirp[n].r * scale, .i = -plan->chirp[n].i * scale };
+
+        plan->kernel[n] = value;
+
+        if (n != 0) {
+            plan->kernel[padded - n] = value;
+        }
+    }
+
+    fft_passes(plan, padded, plan->kernel, scratch);
+    free(scratch);
+
+    return true;
+}
+
+void
+fft_plan_free(fft_plan_t *plan)
+{
+    free(plan->twiddles);
+    free(plan->chirp);
+    free(plan->kernel);
+    *plan = (fft_plan_t) {0};
+}
+
+// Every pass splits `n` point transforms into `radix` interleaved ones of `m = n / radix` points, `stride` of them
+// interleaved in turn: the radix point DFTs of `src[q + stride (p + j m)]` go to `dst[q + stride (radix p + k)]`
+// times the twiddle `W_n^(p k)`. The odd radices (3, 5 and 7) pair up `j` and `radix - j`.
+static void
+fft_pass_odd(const cn_t *twiddles, u32 size, const cn_t *src, cn_t *dst, u32 m, u32 stride, const u32 radix)
+{
+    // `W_radix^(j k)` for the pairs.
+    cn_t roots[4][4];
+
+    for (u32 k = 1; k <= radix / 2; ++k) {
+        for (u32 j = 1; j <= radix / 2; ++j) {
+            roots[k][j] = twiddles[(j * k) % radix * (size / radix)];
+        }
+    }
+
+    for (u32 p = 0; p < m; ++p) {
+        cn_t w[7];
+
+        for (u32 k = 0; k < radix; ++k) {
+            w[k] = twiddles[p * k * stride];
+        }
+
+        for (u32 q = 0; q < stride; ++q) {
+            cn_t a0 = src[q + stride * p];
+            cn_t sum[4], diff[4];
+
+            cn_t y0 = a0;
+
+            for (u32 j = 1; j <= radix / 2; ++j) {
+                cn_t a = src[q + stride * (p + j * m)];
+                cn_t b = src[q + stride * (p + (radix - j) * m)];
+
+                sum[j]  = (cn_t) { .r = a.r + b.r, .i = a.i + b.i };
+                diff[j] = (cn_t) { .r = a.r - b.r, .i = a.i - b.i };
+
+                y0.r += sum[j].r;
+                y0.i += sum[j].i;
+            }
+
+            dst[q + stride * radix * p] = y0;
+
+            for (u32 k = 1; k <= radix / 2; ++k) {
+                cn_t even = a0, odd = {0};
+
+                for (u32 j = 1; j <= radix / 2; ++j) {
+                    cn_t root = roots[k][j];
+
+                    even.r += root.r * sum[j].r;
+                    even.i += root.r * sum[j].i;
+                    odd.r  -= root.i * diff[j].i;
+                    odd.i  += root.i * diff[j].r;
+                }
+
+                cn_t y1 = { .r = even.r + odd.r, .i = even.i + odd.i };
+                cn_t y2 = { .r = even.r - odd.r, .i = even.i - odd.i };
+                cn_t w1 = w[k], w2 = w[radix - k];
+
+                dst[q + stride * (radix * p + k)] = (cn_t) {
+                    .r = y1.r * w1.r - y1.i * w1.i,
+                    .i = y1.r * w1.i + y1.i * w1.r,
+                };
+
+                dst[q + stride * (radix * p + radix - k)] = (cn_t) {
+                    .r = y2.r * w2.r - y2.i * w2.i,
+                    .i = y2.r * w2.i + y2.i * w2.r,
+                };
+            }
+        }
+    }
+}
+
+static void
+fft_pass_2(const cn_t *twiddles, const cn_t *src, cn_t *dst, u32 m, u32 stride)
+{
+    for (u32 p = 0; p < m; ++p) {
+        cn_t w = twiddles[p * stride];
+
+        for (u32 q = 0; q < stride; ++q) {
+            cn_t a = src[q + stride * p];
+            cn_t b = src[q + stride * (p + m)];
+
+            cn_t diff = {
+                .r = a.r - b.r,
+                .i = a.i - b.i,
+            };
+
+            dst[q + stride * (2 * p + 0)] = (cn_t) {
+                .r = a.r + b.r,
+                .i = a.i + b.i,
+            };
+
+            dst[q + stride * (2 * p + 1)] = (cn_t) {
+                .r = diff.r * w.r - diff.i * w.i,
+                .i = diff.r * w.i + diff.i * w.r,
+            };
+        }
+    }
+}
+
+static void
+fft_pass_4(const cn_t *twiddles, const cn_t *src, cn_t *dst, u32 m, u32 stride)
+{
+    for (u32 p = 0; p < m; ++p) {
+        cn_t w1 = twiddles[p * stride];
+        cn_t w2 = twiddles[p * stride * 2];
+        cn_t w3 = twiddles[p * stride * 3];
+
+        for (u32 q = 0; q < stride; ++q) {
+            cn_t a0 = src[q + stride * (p + 0 * m)];
+            cn_t a1 = src[q + stride * (p + 1 * m)];
+            cn_t a2 = src[q + stride * (p + 2 * m)];
+            cn_t a3 = src[q + stride * (p + 3 * m)];
+
+            cn_t t0 = { .r = a0.r + a2.r, .i = a0.i + a2.i };
+            cn_t t1 = { .r = a0.r - a2.r, .i = a0.i - a2.i };
+            cn_t t2 = { .r = a1.r + a3.r, .i = a1.i + a3.i };
+            cn_t t3 = { .r = a1.i - a3.i, .i = a3.r - a1.r }; // (a1 - a3) times -i.
+
+            cn_t y1 = { .r = t1.r + t3.r, .i = t1.i + t3.i };
+            cn_t y2 = { .r = t0.r - t2.r, .i = t0.i - t2.i };
+            cn_t y3 = { .r = t1.r - t3.r, .i = t1.i - t3.i };
+
+            dst[q + stride * (4 * p + 0)] = (cn_t) { .r = t0.r + t2.r, .i = t0.i + t2.i };
+
+            dst[q + stride * (4 * p + 1)] = (cn_t) {
+                .r = y1.r * w1.r - y1.i * w1.i,
+                .i = y1.r * w1.i + y1.i * w1.r,
+            };
+
+            dst[q + stride * (4 * p + 2)] = (cn_t) {
+                .r = y2.r * w2.r - y2.i * w2.i,
+                .i = y2.r * w2.i + y2.i * w2.r,
+            };
+
+            dst[q + stride * (4 * p + 3)] = (cn_t) {
+                .r = y3.r * w3.r - y3.i * w3.i,
+                .i = y3.r * w3.i + y3.i * w3.r,
+            };
+        }
+    }
+}
+
+// Forward transform of `size` values by the plan's factors, the size they multiply to.
+static void
+fft_passes(const fft_plan_t *plan, u32 size, cn_t *data, cn_t *scratch)
+{
+    cn_t *src = data;
+    cn_t *dst = scratch;
+
+    for (u32 f = 0, n = size, stride = 1; f < plan->factor_count; ++f) {
+        u32 radix = plan->factors[f];
+        u32 m = n / radix;
+
+        switch (radix) {
+            case 2: fft_pass_2(plan->twiddles, src, dst, m, stride); break;
+            case 4: fft_pass_4(plan->twiddles, src, dst, m, stride); break;
+            case 3: fft_pass_odd(plan->twiddles, size, src, dst, m, stride, 3); break;
+            case 5: fft_pass_odd(plan->twiddles, size, src, dst, m, stride, 5); break;
+            case 7: fft_pass_odd(plan->twiddles, size, src, dst, m, stride, 7); break;
+        }
+
+        n = m;
+        stride *= radix;
+
+        cn_t *tmp = dst;
+        dst = src;
+        src = tmp;
+    }
+
+    if (src != data) {
+        memcpy(data, src, size * sizeof(cn_t));
+    }
+}
+
+void
+fft_forward(const fft_plan_t *plan, cn_t *data, cn_t *scratch)
+{
+    if (!plan->padded) {
+        fft_passes(plan, plan->size, data, scratch);
+        return;
+    }
+
+    u32 size = plan->size, padded = plan->padded;
+    cn_t *work = scratch;
+    cn_t *rest = scratch + padded;
+
+    for (u32 n = 0; n < size; ++n) {
+        cn_t x = data[n], c = plan->chirp[n];
+
+        work[n] = (cn_t) {
+            .r = x.r * c.r - x.i * c.i,
+            .i = x.r * c.i + x.i * c.r,
+        };
+    }
+
+    memset(work + size, 0, (padded - size) * sizeof(cn_t));
+
+    fft_passes(plan, padded, work, rest);
+
+    // Times the kernel, conjugated so the forward passes do the inverse transform.
+    for (u32 k = 0; k < padded; ++k) {
+        cn_t x = work[k], h = plan->kernel[k];
+
+        work[k] = (cn_t) {
+            .r =   x.r * h.r - x.i * h.i,
+            .i = -(x.r * h.i + x.i * h.r),
+        };
+    }
+
+    fft_passes(plan, padded, work, rest);
+
+    for (u32 k = 0; k < size; ++k) {
+        cn_t x = { .r = work[k].r, .i = -work[k].i };
+        cn_t c = plan->chirp[k];
+
+        data[k] = (cn_t) {
+            .r = x.r * c.r - x.i * c.i,
+            .i = x.r * c.i + x.i * c.r,
+        };
+    }
+}
+
+void
+fft_inverse(const fft_plan_t *plan, cn_t *data, cn_t *scratch)
+{
+    for (u32 i = 0; i < plan->size; ++i) {
+        data[i].i = -data[i].i;
+    }
+
+    fft_forward(plan, data, scratch);
+
+    f32 scale = 1.0f / plan->size;
+
+    for (u32 i = 0; i < plan->size; ++i) {
+        data[i].r *=  scale;
+        data[i].i *= -scale;
+    }
+}
+
+b32
+fft_real_plan_init(fft_real_plan_t *plan, u32 size)
+{
+    *plan = (fft_real_plan_t) {0};
+
+    if (size < 4 || size % 2 != 0 || !fft_plan_init(&plan->half, size / 2))
+        return false;
+
+    plan->size     = size;
+    plan->twiddles = malloc((size / 4 + 1) * sizeof(cn_t));
+
+    if (!plan->twiddles) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 k = 0; k <= size / 4; ++k) {
+        f64 angle = 2.0 * M_PI * k / size;
+
+        plan->twiddles[k] = (cn_t) {
+            .r =  (f32)cos(angle),
+            .i = -(f32)sin(angle),
+        };
+    }
+
+    return true;
+}
+
+void
+fft_real_plan_free(fft_real_plan_t *plan)
+{
+    fft_plan_free(&plan->half);
+    free(plan->twiddles);
+    *plan = (fft_real_plan_t) {0};
+}
+
+void
+fft_real_forward(const fft_real_plan_t *plan, const f32 *samples, cn_t *bins, cn_t *scratch)
+{
+    u32 half = plan->size / 2;
+
+    for (u32 n = 0; n < half; ++n) {
+        bins[n] = (cn_t) { .r = samples[2 * n], .i = samples[2 * n + 1] };
+    }
+
+    fft_forward(&plan->half, bins, scratch);
+
+    // Z = E + iO for the spectra E and O of the even and odd samples, X[k] = E[k] + W^k O[k]
+    // and X[half - k] = conj(E[k] - W^k O[k]), so bins `k` and `half - k` are done together.
+    cn_t z0 = bins[0];
+
+    bins[0]    = (cn_t) { .r = z0.r + z0.i };
+    bins[half] = (cn_t) { .r = z0.r - z0.i };
+
+    for (u32 k = 1; k <= half / 2; ++k) {
+        cn_t a = bins[k];
+        cn_t b = bins[half - k];
+        cn_t w = plan->twiddles[k];
+
+        cn_t even = { .r = 0.5f * (a.r + b.r), .i = 0.5f * (a.i - b.i) };
+        cn_t odd  = { .r = 0.5f * (a.i + b.i), .i = 0.5f * (b.r - a.r) };
+
+        cn_t wo = {
+            .r = w.r * odd.r - w.i * odd.i,
+            .i = w.r * odd.i + w.i * odd.r,
+        };
+
+        bins[k]        = (cn_t) { .r = even.r + wo.r, .i =   even.i + wo.i  };
+        bins[half - k] = (cn_t) { .r = even.r - wo.r, .i = -(even.i - wo.i) };
+    }
+}
+
+void
+fft_real_inverse(const fft_real_plan_t *plan, cn_t *bins, f32 *samples, cn_t *scratch)
+{
+    u32 half = plan->size / 2;
+
+    // The other way around: E[k] = (X[k] + conj(X[half - k])) / 2, O[k] = (X[k] - conj(X[half - k])) / 2 W^-k.
+    cn_t first = bins[0], last = bins[half];
+
+    bins[0] = (cn_t) { .r = 0.5f * (first.r + last.r), .i = 0.5f * (first.r - last.r) };
+
+    for (u32 k = 1; k <= half / 2; ++k) {
+        cn_t a = bins[k];
+        cn_t b = bins[half - k];
+        cn_t w = plan->twiddles[k];
+
+        cn_t even = { .r = 0.5f * (a.r + b.r), .i = 0.5f * (a.i - b.i) };
+        cn_t diff = { .r = 0.5f * (a.r - b.r), .i = 0.5f * (a.i + b.i) };
+
+        // Times conj(w).
+        cn_t odd = {
+            .r = diff.r * w.r + diff.i * w.i,
+            .i = diff.i * w.r - diff.r * w.i,
+        };
+
+        // Z[k] = E + iO and Z[half - k] = conj(E) + i conj(O).
+        bins[k]        = (cn_t) { .r = even.r - odd.i, .i =  even.i + odd.r };
+        bins[half - k] = (cn_t) { .r = even.r + odd.i, .i = -even.i + odd.r };
+    }
+
+    fft_inverse(&plan->half, bins, scratch);
+
+    for (u32 n = 0; n < half; ++n) {
+        samples[2 * n]     = bins[n].r;
+        samples[2 * n + 1] = bins[n].i;
+    }
+}
+
+b32
+fft_q15_plan_init(fft_q15_plan_t *plan, u32 size)
+{
+    *plan = (fft_q15_plan_t) {0};
+
+    if (size < 2 || (size & (size - 1)) != 0)
+        return false;
+
+    plan->size     = size;
+    plan->twiddles = malloc(size / 2 * sizeof(cq15_t));
+
+    if (!plan->twiddles) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 k = 0; k < size / 2; ++k) {
+        f64 angle = 2.0 * M_PI * k / size;
+
+        plan->twiddles[k] = (cq15_t) {
+            .r = (i16)lrint( cos(angle) * 32767.0),
+            .i = (i16)lrint(-sin(angle) * 32767.0),
+        };
+    }
+
+    return true;
+}
+
+void
+fft_q15_plan_free(fft_q15_plan_t *plan)
+{
+    free(plan->twiddles);
+    *plan = (fft_q15_plan_t) {0};
+}
+
+// Largest value a pass can take: the sum of two is below 2^15, and so is their difference times a twiddle,
+// which can be up to sqrt(2) times as long in one component.
+#define FFT_Q15_HEADROOM 11584
+
+static i32
+fft_q15_largest(const cq15_t *data, u32 count)
+{
+    i32 largest = 0;
+    u32 i = 0;
+
+#if defined(__SSE2__)
+    // Highest and lowest apart, -32768 has no absolute value in 16 bits.
+    __m128i high = _mm_setzero_si128();
+    __m128i low  = _mm_setzero_si128();
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i values = _mm_loadu_si128((const __m128i *)(data + i));
+
+        high = _mm_max_epi16(high, values);
+        low  = _mm_min_epi16(low,  values);
+    }
+
+    i16 highs[8], lows[8];
+    _mm_storeu_si128((__m128i *)highs, high);
+    _mm_storeu_si128((__m128i *)lows,  low);
+
+    for (u32 j = 0; j < 8; ++j) {
+        largest = highs[j] > largest ? highs[j] : largest;
+        largest = -lows[j] > largest ? -lows[j] : largest;
+    }
+#endif
+
+    for (; i < count; ++i) {
+        i32 r = abs(data[i].r), m = abs(data[i].i);
+
+        largest = r > largest ? r : largest;
+        largest = m > largest ? m : largest;
+    }
+
+    return largest;
+}
+
+#if defined(__SSE2__)
+// Four butterflies of shifted `a` and `b` and the twiddles `w`, all (r, i) pairs: `sum = a + b`, `out = (a - b) w`.
+// The complex product is two `madd`s, of the difference with its imaginary parts negated and with `w` swapped.
+static void
+fft_q15_butterflies(__m128i a, __m128i b, __m128i w, __m128i *sum, __m128i *out)
+{
+    const __m128i odd   = _mm_set1_epi32((i32)0xFFFF0000);
+    const __m128i round = _mm_set1_epi32(1 << 14);
+
+    __m128i diff      = _mm_sub_epi16(a, b);
+    __m128i conjugate = _mm_sub_epi16(_mm_xor_si128(diff, odd), odd);
+    __m128i swapped   = _mm_shufflehi_epi16(_mm_shufflelo_epi16(w, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+
+    __m128i out_r = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(conjugate, w), round), 15);
+    __m128i out_i = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(diff, swapped), round), 15);
+
+    // (r0 r1 r2 r3 i0 i1 i2 i3) to (r0 i0 r1 i1 ...).
+    __m128i packed = _mm_packs_epi32(out_r, out_i);
+
+    *sum = _mm_add_epi16(a, b);
+    *out = _mm_unpacklo_epi16(packed, _mm_srli_si128(packed, 8));
+}
+#endif
+
+i32
+fft_q15_forward(const fft_q15_plan_t *plan, cq15_t *data, cq15_t *scratch)
+{
+    cq15_t *src = data;
+    cq15_t *dst = scratch;
+
+    i32 largest  = fft_q15_largest(data, plan->size);
+    i32 exponent = 0;
+
+    // Quiet blocks get scaled up first, so rounding in the passes stays small next to them.
+    if (largest > 0 && largest * 2 <= FFT_Q15_HEADROOM) {
+        while ((largest << (1 - exponent)) <= FFT_Q15_HEADROOM) {
+            --exponent;
+        }
+
+        i32 gain = 1 << -exponent;
+
+        for (u32 i = 0; i < plan->size; ++i) {
+            data[i].r = (i16)(data[i].r * gain);
+            data[i].i = (i16)(data[i].i * gain);
+        }
+
+        largest <<= -exponent;
+    }
+
+    for (u32 n = plan->size, stride = 1; n > 1; n /= 2, stride *= 2) {
+        u32 half = n / 2;
+        i32 shift = 0;
+
+        // Rounding up, a negative value shifted right can be one further from zero than the positive one.
+        while (((largest + (1 << shift) - 1) >> shift) > FFT_Q15_HEADROOM) {
+            ++shift;
+        }
+
+        exponent += shift;
+
+        u32 p = 0;
+
+#if defined(__SSE2__)
+        // The first two passes have too few interleaved transforms for a vector, they take a vector of `p`s instead.
+        __m128i count = _mm_cvtsi32_si128(shift);
+
+        if (stride == 1) {
+            for (; p + 4 <= half; p += 4) {
+                __m128i a = _mm_sra_epi16(_mm_loadu_si128((const __m128i *)(src + p)), count);
+                __m128i b = _mm_sra_epi16(_mm_loadu_si128((const __m128i *)(src + p + half)), count);
+                __m128i w = _mm_loadu_si128((const __m128i *)(plan->twiddles + p));
+
+                __m128i sum, out;
+                fft_q15_butterflies(a, b, w, &sum, &out);
+
+                _mm_storeu_si128((__m128i *)(dst + 2 * p + 0), _mm_unpacklo_epi32(sum, out));
+                _mm_storeu_si128((__m128i *)(dst + 2 * p + 4), _mm_unpackhi_epi32(sum, out));
+            }
+        }
+        else if (stride == 2) {
+            for (; p + 2 <= half; p += 2) {
+                __m128i a = _mm_sra_epi16(_mm_loadu_si128((const __m128i *)(src + 2 * p)), count);
+                __m128i b = _mm_sra_epi16(_mm_loadu_si128((const __m128i *)(src + 2 * (p + half))), count);
+
+                i32 w0, w1;
+                memcpy(&w0, plan->twiddles + 2 * p, sizeof(i32));
+                memcpy(&w1, plan->twiddles + 2 * p + 2, sizeof(i32));
+
+                __m128i sum, out;
+                fft_q15_butterflies(a, b, _mm_set_epi32(w1, w1, w0, w0), &sum, &out);
+
+                _mm_storeu_si128((__m128i *)(dst + 4 * p + 0), _mm_unpacklo_epi64(sum, out));
+                _mm_storeu_si128((__m128i *)(dst + 4 * p + 4), _mm_unpackhi_epi64(sum, out));
+            }
+        }
+#endif
+
+        for (; p < half; ++p) {
+            cq15_t w = plan->twiddles[p * stride];
+            u32 q = 0;
+
+#if defined(__SSE2__)
+            i32 w_pair;
+            memcpy(&w_pair, &w, sizeof(i32));
+
+            for (; q + 4 <= stride; q += 4) {
+                __m128i a = _mm_sra_epi16(_mm_loadu_si128((const __m128i *)(src + q + stride * p)), count);
+                __m128i b = _mm_sra_epi16(_mm_loadu_si128((const __m128i *)(src + q + stride * (p + half))), count);
+
+                __m128i sum, out;
+                fft_q15_butterflies(a, b, _mm_set1_epi32(w_pair), &sum, &out);
+
+                _mm_storeu_si128((__m128i *)(dst + q + stride * (2 * p + 0)), sum);
+                _mm_storeu_si128((__m128i *)(dst + q + stride * (2 * p + 1)), out);
+            }
+#endif
+
+            for (; q < stride; ++q) {
+                cq15_t a = src[q + stride * p];
+                cq15_t b = src[q + stride * (p + half)];
+
+                i32 ar = a.r >> shift, ai = a.i >> shift;
+                i32 br = b.r >> shift, bi = b.i >> shift;
+
+                i32 diff_r = ar - br, diff_i = ai - bi;
+
+                dst[q + stride * (2 * p + 0)] = (cq15_t) {
+                    .r = (i16)(ar + br),
+                    .i = (i16)(ai + bi),
+                };
+
+                dst[q + stride * (2 * p + 1)] = (cq15_t) {
+                    .r = (i16)((diff_r * w.r - diff_i * w.i + (1 << 14)) >> 15),
+                    .i = (i16)((diff_r * w.i + diff_i * w.r + (1 << 14)) >> 15),
+                };
+            }
+        }
+
+        largest = fft_q15_largest(dst, plan->size);
+
+        cq15_t *tmp = dst;
+        dst = src;
+        src = tmp;
+    }
+
+    if (src != data) {
+        memcpy(data, src, plan->size * sizeof(cq15_t));
+    }
+
+    return exponent;
+}
+
+#endif // FFT_IMPL
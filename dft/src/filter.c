@@ -0,0 +1,170 @@
+#include <raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/utils.h"
+
+#define CONV_IMPL
+#include "conv.h"
+
+// cc src/filter.c ../raylib/lib/libraylib.a -o filter.exe -I. -I../raylib/include -O2 -lm -ldl -lpthread && ./filter.exe audio.ogg voice.wav
+
+#define FILTER_TAPS  1023
+#define FILTER_BLOCK 1024 // Latency doesn't matter offline, bigger blocks are cheaper.
+
+static f64
+filter_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Comma separated values, returns how many were read.
+static u32
+filter_parse_list(const char *text, f32 *values, u32 capacity)
+{
+    u32 count = 0;
+
+    while (count < capacity && *text) {
+        char *end;
+        values[count++] = strtof(text, &end);
+
+        if (end == text || (*end != ',' && *end != '\0'))
+            return 0;
+
+        text = *end == ',' ? end + 1 : end;
+    }
+
+    return count;
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-v low,high] [-e gain_db,...] [-n taps] <audio> <out.wav>\n", program);
+    fprintf(stderr, "  -v  band pass, %.0f to %.0fHz by default\n", CONV_VOICE_LOW, CONV_VOICE_HIGH);
+    fprintf(stderr, "  -e  EQ instead, %u octave gains from %.2fHz up\n", CONV_EQ_BANDS, CONV_EQ_LOW);
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    f32 band[2] = { CONV_VOICE_LOW, CONV_VOICE_HIGH };
+    f32 gains[CONV_EQ_BANDS];
+    b32 eq = false;
+    u32 tap_count = FILTER_TAPS;
+
+    i32 arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'v': {
+                if (filter_parse_list(argv[arg + 1], band, 2) != 2 || band[0] >= band[1]) {
+                    fprintf(stderr, "Expected the band as 'low,high'!\n");
+                    return 1;
+                }
+            } break;
+
+            case 'e': {
+                if (filter_parse_list(argv[arg + 1], gains, CONV_EQ_BANDS) != CONV_EQ_BANDS) {
+                    fprintf(stderr, "Expected %u gains!\n", CONV_EQ_BANDS);
+                    return 1;
+                }
+
+                eq = true;
+            } break;
+
+            case 'n': tap_count = atoi(argv[arg + 1]) | 1; break;
+
+            default: {
+                fprintf(stderr, "Unknown option '%s'!\n", argv[arg]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 2 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Wave wave = LoadWave(argv[arg]);
+
+    if (!IsWaveReady(wave) || wave.frameCount == 0) {
+        fprintf(stderr, "Failed to decode '%s'!\n", argv[arg]);
+        return 1;
+    }
+
+    WaveFormat(&wave, wave.sampleRate, 32, wave.channels < CONV_MAX_CHANNELS ? wave.channels : CONV_MAX_CHANNELS);
+
+    f32 *taps = malloc(tap_count * sizeof(f32));
+
+    if (!taps) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    if (eq) {
+        conv_design_eq(taps, tap_count, wave.sampleRate, gains);
+    }
+    else {
+        conv_design_bandpass(taps, tap_count, wave.sampleRate, band[0], band[1]);
+    }
+
+    conv_t conv;
+    conv_init(&conv, taps, tap_count, FILTER_BLOCK, wave.channels);
+
+    f64 start = filter_seconds();
+
+    // Skips the block and the filter delay, then flushes them out with silence so the output lines up with the input.
+    // Input shorter than the delay is skipped whole and silence skips the rest.
+    u32 delay = FILTER_BLOCK + (tap_count - 1) / 2;
+    f32 *samples = wave.data;
+    f32 *flush   = calloc((u64)delay * wave.channels, sizeof(f32));
+
+    if (!flush) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    u32 skip = delay < wave.frameCount ? delay : wave.frameCount;
+
+    conv_process(&conv, samples, flush, skip);
+    conv_process(&conv, samples + (u64)skip * wave.channels, samples, wave.frameCount - skip);
+
+    u32 tail = wave.frameCount - skip;
+
+    memset(flush, 0, (u64)delay * wave.channels * sizeof(f32));
+    conv_process(&conv, flush, flush, delay - skip);
+
+    memset(flush, 0, (u64)(delay - skip) * wave.channels * sizeof(f32));
+    conv_process(&conv, flush, samples + (u64)tail * wave.channels, skip);
+
+    f64 seconds = filter_seconds() - start;
+    f64 audio_seconds = wave.frameCount / (f64)wave.sampleRate;
+
+    WaveFormat(&wave, wave.sampleRate, 16, wave.channels);
+
+    b32 ok = ExportWave(wave, argv[arg + 1]);
+
+    if (ok) {
+        printf("%.1fs of audio, %u taps in %u partitions, in %.3fs (%.0fx real time)\n", audio_seconds, tap_count,
+               conv.partitions, seconds, seconds > 0.0 ? audio_seconds / seconds : 0.0);
+    }
+    else {
+        fprintf(stderr, "Failed to write '%s'!\n", argv[arg + 1]);
+    }
+
+    conv_free(&conv);
+    free(taps);
+    free(flush);
+    UnloadWave(wave);
+
+    return ok ? 0 : 1;
+}
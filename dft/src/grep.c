@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define PAR_IMPL
+#include "par.h"
+
+#define RX_IMPL
+#include "rx.h"
+
+// cc src/grep.c -o grep.exe -I. -O2 -lm -lpthread && ./grep.exe '\bwitch(es)?\b hunt' ../oneyplays/witch_hunt_test/*.vtt
+
+/* Regex search over the caption text of many videos. Every file is parsed,
+ * skipped right away when it doesn't contain the literal every match needs,
+ * and scanned with `rx_search` otherwise. Matches are printed with the time
+ * of the word they start in.
+ */
+
+#define GREP_CONTEXT_MAX 160
+
+typedef dck_stretchy_t (u8, u32) grep_buffer_t;
+
+typedef struct
+{
+    vtt_data_t vtt;
+    rx_cache_t cache;
+} grep_thread_t;
+
+typedef struct
+{
+    const rx_t *rx;
+
+    char **files;
+    u32    file_count;
+
+    grep_thread_t *threads;
+    char         **reports;
+    u32           *match_counts;
+    u32            skipped;
+} grep_t;
+
+static void
+grep_printf(grep_buffer_t *out, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    i32 size = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    dck_stretchy_reserve(*out, (u32)size + 1);
+
+    va_start(args, fmt);
+    vsnprintf((char *)out->data + out->count, size + 1, fmt, args);
+    va_end(args);
+
+    out->count += size;
+}
+
+// Last word starting at or before `offset`.
+static u32
+grep_word_at(const vtt_data_t *data, vtt_chunk_t chunk, u32 offset)
+{
+    u32 lo = 0, hi = chunk.word_count;
+
+    while (hi - lo > 1) {
+        u32 mid = lo + (hi - lo) / 2;
+
+        if (data->words.data[chunk.word_offset + mid].text_offset <= offset) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return chunk.word_offset + lo;
+}
+
+static void
+grep_file(void *context, u32 thread_index, u32 file)
+{
+    grep_t *grep = context;
+    grep_thread_t *thread = grep->threads + thread_index;
+
+    thread->vtt.text.count  = 0;
+    thread->vtt.words.count = 0;
+
+    vtt_chunk_t chunk = vtt_parse_file(&thread->vtt, grep->files[file]);
+
+    const u8 *text = thread->vtt.text.data;
+    u32 size = thread->vtt.text.count;
+
+    if (chunk.word_count == 0 || !rx_prefilter(grep->rx, text, size)) {
+        __atomic_fetch_add(&grep->skipped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    grep_buffer_t out = {0};
+    u32 count = 0;
+    u32 pos = 0;
+    rx_match_t match;
+
+    while (pos <= size && rx_search(grep->rx, &thread->cache, text, size, pos, &match)) {
+        vtt_word_t word = thread->vtt.words.data[grep_word_at(&thread->vtt, chunk, match.start)];
+
+        u32 start = match.start;
+        u32 end   = match.end;
+
+        while (start < end && text[start] == ' ') {
+            ++start;
+        }
+
+        if (end - start > GREP_CONTEXT_MAX) {
+            end = start + GREP_CONTEXT_MAX;
+        }
+
+        u32 ms = (u32)(word.time_start * 1000.0f);
+
+        grep_printf(&out, "%s:%02u:%02u:%02u.%03u: %.*s\n", grep->files[file],
+                    ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000, (int)(end - start), text + start);
+
+        ++count;
+
+        // Empty matches would find themselves again.
+        pos = match.end > match.start ? match.end : match.end + 1;
+    }
+
+    if (out.count != 0) {
+        grep_printf(&out, "%c", 0);
+        grep->reports[file] = (char *)out.data;
+    }
+
+    grep->match_counts[file] = count;
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-i] [-c] [-t threads] <pattern> <file.vtt>...\n", program);
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    u32 thread_count = par_thread_count();
+    b32 ignore_case = false;
+    b32 count_only  = false;
+
+    i32 arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != 0; ++arg) {
+        switch (argv[arg][1]) {
+            case 'i': ignore_case = true; break;
+            case 'c': count_only  = true; break;
+            case 't': {
+                if (arg + 1 == argc) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+
+                thread_count = atoi(argv[++arg]);
+            } break;
+
+            default: {
+                print_usage(argv[0]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 2 > argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    rx_t rx;
+    char error[256];
+
+    if (!rx_compile(&rx, argv[arg], ignore_case, error, sizeof(error))) {
+        fprintf(stderr, "Bad pattern '%s': %s\n", argv[arg], error);
+        return 1;
+    }
+
+    grep_t grep = {
+        .rx         = &rx,
+        .files      = argv + arg + 1,
+        .file_count = argc - arg - 1,
+    };
+
+    // `vtt_parse_file` expects the files to be there.
+    for (u32 i = 0; i < grep.file_count; ++i) {
+        if (access(grep.files[i], R_OK) != 0) {
+            fprintf(stderr, "Can't read '%s'!\n", grep.files[i]);
+            return 1;
+        }
+    }
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    grep.threads      = calloc(thread_count, sizeof(grep_thread_t));
+    grep.reports      = calloc(grep.file_count, sizeof(char *));
+    grep.match_counts = calloc(grep.file_count, sizeof(u32));
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        rx_cache_init(&grep.threads[t].cache, &rx);
+    }
+
+    par_for(grep.file_count, thread_count, grep_file, &grep);
+
+    u64 total = 0;
+
+    for (u32 i = 0; i < grep.file_count; ++i) {
+        if (count_only && grep.match_counts[i] != 0) {
+            printf("%s: %u\n", grep.files[i], grep.match_counts[i]);
+        }
+        else if (!count_only && grep.reports[i]) {
+            fputs(grep.reports[i], stdout);
+        }
+
+        total += grep.match_counts[i];
+        free(grep.reports[i]);
+    }
+
+    fprintf(stderr, ""FMT_U64" matches, %u of %u files skipped by the prefilter\n", total, grep.skipped, grep.file_count);
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        grep_thread_t *thread = grep.threads + t;
+
+        rx_cache_free(&thread->cache);
+        free(thread->vtt.text.data);
+        free(thread->vtt.words.data);
+    }
+
+    free(grep.threads);
+    free(grep.reports);
+    free(grep.match_counts);
+    rx_free(&rx);
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <string.h>
+
+#include "core/utils.h"
+
+#define HASH_SEED 0x9E3779B97F4A7C15ull
+
+static inline u64
+hash_u64(u64 x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline u64
+hash_combine(u64 a, u64 b)
+{
+    return hash_u64(a ^ (b + HASH_SEED + (a << 6) + (a >> 2)));
+}
+
+// Word-at-a-time hash. Good enough for hash tables and content fingerprints,
+// not meant to be cryptographic.
+static inline u64
+hash_bytes(const void *data, u64 size)
+{
+    const u8 *bytes = data;
+    u64 h = HASH_SEED ^ (size * 0xFF51AFD7ED558CCDull);
+
+    while (size >= 8) {
+        u64 w;
+        memcpy(&w, bytes, 8);
+        h = (h ^ hash_u64(w)) * 0xC4CEB9FE1A85EC53ull;
+        bytes += 8;
+        size  -= 8;
+    }
+
+    u64 w = 0;
+    memcpy(&w, bytes, size);
+    h ^= hash_u64(w ^ size);
+
+    return hash_u64(h);
+}
+
+#endif // HASH_H_
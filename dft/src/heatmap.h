@@ -0,0 +1,338 @@
+#ifndef HEATMAP_H_
+#define HEATMAP_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+#include "vocab.h"
+
+/* Word occurrence histograms over the timeline of a video. Occurrences are
+ * counted into fixed time buckets and every histogram carries a pyramid of
+ * coarser levels (each bucket sums two of the level below), the same way the
+ * waveform mips work, so drawing one takes O(screen width).
+ *
+ * The most frequent words get their pyramids precomputed, the rest can be
+ * built on demand from the postings.
+ */
+
+#define HEATMAP_BUCKET_SECONDS 1.0f
+#define HEATMAP_DEFAULT_TOP    64
+#define HEATMAP_NONE           0xFFFFFFFF
+
+typedef struct
+{
+    u32 offset, size;
+} heatmap_level_t;
+
+typedef struct
+{
+    f32 bucket_seconds;
+
+    // The level layout is the same for every pyramid, level 0 holds the finest buckets.
+    dck_stretchy_t (heatmap_level_t, u32) levels;
+    u32 stride;
+
+    dck_stretchy_t (u32, u32) terms;  // Term of every precomputed pyramid, sorted.
+    dck_stretchy_t (u32, u32) values; // `stride` values per pyramid.
+    dck_stretchy_t (u32, u32) maxima; // Largest bucket of every level, `levels.count` per pyramid.
+} heatmap_t;
+
+void
+heatmap_init(heatmap_t *heatmap, f32 duration, f32 bucket_seconds);
+
+// Precomputes the pyramids of the `top_count` most frequent words in `chunk`.
+void
+heatmap_build_top(heatmap_t *heatmap, const vocab_index_t *index, const vtt_data_t *data, vtt_chunk_t chunk, u32 top_count);
+
+// Builds the pyramid of any word, `values_o` needs `stride` and `maxima_o` `levels.count` entries.
+void
+heatmap_build_term(const heatmap_t *heatmap, const vocab_index_t *index, const vtt_data_t *data, vtt_chunk_t chunk,
+                   u32 term, u32 *values_o, u32 *maxima_o);
+
+// Returns the index of a precomputed pyramid or `HEATMAP_NONE`.
+u32
+heatmap_find(const heatmap_t *heatmap, u32 term);
+
+void
+heatmap_free(heatmap_t *heatmap);
+
+static inline const u32 *
+heatmap_values(const heatmap_t *heatmap, u32 pyramid)
+{
+    return heatmap->values.data + pyramid * heatmap->stride;
+}
+
+static inline const u32 *
+heatmap_maxima(const heatmap_t *heatmap, u32 pyramid)
+{
+    return heatmap->maxima.data + pyramid * heatmap->levels.count;
+}
+
+// Picks the coarsest level that still has a bucket for every one of `width` pixels.
+static inline u32
+heatmap_level_for(const heatmap_t *heatmap, u32 width)
+{
+    u32 level = heatmap->levels.count - 1;
+
+    while (heatmap->levels.data[level].size < width && level != 0) {
+        --level;
+    }
+
+    return level;
+}
+
+// Density of pixel `x` out of `width` in `[0, 1]`, relative to the busiest bucket of the level. Takes the busiest
+// of the buckets under the pixel, so a lone occurrence shows up however the buckets fall on the pixels.
+static inline f32
+heatmap_sample(const heatmap_t *heatmap, const u32 *values, const u32 *maxima, u32 level, u32 x, u32 width)
+{
+    heatmap_level_t info = heatmap->levels.data[level];
+
+    if (maxima[level] == 0)
+        return 0.0f;
+
+    u32 first = (u32)(((u64)x * info.size) / width);
+    u32 end   = (u32)(((u64)(x + 1) * info.size) / width);
+
+    end = end > first ? end : first + 1;
+
+    u32 value = 0;
+
+    for (u32 b = first; b < end; ++b) {
+        value = values[info.offset + b] > value ? values[info.offset + b] : value;
+    }
+
+    return value / (f32)maxima[level];
+}
+
+#endif // HEATMAP_H_
+
+#if defined(HEATMAP_IMPL) && !defined(HEATMAP_IMPL_)
+#define HEATMAP_IMPL_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void
+heatmap_init(heatmap_t *heatmap, f32 duration, f32 bucket_seconds)
+{
+    *heatmap = (heatmap_t) {
+        .bucket_seconds = bucket_seconds,
+    };
+
+    u32 size = (u32)(duration / bucket_seconds) + 1;
+    u32 offset = 0;
+
+    for (;;) {
+        dck_stretchy_push(heatmap->levels, (heatmap_level_t) {
+            .offset = offset,
+            .size   = size,
+        });
+
+        offset += size;
+
+        if (size == 1)
+            break;
+
+        // Round up so that the last odd bucket isn't dropped.
+        size = (size + 1) / 2;
+    }
+
+    heatmap->stride = offset;
+}
+
+// Postings are sorted, the ones of a chunk are a contiguous range.
+static const u32 *
+heatmap_chunk_postings(const vocab_index_t *index, vtt_chunk_t chunk, u32 term, u32 *count_o)
+{
+    u32 count;
+    const u32 *postings = vocab_index_postings(index, term, &count);
+
+    u32 lo = 0, hi = count;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+
+        if (postings[mid] < chunk.word_offset) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    u32 begin = lo;
+
+    hi = count;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+
+        if (postings[mid] < chunk.word_offset + chunk.word_count) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    *count_o = lo - begin;
+    return postings + begin;
+}
+
+void
+heatmap_build_term(const heatmap_t *heatmap, const vocab_index_t *index, const vtt_data_t *data, vtt_chunk_t chunk,
+                   u32 term, u32 *values_o, u32 *maxima_o)
+{
+    memset(values_o, 0, heatmap->stride * sizeof(u32));
+
+    u32 posting_count;
+    const u32 *postings = heatmap_chunk_postings(index, chunk, term, &posting_count);
+
+    heatmap_level_t base = heatmap->levels.data[0];
+
+    for (u32 p = 0; p < posting_count; ++p) {
+        f32 time = data->words.data[postings[p]].time_start;
+        u32 bucket = time > 0.0f ? (u32)(time / heatmap->bucket_seconds) : 0;
+
+        if (bucket >= base.size) {
+            bucket = base.size - 1;
+        }
+
+        values_o[base.offset + bucket]++;
+    }
+
+    for (u32 l = 0; l < heatmap->levels.count; ++l) {
+        heatmap_level_t level = heatmap->levels.data[l];
+        u32 *level_values = values_o + level.offset;
+
+        if (l != 0) {
+            heatmap_level_t prev = heatmap->levels.data[l - 1];
+            const u32 *prev_values = values_o + prev.offset;
+
+            for (u32 i = 0; i < level.size; ++i) {
+                u32 a = prev_values[i * 2 + 0];
+                u32 b = i * 2 + 1 < prev.size ? prev_values[i * 2 + 1] : 0;
+                level_values[i] = a + b;
+            }
+        }
+
+        u32 max = 0;
+
+        for (u32 i = 0; i < level.size; ++i) {
+            max = level_values[i] > max ? level_values[i] : max;
+        }
+
+        maxima_o[l] = max;
+    }
+}
+
+typedef struct
+{
+    u32 term, count;
+} heatmap_term_count_t;
+
+static int
+heatmap_count_cmp(const void *a, const void *b)
+{
+    const heatmap_term_count_t *ca = a;
+    const heatmap_term_count_t *cb = b;
+
+    if (ca->count != cb->count)
+        return ca->count < cb->count ? 1 : -1;
+
+    return (ca->term > cb->term) - (ca->term < cb->term);
+}
+
+static int
+heatmap_term_cmp(const void *a, const void *b)
+{
+    u32 ta = *(const u32 *)a;
+    u32 tb = *(const u32 *)b;
+    return (ta > tb) - (ta < tb);
+}
+
+void
+heatmap_build_top(heatmap_t *heatmap, const vocab_index_t *index, const vtt_data_t *data, vtt_chunk_t chunk, u32 top_count)
+{
+    u32 term_count = index->vocab.words.count;
+    heatmap_term_count_t *counts = malloc(term_count * sizeof(heatmap_term_count_t) + 1);
+
+    if (!counts) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 t = 0; t < term_count; ++t) {
+        counts[t] = (heatmap_term_count_t) { .term = t };
+    }
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        u32 term = index->word_ids.data[chunk.word_offset + i];
+
+        if (term != VOCAB_NONE) {
+            counts[term].count++;
+        }
+    }
+
+    qsort(counts, term_count, sizeof(heatmap_term_count_t), heatmap_count_cmp);
+
+    heatmap->terms.count = 0;
+
+    for (u32 t = 0; t < term_count && t < top_count && counts[t].count != 0; ++t) {
+        dck_stretchy_push(heatmap->terms, counts[t].term);
+    }
+
+    free(counts);
+
+    qsort(heatmap->terms.data, heatmap->terms.count, sizeof(u32), heatmap_term_cmp);
+
+    u32 pyramid_count = heatmap->terms.count;
+
+    heatmap->values.count = 0;
+    heatmap->maxima.count = 0;
+    dck_stretchy_reserve(heatmap->values, pyramid_count * heatmap->stride);
+    dck_stretchy_reserve(heatmap->maxima, pyramid_count * heatmap->levels.count);
+    heatmap->values.count = pyramid_count * heatmap->stride;
+    heatmap->maxima.count = pyramid_count * heatmap->levels.count;
+
+    for (u32 p = 0; p < pyramid_count; ++p) {
+        heatmap_build_term(heatmap, index, data, chunk, heatmap->terms.data[p],
+                           heatmap->values.data + p * heatmap->stride,
+                           heatmap->maxima.data + p * heatmap->levels.count);
+    }
+}
+
+u32
+heatmap_find(const heatmap_t *heatmap, u32 term)
+{
+    u32 lo = 0, hi = heatmap->terms.count;
+
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+
+        if (heatmap->terms.data[mid] == term)
+            return mid;
+
+        if (heatmap->terms.data[mid] < term) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return HEATMAP_NONE;
+}
+
+void
+heatmap_free(heatmap_t *heatmap)
+{
+    free(heatmap->levels.data);
+    free(heatmap->terms.data);
+    free(heatmap->values.data);
+    free(heatmap->maxima.data);
+    *heatmap = (heatmap_t) {0};
+}
+
+#endif // HEATMAP_IMPL
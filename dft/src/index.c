@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+#include "core/sv.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define SEGMENT_IMPL
+#include "segment.h"
+
+// cc src/index.c -o index.exe -I. -O2 -lpthread && ./index.exe ../index add ../oneyplays/witch_hunt_test/*.vtt
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s <index dir> add <file.vtt>...\n", program);
+    fprintf(stderr, "       %s <index dir> find <word>\n", program);
+    fprintf(stderr, "       %s <index dir> list\n", program);
+}
+
+static i32
+index_add(segment_set_t *set, i32 file_count, char **files)
+{
+    // Merges run next to the parsing, whatever is left gets finished on close.
+    segment_set_start_merger(set);
+
+    for (i32 i = 0; i < file_count; ++i) {
+        vtt_data_t vtt_data = {0};
+        vtt_chunk_t chunk = vtt_parse_file(&vtt_data, files[i]);
+
+        u32 video_id = segment_set_add_video(set, files[i], &vtt_data, chunk);
+
+        free(vtt_data.text.data);
+        free(vtt_data.words.data);
+
+        if (video_id == SEGMENT_NONE)
+            return 1;
+
+        printf("%u: %s (%u words)\n", video_id, files[i], chunk.word_count);
+    }
+
+    while (segment_set_merge_step(set))
+        ;;
+
+    return 0;
+}
+
+static i32
+index_find(segment_set_t *set, const char *word)
+{
+    u8 term[256];
+    u32 size = strlen(word) < sizeof(term) ? strlen(word) : sizeof(term);
+    size = vocab_normalize((const u8 *)word, size, term);
+
+    segment_snapshot_t snapshot = segment_set_snapshot(set);
+    segment_hits_t hits = {0};
+
+    segment_snapshot_find(&snapshot, term, size, &hits);
+
+    for (u32 i = 0; i < hits.count; ++i) {
+        segment_hit_t hit = hits.data[i];
+
+        u32 name_size;
+        const u8 *name = segment_snapshot_video_name(&snapshot, hit.video_id, &name_size);
+
+        u32 ms = (u32)(hit.time_start * 1000.0f);
+
+        printf("%u "SV_FMT" %02u:%02u:%02u.%03u\n", hit.video_id, (int)name_size, name,
+               ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000);
+    }
+
+    printf("%u occurrences in %u segments\n", hits.count, snapshot.count);
+
+    free(hits.data);
+    segment_snapshot_release(&snapshot);
+
+    return 0;
+}
+
+static i32
+index_list(segment_set_t *set)
+{
+    segment_snapshot_t snapshot = segment_set_snapshot(set);
+
+    for (u32 s = 0; s < snapshot.count; ++s) {
+        const segment_header_t *header = snapshot.segments[s]->header;
+
+        printf("%08u.seg: %u videos, %u terms, %u tokens, "FMT_U64" bytes\n", snapshot.segments[s]->id,
+               header->video_count, header->term_count, header->token_count, header->size);
+    }
+
+    segment_snapshot_release(&snapshot);
+
+    return 0;
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    segment_set_t set;
+
+    if (!segment_set_open(&set, argv[1]))
+        return 1;
+
+    i32 res = 1;
+
+    if (strcmp(argv[2], "add") == 0) {
+        res = index_add(&set, argc - 3, argv + 3);
+    }
+    else if (strcmp(argv[2], "find") == 0 && argc == 4) {
+        res = index_find(&set, argv[3]);
+    }
+    else if (strcmp(argv[2], "list") == 0) {
+        res = index_list(&set);
+    }
+    else {
+        print_usage(argv[0]);
+    }
+
+    segment_set_close(&set);
+
+    return res;
+}
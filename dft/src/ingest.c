@@ -0,0 +1,810 @@
+#include <raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define CATALOG_IMPL
+#include "catalog.h"
+
+#define FFT_IMPL
+#include "fft.h"
+
+#define PIPELINE_IMPL
+#include "pipeline.h"
+
+#define VAD_IMPL
+#include "vad.h"
+
+#include "hash.h"
+
+// cc src/ingest.c ../raylib/lib/libraylib.a -o ingest.exe -I. -I../raylib/include -O2 -lm -ldl -lpthread && ./ingest.exe ../corpus.cat ../features
+
+/* Bulk feature extraction for every catalog entry with audio:
+ *
+ *   decode   - decode the audio, mix it down to mono and resample it to `INGEST_SAMPLE_RATE`, parse the captions
+ *   mip      - amplitude pyramid for drawing the timeline
+ *   vad      - speech intervals from the first mip level and spectral flatness
+ *   stft     - Hann windowed FFT frames, summed into log spaced bands, silent frames are skipped
+ *   features - log band energies, loudness, flux and centroid pooled over `INGEST_POOL` frames
+ *   index    - the frame of every word, write the feature file
+ *
+ * Every finished video gets a line in the checkpoint file of the output
+ * folder, keyed by its content hashes and `FEATURES_VERSION`, and a
+ * restarted run skips those. Files of an older version get redone.
+ * The feature file is synced and renamed into place, and the folder
+ * synced, before its checkpoint line is written.
+ */
+
+#define INGEST_SAMPLE_RATE 16000
+#define INGEST_FFT_SIZE    512
+#define INGEST_HOP         256
+#define INGEST_BANDS       32
+#define INGEST_BAND_LOW    50.0f
+#define INGEST_BAND_HIGH   8000.0f
+#define INGEST_POOL        4
+#define INGEST_FEATURES    (INGEST_BANDS + 3)
+#define INGEST_MIP_BLOCK   64
+#define INGEST_LOG_FLOOR   1e-10f
+
+#define INGEST_DEFAULT_QUEUE 4
+#define INGEST_CHECKPOINT    "ingest.ckpt"
+
+#define FEATURES_MAGIC   0x31414546 // "FEA1"
+#define FEATURES_VERSION 2
+
+typedef enum
+{
+    ingest_stage_Decode,
+    ingest_stage_Mip,
+    ingest_stage_Vad,
+    ingest_stage_Stft,
+    ingest_stage_Features,
+    ingest_stage_Index,
+    ingest_stage_Count,
+} ingest_stage_t;
+
+static const char *ingest_stage_names[ingest_stage_Count] = { "decode", "mip", "vad", "stft", "features", "index" };
+
+typedef struct
+{
+    u32 offset, size;
+} ingest_mip_level_t;
+
+typedef struct
+{
+    u32 magic, version;
+
+    u32 sample_rate;
+    u32 hop;          // Samples per STFT frame.
+    u32 pool;         // STFT frames per feature frame.
+    u32 feature_count; // Values per feature frame.
+    u32 frame_count;
+    u32 mip_block;     // Samples per value of the first mip level.
+    u32 mip_level_count;
+    u32 mip_value_count;
+    u32 word_count;
+    u32 speech_count;
+
+    f32 duration;
+    u64 audio_hash, caption_hash;
+
+    u64 mip_levels_offset;
+    u64 mip_values_offset;
+    u64 features_offset;
+    u64 word_frames_offset; // Feature frame every caption word starts in.
+    u64 speech_offset;      // `vad_interval_t` of every stretch of speech.
+    u64 size;
+} features_header_t;
+
+typedef struct
+{
+    u32 entry;
+    u64 key;
+
+    f32 *samples;
+    u32  sample_count;
+
+    vtt_data_t  vtt;
+    vtt_chunk_t chunk;
+
+    dck_stretchy_t (ingest_mip_level_t, u32) mip_levels;
+    dck_stretchy_t (f32,                u32) mip_values;
+
+    vad_intervals_t speech;
+
+    f32 *bands; // `INGEST_BANDS` per STFT frame.
+    u32  band_frame_count;
+
+    f32 *features; // `INGEST_FEATURES` per feature frame.
+    u32  frame_count;
+} ingest_item_t;
+
+typedef struct
+{
+    cn_t *data, *scratch;
+} ingest_fft_buffers_t;
+
+typedef dck_stretchy_t (u64, u32) ingest_keys_t;
+
+typedef struct
+{
+    catalog_t   catalog;
+    const char *out_dir;
+
+    fft_plan_t fft_plan;
+    f32        window[INGEST_FFT_SIZE];
+    u32        band_edges[INGEST_BANDS + 1]; // First FFT bin of every band.
+
+    ingest_fft_buffers_t *fft_buffers; // One per stft thread.
+
+    pthread_mutex_t checkpoint_mutex;
+    FILE           *checkpoint;
+
+    atomic_uint done, failed;
+    atomic_ullong stft_frames, stft_skipped;
+} ingest_t;
+
+static void
+ingest_item_free(ingest_item_t *item)
+{
+    free(item->samples);
+    free(item->vtt.text.data);
+    free(item->vtt.words.data);
+    free(item->mip_levels.data);
+    free(item->mip_values.data);
+    free(item->speech.data);
+    free(item->bands);
+    free(item->features);
+    free(item);
+}
+
+static f32 *
+ingest_alloc_f32(u64 count)
+{
+    f32 *values = malloc(count * sizeof(f32) + 1);
+
+    if (!values) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    return values;
+}
+
+static b32
+ingest_decode(void *context, u32 thread, void *item_ptr)
+{
+    (void)thread;
+
+    ingest_t *ingest = context;
+    ingest_item_t *item = item_ptr;
+
+    catalog_entry_t entry = catalog_entry(&ingest->catalog, item->entry);
+
+    Wave wave = LoadWave(entry.audio_path);
+
+    if (!IsWaveReady(wave) || wave.frameCount == 0) {
+        fprintf(stderr, "Failed to decode '%s'!\n", entry.audio_path);
+        atomic_fetch_add(&ingest->failed, 1);
+        ingest_item_free(item);
+        return false;
+    }
+
+    // Float samples whatever the file had.
+    WaveFormat(&wave, wave.sampleRate, 32, wave.channels);
+
+    const f32 *frames = wave.data;
+    f64 ratio = wave.sampleRate / (f64)INGEST_SAMPLE_RATE;
+
+    item->sample_count = (u32)(wave.frameCount / ratio);
+    item->samples = ingest_alloc_f32(item->sample_count);
+
+    // Box filter over the source frames of every output sample, enough against aliasing for features.
+    for (u32 i = 0; i < item->sample_count; ++i) {
+        u64 begin = (u64)(i * ratio);
+        u64 end   = (u64)((i + 1) * ratio);
+
+        if (end <= begin) {
+            end = begin + 1;
+        }
+
+        if (end > wave.frameCount) {
+            end = wave.frameCount;
+        }
+
+        f32 sum = 0.0f;
+
+        for (u64 f = begin; f < end; ++f) {
+            for (u32 c = 0; c < wave.channels; ++c) {
+                sum += frames[f * wave.channels + c];
+            }
+        }
+
+        item->samples[i] = end > begin ? sum / ((end - begin) * wave.channels) : 0.0f;
+    }
+
+    UnloadWave(wave);
+
+    item->chunk = vtt_parse_file(&item->vtt, entry.caption_path);
+
+    return true;
+}
+
+static b32
+ingest_mip(void *context, u32 thread, void *item_ptr)
+{
+    (void)context;
+    (void)thread;
+
+    ingest_item_t *item = item_ptr;
+
+    u32 size = (item->sample_count + INGEST_MIP_BLOCK - 1) / INGEST_MIP_BLOCK;
+
+    // Rounding the levels up adds at most one bucket per level to the halvings.
+    dck_stretchy_reserve(item->mip_values, size * 2 + 32);
+
+    for (u32 i = 0; i < size; ++i) {
+        u32 begin = i * INGEST_MIP_BLOCK;
+        u32 end   = begin + INGEST_MIP_BLOCK < item->sample_count ? begin + INGEST_MIP_BLOCK : item->sample_count;
+
+        f32 sum = 0.0f;
+
+        for (u32 s = begin; s < end; ++s) {
+            sum += fabsf(item->samples[s]);
+        }
+
+        item->mip_values.data[i] = sum / (end - begin);
+    }
+
+    dck_stretchy_push(item->mip_levels, ((ingest_mip_level_t) { .offset = 0, .size = size }));
+    item->mip_values.count = size;
+
+    while (size > 1) {
+        ingest_mip_level_t prev = item->mip_levels.data[item->mip_levels.count - 1];
+
+        // Round up so that the last odd bucket isn't dropped, it's kept as it is.
+        size = (size + 1) / 2;
+
+        for (u32 i = 0; i < size; ++i) {
+            f32 a = item->mip_values.data[prev.offset + i * 2 + 0];
+
+            if (i * 2 + 1 == prev.size) {
+                item->mip_values.data[item->mip_values.count + i] = a;
+                continue;
+            }
+
+            f32 b = item->mip_values.data[prev.offset + i * 2 + 1];
+            item->mip_values.data[item->mip_values.count + i] = (a + b) * 0.5f;
+        }
+
+        dck_stretchy_push(item->mip_levels, ((ingest_mip_level_t) { .offset = item->mip_values.count, .size = size }));
+        item->mip_values.count += size;
+    }
+
+    return true;
+}
+
+static b32
+ingest_vad(void *context, u32 thread, void *item_ptr)
+{
+    (void)context;
+    (void)thread;
+
+    ingest_item_t *item = item_ptr;
+    ingest_mip_level_t level = item->mip_levels.data[0];
+
+    vad_detect(&item->speech, item->samples, item->sample_count, INGEST_SAMPLE_RATE,
+               item->mip_values.data + level.offset, level.size, INGEST_MIP_BLOCK, NULL);
+
+    return true;
+}
+
+static b32
+ingest_stft(void *context, u32 thread, void *item_ptr)
+{
+    ingest_t *ingest = context;
+    ingest_item_t *item = item_ptr;
+    ingest_fft_buffers_t buffers = ingest->fft_buffers[thread];
+
+    u32 frame_count = item->sample_count >= INGEST_FFT_SIZE ? (item->sample_count - INGEST_FFT_SIZE) / INGEST_HOP + 1 : 0;
+
+    item->band_frame_count = frame_count;
+    item->bands = ingest_alloc_f32((u64)frame_count * INGEST_BANDS);
+
+    u32 cursor = 0, skipped = 0;
+
+    for (u32 frame = 0; frame < frame_count; ++frame) {
+        const f32 *samples = item->samples + (u64)frame * INGEST_HOP;
+        f32 *bands = item->bands + (u64)frame * INGEST_BANDS;
+
+        f32 start = frame * INGEST_HOP / (f32)INGEST_SAMPLE_RATE;
+        f32 end   = start + INGEST_FFT_SIZE / (f32)INGEST_SAMPLE_RATE;
+
+        // Silence gets no energy, which the features turn into their floor.
+        if (!vad_overlaps(&item->speech, &cursor, start, end)) {
+            memset(bands, 0, INGEST_BANDS * sizeof(f32));
+            ++skipped;
+            continue;
+        }
+
+        for (u32 i = 0; i < INGEST_FFT_SIZE; ++i) {
+            buffers.data[i] = (cn_t) { .r = samples[i] * ingest->window[i] };
+        }
+
+        fft_forward(&ingest->fft_plan, buffers.data, buffers.scratch);
+
+        for (u32 b = 0; b < INGEST_BANDS; ++b) {
+            f32 energy = 0.0f;
+
+            for (u32 bin = ingest->band_edges[b]; bin < ingest->band_edges[b + 1]; ++bin) {
+                cn_t cn = buffers.data[bin];
+                energy += cn.r * cn.r + cn.i * cn.i;
+            }
+
+            bands[b] = energy;
+        }
+    }
+
+    atomic_fetch_add(&ingest->stft_frames, frame_count);
+    atomic_fetch_add(&ingest->stft_skipped, skipped);
+
+    // Everything after this works on the bands.
+    free(item->samples);
+    item->samples = NULL;
+
+    return true;
+}
+
+static b32
+ingest_features(void *context, u32 thread, void *item_ptr)
+{
+    (void)context;
+    (void)thread;
+
+    ingest_item_t *item = item_ptr;
+
+    item->frame_count = item->band_frame_count / INGEST_POOL;
+    item->features = ingest_alloc_f32((u64)item->frame_count * INGEST_FEATURES);
+
+    f32 prev[INGEST_BANDS] = {0};
+
+    for (u32 frame = 0; frame < item->frame_count; ++frame) {
+        f32 *features = item->features + (u64)frame * INGEST_FEATURES;
+        f32 pooled[INGEST_BANDS] = {0};
+
+        for (u32 p = 0; p < INGEST_POOL; ++p) {
+            const f32 *bands = item->bands + ((u64)frame * INGEST_POOL + p) * INGEST_BANDS;
+
+            for (u32 b = 0; b < INGEST_BANDS; ++b) {
+                pooled[b] += bands[b] / INGEST_POOL;
+            }
+        }
+
+        f32 total = 0.0f, weighted = 0.0f, flux = 0.0f;
+
+        for (u32 b = 0; b < INGEST_BANDS; ++b) {
+            f32 level = log10f(pooled[b] + INGEST_LOG_FLOOR);
+
+            // Only rising bands count, onsets matter more than decays.
+            if (frame != 0 && level > prev[b]) {
+                flux += level - prev[b];
+            }
+
+            features[b] = level;
+            prev[b]     = level;
+
+            total    += pooled[b];
+            weighted += pooled[b] * b;
+        }
+
+        features[INGEST_BANDS + 0] = 10.0f * log10f(total + INGEST_LOG_FLOOR);
+        features[INGEST_BANDS + 1] = flux;
+        features[INGEST_BANDS + 2] = total > INGEST_LOG_FLOOR ? weighted / total / INGEST_BANDS : 0.0f;
+    }
+
+    free(item->bands);
+    item->bands = NULL;
+
+    return true;
+}
+
+static u64
+ingest_align(u64 offset)
+{
+    return (offset + 7) & ~(u64)7;
+}
+
+// Makes the renames in `dir` durable.
+static b32
+ingest_sync_dir(const char *dir)
+{
+    i32 fd = open(dir, O_RDONLY | O_DIRECTORY);
+
+    if (fd < 0)
+        return false;
+
+    b32 ok = fsync(fd) == 0;
+    close(fd);
+
+    return ok;
+}
+
+static b32
+ingest_write_section(FILE *file, u64 *offset, const void *data, u64 size)
+{
+    static const u8 zeros[8] = {0};
+
+    u64 aligned = ingest_align(*offset);
+
+    if (aligned != *offset && fwrite(zeros, 1, aligned - *offset, file) != aligned - *offset)
+        return false;
+
+    if (size != 0 && fwrite(data, 1, size, file) != size)
+        return false;
+
+    *offset = aligned + size;
+    return true;
+}
+
+static b32
+ingest_index(void *context, u32 thread, void *item_ptr)
+{
+    (void)thread;
+
+    ingest_t *ingest = context;
+    ingest_item_t *item = item_ptr;
+
+    catalog_entry_t entry = catalog_entry(&ingest->catalog, item->entry);
+
+    u32 word_count = item->chunk.word_count;
+    u32 *word_frames = malloc(word_count * sizeof(u32) + 1);
+
+    if (!word_frames) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    f32 frames_per_second = INGEST_SAMPLE_RATE / (f32)(INGEST_HOP * INGEST_POOL);
+
+    for (u32 i = 0; i < word_count; ++i) {
+        f32 frame = item->vtt.words.data[item->chunk.word_offset + i].time_start * frames_per_second;
+        word_frames[i] = frame > 0.0f ? (u32)frame : 0;
+    }
+
+    features_header_t header = {
+        .magic           = FEATURES_MAGIC,
+        .version         = FEATURES_VERSION,
+        .sample_rate     = INGEST_SAMPLE_RATE,
+        .hop             = INGEST_HOP,
+        .pool            = INGEST_POOL,
+        .feature_count   = INGEST_FEATURES,
+        .frame_count     = item->frame_count,
+        .mip_block       = INGEST_MIP_BLOCK,
+        .mip_level_count = item->mip_levels.count,
+        .mip_value_count = item->mip_values.count,
+        .word_count      = word_count,
+        .speech_count    = item->speech.count,
+        .duration        = item->sample_count / (f32)INGEST_SAMPLE_RATE,
+        .audio_hash      = entry.audio_hash,
+        .caption_hash    = entry.caption_hash,
+    };
+
+    u64 mip_levels_size = item->mip_levels.count * sizeof(ingest_mip_level_t);
+    u64 mip_values_size = item->mip_values.count * sizeof(f32);
+    u64 features_size   = (u64)item->frame_count * INGEST_FEATURES * sizeof(f32);
+    u64 word_size       = word_count * sizeof(u32);
+    u64 speech_size     = item->speech.count * sizeof(vad_interval_t);
+
+    u64 offset = sizeof(header);
+
+    offset = ingest_align(offset); header.mip_levels_offset  = offset; offset += mip_levels_size;
+    offset = ingest_align(offset); header.mip_values_offset  = offset; offset += mip_values_size;
+    offset = ingest_align(offset); header.features_offset    = offset; offset += features_size;
+    offset = ingest_align(offset); header.word_frames_offset = offset; offset += word_size;
+    offset = ingest_align(offset); header.speech_offset      = offset; offset += speech_size;
+    header.size = offset;
+
+    char path[CATALOG_PATH_MAX], tmp_path[CATALOG_PATH_MAX + 8];
+    snprintf(path, sizeof(path), "%s/%016llx.fea", ingest->out_dir, (unsigned long long)item->key);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    b32 ok = false;
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file) {
+        offset = 0;
+
+        ok = ingest_write_section(file, &offset, &header, sizeof(header))
+          && ingest_write_section(file, &offset, item->mip_levels.data, mip_levels_size)
+          && ingest_write_section(file, &offset, item->mip_values.data, mip_values_size)
+          && ingest_write_section(file, &offset, item->features, features_size)
+          && ingest_write_section(file, &offset, word_frames, word_size)
+          && ingest_write_section(file, &offset, item->speech.data, speech_size);
+
+        // On disk before the rename, or a crash could leave a renamed but empty file behind a checkpoint line.
+        ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+
+        if (fclose(file) != 0) {
+            ok = false;
+        }
+
+        if (ok && rename(tmp_path, path) != 0) {
+            ok = false;
+        }
+
+        ok = ok && ingest_sync_dir(ingest->out_dir);
+    }
+
+    free(word_frames);
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write '%s': %s\n", path, strerror(errno));
+        remove(tmp_path);
+        atomic_fetch_add(&ingest->failed, 1);
+    }
+    else {
+        pthread_mutex_lock(&ingest->checkpoint_mutex);
+
+        fprintf(ingest->checkpoint, "%016llx %s\n", (unsigned long long)item->key, entry.caption_path);
+        fflush(ingest->checkpoint);
+        fsync(fileno(ingest->checkpoint));
+
+        pthread_mutex_unlock(&ingest->checkpoint_mutex);
+
+        atomic_fetch_add(&ingest->done, 1);
+    }
+
+    ingest_item_free(item);
+    return ok;
+}
+
+static int
+ingest_u64_cmp(const void *a, const void *b)
+{
+    u64 ua = *(const u64 *)a;
+    u64 ub = *(const u64 *)b;
+    return (ua > ub) - (ua < ub);
+}
+
+// Keys of the videos a previous run finished, sorted. A torn last line is ignored.
+static void
+ingest_read_checkpoint(const char *path, ingest_keys_t *keys)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return;
+
+    char line[CATALOG_PATH_MAX + 32];
+
+    while (fgets(line, sizeof(line), file)) {
+        u64 size = strlen(line);
+
+        if (size < 17 || line[size - 1] != '\n' || line[16] != ' ')
+            continue;
+
+        char *end;
+        u64 key = strtoull(line, &end, 16);
+
+        if (end == line + 16) {
+            dck_stretchy_push(*keys, key);
+        }
+    }
+
+    fclose(file);
+
+    if (keys->count > 1) {
+        qsort(keys->data, keys->count, sizeof(u64), ingest_u64_cmp);
+    }
+}
+
+static b32
+ingest_has_key(const u64 *keys, u32 count, u64 key)
+{
+    u32 lo = 0, hi = count;
+
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+
+        if (keys[mid] == key)
+            return true;
+
+        if (keys[mid] < key) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return false;
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-j stage=threads]... [-q queue size] [-r report seconds] <catalog.cat> <out folder>\n", program);
+    fprintf(stderr, "       stages: decode, mip, vad, stft, features, index\n");
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    u32 threads[ingest_stage_Count] = { 2, 1, 1, 2, 1, 1 };
+    u32 queue_capacity = INGEST_DEFAULT_QUEUE;
+    f32 report_seconds = 1.0f;
+
+    i32 arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'q': queue_capacity = atoi(argv[arg + 1]); break;
+            case 'r': report_seconds = atof(argv[arg + 1]); break;
+            case 'j': {
+                const char *eq = strchr(argv[arg + 1], '=');
+                u32 s = 0;
+
+                for (; eq && s < ingest_stage_Count; ++s) {
+                    if (strlen(ingest_stage_names[s]) == (u64)(eq - argv[arg + 1]) && strncmp(argv[arg + 1], ingest_stage_names[s], eq - argv[arg + 1]) == 0)
+                        break;
+                }
+
+                if (!eq || s == ingest_stage_Count) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+
+                threads[s] = atoi(eq + 1) > 0 ? atoi(eq + 1) : 1;
+            } break;
+
+            default: {
+                print_usage(argv[0]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 2 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    ingest_t ingest = { .out_dir = argv[arg + 1] };
+
+    if (!catalog_open(&ingest.catalog, argv[arg]))
+        return 1;
+
+    if (mkdir(ingest.out_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create '%s': %s\n", ingest.out_dir, strerror(errno));
+        return 1;
+    }
+
+    char checkpoint_path[CATALOG_PATH_MAX];
+    snprintf(checkpoint_path, sizeof(checkpoint_path), "%s/%s", ingest.out_dir, INGEST_CHECKPOINT);
+
+    ingest_keys_t finished = {0};
+    ingest_read_checkpoint(checkpoint_path, &finished);
+
+    ingest.checkpoint = fopen(checkpoint_path, "ab");
+
+    if (!ingest.checkpoint) {
+        fprintf(stderr, "Failed to open '%s': %s\n", checkpoint_path, strerror(errno));
+        return 1;
+    }
+
+    pthread_mutex_init(&ingest.checkpoint_mutex, NULL);
+
+    fft_plan_init(&ingest.fft_plan, INGEST_FFT_SIZE);
+
+    for (u32 i = 0; i < INGEST_FFT_SIZE; ++i) {
+        ingest.window[i] = 0.5f - 0.5f * cosf(2.0f * M_PI * i / INGEST_FFT_SIZE);
+    }
+
+    // Log spaced, but every band gets at least one bin of its own.
+    f32 bin_hz = INGEST_SAMPLE_RATE / (f32)INGEST_FFT_SIZE;
+
+    for (u32 b = 0; b <= INGEST_BANDS; ++b) {
+        f32 hz = INGEST_BAND_LOW * powf(INGEST_BAND_HIGH / INGEST_BAND_LOW, b / (f32)INGEST_BANDS);
+        u32 bin = (u32)(hz / bin_hz);
+
+        if (b != 0 && bin <= ingest.band_edges[b - 1]) {
+            bin = ingest.band_edges[b - 1] + 1;
+        }
+
+        ingest.band_edges[b] = bin < INGEST_FFT_SIZE / 2 + 1 ? bin : INGEST_FFT_SIZE / 2 + 1;
+    }
+
+    ingest.fft_buffers = calloc(threads[ingest_stage_Stft], sizeof(ingest_fft_buffers_t));
+
+    for (u32 t = 0; t < threads[ingest_stage_Stft]; ++t) {
+        ingest.fft_buffers[t].data    = malloc(INGEST_FFT_SIZE * sizeof(cn_t));
+        ingest.fft_buffers[t].scratch = malloc(INGEST_FFT_SIZE * sizeof(cn_t));
+
+        if (!ingest.fft_buffers[t].data || !ingest.fft_buffers[t].scratch) {
+            fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+            exit(666);
+        }
+    }
+
+    pipeline_fn_t fns[ingest_stage_Count] = { ingest_decode, ingest_mip, ingest_vad, ingest_stft, ingest_features, ingest_index };
+
+    pipeline_t pipeline;
+    pipeline_init(&pipeline, queue_capacity, &ingest);
+
+    for (u32 s = 0; s < ingest_stage_Count; ++s) {
+        pipeline_add_stage(&pipeline, ingest_stage_names[s], fns[s], threads[s]);
+    }
+
+    pipeline_start(&pipeline, stderr, report_seconds);
+
+    u32 skipped = 0, without_audio = 0;
+
+    for (u32 i = 0; i < ingest.catalog.count; ++i) {
+        if (ingest.catalog.audio_path[i] == CATALOG_NONE) {
+            ++without_audio;
+            continue;
+        }
+
+        u64 key = hash_combine(hash_combine(ingest.catalog.audio_hash[i], ingest.catalog.caption_hash[i]), FEATURES_VERSION);
+
+        if (ingest_has_key(finished.data, finished.count, key)) {
+            ++skipped;
+            continue;
+        }
+
+        ingest_item_t *item = calloc(1, sizeof(ingest_item_t));
+
+        if (!item) {
+            fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+            exit(666);
+        }
+
+        item->entry = i;
+        item->key   = key;
+
+        pipeline_push(&pipeline, item);
+    }
+
+    pipeline_finish(&pipeline);
+    pipeline_report(&pipeline, stderr);
+
+    printf("%u done, %u failed, %u already done, %u without audio\n",
+           atomic_load(&ingest.done), atomic_load(&ingest.failed), skipped, without_audio);
+
+    u64 stft_frames = atomic_load(&ingest.stft_frames);
+
+    if (stft_frames) {
+        u64 stft_skipped = atomic_load(&ingest.stft_skipped);
+        printf("%llu of %llu stft frames skipped as silence (%.1f%%)\n", (unsigned long long)stft_skipped,
+               (unsigned long long)stft_frames, stft_skipped * 100.0 / stft_frames);
+    }
+
+    pipeline_free(&pipeline);
+
+    for (u32 t = 0; t < threads[ingest_stage_Stft]; ++t) {
+        free(ingest.fft_buffers[t].data);
+        free(ingest.fft_buffers[t].scratch);
+    }
+
+    free(ingest.fft_buffers);
+    free(finished.data);
+    fft_plan_free(&ingest.fft_plan);
+    fclose(ingest.checkpoint);
+    pthread_mutex_destroy(&ingest.checkpoint_mutex);
+    catalog_close(&ingest.catalog);
+
+    return atomic_load(&ingest.failed) == 0 ? 0 : 1;
+}
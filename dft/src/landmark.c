@@ -0,0 +1,276 @@
+#include <raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define CATALOG_IMPL
+#include "catalog.h"
+
+#define LANDMARK_IMPL
+#include "landmark.h"
+
+// cc src/landmark.c ../raylib/lib/libraylib.a -o landmark.exe -I. -I../raylib/include -O2 -lm -ldl -lpthread && ./landmark.exe build ../corpus.cat ../corpus.lmk
+
+#define LANDMARK_DEFAULT_HITS 10
+
+typedef struct
+{
+    landmark_t landmark;
+    f64        audio_seconds;
+} landmark_thread_t;
+
+typedef struct
+{
+    catalog_t          catalog;
+    landmark_thread_t *threads;
+    landmarks_t       *lists;
+} landmark_batch_t;
+
+static f64
+landmark_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Mono 16 bit at `LANDMARK_RATE`, the format landmarks are taken from.
+static b32
+landmark_load_wave(const char *path, Wave *wave)
+{
+    *wave = LoadWave(path);
+
+    if (!IsWaveReady(*wave) || wave->frameCount == 0) {
+        fprintf(stderr, "Failed to decode '%s'!\n", path);
+        return false;
+    }
+
+    if (wave->sampleRate != LANDMARK_RATE || wave->sampleSize != 16 || wave->channels != 1) {
+        WaveFormat(wave, LANDMARK_RATE, 16, 1);
+    }
+
+    return true;
+}
+
+static void
+landmark_batch_entry(void *context, u32 thread_index, u32 item)
+{
+    landmark_batch_t *batch = context;
+    landmark_thread_t *thread = batch->threads + thread_index;
+    catalog_entry_t entry = catalog_entry(&batch->catalog, item);
+
+    if (!entry.audio_path)
+        return;
+
+    Wave wave;
+
+    if (!landmark_load_wave(entry.audio_path, &wave))
+        return;
+
+    landmark_extract(&thread->landmark, wave.data, wave.frameCount, batch->lists + item);
+    thread->audio_seconds += wave.frameCount / (f64)LANDMARK_RATE;
+
+    UnloadWave(wave);
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s build [-t threads] <catalog.cat> <out.lmk>\n", program);
+    fprintf(stderr, "       %s query [-k hits] <catalog.cat> <index.lmk> <audio> [start seconds] [seconds]\n", program);
+}
+
+static i32
+landmark_tool_build(i32 argc, char **argv)
+{
+    u32 thread_count = par_thread_count();
+
+    i32 arg = 0;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 't': thread_count = atoi(argv[arg + 1]); break;
+
+            default: {
+                fprintf(stderr, "Unknown option '%s'!\n", argv[arg]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 2 != argc) {
+        fprintf(stderr, "Expected the catalog and the output file!\n");
+        return 1;
+    }
+
+    landmark_batch_t batch = {0};
+
+    if (!catalog_open(&batch.catalog, argv[arg]))
+        return 1;
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    batch.threads = calloc(thread_count, sizeof(landmark_thread_t));
+    batch.lists   = calloc(batch.catalog.count + 1, sizeof(landmarks_t));
+
+    if (!batch.threads || !batch.lists) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        landmark_init(&batch.threads[t].landmark);
+    }
+
+    f64 start = landmark_seconds();
+
+    par_for(batch.catalog.count, thread_count, landmark_batch_entry, &batch);
+
+    f64 seconds = landmark_seconds() - start;
+    f64 audio_seconds = 0.0;
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        audio_seconds += batch.threads[t].audio_seconds;
+        landmark_free(&batch.threads[t].landmark);
+    }
+
+    u64 count = 0;
+
+    for (u32 i = 0; i < batch.catalog.count; ++i) {
+        count += batch.lists[i].count;
+    }
+
+    b32 ok = landmark_index_write(argv[arg + 1], batch.lists, batch.catalog.count);
+
+    printf("%llu landmarks of %u entries (%.1f/s), %.1fs of audio in %.1fs (%.0fx real time)\n",
+           (unsigned long long)count, batch.catalog.count, audio_seconds > 0.0 ? count / audio_seconds : 0.0,
+           audio_seconds, seconds, seconds > 0.0 ? audio_seconds / seconds : 0.0);
+
+    for (u32 i = 0; i < batch.catalog.count; ++i) {
+        free(batch.lists[i].data);
+    }
+
+    free(batch.lists);
+    free(batch.threads);
+    catalog_close(&batch.catalog);
+
+    return ok ? 0 : 1;
+}
+
+static i32
+landmark_tool_query(i32 argc, char **argv)
+{
+    u32 k = LANDMARK_DEFAULT_HITS;
+
+    i32 arg = 0;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'k': k = atoi(argv[arg + 1]); break;
+
+            default: {
+                fprintf(stderr, "Unknown option '%s'!\n", argv[arg]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 3 > argc || arg + 5 < argc) {
+        fprintf(stderr, "Expected the catalog, the index and the clip!\n");
+        return 1;
+    }
+
+    catalog_t catalog;
+    landmark_index_t index;
+
+    if (!catalog_open(&catalog, argv[arg]))
+        return 1;
+
+    if (!landmark_index_open(&index, argv[arg + 1])) {
+        catalog_close(&catalog);
+        return 1;
+    }
+
+    Wave wave;
+    b32 ok = landmark_load_wave(argv[arg + 2], &wave);
+
+    if (ok) {
+        f64 clip_start   = arg + 3 < argc ? atof(argv[arg + 3]) : 0.0;
+        f64 clip_seconds = arg + 4 < argc ? atof(argv[arg + 4]) : wave.frameCount / (f64)LANDMARK_RATE;
+
+        u64 first = (u64)(clip_start * LANDMARK_RATE);
+        u64 count = (u64)(clip_seconds * LANDMARK_RATE);
+
+        first = first < wave.frameCount ? first : wave.frameCount;
+        count = count < wave.frameCount - first ? count : wave.frameCount - first;
+
+        landmark_t landmark;
+        landmarks_t clip = {0};
+
+        k = k ? k : 1;
+        landmark_hit_t *hits = malloc(k * sizeof(landmark_hit_t));
+
+        if (!hits) {
+            fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+            exit(666);
+        }
+
+        f64 start = landmark_seconds();
+
+        landmark_init(&landmark);
+        landmark_extract(&landmark, (const i16 *)wave.data + first, (u32)count, &clip);
+
+        u64 matches;
+        u32 hit_count = landmark_query(&index, &clip, hits, k, &matches);
+
+        f64 seconds = landmark_seconds() - start;
+
+        printf("%u landmarks, %llu matches in %.2fms\n", clip.count, (unsigned long long)matches, seconds * 1000.0);
+
+        for (u32 i = 0; i < hit_count; ++i) {
+            const char *audio_path = hits[i].entry < catalog.count ? catalog_entry(&catalog, hits[i].entry).audio_path : "?";
+
+            printf("  %6u votes %9.2fs %s\n", hits[i].votes, hits[i].offset * (f64)LANDMARK_HOP / LANDMARK_RATE, audio_path);
+        }
+
+        landmark_free(&landmark);
+        free(clip.data);
+        free(hits);
+        UnloadWave(wave);
+    }
+
+    landmark_index_close(&index);
+    catalog_close(&catalog);
+
+    return ok ? 0 : 1;
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "build") == 0)
+        return landmark_tool_build(argc - 2, argv + 2);
+
+    if (strcmp(argv[1], "query") == 0)
+        return landmark_tool_query(argc - 2, argv + 2);
+
+    print_usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,657 @@
+#ifndef LANDMARK_H_
+#define LANDMARK_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "fft.h"
+
+/* Landmark fingerprints for finding the same clip in other tracks. Audio is
+ * taken as mono at `LANDMARK_RATE`, so frequency bins mean the same thing in
+ * every track. The log magnitude spectrogram (two frames per complex FFT)
+ * gets its peaks: points that are the maximum of their neighbourhood of
+ * `LANDMARK_PEAK_BINS` bins and `LANDMARK_PEAK_FRAMES` frames each way and
+ * louder than `LANDMARK_FLOOR_DB`. The neighbourhood maximum is separable, a
+ * van Herk max filter over the bins of every frame and a plain one over a
+ * ring of the last few frames. The FFT is the Q15 one, taking the 16 bit PCM
+ * as it is decoded without a float copy.
+ *
+ * Every peak is paired with the next `LANDMARK_FAN_OUT` peaks less than
+ * `LANDMARK_DT_MAX` frames after it and `LANDMARK_DF_MAX` bins away. Both
+ * frequencies and the time difference are hashed into a 32 bit key, the
+ * anchor's frame is the time of the landmark. Gain changes, noise and
+ * compression move peaks less than they move the spectrum, and a pair
+ * doesn't depend on where the clip starts.
+ *
+ * The index is one file, mapped: landmarks of all entries bucketed by the
+ * top `directory_bits` of their key. A query looks up every landmark of the
+ * clip and votes for (entry, track time - clip time). The offset of a clip
+ * that really appears collects votes from most of its landmarks, chance
+ * matches spread over all offsets.
+ */
+
+#define LANDMARK_RATE        8000
+#define LANDMARK_SIZE        512  // Samples per frame,
+#define LANDMARK_HOP         256  // 32ms apart.
+#define LANDMARK_BINS        (LANDMARK_SIZE / 2)
+#define LANDMARK_PEAK_BINS   12
+#define LANDMARK_PEAK_FRAMES 4
+#define LANDMARK_FLOOR_DB    -60.0f // Of a full scale sine.
+#define LANDMARK_FAN_OUT     5
+#define LANDMARK_DT_MAX      63   // Frames.
+#define LANDMARK_DF_MAX      63   // Bins.
+
+#define LANDMARK_MAGIC   0x314B4D4C // "LMK1"
+#define LANDMARK_VERSION 1
+
+typedef struct
+{
+    u32 key;
+    u32 time; // Frame of the anchor peak.
+} landmark_entry_t;
+
+typedef dck_stretchy_t (landmark_entry_t, u32) landmarks_t;
+
+typedef struct
+{
+    u32 time, bin;
+} landmark_peak_t;
+
+typedef dck_stretchy_t (landmark_peak_t, u32) landmark_peaks_t;
+
+typedef struct
+{
+    fft_q15_plan_t plan;
+    cq15_t        *data, *scratch;
+    i16            window[LANDMARK_SIZE]; // Q15.
+
+    // Last `2 * LANDMARK_PEAK_FRAMES + 1` frames, spectrum and its max over nearby bins.
+    f32 ring[2 * LANDMARK_PEAK_FRAMES + 1][LANDMARK_BINS];
+    f32 ring_max[2 * LANDMARK_PEAK_FRAMES + 1][LANDMARK_BINS];
+
+    landmark_peaks_t peaks;
+} landmark_t;
+
+typedef struct
+{
+    u32 entry;
+    u32 time;
+} landmark_posting_t;
+
+typedef struct
+{
+    u32 magic, version;
+
+    u32 entry_count;
+    u32 directory_bits;
+    u32 rate, hop;
+    u64 count;              // Landmarks.
+    u64 directory_offset;   // First landmark of every bucket, plus the count at the end.
+    u64 keys_offset;        // Key of every landmark.
+    u64 postings_offset;    // Entry and time of every landmark.
+    u64 size;
+} landmark_header_t;
+
+typedef struct
+{
+    u8 *base;
+    u64 size;
+
+    const landmark_header_t *header;
+    u32 entry_count, directory_bits;
+    u64 count;
+
+    const u64                *directory;
+    const u32                *keys;
+    const landmark_posting_t *postings;
+} landmark_index_t;
+
+typedef struct
+{
+    u32 entry;
+    i32 offset; // Frames from the start of the entry to the start of the clip.
+    u32 votes;
+} landmark_hit_t;
+
+void
+landmark_init(landmark_t *landmark);
+
+void
+landmark_free(landmark_t *landmark);
+
+// Appends the landmarks of mono `samples` at `LANDMARK_RATE` to `landmarks`.
+void
+landmark_extract(landmark_t *landmark, const i16 *samples, u32 sample_count, landmarks_t *landmarks);
+
+// `lists[i]` holds the landmarks of entry `i`.
+b32
+landmark_index_write(const char *path, const landmarks_t *lists, u32 entry_count);
+
+b32
+landmark_index_open(landmark_index_t *index, const char *path);
+
+void
+landmark_index_close(landmark_index_t *index);
+
+// Best offset of up to `k` entries, most votes first. `matches_o` gets the number of key matches.
+u32
+landmark_query(const landmark_index_t *index, const landmarks_t *clip, landmark_hit_t *hits, u32 k, u64 *matches_o);
+
+#endif // LANDMARK_H_
+
+#if defined(LANDMARK_IMPL) && !defined(LANDMARK_IMPL_)
+#define LANDMARK_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+
+#define FFT_IMPL
+#include "fft.h"
+
+#define LANDMARK_RING (2 * LANDMARK_PEAK_FRAMES + 1)
+
+void
+landmark_init(landmark_t *landmark)
+{
+    *landmark = (landmark_t) {0};
+
+    fft_q15_plan_init(&landmark->plan, LANDMARK_SIZE);
+
+    landmark->data    = malloc(LANDMARK_SIZE * sizeof(cq15_t));
+    landmark->scratch = malloc(LANDMARK_SIZE * sizeof(cq15_t));
+
+    if (!landmark->data || !landmark->scratch) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < LANDMARK_SIZE; ++i) {
+        landmark->window[i] = (i16)lrintf((0.5f - 0.5f * cosf(2.0f * M_PI * (i + 0.5f) / LANDMARK_SIZE)) * 32767.0f);
+    }
+}
+
+void
+landmark_free(landmark_t *landmark)
+{
+    fft_q15_plan_free(&landmark->plan);
+    free(landmark->data);
+    free(landmark->scratch);
+    free(landmark->peaks.data);
+    *landmark = (landmark_t) {0};
+}
+
+// Maximum of `values` over `[k - LANDMARK_PEAK_BINS, k + LANDMARK_PEAK_BINS]` for every bin,
+// from prefix and suffix maxima of blocks as wide as the window.
+static void
+landmark_max_filter(const f32 *values, f32 *max)
+{
+    enum { width = 2 * LANDMARK_PEAK_BINS + 1, padded = LANDMARK_BINS + 2 * LANDMARK_PEAK_BINS };
+
+    f32 prefix[padded + width], suffix[padded + width];
+
+    for (u32 i = 0; i < padded + width; ++i) {
+        u32 k = i - LANDMARK_PEAK_BINS;
+        prefix[i] = i >= LANDMARK_PEAK_BINS && k < LANDMARK_BINS ? values[k] : -INFINITY;
+        suffix[i] = prefix[i];
+    }
+
+    for (u32 i = 1; i < padded + width; ++i) {
+        if (i % width != 0 && prefix[i - 1] > prefix[i]) {
+            prefix[i] = prefix[i - 1];
+        }
+    }
+
+    for (u32 i = padded + width - 1; i-- > 0;) {
+        if ((i + 1) % width != 0 && suffix[i + 1] > suffix[i]) {
+            suffix[i] = suffix[i + 1];
+        }
+    }
+
+    // The window of bin `k` is `[k, k + width)` in padded indices.
+    for (u32 k = 0; k < LANDMARK_BINS; ++k) {
+        f32 a = suffix[k], b = prefix[k + width - 1];
+        max[k] = a > b ? a : b;
+    }
+}
+
+static void
+landmark_load(landmark_t *landmark, const i16 *samples, u32 sample_count, u32 frame, b32 imaginary)
+{
+    u64 first = (u64)frame * LANDMARK_HOP;
+
+    for (u32 i = 0; i < LANDMARK_SIZE; ++i) {
+        i16 value = first + i < sample_count ? (i16)((samples[first + i] * landmark->window[i] + (1 << 14)) >> 15) : 0;
+
+        if (imaginary) {
+            landmark->data[i].i = value;
+        }
+        else {
+            landmark->data[i] = (cq15_t) { .r = value };
+        }
+    }
+}
+
+// Peaks of the frame in the middle of the ring, `frame` is the newest one.
+static void
+landmark_find_peaks(landmark_t *landmark, u32 frame)
+{
+    u32 center = (frame - LANDMARK_PEAK_FRAMES) % LANDMARK_RING;
+    const f32 *values = landmark->ring[center];
+
+    for (u32 k = 1; k < LANDMARK_BINS; ++k) {
+        f32 value = values[k];
+
+        if (value < LANDMARK_FLOOR_DB || value < landmark->ring_max[center][k])
+            continue;
+
+        b32 peak = true;
+
+        for (u32 r = 0; r < LANDMARK_RING && peak; ++r) {
+            peak = landmark->ring_max[r][k] <= value;
+        }
+
+        if (peak) {
+            dck_stretchy_push(landmark->peaks, ((landmark_peak_t) { .time = frame - LANDMARK_PEAK_FRAMES, .bin = k }));
+        }
+    }
+}
+
+static void
+landmark_push(landmark_t *landmark, const f32 *values, u32 frame)
+{
+    u32 slot = frame % LANDMARK_RING;
+
+    memcpy(landmark->ring[slot], values, sizeof(landmark->ring[slot]));
+    landmark_max_filter(values, landmark->ring_max[slot]);
+
+    if (frame >= LANDMARK_PEAK_FRAMES) {
+        landmark_find_peaks(landmark, frame);
+    }
+}
+
+void
+landmark_extract(landmark_t *landmark, const i16 *samples, u32 sample_count, landmarks_t *landmarks)
+{
+    u32 frame_count = sample_count >= LANDMARK_SIZE ? (sample_count - LANDMARK_SIZE) / LANDMARK_HOP + 1 : 0;
+
+    landmark->peaks.count = 0;
+
+    // Frames before the first one are silent.
+    for (u32 r = 0; r < LANDMARK_RING; ++r) {
+        for (u32 k = 0; k < LANDMARK_BINS; ++k) {
+            landmark->ring[r][k]     = -INFINITY;
+            landmark->ring_max[r][k] = -INFINITY;
+        }
+    }
+
+    // dB of a full scale sine: its bin holds `32768 size / 4` through the Hann window.
+    f32 full_scale = 4.0f / (LANDMARK_SIZE * 32768.0f);
+    f32 values_a[LANDMARK_BINS], values_b[LANDMARK_BINS];
+
+    for (u32 frame = 0; frame < frame_count; frame += 2) {
+        b32 pair = frame + 1 < frame_count;
+
+        landmark_load(landmark, samples, sample_count, frame, false);
+
+        if (pair) {
+            landmark_load(landmark, samples, sample_count, frame + 1, true);
+        }
+
+        i32 exponent = fft_q15_forward(&landmark->plan, landmark->data, landmark->scratch);
+        f32 scale    = ldexpf(full_scale, exponent);
+
+        for (u32 k = 0; k < LANDMARK_BINS; ++k) {
+            cq15_t z  = landmark->data[k];
+            cq15_t zn = landmark->data[(LANDMARK_SIZE - k) & (LANDMARK_SIZE - 1)];
+
+            f32 ar = 0.5f * (z.r + zn.r), ai = 0.5f * (z.i - zn.i);
+            f32 br = 0.5f * (z.i + zn.i), bi = 0.5f * (zn.r - z.r);
+
+            values_a[k] = 10.0f * log10f((ar * ar + ai * ai) * scale * scale + 1e-12f);
+            values_b[k] = 10.0f * log10f((br * br + bi * bi) * scale * scale + 1e-12f);
+        }
+
+        landmark_push(landmark, values_a, frame);
+
+        if (pair) {
+            landmark_push(landmark, values_b, frame + 1);
+        }
+    }
+
+    // Silence after the last frame lets the last ones have peaks.
+    for (u32 k = 0; k < LANDMARK_BINS; ++k) {
+        values_a[k] = -INFINITY;
+    }
+
+    for (u32 frame = frame_count; frame < frame_count + LANDMARK_PEAK_FRAMES; ++frame) {
+        landmark_push(landmark, values_a, frame);
+    }
+
+    // Peaks come out in time order.
+    const landmark_peak_t *peaks = landmark->peaks.data;
+    u32 peak_count = landmark->peaks.count;
+
+    for (u32 i = 0; i < peak_count; ++i) {
+        u32 fan_out = 0;
+
+        for (u32 j = i + 1; j < peak_count && fan_out < LANDMARK_FAN_OUT; ++j) {
+            u32 dt = peaks[j].time - peaks[i].time;
+
+            if (dt > LANDMARK_DT_MAX)
+                break;
+
+            i32 df = (i32)peaks[j].bin - (i32)peaks[i].bin;
+
+            if (dt == 0 || df > LANDMARK_DF_MAX || df < -LANDMARK_DF_MAX)
+                continue;
+
+            u64 packed = (u64)peaks[i].bin | (u64)peaks[j].bin << 16 | (u64)dt << 32;
+
+            dck_stretchy_push(*landmarks, ((landmark_entry_t) { .key = (u32)hash_u64(packed), .time = peaks[i].time }));
+            ++fan_out;
+        }
+    }
+}
+
+static u64
+landmark_align(u64 offset)
+{
+    return (offset + 7) & ~(u64)7;
+}
+
+static b32
+landmark_write_section(FILE *file, u64 *offset, const void *data, u64 size)
+{
+    static const u8 zeros[8] = {0};
+
+    u64 aligned = landmark_align(*offset);
+
+    if (aligned != *offset && fwrite(zeros, 1, aligned - *offset, file) != aligned - *offset)
+        return false;
+
+    if (size != 0 && fwrite(data, 1, size, file) != size)
+        return false;
+
+    *offset = aligned + size;
+    return true;
+}
+
+b32
+landmark_index_write(const char *path, const landmarks_t *lists, u32 entry_count)
+{
+    u64 count = 0;
+
+    for (u32 i = 0; i < entry_count; ++i) {
+        count += lists[i].count;
+    }
+
+    // Around eight landmarks per bucket.
+    u32 bits = 10;
+
+    while (bits < 24 && ((u64)8 << bits) < count) {
+        ++bits;
+    }
+
+    u32 bucket_count = 1u << bits;
+
+    u64 *directory = calloc(bucket_count + 1, sizeof(u64));
+    u32 *keys      = malloc(count * sizeof(u32) + 1);
+
+    landmark_posting_t *postings = malloc(count * sizeof(landmark_posting_t) + 1);
+
+    if (!directory || !keys || !postings) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    // Counting sort by bucket, landmarks of a bucket stay in entry and time order.
+    for (u32 i = 0; i < entry_count; ++i) {
+        for (u32 l = 0; l < lists[i].count; ++l) {
+            directory[(lists[i].data[l].key >> (32 - bits)) + 1]++;
+        }
+    }
+
+    for (u32 b = 0; b < bucket_count; ++b) {
+        directory[b + 1] += directory[b];
+    }
+
+    u64 *cursors = malloc(bucket_count * sizeof(u64));
+
+    if (!cursors) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    memcpy(cursors, directory, bucket_count * sizeof(u64));
+
+    for (u32 i = 0; i < entry_count; ++i) {
+        for (u32 l = 0; l < lists[i].count; ++l) {
+            landmark_entry_t landmark = lists[i].data[l];
+            u64 at = cursors[landmark.key >> (32 - bits)]++;
+
+            keys[at]     = landmark.key;
+            postings[at] = (landmark_posting_t) { .entry = i, .time = landmark.time };
+        }
+    }
+
+    free(cursors);
+
+    landmark_header_t header = {
+        .magic          = LANDMARK_MAGIC,
+        .version        = LANDMARK_VERSION,
+        .entry_count    = entry_count,
+        .directory_bits = bits,
+        .rate           = LANDMARK_RATE,
+        .hop            = LANDMARK_HOP,
+        .count          = count,
+    };
+
+    u64 directory_size = (bucket_count + 1) * sizeof(u64);
+    u64 keys_size      = count * sizeof(u32);
+    u64 postings_size  = count * sizeof(landmark_posting_t);
+
+    u64 offset = sizeof(header);
+
+    offset = landmark_align(offset); header.directory_offset = offset; offset += directory_size;
+    offset = landmark_align(offset); header.keys_offset      = offset; offset += keys_size;
+    offset = landmark_align(offset); header.postings_offset  = offset; offset += postings_size;
+
+    header.size = offset;
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    b32 ok = false;
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file) {
+        offset = 0;
+
+        ok = landmark_write_section(file, &offset, &header, sizeof(header))
+          && landmark_write_section(file, &offset, directory, directory_size)
+          && landmark_write_section(file, &offset, keys, keys_size)
+          && landmark_write_section(file, &offset, postings, postings_size);
+
+        if (fclose(file) != 0) {
+            ok = false;
+        }
+
+        if (ok && rename(tmp_path, path) != 0) {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write landmarks '%s': %s\n", path, strerror(errno));
+        remove(tmp_path);
+    }
+
+    free(directory);
+    free(keys);
+    free(postings);
+
+    return ok;
+}
+
+b32
+landmark_index_open(landmark_index_t *index, const char *path)
+{
+    *index = (landmark_index_t) {0};
+
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open landmarks '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(landmark_header_t)) {
+        fprintf(stderr, "Landmarks '%s' are truncated!\n", path);
+        close(fd);
+        return false;
+    }
+
+    u8 *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map landmarks '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    const landmark_header_t *header = (const landmark_header_t *)base;
+
+    if (header->magic != LANDMARK_MAGIC || header->version != LANDMARK_VERSION || header->rate != LANDMARK_RATE
+     || header->hop != LANDMARK_HOP || header->directory_bits > 24 || header->size != (u64)st.st_size) {
+        fprintf(stderr, "Landmarks '%s' are corrupted!\n", path);
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    index->base           = base;
+    index->size           = st.st_size;
+    index->header         = header;
+    index->entry_count    = header->entry_count;
+    index->directory_bits = header->directory_bits;
+    index->count          = header->count;
+    index->directory      = (const u64 *)(base + header->directory_offset);
+    index->keys           = (const u32 *)(base + header->keys_offset);
+    index->postings       = (const landmark_posting_t *)(base + header->postings_offset);
+
+    return true;
+}
+
+void
+landmark_index_close(landmark_index_t *index)
+{
+    if (index->base) {
+        munmap(index->base, index->size);
+    }
+
+    *index = (landmark_index_t) {0};
+}
+
+static int
+landmark_u64_cmp(const void *a, const void *b)
+{
+    u64 ua = *(const u64 *)a;
+    u64 ub = *(const u64 *)b;
+    return (ua > ub) - (ua < ub);
+}
+
+static int
+landmark_hit_cmp(const void *a, const void *b)
+{
+    const landmark_hit_t *ha = a;
+    const landmark_hit_t *hb = b;
+
+    if (ha->votes != hb->votes)
+        return ha->votes < hb->votes ? 1 : -1;
+
+    return (ha->entry > hb->entry) - (ha->entry < hb->entry);
+}
+
+u32
+landmark_query(const landmark_index_t *index, const landmarks_t *clip, landmark_hit_t *hits, u32 k, u64 *matches_o)
+{
+    // Entry in the high half, offset biased to stay positive in the low half.
+    dck_stretchy_t (u64, u64) votes = {0};
+
+    u32 shift = 32 - index->directory_bits;
+
+    for (u32 l = 0; l < clip->count; ++l) {
+        landmark_entry_t landmark = clip->data[l];
+        u32 bucket = landmark.key >> shift;
+
+        for (u64 p = index->directory[bucket]; p < index->directory[bucket + 1]; ++p) {
+            if (index->keys[p] != landmark.key)
+                continue;
+
+            landmark_posting_t posting = index->postings[p];
+            i64 offset = (i64)posting.time - landmark.time;
+
+            dck_stretchy_push(votes, (u64)posting.entry << 32 | (u32)(offset + 0x80000000ll));
+        }
+    }
+
+    if (matches_o) {
+        *matches_o = votes.count;
+    }
+
+    qsort(votes.data, votes.count, sizeof(u64), landmark_u64_cmp);
+
+    // Best offset of every entry, the next offset counts too as peaks can land a frame apart.
+    dck_stretchy_t (landmark_hit_t, u32) best = {0};
+
+    for (u64 i = 0; i < votes.count;) {
+        u64 run = i;
+
+        while (run < votes.count && votes.data[run] == votes.data[i]) {
+            ++run;
+        }
+
+        u64 next = run;
+
+        while (next < votes.count && votes.data[next] == votes.data[i] + 1) {
+            ++next;
+        }
+
+        u32 entry = (u32)(votes.data[i] >> 32);
+        i32 offset = (i32)((i64)(u32)votes.data[i] - 0x80000000ll);
+        u32 count = (u32)(next - i);
+
+        if (best.count == 0 || best.data[best.count - 1].entry != entry) {
+            dck_stretchy_push(best, ((landmark_hit_t) { .entry = entry, .offset = offset, .votes = count }));
+        }
+        else if (best.data[best.count - 1].votes < count) {
+            best.data[best.count - 1].offset = offset;
+            best.data[best.count - 1].votes  = count;
+        }
+
+        i = run;
+    }
+
+    qsort(best.data, best.count, sizeof(landmark_hit_t), landmark_hit_cmp);
+
+    u32 hit_count = best.count < k ? best.count : k;
+
+    if (hit_count) {
+        memcpy(hits, best.data, hit_count * sizeof(landmark_hit_t));
+    }
+
+    free(votes.data);
+    free(best.data);
+
+    return hit_count;
+}
+
+#endif // LANDMARK_IMPL
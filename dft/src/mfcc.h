@@ -0,0 +1,648 @@
+#ifndef MFCC_H_
+#define MFCC_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+#include "fft.h"
+
+/* Mel frequency cepstral coefficients of every caption word, and a store
+ * for them indexed by global word id.
+ *
+ * Frames are `MFCC_FRAME` long every `MFCC_HOP`, on the pre-emphasized mono
+ * mix of the audio at its own sample rate. Only frames a word needs are
+ * computed, and each of them once: they are marked first, then transformed
+ * two per complex FFT. The mel filterbank is stored sparse (first bin, count
+ * and the nonzero weights of every filter), so the filterbank and the DCT
+ * are both plain dot products.
+ *
+ * A word owns the frames whose centers fall in its span, or the one nearest
+ * its start when there are none. Its features are the mean and the standard
+ * deviation of every coefficient over those frames.
+ *
+ * The store numbers the non-blank words of all catalog entries one after the
+ * other. It keeps the first word id of every entry, the start time and frame
+ * count of every word and one column per feature, so reading a coefficient
+ * across the corpus touches one contiguous array.
+ */
+
+#define MFCC_FRAME       0.025f // Seconds, rounded up to a power of two in samples for the FFT.
+#define MFCC_HOP         0.010f // Seconds.
+#define MFCC_MELS        40
+#define MFCC_COEFFS      13
+#define MFCC_FEATURES    (MFCC_COEFFS * 2) // Means, then standard deviations.
+#define MFCC_LOW_HZ      20.0f
+#define MFCC_HIGH_HZ     8000.0f
+#define MFCC_PREEMPHASIS 0.97f
+#define MFCC_LOG_FLOOR   1e-10f
+
+#define MFCC_MAGIC   0x3143464D // "MFC1"
+#define MFCC_VERSION 2
+
+typedef struct
+{
+    u32 sample_rate;
+    u32 size;   // FFT size.
+    u32 length; // Samples per frame.
+    u32 hop;    // Samples between frames.
+    u32 bins;
+
+    fft_plan_t plan;
+    cn_t      *data, *scratch;
+    f32       *window;
+    f32       *power[2];
+
+    u32  filter_first[MFCC_MELS], filter_count[MFCC_MELS], filter_offset[MFCC_MELS];
+    f32 *weights;
+    f32  dct[MFCC_COEFFS][MFCC_MELS];
+
+    dck_stretchy_t (u8,  u32) needed;
+    dck_stretchy_t (f32, u32) coeffs; // `MFCC_COEFFS` per frame, valid for the needed ones.
+} mfcc_t;
+
+typedef struct
+{
+    u32 magic, version;
+
+    u32 feature_count;
+    u32 entry_count;
+    u32 word_count;
+    u32 reserved;
+
+    f32 frame_seconds, hop_seconds;
+
+    u64 entry_words_offset; // First word id of every entry, plus the word count at the end.
+    u64 starts_offset;      // Start of every word, seconds.
+    u64 frames_offset;      // Frames of every word, zero when the audio was missing.
+    u64 columns_offset;     // `feature_count` columns of `word_count` values.
+    u64 column_stride;      // Bytes from one column to the next.
+    u64 size;
+} mfcc_store_header_t;
+
+typedef struct
+{
+    u8 *base;
+    u64 size;
+
+    const mfcc_store_header_t *header;
+    u32 entry_count;
+    u32 word_count;
+
+    const u32 *entry_words;
+    const f32 *starts;
+    const u16 *frames;
+} mfcc_store_t;
+
+// Per word outputs, indexed by word id.
+typedef struct
+{
+    f32 *columns[MFCC_FEATURES];
+    f32 *starts;
+    u16 *frames;
+} mfcc_columns_t;
+
+// False when the sample rate is too low for the filterbank.
+b32
+mfcc_init(mfcc_t *mfcc, u32 sample_rate);
+
+void
+mfcc_free(mfcc_t *mfcc);
+
+/* Features of the non-blank words of the chunk, word `i` goes to index
+ * `first_word + i` of the columns. Stops after `word_capacity` words and
+ * returns how many non-blank words there were.
+ */
+u32
+mfcc_words(mfcc_t *mfcc, const i16 *samples, u32 frame_count, u32 channels,
+           const vtt_data_t *data, vtt_chunk_t chunk, const mfcc_columns_t *columns, u32 first_word, u32 word_capacity);
+
+// `entry_words` has `entry_count + 1` values, the last one is the word count.
+b32
+mfcc_store_write(const char *path, const u32 *entry_words, u32 entry_count, const mfcc_columns_t *columns);
+
+b32
+mfcc_store_open(mfcc_store_t *store, const char *path);
+
+void
+mfcc_store_close(mfcc_store_t *store);
+
+// `word_count` values of one feature.
+const f32 *
+mfcc_store_column(const mfcc_store_t *store, u32 feature);
+
+// Entry the word belongs to.
+u32
+mfcc_store_entry(const mfcc_store_t *store, u32 word);
+
+#endif // MFCC_H_
+
+#if defined(MFCC_IMPL) && !defined(MFCC_IMPL_)
+#define MFCC_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FFT_IMPL
+#include "fft.h"
+
+static f32
+mfcc_dot(const f32 *a, const f32 *b, u32 count)
+{
+    f32 sum = 0.0f;
+    u32 i = 0;
+
+#if defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+
+    for (; i + 4 <= count; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+
+    f32 lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+    for (; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+
+    return sum;
+}
+
+static f32
+mfcc_mel(f32 hz)
+{
+    return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static f32
+mfcc_hz(f32 mel)
+{
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+b32
+mfcc_init(mfcc_t *mfcc, u32 sample_rate)
+{
+    *mfcc = (mfcc_t) {0};
+
+    f32 high = MFCC_HIGH_HZ < sample_rate * 0.5f ? MFCC_HIGH_HZ : sample_rate * 0.5f;
+
+    if (high <= MFCC_LOW_HZ * 2.0f)
+        return false;
+
+    mfcc->sample_rate = sample_rate;
+    mfcc->length      = (u32)(sample_rate * MFCC_FRAME);
+    mfcc->hop         = (u32)(sample_rate * MFCC_HOP);
+    mfcc->size        = 1;
+
+    while (mfcc->size < mfcc->length) {
+        mfcc->size *= 2;
+    }
+
+    mfcc->bins = mfcc->size / 2 + 1;
+
+    fft_plan_init(&mfcc->plan, mfcc->size);
+
+    mfcc->data     = malloc(mfcc->size * sizeof(cn_t));
+    mfcc->scratch  = malloc(mfcc->size * sizeof(cn_t));
+    mfcc->window   = malloc(mfcc->length * sizeof(f32));
+    mfcc->power[0] = malloc(mfcc->bins * sizeof(f32));
+    mfcc->power[1] = malloc(mfcc->bins * sizeof(f32));
+
+    // Triangles cover at most all the bins twice, and filters narrower than a bin add one more each.
+    mfcc->weights  = malloc((mfcc->bins * 2 + MFCC_MELS) * sizeof(f32));
+
+    if (!mfcc->data || !mfcc->scratch || !mfcc->window || !mfcc->power[0] || !mfcc->power[1] || !mfcc->weights) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < mfcc->length; ++i) {
+        mfcc->window[i] = 0.54f - 0.46f * cosf(2.0f * M_PI * i / (mfcc->length - 1));
+    }
+
+    f32 mel_low  = mfcc_mel(MFCC_LOW_HZ);
+    f32 mel_high = mfcc_mel(high);
+    f32 bin_hz   = sample_rate / (f32)mfcc->size;
+
+    u32 weight_count = 0;
+
+    for (u32 m = 0; m < MFCC_MELS; ++m) {
+        f32 left   = mfcc_hz(mel_low + (mel_high - mel_low) * (m + 0) / (MFCC_MELS + 1));
+        f32 center = mfcc_hz(mel_low + (mel_high - mel_low) * (m + 1) / (MFCC_MELS + 1));
+        f32 right  = mfcc_hz(mel_low + (mel_high - mel_low) * (m + 2) / (MFCC_MELS + 1));
+
+        u32 first = (u32)ceilf(left / bin_hz);
+        u32 last  = (u32)floorf(right / bin_hz);
+
+        last = last < mfcc->bins - 1 ? last : mfcc->bins - 1;
+
+        mfcc->filter_first[m]  = first;
+        mfcc->filter_offset[m] = weight_count;
+
+        for (u32 k = first; k <= last; ++k) {
+            f32 hz = k * bin_hz;
+            f32 weight = hz <= center ? (hz - left) / (center - left) : (right - hz) / (right - center);
+
+            if (weight > 0.0f) {
+                mfcc->weights[weight_count++] = weight;
+            }
+            else if (k == first) {
+                mfcc->filter_first[m]++;
+            }
+            else {
+                break;
+            }
+        }
+
+        // Narrow low filters can fall between bins, they get the nearest one.
+        if (weight_count == mfcc->filter_offset[m]) {
+            mfcc->filter_first[m] = (u32)(center / bin_hz + 0.5f);
+            mfcc->weights[weight_count++] = 1.0f;
+        }
+
+        mfcc->filter_count[m] = weight_count - mfcc->filter_offset[m];
+    }
+
+    // Orthonormal DCT-II.
+    for (u32 c = 0; c < MFCC_COEFFS; ++c) {
+        f32 scale = sqrtf((c == 0 ? 1.0f : 2.0f) / MFCC_MELS);
+
+        for (u32 m = 0; m < MFCC_MELS; ++m) {
+            mfcc->dct[c][m] = scale * cosf(M_PI * c * (m + 0.5f) / MFCC_MELS);
+        }
+    }
+
+    return true;
+}
+
+void
+mfcc_free(mfcc_t *mfcc)
+{
+    fft_plan_free(&mfcc->plan);
+
+    free(mfcc->data);
+    free(mfcc->scratch);
+    free(mfcc->window);
+    free(mfcc->power[0]);
+    free(mfcc->power[1]);
+    free(mfcc->weights);
+    free(mfcc->needed.data);
+    free(mfcc->coeffs.data);
+
+    *mfcc = (mfcc_t) {0};
+}
+
+static void
+mfcc_load_frame(mfcc_t *mfcc, const i16 *samples, u32 sample_count, u32 channels, u32 frame, b32 imaginary)
+{
+    u64 first = (u64)frame * mfcc->hop;
+    f32 prev  = 0.0f;
+
+    // The sample before the frame, for the pre-emphasis.
+    if (first > 0 && first - 1 < sample_count) {
+        for (u32 c = 0; c < channels; ++c) {
+            prev += samples[(first - 1) * channels + c];
+        }
+
+        prev /= channels * 32768.0f;
+    }
+
+    for (u32 i = 0; i < mfcc->size; ++i) {
+        u64 s = first + i;
+        f32 value = 0.0f;
+
+        if (i < mfcc->length && s < sample_count) {
+            f32 mono = 0.0f;
+
+            for (u32 c = 0; c < channels; ++c) {
+                mono += samples[s * channels + c];
+            }
+
+            mono /= channels * 32768.0f;
+
+            value = (mono - MFCC_PREEMPHASIS * prev) * mfcc->window[i];
+            prev  = mono;
+        }
+
+        if (imaginary) {
+            mfcc->data[i].i = value;
+        }
+        else {
+            mfcc->data[i] = (cn_t) { .r = value };
+        }
+    }
+}
+
+static void
+mfcc_cepstrum(const mfcc_t *mfcc, const f32 *power, f32 *coeffs)
+{
+    f32 mels[MFCC_MELS];
+
+    for (u32 m = 0; m < MFCC_MELS; ++m) {
+        f32 energy = mfcc_dot(mfcc->weights + mfcc->filter_offset[m], power + mfcc->filter_first[m], mfcc->filter_count[m]);
+        mels[m] = logf(energy + MFCC_LOG_FLOOR);
+    }
+
+    for (u32 c = 0; c < MFCC_COEFFS; ++c) {
+        coeffs[c] = mfcc_dot(mfcc->dct[c], mels, MFCC_MELS);
+    }
+}
+
+u32
+mfcc_words(mfcc_t *mfcc, const i16 *samples, u32 frame_count, u32 channels,
+           const vtt_data_t *data, vtt_chunk_t chunk, const mfcc_columns_t *columns, u32 first_word, u32 word_capacity)
+{
+    u32 stft_count = frame_count / mfcc->hop + 1;
+
+    mfcc->needed.count = 0;
+    dck_stretchy_reserve(mfcc->needed, stft_count);
+    mfcc->needed.count = stft_count;
+    memset(mfcc->needed.data, 0, stft_count);
+
+    mfcc->coeffs.count = 0;
+    dck_stretchy_reserve(mfcc->coeffs, stft_count * MFCC_COEFFS);
+    mfcc->coeffs.count = stft_count * MFCC_COEFFS;
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        if (vtt_word_blank(data, word))
+            continue;
+
+        u32 first, last;
+        vtt_word_frames(word, mfcc->sample_rate, mfcc->length, mfcc->hop, stft_count, &first, &last);
+
+        memset(mfcc->needed.data + first, 1, last - first + 1);
+    }
+
+    for (u32 f = 0; f < stft_count;) {
+        if (!mfcc->needed.data[f]) {
+            ++f;
+            continue;
+        }
+
+        b32 pair = f + 1 < stft_count && mfcc->needed.data[f + 1];
+
+        mfcc_load_frame(mfcc, samples, frame_count, channels, f, false);
+
+        if (pair) {
+            mfcc_load_frame(mfcc, samples, frame_count, channels, f + 1, true);
+        }
+
+        fft_forward(&mfcc->plan, mfcc->data, mfcc->scratch);
+
+        // With Z = A + iB for real frames a and b: A[k] = (Z[k] + Z*[-k]) / 2, B[k] = (Z[k] - Z*[-k]) / 2i.
+        for (u32 k = 0; k < mfcc->bins; ++k) {
+            cn_t z  = mfcc->data[k];
+            cn_t zn = mfcc->data[(mfcc->size - k) & (mfcc->size - 1)];
+
+            f32 ar = 0.5f * (z.r + zn.r), ai = 0.5f * (z.i - zn.i);
+            f32 br = 0.5f * (z.i + zn.i), bi = 0.5f * (zn.r - z.r);
+
+            mfcc->power[0][k] = ar * ar + ai * ai;
+            mfcc->power[1][k] = br * br + bi * bi;
+        }
+
+        mfcc_cepstrum(mfcc, mfcc->power[0], mfcc->coeffs.data + (u64)f * MFCC_COEFFS);
+
+        if (pair) {
+            mfcc_cepstrum(mfcc, mfcc->power[1], mfcc->coeffs.data + (u64)(f + 1) * MFCC_COEFFS);
+        }
+
+        f += pair ? 2 : 1;
+    }
+
+    u32 count = 0;
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        if (vtt_word_blank(data, word))
+            continue;
+
+        if (count < word_capacity) {
+            u32 first, last;
+            vtt_word_frames(word, mfcc->sample_rate, mfcc->length, mfcc->hop, stft_count, &first, &last);
+
+            f32 sum[MFCC_COEFFS] = {0}, sum_sq[MFCC_COEFFS] = {0};
+            u32 n = last - first + 1;
+
+            for (u32 f = first; f <= last; ++f) {
+                const f32 *coeffs = mfcc->coeffs.data + (u64)f * MFCC_COEFFS;
+
+                for (u32 c = 0; c < MFCC_COEFFS; ++c) {
+                    sum[c]    += coeffs[c];
+                    sum_sq[c] += coeffs[c] * coeffs[c];
+                }
+            }
+
+            u32 id = first_word + count;
+
+            for (u32 c = 0; c < MFCC_COEFFS; ++c) {
+                f32 mean = sum[c] / n;
+                f32 var  = sum_sq[c] / n - mean * mean;
+
+                columns->columns[c][id]               = mean;
+                columns->columns[MFCC_COEFFS + c][id] = var > 0.0f ? sqrtf(var) : 0.0f;
+            }
+
+            columns->starts[id] = word.time_start;
+            columns->frames[id] = n < 0xFFFF ? n : 0xFFFF;
+        }
+
+        ++count;
+    }
+
+    return count;
+}
+
+static u64
+mfcc_align(u64 offset)
+{
+    return (offset + 7) & ~(u64)7;
+}
+
+static b32
+mfcc_write_section(FILE *file, u64 *offset, const void *data, u64 size)
+{
+    static const u8 zeros[8] = {0};
+
+    u64 aligned = mfcc_align(*offset);
+
+    if (aligned != *offset && fwrite(zeros, 1, aligned - *offset, file) != aligned - *offset)
+        return false;
+
+    if (size != 0 && fwrite(data, 1, size, file) != size)
+        return false;
+
+    *offset = aligned + size;
+    return true;
+}
+
+b32
+mfcc_store_write(const char *path, const u32 *entry_words, u32 entry_count, const mfcc_columns_t *columns)
+{
+    u32 word_count = entry_words[entry_count];
+
+    mfcc_store_header_t header = {
+        .magic         = MFCC_MAGIC,
+        .version       = MFCC_VERSION,
+        .feature_count = MFCC_FEATURES,
+        .entry_count   = entry_count,
+        .word_count    = word_count,
+        .frame_seconds = MFCC_FRAME,
+        .hop_seconds   = MFCC_HOP,
+    };
+
+    u64 entry_words_size = (entry_count + 1) * sizeof(u32);
+    u64 starts_size      = word_count * sizeof(f32);
+    u64 frames_size      = word_count * sizeof(u16);
+    u64 column_size      = word_count * sizeof(f32);
+
+    u64 offset = sizeof(header);
+
+    offset = mfcc_align(offset); header.entry_words_offset = offset; offset += entry_words_size;
+    offset = mfcc_align(offset); header.starts_offset      = offset; offset += starts_size;
+    offset = mfcc_align(offset); header.frames_offset      = offset; offset += frames_size;
+    offset = mfcc_align(offset); header.columns_offset     = offset;
+
+    header.column_stride = mfcc_align(column_size);
+    header.size          = header.columns_offset + header.column_stride * MFCC_FEATURES;
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    b32 ok = false;
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file) {
+        offset = 0;
+
+        ok = mfcc_write_section(file, &offset, &header, sizeof(header))
+          && mfcc_write_section(file, &offset, entry_words, entry_words_size)
+          && mfcc_write_section(file, &offset, columns->starts, starts_size)
+          && mfcc_write_section(file, &offset, columns->frames, frames_size);
+
+        for (u32 f = 0; f < MFCC_FEATURES && ok; ++f) {
+            ok = mfcc_write_section(file, &offset, columns->columns[f], column_size);
+        }
+
+        // The last column's padding, so the size matches the header.
+        ok = ok && mfcc_write_section(file, &offset, NULL, 0);
+
+        if (fclose(file) != 0) {
+            ok = false;
+        }
+
+        if (ok && rename(tmp_path, path) != 0) {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write features '%s': %s\n", path, strerror(errno));
+        remove(tmp_path);
+    }
+
+    return ok;
+}
+
+b32
+mfcc_store_open(mfcc_store_t *store, const char *path)
+{
+    *store = (mfcc_store_t) {0};
+
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open features '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(mfcc_store_header_t)) {
+        fprintf(stderr, "Features '%s' are truncated!\n", path);
+        close(fd);
+        return false;
+    }
+
+    u8 *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map features '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    const mfcc_store_header_t *header = (const mfcc_store_header_t *)base;
+
+    if (header->magic != MFCC_MAGIC || header->version != MFCC_VERSION
+     || header->feature_count != MFCC_FEATURES || header->size != (u64)st.st_size) {
+        fprintf(stderr, "Features '%s' are corrupted!\n", path);
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    store->base        = base;
+    store->size        = st.st_size;
+    store->header      = header;
+    store->entry_count = header->entry_count;
+    store->word_count  = header->word_count;
+    store->entry_words = (const u32 *)(base + header->entry_words_offset);
+    store->starts      = (const f32 *)(base + header->starts_offset);
+    store->frames      = (const u16 *)(base + header->frames_offset);
+
+    return true;
+}
+
+void
+mfcc_store_close(mfcc_store_t *store)
+{
+    if (store->base) {
+        munmap(store->base, store->size);
+    }
+
+    *store = (mfcc_store_t) {0};
+}
+
+const f32 *
+mfcc_store_column(const mfcc_store_t *store, u32 feature)
+{
+    return (const f32 *)(store->base + store->header->columns_offset + store->header->column_stride * feature);
+}
+
+u32
+mfcc_store_entry(const mfcc_store_t *store, u32 word)
+{
+    // Last entry starting at or before the word, entries without words share their first id.
+    u32 lo = 0, hi = store->entry_count;
+
+    while (lo + 1 < hi) {
+        u32 mid = (lo + hi) / 2;
+
+        if (store->entry_words[mid] <= word) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+#endif // MFCC_IMPL
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include <math.h>
 
 #include "core/utils.h"
@@ -13,7 +14,28 @@
 #define VTT_PARSER_IMPL
 #include "vtt_parser.h"
 
-// cc src/naive.c ../raylib/lib/libraylib.a -o naive.exe -I. -I../raylib/include -lm -ldl -lpthread && ./naive.exe
+#define VOCAB_IMPL
+#include "vocab.h"
+
+#define HEATMAP_IMPL
+#include "heatmap.h"
+
+#define CATALOG_IMPL
+#include "catalog.h"
+
+#define FFT_IMPL
+#include "fft.h"
+
+#define CONV_IMPL
+#include "conv.h"
+
+#define CQT_IMPL
+#include "cqt.h"
+
+#define PCM_IMPL
+#include "pcm.h"
+
+// cc src/naive.c ../raylib/lib/libraylib.a -o naive.exe -I. -I../raylib/include -lm -ldl -lpthread && ./naive.exe [folder | catalog.cat [entry]]
 
 #define BG_COLOR ((Color) { \
     .r = 66, \
@@ -50,6 +72,13 @@
     .a = 255, \
 })
 
+#define HEAT_COLOR ((Color) { \
+    .r = 234, \
+    .g = 178, \
+    .b = 66, \
+    .a = 255, \
+})
+
 #define TEXT_FG_COLOR ((Color) { \
     .r = 255, \
     .g = 255, \
@@ -62,24 +91,89 @@ typedef struct
     u32 offset, size;
 } wave_mip_level_t;
 
-#define FFT_POW 12
-#define FFT_SIZE (1 << FFT_POW)
+// Whole milliseconds of the track's rate, 4410 or 4800 samples at 44.1kHz or 48kHz.
+#define FFT_MS 100
 
-typedef struct
+// Log frequency spectrum, so speech gets most of the width.
+#define SPECTRUM_MIN_HZ          50.0f
+#define SPECTRUM_MAX_HZ          8000.0f
+#define SPECTRUM_BINS_PER_OCTAVE 24
+#define SPECTRUM_FLOOR_DB        80.0f
+
+// Stream processors get float stereo at the mixing rate, which is the device's (48kHz on most backends).
+#define FILTER_RATE  48000
+#define FILTER_BLOCK 256 // Frames of latency, raylib hands over up to 512 at a time.
+#define FILTER_TAPS  1023
+
+enum { FILTER_OFF, FILTER_VOICE, FILTER_EQ, FILTER_COUNT };
+
+static const char *filter_names[FILTER_COUNT] = { "off", "voice", "eq" };
+
+// Rumble cut and a presence lift for speech.
+static const f32 filter_eq_gains[CONV_EQ_BANDS] = { -12.0f, -9.0f, -3.0f, 0.0f, 0.0f, 2.0f, 4.0f, 4.0f, 1.0f, 0.0f };
+
+static conv_t      filters[FILTER_COUNT];
+static atomic_uint filter_selected;
+static u32         filter_active; // Audio thread only.
+
+static void
+filter_process(void *buffer, unsigned int frames)
 {
-    f32 r, i;
-} cn_t;
+    u32 selected = atomic_load_explicit(&filter_selected, memory_order_relaxed);
 
-static cn_t fft_buffer[FFT_SIZE * 2];
+    // A filter picked again starts from silence, not from where it was left.
+    if (selected != filter_active) {
+        if (selected != FILTER_OFF) {
+            conv_reset(filters + selected);
+        }
+
+        filter_active = selected;
+    }
+
+    if (selected != FILTER_OFF) {
+        conv_process(filters + selected, buffer, buffer, frames);
+    }
+}
 
 i32
-main(void)
+main(i32 argc, char *argv[])
 {
     SetTraceLogLevel(LOG_WARNING); // KYS
 
-    const char *audio_file   = "../oneyplays/witch_hunt_test/audio.ogg";
-    const char *caption_file = "../oneyplays/witch_hunt_test/text.en.vtt";
-    // const char *caption_file = "../oneyplays/witch_hunt_test/short.en.vtt";
+    const char *folder = "../oneyplays/witch_hunt_test";
+
+    char audio_file[CATALOG_PATH_MAX];
+    char caption_file[CATALOG_PATH_MAX];
+
+    if (argc > 1 && catalog_has_suffix(argv[1], ".cat")) {
+        catalog_t catalog;
+
+        if (!catalog_open(&catalog, argv[1]))
+            exit(1);
+
+        u32 entry_i = argc > 2 ? (u32)atoi(argv[2]) : 0;
+
+        if (entry_i >= catalog.count || catalog.audio_path[entry_i] == CATALOG_NONE) {
+            fprintf(stderr, "Catalog '%s' has no entry %u with audio!\n", argv[1], entry_i);
+            exit(1);
+        }
+
+        catalog_entry_t entry = catalog_entry(&catalog, entry_i);
+
+        snprintf(audio_file,   sizeof(audio_file),   "%s", entry.audio_path);
+        snprintf(caption_file, sizeof(caption_file), "%s", entry.caption_path);
+
+        catalog_close(&catalog);
+    }
+    else {
+        if (argc > 1) {
+            folder = argv[1];
+        }
+
+        snprintf(audio_file,   sizeof(audio_file),   "%s/audio.ogg",   folder);
+        snprintf(caption_file, sizeof(caption_file), "%s/text.en.vtt", folder);
+        // snprintf(caption_file, sizeof(caption_file), "%s/short.en.vtt", folder);
+    }
 
     InitAudioDevice();
 
@@ -104,11 +198,23 @@ main(void)
     assert(wave.sampleSize == 16);
     assert(wave.channels   == 2);
 
-    u16 *wave_data = wave.data;
+    i16 *wave_data = wave.data;
 
     vtt_data_t vtt_data = {0};
     vtt_chunk_t vtt_chunk = vtt_parse_file(&vtt_data, caption_file);
 
+    {
+        f32 taps[FILTER_TAPS];
+
+        conv_design_bandpass(taps, FILTER_TAPS, FILTER_RATE, CONV_VOICE_LOW, CONV_VOICE_HIGH);
+        conv_init(filters + FILTER_VOICE, taps, FILTER_TAPS, FILTER_BLOCK, 2);
+
+        conv_design_eq(taps, FILTER_TAPS, FILTER_RATE, filter_eq_gains);
+        conv_init(filters + FILTER_EQ, taps, FILTER_TAPS, FILTER_BLOCK, 2);
+
+        AttachAudioStreamProcessor(music.stream, filter_process);
+    }
+
     PlayMusicStream(music);
 
     InitWindow(1920, 1080, "Naive DFT");
@@ -118,6 +224,18 @@ main(void)
 
     f32 music_length = GetMusicTimeLength(music);
 
+    // Signed mono for the spectrum, zero padded so the last window stays in bounds.
+    u32 wave_tail = wave.sampleRate * FFT_MS / 1000;
+    f32 *wave_mono = calloc(wave.frameCount + wave_tail, sizeof(f32));
+
+    if (!wave_mono) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    pcm_downmix(wave_data, wave.frameCount, 2, wave_mono);
+
+    // The waveform mips hold the envelope, mean |x| over the samples of a bucket.
     dck_stretchy_t (f32,              u32) wave_mip_values = {0};
     dck_stretchy_t (wave_mip_level_t, u32) wave_mip_levels = {0};
     {
@@ -126,11 +244,7 @@ main(void)
         dck_stretchy_reserve(wave_mip_values, wave_size);
 
         for (u32 i = 0; i < wave_size; ++i) {
-            u16 amp_l = wave_data[i * 2 + 0];
-            u16 amp_r = wave_data[i * 2 + 1];
-
-            f32 amp_ratio = (amp_l + amp_r) / (f32)(UINT16_MAX * 2);
-            wave_mip_values.data[wave_mip_values.count + i] = amp_ratio;
+            wave_mip_values.data[wave_mip_values.count + i] = fabsf(wave_mono[i]);
         }
 
         dck_stretchy_push(wave_mip_levels, (wave_mip_level_t) {
@@ -164,6 +278,43 @@ main(void)
 
     UnloadWave(wave);
 
+    vocab_index_t vocab_index = {0};
+    vocab_index_add(&vocab_index, &vtt_data, vtt_chunk);
+    vocab_index_finish(&vocab_index);
+
+    heatmap_t heatmap;
+    heatmap_init(&heatmap, music_length, HEATMAP_BUCKET_SECONDS);
+    heatmap_build_top(&heatmap, &vocab_index, &vtt_data, vtt_chunk, HEATMAP_DEFAULT_TOP);
+
+    // Words outside of the precomputed ones get built once when they show up.
+    u32 *rare_heat_values = malloc(heatmap.stride * sizeof(u32));
+    u32 *rare_heat_maxima = malloc(heatmap.levels.count * sizeof(u32));
+    u32  rare_heat_term   = VOCAB_NONE;
+
+    if (!rare_heat_values || !rare_heat_maxima) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    b32 show_heatmap = false;
+
+    u32 fft_size = (wave.sampleRate * FFT_MS / 1000) & ~1u; // Real transforms need it even.
+
+    fft_real_plan_t fft_plan;
+    fft_real_plan_init(&fft_plan, fft_size);
+
+    cqt_t cqt;
+    cqt_init(&cqt, fft_size, wave.sampleRate, SPECTRUM_MIN_HZ, SPECTRUM_MAX_HZ, SPECTRUM_BINS_PER_OCTAVE);
+
+    cn_t *fft_buffer  = malloc((fft_size / 2 + 1) * sizeof(cn_t));
+    cn_t *fft_scratch = malloc(fft_plan.half.scratch_size * sizeof(cn_t));
+    f32  *spectrum    = malloc(cqt.bins * sizeof(f32));
+
+    if (!fft_buffer || !fft_scratch || !spectrum) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
     u8 text_buffer[256];
 
     dck_stretchy_t (f32, u32) cos_cross = {0};
@@ -192,6 +343,16 @@ main(void)
             }
         }
 
+        if (IsKeyPressed(KEY_H)) {
+            show_heatmap = !show_heatmap;
+        }
+
+        if (IsKeyPressed(KEY_F)) {
+            u32 selected = (atomic_load(&filter_selected) + 1) % FILTER_COUNT;
+            atomic_store(&filter_selected, selected);
+            printf("filter: %s\n", filter_names[selected]);
+        }
+
         if (IsKeyPressed(KEY_SPACE)) {
             if (IsMusicStreamPlaying(music)) {
                 PauseMusicStream(music);
@@ -239,12 +400,50 @@ main(void)
 
         f32 music_played = GetMusicTimePlayed(music);
 
+        u32 caption_word_i = 0;
+
+        for (u32 i = 1; i < vtt_chunk.word_count; ++i) {
+            if (vtt_data.words.data[i].time_start > music_played)
+                break;
+
+            caption_word_i = i;
+        }
+
+        // Occurrences of the current caption word along the bar.
+        u32 heat_term = vtt_chunk.word_count != 0 ? vocab_index.word_ids.data[caption_word_i] : VOCAB_NONE;
+
+        if (show_heatmap && heat_term != VOCAB_NONE) {
+            const u32 *heat_values = rare_heat_values;
+            const u32 *heat_maxima = rare_heat_maxima;
+
+            u32 pyramid = heatmap_find(&heatmap, heat_term);
+
+            if (pyramid != HEATMAP_NONE) {
+                heat_values = heatmap_values(&heatmap, pyramid);
+                heat_maxima = heatmap_maxima(&heatmap, pyramid);
+            }
+            else if (heat_term != rare_heat_term) {
+                heatmap_build_term(&heatmap, &vocab_index, &vtt_data, vtt_chunk, heat_term, rare_heat_values, rare_heat_maxima);
+                rare_heat_term = heat_term;
+            }
+
+            u32 heat_level = heatmap_level_for(&heatmap, window_width);
+
+            for (u32 x_pos = 0; x_pos < (u32)window_width; ++x_pos) {
+                f32 heat = heatmap_sample(&heatmap, heat_values, heat_maxima, heat_level, x_pos, window_width);
+
+                if (heat > 0.0f) {
+                    DrawLine(x_pos, window_height - bar_height, x_pos, window_height, ColorAlpha(HEAT_COLOR, 0.25f + heat * 0.5f));
+                }
+            }
+        }
+
         i32 cursor_x = (i32)(window_width * (music_played / music_length)) - (cursor_width / 2);
 
         DrawRectangle(cursor_x, window_height - bar_height, cursor_width, bar_height, CURSOR_COLOR);
 
         u32 wave_pos = wave.frameCount * (music_played / music_length);
-        f32 *wave_values = wave_mip_values.data + wave_pos;
+        f32 *wave_values = wave_mono + wave_pos;
 
 #if 0
         cos_cross.count = 0;
@@ -258,7 +457,7 @@ main(void)
             f32 cross_i = 0.0f;
 
             for (u32 x_pos_2 = 0; x_pos_2 < window_width; ++x_pos_2) {
-                f32 val = wave_values[x_pos_2] * 2.0 - 1.0f;
+                f32 val = wave_values[x_pos_2];
                 cross_r += cosf(freq * M_PI * 2.0f * x_pos_2) * val;
                 cross_i += sinf(freq * M_PI * 2.0f * x_pos_2) * val;
             }
@@ -280,78 +479,21 @@ main(void)
             DrawLine(x_pos, window_height - bar_height, x_pos, window_height - bar_height - val, DCC_COLOR);
         }
 #else
-        for (u32 i = 0; i < FFT_SIZE; ++i) {
-            fft_buffer[i] = (cn_t) {
-                .r = wave_values[i],
-                .i = 0.0f,
-            };
-        }
-
-        cn_t *fft_src = fft_buffer + 0;
-        cn_t *fft_dst = fft_buffer + FFT_SIZE;
-
-        u32 fft_span   = FFT_SIZE / 2;
-        u32 fft_blocks = 1;
-
-        while (fft_span > 0) {
-            for (u32 block = 0; block < fft_blocks; ++block) {
-                u32 block_offset = block * fft_span * 2;
-
-                for (u32 off = 0; off < fft_span; ++off) {
-                    u32 index = block_offset + off;
-
-                    f32 angle = 2.0f * M_PI * (index / (f32)FFT_SIZE);
-                    cn_t mf = {
-                        .r =  cosf(angle),
-                        .i = -sinf(angle),
-                    };
-
-                    cn_t a = fft_src[index];
-                    cn_t b = fft_src[index + fft_span];
-                    cn_t b_2 = {
-                        .r = mf.r * b.r - mf.i * b.i,
-                        .i = mf.r * b.i + mf.i * b.r,
-                    };
-
-                    fft_dst[index] = (cn_t) {
-                        .r = a.r + b_2.r,
-                        .i = a.i + b_2.i,
-                    };
-
-                    fft_dst[index + fft_span] = (cn_t) {
-                        .r = a.r - b_2.r,
-                        .i = a.i - b_2.i,
-                    };
-                }
-            }
-
-            fft_span   /= 2;
-            fft_blocks *= 2;
-
-            cn_t *tmp = fft_dst;
-            fft_dst = fft_src;
-            fft_src = tmp;
-        }
+        fft_real_forward(&fft_plan, wave_values, fft_buffer, fft_scratch);
+        cqt_apply(&cqt, fft_buffer, spectrum);
 
         for (u32 x_pos = 0; x_pos < window_width; ++x_pos) {
-            cn_t cn = fft_src[(x_pos * FFT_SIZE) / window_width];
-            f32 val = sqrtf(cn.r * cn.r + cn.i * cn.i);
+            f32 db  = 20.0f * log10f(spectrum[((u64)x_pos * cqt.bins) / window_width] + 1e-9f);
+            f32 val = bar_height * (db + SPECTRUM_FLOOR_DB) / SPECTRUM_FLOOR_DB;
+
+            val = val > 0.0f ? val : 0.0f;
 
             DrawLine(x_pos, window_height - bar_height, x_pos, window_height - bar_height - val, DCC_COLOR);
         }
 #endif
 
         if (vtt_chunk.word_count != 0) {
-            vtt_word_t vtt_word = vtt_data.words.data[0];
-
-            for (u32 i = 1; i < vtt_chunk.word_count; ++i) {
-                vtt_word_t vtt_word_2 = vtt_data.words.data[i];
-
-                if (vtt_word_2.time_start > music_played)
-                    break;
-
-                vtt_word = vtt_word_2;
-            }
+            vtt_word_t vtt_word = vtt_data.words.data[caption_word_i];
 
             snprintf(text_buffer, sizeof(text_buffer), SV_FMT, vtt_word.text_size, vtt_data.text.data + vtt_word.text_offset);
 
@@ -366,6 +508,26 @@ main(void)
         EndDrawing();  
     }
 
+    DetachAudioStreamProcessor(music.stream, filter_process);
+    UnloadMusicStream(music);
+
+    for (u32 i = 0; i < FILTER_COUNT; ++i) {
+        if (i != FILTER_OFF) {
+            conv_free(filters + i);
+        }
+    }
+
+    fft_real_plan_free(&fft_plan);
+    cqt_free(&cqt);
+    free(wave_mono);
+    free(fft_buffer);
+    free(fft_scratch);
+    free(spectrum);
+    heatmap_free(&heatmap);
+    vocab_index_free(&vocab_index);
+    free(rare_heat_values);
+    free(rare_heat_maxima);
+
     CloseWindow();
     CloseAudioDevice();
 
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+#include "core/sv.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define VOCAB_IMPL
+#include "vocab.h"
+
+#define NGRAM_IMPL
+#include "ngram.h"
+
+// cc src/ngram.c -o ngram.exe -I. -O2 -lm && ./ngram.exe build ../captions.ngm ../oneyplays/witch_hunt_test/*.vtt
+
+#define NGRAM_TOOL_PREDICTIONS 10
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s build <model.ngm> [-k min count] <file.vtt>...\n", program);
+    fprintf(stderr, "       %s next <model.ngm> [word]...\n", program);
+    fprintf(stderr, "       %s count <model.ngm> <word>...\n", program);
+    fprintf(stderr, "       %s stats <model.ngm>\n", program);
+}
+
+static i32
+ngram_tool_build(const char *path, i32 argc, char **argv)
+{
+    ngram_builder_t builder = { .min_count = 2 };
+
+    i32 arg = 0;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-k") == 0) {
+        builder.min_count = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+
+    for (; arg < argc; ++arg) {
+        FILE *file = fopen(argv[arg], "rb");
+
+        if (!file) {
+            fprintf(stderr, "Failed to open '%s'!\n", argv[arg]);
+            continue;
+        }
+
+        fclose(file);
+
+        vtt_data_t vtt_data = {0};
+        vtt_chunk_t chunk = vtt_parse_file(&vtt_data, argv[arg]);
+
+        ngram_builder_add(&builder, &vtt_data, chunk);
+
+        free(vtt_data.text.data);
+        free(vtt_data.words.data);
+    }
+
+    b32 ok = ngram_builder_write(&builder, path);
+    ngram_builder_free(&builder);
+
+    return ok ? 0 : 1;
+}
+
+// Maps the words to ids, returns false when one of them is unknown.
+static b32
+ngram_tool_words(const ngram_model_t *model, i32 argc, char **argv, u32 *ids_o)
+{
+    for (i32 i = 0; i < argc; ++i) {
+        u8 term[256];
+        u32 size = strlen(argv[i]) < sizeof(term) ? strlen(argv[i]) : sizeof(term);
+        size = vocab_normalize((const u8 *)argv[i], size, term);
+
+        ids_o[i] = ngram_word(model, term, size);
+
+        if (ids_o[i] == NGRAM_NONE) {
+            printf("'%s' is not in the vocabulary\n", argv[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static i32
+ngram_tool_next(const ngram_model_t *model, i32 argc, char **argv)
+{
+    // Only the last words matter for the prediction.
+    if (argc > NGRAM_ORDER - 1) {
+        argv += argc - (NGRAM_ORDER - 1);
+        argc  = NGRAM_ORDER - 1;
+    }
+
+    u32 context[NGRAM_ORDER];
+
+    if (!ngram_tool_words(model, argc, argv, context))
+        return 1;
+
+    ngram_prediction_t predictions[NGRAM_TOOL_PREDICTIONS];
+    u32 count = ngram_predict(model, context, argc, predictions, NGRAM_TOOL_PREDICTIONS);
+
+    for (u32 i = 0; i < count; ++i) {
+        u32 size;
+        const u8 *text = ngram_word_text(model, predictions[i].word, &size);
+
+        printf("%.4f "SV_FMT"\n", predictions[i].score, (int)size, text);
+    }
+
+    return 0;
+}
+
+static i32
+ngram_tool_count(const ngram_model_t *model, i32 argc, char **argv)
+{
+    if (argc > NGRAM_ORDER) {
+        fprintf(stderr, "At most %u words!\n", NGRAM_ORDER);
+        return 1;
+    }
+
+    u32 ids[NGRAM_ORDER];
+    ngram_node_t node;
+
+    if (!ngram_tool_words(model, argc, argv, ids))
+        return 1;
+
+    if (!ngram_find(model, ids, argc, &node)) {
+        printf("0\n");
+        return 0;
+    }
+
+    printf("~%.0f\n", ngram_count(model, node));
+
+    return 0;
+}
+
+static i32
+ngram_tool_stats(const ngram_model_t *model)
+{
+    const ngram_header_t *header = model->header;
+
+    printf("%u words, "FMT_U64" tokens, "FMT_U64" bytes\n", header->word_count, header->token_count, header->size);
+
+    for (u32 l = 0; l < NGRAM_ORDER; ++l) {
+        printf("%u-grams: %u\n", l + 1, header->node_counts[l]);
+    }
+
+    return 0;
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "build") == 0)
+        return ngram_tool_build(argv[2], argc - 3, argv + 3);
+
+    ngram_model_t model;
+
+    if (!ngram_model_open(&model, argv[2]))
+        return 1;
+
+    i32 res = 1;
+
+    if (strcmp(argv[1], "next") == 0) {
+        res = ngram_tool_next(&model, argc - 3, argv + 3);
+    }
+    else if (strcmp(argv[1], "count") == 0 && argc > 3) {
+        res = ngram_tool_count(&model, argc - 3, argv + 3);
+    }
+    else if (strcmp(argv[1], "stats") == 0) {
+        res = ngram_tool_stats(&model);
+    }
+    else {
+        print_usage(argv[0]);
+    }
+
+    ngram_model_close(&model);
+
+    return res;
+}
@@ -0,0 +1,798 @@
+#ifndef NGRAM_H_
+#define NGRAM_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+#include "vocab.h"
+
+/* 1 to 4-gram counts of the caption corpus stored as a sorted trie that is
+ * used straight from a mapped file. Every level of the trie is a flat array
+ * of nodes sorted by their whole n-gram, a node holds its last word id and
+ * a quantized count, and the nodes of all but the last level hold the offset
+ * of their first child on the next level. Ids and offsets are bit-packed to
+ * the width they need, counts take one byte (log scale, `NGRAM_QUANT_SCALE`
+ * steps per doubling).
+ *
+ * Looking up an n-gram is one binary search in a child range per word, the
+ * unigram level is indexed by the word id directly. Word ids are the ranks
+ * of the bytewise sorted vocabulary.
+ */
+
+#define NGRAM_MAGIC   0x314D474E // "NGM1"
+#define NGRAM_VERSION 1
+
+#define NGRAM_ORDER       4
+#define NGRAM_NONE        0xFFFFFFFF
+#define NGRAM_QUANT_SCALE 8.0f
+#define NGRAM_BACKOFF     0.4f // Stupid backoff weight per dropped context word.
+
+typedef struct
+{
+    u32 magic, version;
+
+    u32 order;
+    u32 word_count;     // Vocabulary size, also the number of unigrams.
+    u32 word_text_size;
+    u32 id_bits;        // Width of the packed word ids.
+
+    u32 node_counts[NGRAM_ORDER];
+    u32 child_bits[NGRAM_ORDER]; // Width of the packed child offsets of every level.
+
+    u64 token_count;
+
+    f32 count_table[256]; // Quantized count to count.
+
+    u64 word_offsets_offset; // `word_count + 1` offsets into the word text.
+    u64 word_text_offset;
+    u64 ids_offset[NGRAM_ORDER];      // Packed word ids, the unigram level has none.
+    u64 counts_offset[NGRAM_ORDER];   // Quantized count of every node.
+    u64 children_offset[NGRAM_ORDER]; // `node_counts + 1` packed offsets, the last level has none.
+    u64 size;
+} ngram_header_t;
+
+typedef struct
+{
+    u8 *base;
+    u64 size;
+
+    const ngram_header_t *header;
+    const u32            *word_offsets;
+    const u8             *word_text;
+
+    const u64 *ids[NGRAM_ORDER];
+    const u8  *counts[NGRAM_ORDER];
+    const u64 *children[NGRAM_ORDER];
+} ngram_model_t;
+
+// Node `index` on `level`, the level is the n-gram length minus one.
+typedef struct
+{
+    u32 level, index;
+} ngram_node_t;
+
+typedef struct
+{
+    u32 word;
+    f32 score;
+} ngram_prediction_t;
+
+typedef struct
+{
+    vocab_t vocab;
+
+    // Interned ids of all of the words, files are separated by `NGRAM_NONE`.
+    dck_stretchy_t (u32, u32) tokens;
+
+    u32 min_count; // N-grams (n > 1) seen fewer times are dropped.
+} ngram_builder_t;
+
+void
+ngram_builder_add(ngram_builder_t *builder, const vtt_data_t *data, vtt_chunk_t chunk);
+
+// Renumbers the collected tokens in place, so a builder is written only once.
+b32
+ngram_builder_write(ngram_builder_t *builder, const char *path);
+
+void
+ngram_builder_free(ngram_builder_t *builder);
+
+b32
+ngram_model_open(ngram_model_t *model, const char *path);
+
+void
+ngram_model_close(ngram_model_t *model);
+
+// Id of a normalized word, `NGRAM_NONE` when it is not in the vocabulary.
+u32
+ngram_word(const ngram_model_t *model, const u8 *text, u32 size);
+
+b32
+ngram_find(const ngram_model_t *model, const u32 *ids, u32 count, ngram_node_t *node_o);
+
+// Most likely next words after `context` scored with stupid backoff, best first.
+u32
+ngram_predict(const ngram_model_t *model, const u32 *context, u32 context_size,
+              ngram_prediction_t *predictions_o, u32 max_predictions);
+
+static inline u64
+ngram_unpack(const u64 *words, u32 bits, u64 index)
+{
+    u64 bit   = index * bits;
+    u64 word  = bit >> 6;
+    u32 shift = bit & 63;
+
+    u64 value = words[word] >> shift;
+
+    if (shift + bits > 64) {
+        value |= words[word + 1] << (64 - shift);
+    }
+
+    return bits == 64 ? value : value & ((1ull << bits) - 1);
+}
+
+static inline const u8 *
+ngram_word_text(const ngram_model_t *model, u32 id, u32 *size_o)
+{
+    *size_o = model->word_offsets[id + 1] - model->word_offsets[id];
+    return model->word_text + model->word_offsets[id];
+}
+
+static inline f32
+ngram_count(const ngram_model_t *model, ngram_node_t node)
+{
+    return model->header->count_table[model->counts[node.level][node.index]];
+}
+
+static inline u32
+ngram_child_begin(const ngram_model_t *model, ngram_node_t node)
+{
+    return (u32)ngram_unpack(model->children[node.level], model->header->child_bits[node.level], node.index);
+}
+
+static inline u32
+ngram_child_end(const ngram_model_t *model, ngram_node_t node)
+{
+    return (u32)ngram_unpack(model->children[node.level], model->header->child_bits[node.level], node.index + 1);
+}
+
+static inline u32
+ngram_node_word(const ngram_model_t *model, ngram_node_t node)
+{
+    if (node.level == 0)
+        return node.index;
+
+    return (u32)ngram_unpack(model->ids[node.level], model->header->id_bits, node.index);
+}
+
+#endif // NGRAM_H_
+
+#if defined(NGRAM_IMPL) && !defined(NGRAM_IMPL_)
+#define NGRAM_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+void
+ngram_builder_add(ngram_builder_t *builder, const vtt_data_t *data, vtt_chunk_t chunk)
+{
+    dck_stretchy_reserve(builder->tokens, chunk.word_count + 1);
+
+    normalize_batch_t batch = {0};
+    normalize_batch(&batch, data, chunk);
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        u32 size;
+        const u8 *text = normalize_batch_word(&batch, i, &size);
+
+        if (size != 0) {
+            builder->tokens.data[builder->tokens.count++] = vocab_intern(&builder->vocab, text, size);
+        }
+    }
+
+    builder->tokens.data[builder->tokens.count++] = NGRAM_NONE;
+
+    normalize_batch_free(&batch);
+}
+
+void
+ngram_builder_free(ngram_builder_t *builder)
+{
+    vocab_free(&builder->vocab);
+    free(builder->tokens.data);
+    *builder = (ngram_builder_t) {0};
+}
+
+typedef struct
+{
+    u32 ids[NGRAM_ORDER];
+    u32 count;
+} ngram_entry_t;
+
+typedef dck_stretchy_t (ngram_entry_t, u32) ngram_entries_t;
+
+static const vocab_t *ngram_sort_vocab;
+
+static int
+ngram_word_cmp(const void *a, const void *b)
+{
+    u32 size_a, size_b;
+    const u8 *text_a = vocab_text(ngram_sort_vocab, *(const u32 *)a, &size_a);
+    const u8 *text_b = vocab_text(ngram_sort_vocab, *(const u32 *)b, &size_b);
+
+    int res = memcmp(text_a, text_b, size_a < size_b ? size_a : size_b);
+    return res != 0 ? res : (size_a > size_b) - (size_a < size_b);
+}
+
+// Unused ids of shorter n-grams are zero, so comparing all of them is fine.
+static int
+ngram_entry_cmp(const void *a, const void *b)
+{
+    const ngram_entry_t *ea = a;
+    const ngram_entry_t *eb = b;
+
+    for (u32 i = 0; i < NGRAM_ORDER; ++i) {
+        if (ea->ids[i] != eb->ids[i])
+            return ea->ids[i] < eb->ids[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static void
+ngram_entries_reduce(ngram_entries_t *entries)
+{
+    if (entries->count == 0)
+        return;
+
+    qsort(entries->data, entries->count, sizeof(ngram_entry_t), ngram_entry_cmp);
+
+    u32 count = 1;
+
+    for (u32 i = 1; i < entries->count; ++i) {
+        if (ngram_entry_cmp(entries->data + count - 1, entries->data + i) == 0) {
+            entries->data[count - 1].count += entries->data[i].count;
+        }
+        else {
+            entries->data[count++] = entries->data[i];
+        }
+    }
+
+    entries->count = count;
+}
+
+/* Collects the n-grams of length `n` and sums duplicates every time the
+ * buffer fills up, so memory follows the number of distinct n-grams rather
+ * than the number of tokens.
+ */
+static void
+ngram_count_level(const u32 *tokens, u32 token_count, u32 n, u32 min_count, ngram_entries_t *entries_o)
+{
+    u32 capacity = 1 << 20;
+
+    entries_o->count = 0;
+    dck_stretchy_reserve(*entries_o, capacity);
+
+    for (u32 p = 0; p + n <= token_count; ++p) {
+        ngram_entry_t entry = { .count = 1 };
+        b32 valid = true;
+
+        for (u32 i = 0; i < n; ++i) {
+            if (tokens[p + i] == NGRAM_NONE) {
+                valid = false;
+                break;
+            }
+
+            entry.ids[i] = tokens[p + i];
+        }
+
+        if (!valid)
+            continue;
+
+        if (entries_o->count == capacity) {
+            ngram_entries_reduce(entries_o);
+
+            if (entries_o->count > capacity / 4 * 3) {
+                capacity *= 2;
+            }
+
+            dck_stretchy_reserve(*entries_o, capacity - entries_o->count);
+        }
+
+        entries_o->data[entries_o->count++] = entry;
+    }
+
+    ngram_entries_reduce(entries_o);
+
+    // Every occurrence of an n-gram contains one of its prefix, so pruning never orphans a node.
+    u32 count = 0;
+
+    for (u32 i = 0; i < entries_o->count; ++i) {
+        if (entries_o->data[i].count >= min_count) {
+            entries_o->data[count++] = entries_o->data[i];
+        }
+    }
+
+    entries_o->count = count;
+}
+
+static u32
+ngram_bits_for(u64 max_value)
+{
+    u32 bits = 1;
+
+    while (bits < 64 && (max_value >> bits) != 0) {
+        ++bits;
+    }
+
+    return bits;
+}
+
+static u64
+ngram_packed_size(u64 count, u32 bits)
+{
+    // One extra word so that unpacking may always read the word after.
+    return ((count * bits + 63) / 64 + 1) * sizeof(u64);
+}
+
+static u64 *
+ngram_pack_alloc(u64 count, u32 bits)
+{
+    u64 *words = calloc(1, ngram_packed_size(count, bits));
+
+    if (!words) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    return words;
+}
+
+static void
+ngram_pack(u64 *words, u32 bits, u64 index, u64 value)
+{
+    u64 bit   = index * bits;
+    u64 word  = bit >> 6;
+    u32 shift = bit & 63;
+
+    words[word] |= value << shift;
+
+    if (shift + bits > 64) {
+        words[word + 1] |= value >> (64 - shift);
+    }
+}
+
+static u8
+ngram_quantize(u32 count)
+{
+    f32 q = roundf(log2f((f32)count) * NGRAM_QUANT_SCALE);
+    return q > 255.0f ? 255 : (u8)q;
+}
+
+static u64
+ngram_align(u64 offset)
+{
+    return (offset + 7) & ~(u64)7;
+}
+
+static b32
+ngram_write_section(FILE *file, u64 *offset, const void *data, u64 size)
+{
+    static const u8 zeros[8] = {0};
+
+    u64 aligned = ngram_align(*offset);
+
+    if (aligned != *offset && fwrite(zeros, 1, aligned - *offset, file) != aligned - *offset)
+        return false;
+
+    if (size != 0 && fwrite(data, 1, size, file) != size)
+        return false;
+
+    *offset = aligned + size;
+    return true;
+}
+
+b32
+ngram_builder_write(ngram_builder_t *builder, const char *path)
+{
+    u32 word_count = builder->vocab.words.count;
+
+    // Renumber the words by their sorted rank.
+    u32 *order = malloc(word_count * sizeof(u32) + 1);
+    u32 *ranks = malloc(word_count * sizeof(u32) + 1);
+    u32 *word_offsets = malloc((word_count + 1) * sizeof(u32));
+
+    if (!order || !ranks || !word_offsets) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < word_count; ++i) {
+        order[i] = i;
+    }
+
+    ngram_sort_vocab = &builder->vocab;
+    qsort(order, word_count, sizeof(u32), ngram_word_cmp);
+
+    dck_stretchy_t (u8, u32) word_text = {0};
+
+    for (u32 i = 0; i < word_count; ++i) {
+        ranks[order[i]] = i;
+        word_offsets[i] = word_text.count;
+
+        u32 size;
+        const u8 *text = vocab_text(&builder->vocab, order[i], &size);
+
+        dck_stretchy_reserve(word_text, size);
+        memcpy(word_text.data + word_text.count, text, size);
+        word_text.count += size;
+    }
+
+    word_offsets[word_count] = word_text.count;
+
+    u64 token_count = 0;
+
+    for (u32 i = 0; i < builder->tokens.count; ++i) {
+        u32 *token = builder->tokens.data + i;
+
+        if (*token != NGRAM_NONE) {
+            *token = ranks[*token];
+            ++token_count;
+        }
+    }
+
+    free(order);
+    free(ranks);
+
+    ngram_header_t header = {
+        .magic          = NGRAM_MAGIC,
+        .version        = NGRAM_VERSION,
+        .order          = NGRAM_ORDER,
+        .word_count     = word_count,
+        .word_text_size = word_text.count,
+        .id_bits        = ngram_bits_for(word_count),
+        .token_count    = token_count,
+    };
+
+    for (u32 q = 0; q < 256; ++q) {
+        header.count_table[q] = exp2f(q / NGRAM_QUANT_SCALE);
+    }
+
+    ngram_entries_t levels[NGRAM_ORDER] = {0};
+
+    // Unigrams are the whole vocabulary, counted directly.
+    dck_stretchy_reserve(levels[0], word_count);
+    levels[0].count = word_count;
+
+    for (u32 i = 0; i < word_count; ++i) {
+        levels[0].data[i] = (ngram_entry_t) { .ids = { i } };
+    }
+
+    for (u32 i = 0; i < builder->tokens.count; ++i) {
+        u32 token = builder->tokens.data[i];
+
+        if (token != NGRAM_NONE) {
+            levels[0].data[token].count++;
+        }
+    }
+
+    u32 min_count = builder->min_count ? builder->min_count : 1;
+
+    for (u32 l = 1; l < NGRAM_ORDER; ++l) {
+        ngram_count_level(builder->tokens.data, builder->tokens.count, l + 1, min_count, levels + l);
+    }
+
+    u64 *ids[NGRAM_ORDER]      = {0};
+    u8  *counts[NGRAM_ORDER]   = {0};
+    u64 *children[NGRAM_ORDER] = {0};
+
+    for (u32 l = 0; l < NGRAM_ORDER; ++l) {
+        ngram_entries_t level = levels[l];
+
+        header.node_counts[l] = level.count;
+
+        counts[l] = malloc(level.count + 1);
+
+        if (!counts[l]) {
+            fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+            exit(666);
+        }
+
+        for (u32 i = 0; i < level.count; ++i) {
+            counts[l][i] = ngram_quantize(level.data[i].count);
+        }
+
+        if (l != 0) {
+            ids[l] = ngram_pack_alloc(level.count, header.id_bits);
+
+            for (u32 i = 0; i < level.count; ++i) {
+                ngram_pack(ids[l], header.id_bits, i, level.data[i].ids[l]);
+            }
+        }
+
+        if (l + 1 < NGRAM_ORDER) {
+            // Both levels are sorted by n-gram, so the children of consecutive nodes are consecutive.
+            ngram_entries_t next = levels[l + 1];
+
+            header.child_bits[l] = ngram_bits_for(next.count);
+            children[l] = ngram_pack_alloc(level.count + 1, header.child_bits[l]);
+
+            u32 child = 0;
+
+            for (u32 i = 0; i < level.count; ++i) {
+                ngram_pack(children[l], header.child_bits[l], i, child);
+
+                while (child < next.count && memcmp(next.data[child].ids, level.data[i].ids, (l + 1) * sizeof(u32)) == 0) {
+                    ++child;
+                }
+            }
+
+            ngram_pack(children[l], header.child_bits[l], level.count, child);
+        }
+    }
+
+    u64 offset = sizeof(header);
+
+    offset = ngram_align(offset); header.word_offsets_offset = offset; offset += (word_count + 1) * sizeof(u32);
+    offset = ngram_align(offset); header.word_text_offset    = offset; offset += word_text.count;
+
+    for (u32 l = 0; l < NGRAM_ORDER; ++l) {
+        u32 count = header.node_counts[l];
+
+        if (ids[l]) {
+            offset = ngram_align(offset); header.ids_offset[l] = offset; offset += ngram_packed_size(count, header.id_bits);
+        }
+
+        offset = ngram_align(offset); header.counts_offset[l] = offset; offset += count;
+
+        if (children[l]) {
+            offset = ngram_align(offset); header.children_offset[l] = offset; offset += ngram_packed_size(count + 1, header.child_bits[l]);
+        }
+    }
+
+    header.size = offset;
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    b32 ok = false;
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file) {
+        offset = 0;
+
+        ok = ngram_write_section(file, &offset, &header, sizeof(header))
+          && ngram_write_section(file, &offset, word_offsets, (word_count + 1) * sizeof(u32))
+          && ngram_write_section(file, &offset, word_text.data, word_text.count);
+
+        for (u32 l = 0; ok && l < NGRAM_ORDER; ++l) {
+            u32 count = header.node_counts[l];
+
+            ok = (!ids[l] || ngram_write_section(file, &offset, ids[l], ngram_packed_size(count, header.id_bits)))
+              && ngram_write_section(file, &offset, counts[l], count)
+              && (!children[l] || ngram_write_section(file, &offset, children[l], ngram_packed_size(count + 1, header.child_bits[l])));
+        }
+
+        if (fclose(file) != 0) {
+            ok = false;
+        }
+
+        if (ok && rename(tmp_path, path) != 0) {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write n-gram model '%s': %s\n", path, strerror(errno));
+        remove(tmp_path);
+    }
+
+    for (u32 l = 0; l < NGRAM_ORDER; ++l) {
+        free(levels[l].data);
+        free(ids[l]);
+        free(counts[l]);
+        free(children[l]);
+    }
+
+    free(word_offsets);
+    free(word_text.data);
+
+    return ok;
+}
+
+b32
+ngram_model_open(ngram_model_t *model, const char *path)
+{
+    *model = (ngram_model_t) {0};
+
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open n-gram model '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(ngram_header_t)) {
+        fprintf(stderr, "N-gram model '%s' is truncated!\n", path);
+        close(fd);
+        return false;
+    }
+
+    u8 *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map n-gram model '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    const ngram_header_t *header = (const ngram_header_t *)base;
+
+    if (header->magic != NGRAM_MAGIC || header->version != NGRAM_VERSION
+     || header->order != NGRAM_ORDER || header->size != (u64)st.st_size) {
+        fprintf(stderr, "N-gram model '%s' is corrupted!\n", path);
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    model->base         = base;
+    model->size         = st.st_size;
+    model->header       = header;
+    model->word_offsets = (const u32 *)(base + header->word_offsets_offset);
+    model->word_text    =               base + header->word_text_offset;
+
+    for (u32 l = 0; l < NGRAM_ORDER; ++l) {
+        model->ids[l]      = header->ids_offset[l]      ? (const u64 *)(base + header->ids_offset[l])      : NULL;
+        model->counts[l]   =                                             base + header->counts_offset[l];
+        model->children[l] = header->children_offset[l] ? (const u64 *)(base + header->children_offset[l]) : NULL;
+    }
+
+    return true;
+}
+
+void
+ngram_model_close(ngram_model_t *model)
+{
+    if (model->base) {
+        munmap(model->base, model->size);
+    }
+
+    *model = (ngram_model_t) {0};
+}
+
+u32
+ngram_word(const ngram_model_t *model, const u8 *text, u32 size)
+{
+    u32 lo = 0, hi = model->header->word_count;
+
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+
+        u32 word_size;
+        const u8 *word = ngram_word_text(model, mid, &word_size);
+
+        int res = memcmp(word, text, word_size < size ? word_size : size);
+        if (res == 0) {
+            res = (word_size > size) - (word_size < size);
+        }
+
+        if (res == 0)
+            return mid;
+
+        if (res < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return NGRAM_NONE;
+}
+
+b32
+ngram_find(const ngram_model_t *model, const u32 *ids, u32 count, ngram_node_t *node_o)
+{
+    if (count == 0 || count > NGRAM_ORDER || ids[0] >= model->header->word_count)
+        return false;
+
+    ngram_node_t node = { .level = 0, .index = ids[0] };
+
+    for (u32 i = 1; i < count; ++i) {
+        u32 lo = ngram_child_begin(model, node);
+        u32 hi = ngram_child_end(model, node);
+
+        const u64 *level_ids = model->ids[i];
+        u32 bits = model->header->id_bits;
+
+        while (lo < hi) {
+            u32 mid = (lo + hi) / 2;
+
+            if (ngram_unpack(level_ids, bits, mid) < ids[i]) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+
+        if (lo == ngram_child_end(model, node) || ngram_unpack(level_ids, bits, lo) != ids[i])
+            return false;
+
+        node = (ngram_node_t) { .level = i, .index = lo };
+    }
+
+    *node_o = node;
+    return true;
+}
+
+static void
+ngram_offer(ngram_prediction_t *predictions, u32 *count, u32 max_predictions, u32 word, f32 score)
+{
+    for (u32 i = 0; i < *count; ++i) {
+        if (predictions[i].word == word)
+            return; // Already scored from a longer context.
+    }
+
+    if (*count == max_predictions && predictions[*count - 1].score >= score)
+        return;
+
+    u32 i = *count < max_predictions ? (*count)++ : *count - 1;
+
+    while (i > 0 && predictions[i - 1].score < score) {
+        predictions[i] = predictions[i - 1];
+        --i;
+    }
+
+    predictions[i] = (ngram_prediction_t) { .word = word, .score = score };
+}
+
+u32
+ngram_predict(const ngram_model_t *model, const u32 *context, u32 context_size,
+              ngram_prediction_t *predictions_o, u32 max_predictions)
+{
+    u32 count = 0;
+
+    if (max_predictions == 0)
+        return 0;
+
+    u32 longest = context_size < NGRAM_ORDER - 1 ? context_size : NGRAM_ORDER - 1;
+    f32 weight = 1.0f;
+
+    for (u32 k = longest; k > 0; --k, weight *= NGRAM_BACKOFF) {
+        ngram_node_t node;
+
+        if (!ngram_find(model, context + context_size - k, k, &node))
+            continue;
+
+        f32 node_count = ngram_count(model, node);
+        u32 end = ngram_child_end(model, node);
+
+        for (u32 c = ngram_child_begin(model, node); c < end; ++c) {
+            ngram_node_t child = { .level = node.level + 1, .index = c };
+            ngram_offer(predictions_o, &count, max_predictions, ngram_node_word(model, child),
+                        weight * ngram_count(model, child) / node_count);
+        }
+    }
+
+    // Backing off to unigrams walks the whole vocabulary, only worth it when nothing else filled the list.
+    if (count < max_predictions) {
+        for (u32 w = 0; w < model->header->word_count; ++w) {
+            ngram_node_t node = { .level = 0, .index = w };
+            ngram_offer(predictions_o, &count, max_predictions, w,
+                        weight * ngram_count(model, node) / model->header->token_count);
+        }
+    }
+
+    return count;
+}
+
+#endif // NGRAM_IMPL
@@ -0,0 +1,416 @@
+#ifndef NORMALIZE_H_
+#define NORMALIZE_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+
+/* Word normalization: lowercase, drop punctuation and whitespace, keep
+ * apostrophes that sit inside a word ("don't"). Non-ASCII text is decoded as
+ * UTF-8, the Latin-1, Latin Extended-A, Greek and Cyrillic capitals get
+ * lowercased and the Unicode punctuation and spaces are dropped, typographic
+ * apostrophes become '\''. Invalid UTF-8 is kept byte for byte. The result is
+ * never longer than the input.
+ *
+ * `normalize_batch` runs over the whole text of a parsed chunk at once. It
+ * lowercases and classifies 16 bytes at a time into bitmaps (SSE2 when
+ * available), plain ASCII words are then cut out of the bitmaps and only
+ * words with non-ASCII bytes take the per code point path.
+ */
+
+#define NORMALIZE_WORD_MAX 256 // Longer words are cut, same as the fixed word buffers everywhere.
+
+typedef struct
+{
+    dck_stretchy_t (u8,  u32) text;    // Normalized words back to back.
+    dck_stretchy_t (u32, u32) offsets; // Word count + 1 offsets into `text`.
+
+    // Scratch space, kept around between chunks.
+    dck_stretchy_t (u8,  u32) folded;
+    dck_stretchy_t (u64, u32) keep_bits, high_bits, quote_bits;
+} normalize_batch_t;
+
+// Normalizes one word into `dst` (at least `size` bytes) and returns its size.
+u32
+normalize_word(const u8 *src, u32 size, u8 *dst);
+
+// Normalizes every word of `chunk`, replacing what the batch held before.
+void
+normalize_batch(normalize_batch_t *batch, const vtt_data_t *data, vtt_chunk_t chunk);
+
+void
+normalize_batch_free(normalize_batch_t *batch);
+
+static inline const u8 *
+normalize_batch_word(const normalize_batch_t *batch, u32 index, u32 *size_o)
+{
+    *size_o = batch->offsets.data[index + 1] - batch->offsets.data[index];
+    return batch->text.data + batch->offsets.data[index];
+}
+
+#endif // NORMALIZE_H_
+
+#if defined(NORMALIZE_IMPL) && !defined(NORMALIZE_IMPL_)
+#define NORMALIZE_IMPL_
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define NORMALIZE_INVALID 0xFFFFFFFF
+
+// Longest word that fits into one unaligned 64 bit read of the bitmaps.
+#define NORMALIZE_FAST_MAX 56
+
+// Decodes the code point at `src`, `NORMALIZE_INVALID` for malformed or truncated sequences.
+static u32
+normalize_decode(const u8 *src, u32 size, u32 *length_o)
+{
+    u8 c = src[0];
+    u32 length, cp;
+
+    if      (c < 0x80)           { *length_o = 1; return c; }
+    else if ((c & 0xE0) == 0xC0) { length = 2; cp = c & 0x1F; }
+    else if ((c & 0xF0) == 0xE0) { length = 3; cp = c & 0x0F; }
+    else if ((c & 0xF8) == 0xF0) { length = 4; cp = c & 0x07; }
+    else                         { *length_o = 1; return NORMALIZE_INVALID; }
+
+    *length_o = 1;
+
+    if (length > size)
+        return NORMALIZE_INVALID;
+
+    for (u32 i = 1; i < length; ++i) {
+        if ((src[i] & 0xC0) != 0x80)
+            return NORMALIZE_INVALID;
+
+        cp = (cp << 6) | (src[i] & 0x3F);
+    }
+
+    static const u32 min_cp[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+    if (cp < min_cp[length] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        return NORMALIZE_INVALID;
+
+    *length_o = length;
+    return cp;
+}
+
+static b32
+normalize_is_apostrophe(u32 cp)
+{
+    return cp == '\'' || cp == 0x2018 || cp == 0x2019 || cp == 0x02BC;
+}
+
+static b32
+normalize_is_word_cp(u32 cp)
+{
+    if (cp < 0x80)
+        return (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z') || (cp >= '0' && cp <= '9');
+
+    if (cp == NORMALIZE_INVALID)
+        return true;
+
+    // Latin-1 punctuation and symbols, except the ordinal indicators and micro sign.
+    if (cp >= 0x80 && cp <= 0xBF)
+        return cp == 0xAA || cp == 0xB5 || cp == 0xBA;
+
+    if (cp == 0xD7 || cp == 0xF7)
+        return false;
+
+    // General punctuation, CJK punctuation, fullwidth ASCII punctuation, byte order mark.
+    if ((cp >= 0x2000 && cp <= 0x206F) || (cp >= 0x3000 && cp <= 0x303F) || cp == 0xFEFF)
+        return false;
+
+    if ((cp >= 0xFF01 && cp <= 0xFF0F) || (cp >= 0xFF1A && cp <= 0xFF20))
+        return false;
+
+    return true;
+}
+
+static u32
+normalize_lower_cp(u32 cp)
+{
+    if (cp >= 'A' && cp <= 'Z')
+        return cp + ('a' - 'A');
+
+    if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7)
+        return cp + 0x20;
+
+    // Latin Extended-A alternates capital and small letters, with the parity flipping twice.
+    if ((cp >= 0x0100 && cp <= 0x0137) || (cp >= 0x014A && cp <= 0x0177))
+        return cp | 1;
+
+    if ((cp >= 0x0139 && cp <= 0x0148) || (cp >= 0x0179 && cp <= 0x017E))
+        return cp & 1 ? cp + 1 : cp;
+
+    if (cp == 0x0178)
+        return 0xFF;
+
+    if (cp >= 0x0391 && cp <= 0x03A9 && cp != 0x03A2)
+        return cp + 0x20;
+
+    if (cp >= 0x0410 && cp <= 0x042F)
+        return cp + 0x20;
+
+    if (cp >= 0x0400 && cp <= 0x040F)
+        return cp + 0x50;
+
+    return cp;
+}
+
+// Only used for lowercased code points, which keep the length of their capitals.
+static u32
+normalize_encode(u32 cp, u8 *dst)
+{
+    if (cp < 0x80) {
+        dst[0] = (u8)cp;
+        return 1;
+    }
+
+    if (cp < 0x800) {
+        dst[0] = (u8)(0xC0 | (cp >> 6));
+        dst[1] = (u8)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+
+    if (cp < 0x10000) {
+        dst[0] = (u8)(0xE0 | (cp >> 12));
+        dst[1] = (u8)(0x80 | ((cp >> 6) & 0x3F));
+        dst[2] = (u8)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+
+    dst[0] = (u8)(0xF0 | (cp >> 18));
+    dst[1] = (u8)(0x80 | ((cp >> 12) & 0x3F));
+    dst[2] = (u8)(0x80 | ((cp >> 6) & 0x3F));
+    dst[3] = (u8)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+u32
+normalize_word(const u8 *src, u32 size, u8 *dst)
+{
+    u32 dst_size = 0;
+    u32 i = 0;
+
+    while (i < size) {
+        u32 length;
+        u32 cp = normalize_decode(src + i, size - i, &length);
+
+        if (cp == NORMALIZE_INVALID) {
+            dst[dst_size++] = src[i];
+        }
+        else if (normalize_is_apostrophe(cp)) {
+            u32 next_length;
+            b32 next_is_word = i + length < size
+                            && normalize_is_word_cp(normalize_decode(src + i + length, size - i - length, &next_length));
+
+            if (dst_size != 0 && next_is_word) {
+                dst[dst_size++] = '\'';
+            }
+        }
+        else if (normalize_is_word_cp(cp)) {
+            dst_size += normalize_encode(normalize_lower_cp(cp), dst + dst_size);
+        }
+
+        i += length;
+    }
+
+    return dst_size;
+}
+
+/* Lowercases 64 bytes into `dst` and returns the bitmaps of the word bytes,
+ * the non-ASCII bytes and the apostrophes. `size` is under 64 only for the
+ * last block of a chunk.
+ */
+static void
+normalize_classify(const u8 *src, u32 size, u8 *dst, u64 *keep_o, u64 *high_o, u64 *quote_o)
+{
+    u64 keep = 0, high = 0, quote = 0;
+    u32 i = 0;
+
+#if defined(__SSE2__)
+    const __m128i upper_lo = _mm_set1_epi8('A' - 1);
+    const __m128i upper_hi = _mm_set1_epi8('Z' + 1);
+    const __m128i lower_lo = _mm_set1_epi8('a' - 1);
+    const __m128i lower_hi = _mm_set1_epi8('z' + 1);
+    const __m128i digit_lo = _mm_set1_epi8('0' - 1);
+    const __m128i digit_hi = _mm_set1_epi8('9' + 1);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i apos     = _mm_set1_epi8('\'');
+
+    // Bytes over 0x7F are negative as signed, so none of the ranges include them.
+    for (; i + 16 <= size; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + i));
+
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, upper_lo), _mm_cmplt_epi8(c, upper_hi));
+        __m128i lower = _mm_or_si128(c, _mm_and_si128(upper, case_bit));
+
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, lower_lo), _mm_cmplt_epi8(lower, lower_hi));
+        __m128i digit  = _mm_and_si128(_mm_cmpgt_epi8(c, digit_lo), _mm_cmplt_epi8(c, digit_hi));
+
+        _mm_storeu_si128((__m128i *)(dst + i), lower);
+
+        keep  |= (u64)(u16)_mm_movemask_epi8(_mm_or_si128(letter, digit)) << i;
+        high  |= (u64)(u16)_mm_movemask_epi8(c) << i;
+        quote |= (u64)(u16)_mm_movemask_epi8(_mm_cmpeq_epi8(c, apos)) << i;
+    }
+#endif
+
+    for (; i < size; ++i) {
+        u8 c = src[i];
+        u8 lower = c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+
+        dst[i] = lower;
+
+        if ((lower >= 'a' && lower <= 'z') || (c >= '0' && c <= '9')) {
+            keep |= 1ull << i;
+        }
+
+        if (c >= 0x80) {
+            high |= 1ull << i;
+        }
+
+        if (c == '\'') {
+            quote |= 1ull << i;
+        }
+    }
+
+    *keep_o  = keep;
+    *high_o  = high;
+    *quote_o = quote;
+}
+
+// Bits `[pos, pos + count)` of a bitmap, `count` is at most `NORMALIZE_FAST_MAX`. Assumes little endian.
+static u64
+normalize_bits(const u64 *bits, u32 pos, u32 count)
+{
+    u64 value;
+    memcpy(&value, (const u8 *)bits + (pos >> 3), sizeof(value));
+
+    return (value >> (pos & 7)) & ((1ull << count) - 1);
+}
+
+void
+normalize_batch(normalize_batch_t *batch, const vtt_data_t *data, vtt_chunk_t chunk)
+{
+    batch->text.count    = 0;
+    batch->offsets.count = 0;
+
+    dck_stretchy_reserve(batch->offsets, chunk.word_count + 1);
+
+    if (chunk.word_count == 0) {
+        batch->offsets.data[batch->offsets.count++] = 0;
+        return;
+    }
+
+    // The parser appends words in order, but don't rely on the text being tight.
+    u32 text_begin = 0xFFFFFFFF, text_end = 0;
+    u32 word_bytes = 0;
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        word_bytes += word.text_size;
+        text_begin = word.text_offset < text_begin ? word.text_offset : text_begin;
+        text_end   = word.text_offset + word.text_size > text_end ? word.text_offset + word.text_size : text_end;
+    }
+
+    u32 text_size  = text_end - text_begin;
+    u32 block_count = (text_size + 63) / 64 + 1; // One spare block for reads across the end.
+
+    batch->folded.count = 0;
+    batch->keep_bits.count = 0;
+    batch->high_bits.count = 0;
+    batch->quote_bits.count = 0;
+
+    dck_stretchy_reserve(batch->folded, block_count * 64);
+    dck_stretchy_reserve(batch->keep_bits, block_count);
+    dck_stretchy_reserve(batch->high_bits, block_count);
+    dck_stretchy_reserve(batch->quote_bits, block_count);
+
+    const u8 *text = data->text.data + text_begin;
+
+    for (u32 b = 0; b < block_count; ++b) {
+        u32 offset = b * 64;
+        u32 size = offset < text_size ? text_size - offset : 0;
+
+        normalize_classify(size ? text + offset : text, size < 64 ? size : 64, batch->folded.data + offset,
+                           batch->keep_bits.data + b, batch->high_bits.data + b, batch->quote_bits.data + b);
+    }
+
+    // Every word shrinks or stays the same size, the slack lets ASCII words get copied in 8 byte steps.
+    dck_stretchy_reserve(batch->text, word_bytes + 64);
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        u32 pos  = word.text_offset - text_begin;
+        u32 size = word.text_size < NORMALIZE_WORD_MAX ? word.text_size : NORMALIZE_WORD_MAX;
+
+        u8 *dst = batch->text.data + batch->text.count;
+
+        batch->offsets.data[batch->offsets.count++] = batch->text.count;
+
+        if (size > NORMALIZE_FAST_MAX || normalize_bits(batch->high_bits.data, pos, size) != 0) {
+            batch->text.count += normalize_word(text + pos, size, dst);
+            continue;
+        }
+
+        u64 keep = normalize_bits(batch->keep_bits.data, pos, size);
+
+        if (keep == 0)
+            continue;
+
+        // Apostrophes count when a word byte came before and one follows right after.
+        u64 first = keep & -keep;
+        u64 quote = normalize_bits(batch->quote_bits.data, pos, size) & (keep >> 1) & ~((first << 1) - 1);
+        u64 out   = keep | quote;
+
+        u32 start = __builtin_ctzll(out);
+        u64 run   = out >> start;
+
+        const u8 *folded = batch->folded.data + pos;
+
+        if ((run & (run + 1)) == 0) {
+            // One contiguous run, the common case of a word with a leading space or trailing comma.
+            u32 length = 64 - __builtin_clzll(run);
+
+            for (u32 k = 0; k < length; k += 8) {
+                memcpy(dst + k, folded + start + k, 8);
+            }
+
+            batch->text.count += length;
+        }
+        else {
+            while (out) {
+                dst[0] = folded[__builtin_ctzll(out)];
+                ++dst;
+                out &= out - 1;
+            }
+
+            batch->text.count = dst - batch->text.data;
+        }
+    }
+
+    batch->offsets.data[batch->offsets.count++] = batch->text.count;
+}
+
+void
+normalize_batch_free(normalize_batch_t *batch)
+{
+    free(batch->text.data);
+    free(batch->offsets.data);
+    free(batch->folded.data);
+    free(batch->keep_bits.data);
+    free(batch->high_bits.data);
+    free(batch->quote_bits.data);
+    *batch = (normalize_batch_t) {0};
+}
+
+#endif // NORMALIZE_IMPL
@@ -0,0 +1,200 @@
+#include <raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define CATALOG_IMPL
+#include "catalog.h"
+
+#define OFFSET_IMPL
+#include "offset.h"
+
+// cc src/offset.c ../raylib/lib/libraylib.a -o offset.exe -I. -I../raylib/include -O2 -lm -ldl -lpthread && ./offset.exe ../oneyplays/witch_hunt_test/audio.ogg ../oneyplays/witch_hunt_test/text.en.vtt
+
+typedef struct
+{
+    offset_envelope_t audio, captions;
+    vtt_data_t        vtt;
+} offset_thread_t;
+
+typedef struct
+{
+    catalog_t        catalog;
+    f32              max_lag;
+    offset_thread_t *threads;
+    char           **reports;
+} offset_batch_t;
+
+static f64
+offset_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static b32
+offset_run(offset_thread_t *thread, const char *audio_path, const char *caption_path, f32 max_lag, offset_result_t *result_o, f64 *estimate_seconds_o)
+{
+    Wave wave = LoadWave(audio_path);
+
+    if (!IsWaveReady(wave) || wave.frameCount == 0) {
+        fprintf(stderr, "Failed to decode '%s'!\n", audio_path);
+        return false;
+    }
+
+    if (wave.sampleSize != 16) {
+        WaveFormat(&wave, wave.sampleRate, 16, wave.channels);
+    }
+
+    offset_audio_envelope(&thread->audio, wave.data, wave.frameCount, wave.channels, wave.sampleRate);
+    UnloadWave(wave);
+
+    thread->vtt.text.count  = 0;
+    thread->vtt.words.count = 0;
+
+    vtt_chunk_t chunk = vtt_parse_file(&thread->vtt, caption_path);
+
+    f64 start = offset_seconds();
+
+    offset_caption_envelope(&thread->captions, &thread->vtt, chunk, thread->audio.count);
+    *result_o = offset_estimate(&thread->audio, &thread->captions, max_lag);
+
+    if (estimate_seconds_o) {
+        *estimate_seconds_o = offset_seconds() - start;
+    }
+
+    return true;
+}
+
+static void
+offset_batch_entry(void *context, u32 thread_index, u32 item)
+{
+    offset_batch_t *batch = context;
+    catalog_entry_t entry = catalog_entry(&batch->catalog, item);
+
+    if (!entry.audio_path)
+        return;
+
+    offset_result_t result;
+
+    if (!offset_run(batch->threads + thread_index, entry.audio_path, entry.caption_path, batch->max_lag, &result, NULL))
+        return;
+
+    char line[CATALOG_PATH_MAX + 64];
+    snprintf(line, sizeof(line), "%+8.3f %6.3f %6.3f %s\n", result.offset, result.correlation, result.margin, entry.caption_path);
+
+    batch->reports[item] = catalog_strdup(line);
+}
+
+static void
+offset_thread_free(offset_thread_t *thread)
+{
+    free(thread->audio.data);
+    free(thread->captions.data);
+    free(thread->vtt.text.data);
+    free(thread->vtt.words.data);
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-l max lag] <audio> <file.vtt>\n", program);
+    fprintf(stderr, "       %s [-l max lag] [-t threads] -c <catalog.cat>\n", program);
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    f32 max_lag = OFFSET_MAX_LAG;
+    u32 thread_count = par_thread_count();
+    const char *catalog_path = NULL;
+
+    i32 arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'l': max_lag      = atof(argv[arg + 1]); break;
+            case 't': thread_count = atoi(argv[arg + 1]); break;
+            case 'c': catalog_path = argv[arg + 1];       break;
+
+            default: {
+                print_usage(argv[0]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (catalog_path) {
+        if (arg != argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        offset_batch_t batch = { .max_lag = max_lag };
+
+        if (!catalog_open(&batch.catalog, catalog_path))
+            return 1;
+
+        if (thread_count == 0) {
+            thread_count = 1;
+        }
+
+        batch.threads = calloc(thread_count, sizeof(offset_thread_t));
+        batch.reports = calloc(batch.catalog.count + 1, sizeof(char *));
+
+        printf("  offset   corr margin caption\n");
+
+        par_for(batch.catalog.count, thread_count, offset_batch_entry, &batch);
+
+        for (u32 i = 0; i < batch.catalog.count; ++i) {
+            if (batch.reports[i]) {
+                fputs(batch.reports[i], stdout);
+                free(batch.reports[i]);
+            }
+        }
+
+        for (u32 t = 0; t < thread_count; ++t) {
+            offset_thread_free(batch.threads + t);
+        }
+
+        free(batch.threads);
+        free(batch.reports);
+        catalog_close(&batch.catalog);
+
+        return 0;
+    }
+
+    if (arg + 2 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    offset_thread_t thread = {0};
+    offset_result_t result;
+    f64 seconds;
+
+    if (!offset_run(&thread, argv[arg], argv[arg + 1], max_lag, &result, &seconds)) {
+        offset_thread_free(&thread);
+        return 1;
+    }
+
+    printf("offset:      %+.3fs (add to the caption times)\n", result.offset);
+    printf("correlation: %.3f\n", result.correlation);
+    printf("margin:      %.3f\n", result.margin);
+    printf("estimated %.1fs of audio in %.1fms\n", thread.audio.count / (f32)OFFSET_RATE, seconds * 1000.0);
+
+    offset_thread_free(&thread);
+
+    return 0;
+}
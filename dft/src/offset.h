@@ -0,0 +1,298 @@
+#ifndef OFFSET_H_
+#define OFFSET_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+
+/* Constant lag between the captions and the audio of a video. Both get
+ * turned into an envelope at `OFFSET_RATE` frames per second, speech
+ * activity (frame energy over the noise floor) for the audio and word
+ * density for the captions, and the lag where the envelopes correlate best
+ * is the offset.
+ *
+ * The correlation of all lags comes from one FFT: the two real envelopes are
+ * packed into one complex signal, split again in the frequency domain and
+ * multiplied, then transformed back. The peak is refined with a parabola
+ * through its neighbours.
+ */
+
+#define OFFSET_RATE        100   // Envelope frames per second.
+#define OFFSET_MAX_LAG     30.0f // Seconds.
+#define OFFSET_SPEECH_DB   10.0f // Over the noise floor counts as speech.
+#define OFFSET_FLOOR_RANK  0.1f  // Quantile of the frame energies taken as the noise floor.
+#define OFFSET_PEAK_GAP    1.0f  // Seconds around the peak skipped when looking for the runner up.
+
+typedef dck_stretchy_t (f32, u32) offset_envelope_t;
+
+typedef struct
+{
+    f32 offset;      // Seconds to add to the caption times.
+    f32 correlation; // Normalized correlation at the peak, -1 to 1.
+    f32 margin;      // 1 - runner up / peak, near zero when the peak isn't unique.
+} offset_result_t;
+
+// Interleaved 16 bit samples.
+void
+offset_audio_envelope(offset_envelope_t *envelope, const i16 *samples, u32 frame_count, u32 channels, u32 sample_rate);
+
+// `frame_count` is the length of the audio envelope, words past it are ignored.
+void
+offset_caption_envelope(offset_envelope_t *envelope, const vtt_data_t *data, vtt_chunk_t chunk, u32 frame_count);
+
+// Lags up to `max_lag` seconds either way.
+offset_result_t
+offset_estimate(const offset_envelope_t *audio, const offset_envelope_t *captions, f32 max_lag);
+
+#endif // OFFSET_H_
+
+#if defined(OFFSET_IMPL) && !defined(OFFSET_IMPL_)
+#define OFFSET_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define FFT_IMPL
+#include "fft.h"
+
+static int
+offset_f32_cmp(const void *a, const void *b)
+{
+    f32 fa = *(const f32 *)a;
+    f32 fb = *(const f32 *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+// Zero mean and unit variance, so the correlation doesn't depend on loudness or talking speed.
+static void
+offset_normalize(f32 *values, u32 count)
+{
+    if (count == 0)
+        return;
+
+    f64 sum = 0.0, sum_sq = 0.0;
+
+    for (u32 i = 0; i < count; ++i) {
+        sum += values[i];
+    }
+
+    f64 mean = sum / count;
+
+    for (u32 i = 0; i < count; ++i) {
+        values[i] -= mean;
+        sum_sq += values[i] * values[i];
+    }
+
+    f64 scale = sum_sq > 0.0 ? 1.0 / sqrt(sum_sq / count) : 0.0;
+
+    for (u32 i = 0; i < count; ++i) {
+        values[i] *= scale;
+    }
+}
+
+void
+offset_audio_envelope(offset_envelope_t *envelope, const i16 *samples, u32 frame_count, u32 channels, u32 sample_rate)
+{
+    u32 hop   = sample_rate / OFFSET_RATE;
+    u32 count = hop ? frame_count / hop : 0;
+
+    envelope->count = 0;
+    dck_stretchy_reserve(*envelope, count);
+    envelope->count = count;
+
+    f32 prev = 0.0f;
+
+    for (u32 f = 0; f < count; ++f) {
+        f32 energy = 0.0f;
+
+        for (u32 i = 0; i < hop; ++i) {
+            const i16 *frame = samples + ((u64)f * hop + i) * channels;
+            f32 mono = 0.0f;
+
+            for (u32 c = 0; c < channels; ++c) {
+                mono += frame[c];
+            }
+
+            mono /= channels * 32768.0f;
+
+            // Pre-emphasis keeps the bass of the music from drowning the voices.
+            f32 x = mono - 0.97f * prev;
+            prev = mono;
+
+            energy += x * x;
+        }
+
+        envelope->data[f] = 10.0f * log10f(energy / hop + 1e-10f);
+    }
+
+    if (count == 0)
+        return;
+
+    f32 *sorted = malloc(count * sizeof(f32));
+
+    if (!sorted) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    memcpy(sorted, envelope->data, count * sizeof(f32));
+    qsort(sorted, count, sizeof(f32), offset_f32_cmp);
+
+    f32 threshold = sorted[(u32)(OFFSET_FLOOR_RANK * (count - 1))] + OFFSET_SPEECH_DB;
+    free(sorted);
+
+    for (u32 f = 0; f < count; ++f) {
+        f32 level = envelope->data[f] - threshold;
+        envelope->data[f] = level > 0.0f ? level : 0.0f;
+    }
+
+    offset_normalize(envelope->data, count);
+}
+
+void
+offset_caption_envelope(offset_envelope_t *envelope, const vtt_data_t *data, vtt_chunk_t chunk, u32 frame_count)
+{
+    envelope->count = 0;
+    dck_stretchy_reserve(*envelope, frame_count);
+    envelope->count = frame_count;
+
+    memset(envelope->data, 0, frame_count * sizeof(f32));
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+        const u8 *text = data->text.data + word.text_offset;
+
+        b32 blank = true;
+
+        for (u32 c = 0; c < word.text_size && blank; ++c) {
+            blank = text[c] == ' ' || text[c] == '\n';
+        }
+
+        if (blank || word.time_start < 0.0f)
+            continue;
+
+        u32 begin = (u32)(word.time_start * OFFSET_RATE);
+        u32 end   = (u32)(word.time_end   * OFFSET_RATE);
+
+        // Auto captions often give words no length.
+        if (end <= begin) {
+            end = begin + 1;
+        }
+
+        for (u32 f = begin; f < end && f < frame_count; ++f) {
+            envelope->data[f] += 1.0f;
+        }
+    }
+
+    offset_normalize(envelope->data, frame_count);
+}
+
+offset_result_t
+offset_estimate(const offset_envelope_t *audio, const offset_envelope_t *captions, f32 max_lag)
+{
+    offset_result_t result = {0};
+
+    u32 length  = audio->count > captions->count ? audio->count : captions->count;
+    u32 max_off = (u32)(max_lag * OFFSET_RATE);
+
+    if (length == 0)
+        return result;
+
+    // Long enough that the lags we look at don't wrap around.
+    u32 size = 1;
+
+    while (size < length + max_off + 1) {
+        size *= 2;
+    }
+
+    fft_plan_t plan;
+    fft_plan_init(&plan, size);
+
+    cn_t *data    = calloc(size, sizeof(cn_t));
+    cn_t *scratch = malloc(size * sizeof(cn_t));
+
+    if (!data || !scratch) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    // Audio as the real part, captions as the imaginary one.
+    for (u32 i = 0; i < audio->count; ++i) {
+        data[i].r = audio->data[i];
+    }
+
+    for (u32 i = 0; i < captions->count; ++i) {
+        data[i].i = captions->data[i];
+    }
+
+    fft_forward(&plan, data, scratch);
+
+    // With Z = A + iB for real a and b: A[k] = (Z[k] + Z*[-k]) / 2, B[k] = (Z[k] - Z*[-k]) / 2i.
+    // The cross spectrum A B* goes into `scratch`, conjugated so a forward FFT inverts it.
+    for (u32 k = 0; k < size; ++k) {
+        cn_t z  = data[k];
+        cn_t zn = data[(size - k) & (size - 1)];
+
+        cn_t a = { .r = 0.5f * (z.r + zn.r), .i = 0.5f * (z.i - zn.i) };
+        cn_t b = { .r = 0.5f * (z.i + zn.i), .i = 0.5f * (zn.r - z.r) };
+
+        cn_t cross = {
+            .r = a.r * b.r + a.i * b.i,
+            .i = a.i * b.r - a.r * b.i,
+        };
+
+        scratch[k] = (cn_t) { .r = cross.r, .i = -cross.i };
+    }
+
+    fft_forward(&plan, scratch, data);
+
+    // `scratch[k]` is now the correlation at lag k (negative lags wrapped to the end), times `size`.
+    u32 overlap = audio->count < captions->count ? audio->count : captions->count;
+    f32 scale = 1.0f / ((f32)size * (overlap ? overlap : 1));
+
+    i32 best_lag = 0;
+    f32 best = -INFINITY;
+
+    for (i32 lag = -(i32)max_off; lag <= (i32)max_off; ++lag) {
+        f32 value = scratch[(u32)lag & (size - 1)].r * scale;
+
+        if (value > best) {
+            best = value;
+            best_lag = lag;
+        }
+    }
+
+    i32 gap = (i32)(OFFSET_PEAK_GAP * OFFSET_RATE);
+    f32 runner_up = -INFINITY;
+
+    for (i32 lag = -(i32)max_off; lag <= (i32)max_off; ++lag) {
+        if (lag > best_lag - gap && lag < best_lag + gap)
+            continue;
+
+        f32 value = scratch[(u32)lag & (size - 1)].r * scale;
+
+        if (value > runner_up) {
+            runner_up = value;
+        }
+    }
+
+    f32 y0 = scratch[(u32)(best_lag - 1) & (size - 1)].r * scale;
+    f32 y2 = scratch[(u32)(best_lag + 1) & (size - 1)].r * scale;
+    f32 denom = y0 - 2.0f * best + y2;
+    f32 refine = denom < 0.0f ? 0.5f * (y0 - y2) / denom : 0.0f;
+
+    result.offset      = (best_lag + refine) / OFFSET_RATE;
+    result.correlation = best;
+    result.margin      = best > 0.0f && runner_up > -INFINITY ? 1.0f - (runner_up > 0.0f ? runner_up : 0.0f) / best : 0.0f;
+
+    free(data);
+    free(scratch);
+    fft_plan_free(&plan);
+
+    return result;
+}
+
+#endif // OFFSET_IMPL
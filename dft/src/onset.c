@@ -0,0 +1,244 @@
+#include <raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define CATALOG_IMPL
+#include "catalog.h"
+
+#define OFFSET_IMPL
+#include "offset.h"
+
+#define ONSET_IMPL
+#include "onset.h"
+
+// cc src/onset.c ../raylib/lib/libraylib.a -o onset.exe -I. -I../raylib/include -O2 -lm -ldl -lpthread && ./onset.exe ../oneyplays/witch_hunt_test/audio.ogg ../oneyplays/witch_hunt_test/text.en.vtt
+
+// Estimated offsets whose correlation peak doesn't stand out by this much are ignored, the captions keep their times.
+#define ONSET_OFFSET_MARGIN 0.1f
+
+typedef dck_stretchy_t (f32, u32) onset_starts_t;
+
+typedef struct
+{
+    vtt_data_t        vtt;
+    onset_starts_t    starts;
+    offset_envelope_t audio, captions;
+    u8               *block;
+} onset_thread_t;
+
+typedef struct
+{
+    catalog_t       catalog;
+    onset_thread_t *threads;
+    char          **reports;
+} onset_batch_t;
+
+static f64
+onset_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// With `estimate` set, `*offset` is estimated from the audio instead of given.
+static b32
+onset_run(onset_thread_t *thread, const char *audio_path, const char *caption_path, u64 caption_hash, f32 *offset,
+          b32 estimate, onset_stats_t *stats_o, u32 *word_count_o, f64 *refine_seconds_o)
+{
+    Wave wave = LoadWave(audio_path);
+
+    if (!IsWaveReady(wave) || wave.frameCount == 0) {
+        fprintf(stderr, "Failed to decode '%s'!\n", audio_path);
+        return false;
+    }
+
+    if (wave.sampleSize != 16) {
+        WaveFormat(&wave, wave.sampleRate, 16, wave.channels);
+    }
+
+    thread->vtt.text.count  = 0;
+    thread->vtt.words.count = 0;
+
+    vtt_chunk_t chunk = vtt_parse_file(&thread->vtt, caption_path);
+
+    thread->starts.count = 0;
+    dck_stretchy_reserve(thread->starts, chunk.word_count);
+    thread->starts.count = chunk.word_count;
+
+    if (estimate) {
+        offset_audio_envelope(&thread->audio, wave.data, wave.frameCount, wave.channels, wave.sampleRate);
+        offset_caption_envelope(&thread->captions, &thread->vtt, chunk, thread->audio.count);
+
+        offset_result_t result = offset_estimate(&thread->audio, &thread->captions, OFFSET_MAX_LAG);
+        *offset = result.margin >= ONSET_OFFSET_MARGIN ? result.offset : 0.0f;
+    }
+
+    f64 start = onset_seconds();
+
+    onset_refine(wave.data, wave.frameCount, wave.channels, wave.sampleRate,
+                 &thread->vtt, chunk, *offset, thread->starts.data, stats_o);
+
+    if (refine_seconds_o) {
+        *refine_seconds_o = onset_seconds() - start;
+    }
+
+    UnloadWave(wave);
+
+    char path[CATALOG_PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", caption_path, ONSET_SUFFIX);
+
+    *word_count_o = chunk.word_count;
+
+    return onset_write(path, thread->starts.data, chunk.word_count, caption_hash);
+}
+
+static void
+onset_batch_entry(void *context, u32 thread_index, u32 item)
+{
+    onset_batch_t *batch = context;
+    catalog_entry_t entry = catalog_entry(&batch->catalog, item);
+
+    if (!entry.audio_path)
+        return;
+
+    onset_stats_t stats;
+    u32 word_count;
+    f32 offset;
+
+    if (!onset_run(batch->threads + thread_index, entry.audio_path, entry.caption_path, entry.caption_hash, &offset, true,
+                   &stats, &word_count, NULL))
+        return;
+
+    char line[CATALOG_PATH_MAX + 64];
+    snprintf(line, sizeof(line), "%+8.3f %8u %8u %+8.1f %5.1f%% %s\n", offset, word_count, stats.moved,
+             stats.moved ? stats.shift_sum * 1000.0 / stats.moved : 0.0,
+             stats.all_frames ? stats.frames * 100.0 / stats.all_frames : 0.0, entry.caption_path);
+
+    batch->reports[item] = catalog_strdup(line);
+}
+
+static void
+onset_thread_free(onset_thread_t *thread)
+{
+    free(thread->vtt.text.data);
+    free(thread->vtt.words.data);
+    free(thread->starts.data);
+    free(thread->audio.data);
+    free(thread->captions.data);
+    free(thread->block);
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-o offset] <audio> <file.vtt>\n", program);
+    fprintf(stderr, "       %s [-t threads] -c <catalog.cat>\n", program);
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    f32 offset = 0.0f;
+    u32 thread_count = par_thread_count();
+    const char *catalog_path = NULL;
+
+    i32 arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'o': offset       = atof(argv[arg + 1]); break;
+            case 't': thread_count = atoi(argv[arg + 1]); break;
+            case 'c': catalog_path = argv[arg + 1];       break;
+
+            default: {
+                print_usage(argv[0]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (catalog_path) {
+        if (arg != argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        onset_batch_t batch = {0};
+
+        if (!catalog_open(&batch.catalog, catalog_path))
+            return 1;
+
+        if (thread_count == 0) {
+            thread_count = 1;
+        }
+
+        batch.threads = calloc(thread_count, sizeof(onset_thread_t));
+        batch.reports = calloc(batch.catalog.count + 1, sizeof(char *));
+
+        printf("  offset    words    moved  mean ms frames caption\n");
+
+        par_for(batch.catalog.count, thread_count, onset_batch_entry, &batch);
+
+        for (u32 i = 0; i < batch.catalog.count; ++i) {
+            if (batch.reports[i]) {
+                fputs(batch.reports[i], stdout);
+                free(batch.reports[i]);
+            }
+        }
+
+        for (u32 t = 0; t < thread_count; ++t) {
+            onset_thread_free(batch.threads + t);
+        }
+
+        free(batch.threads);
+        free(batch.reports);
+        catalog_close(&batch.catalog);
+
+        return 0;
+    }
+
+    if (arg + 2 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    onset_thread_t thread = {0};
+    thread.block = malloc(CATALOG_HASH_BLOCK);
+
+    if (!thread.block) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    onset_stats_t stats;
+    u32 word_count;
+    f64 seconds;
+
+    u64 caption_hash = catalog_hash_file(argv[arg + 1], thread.block);
+
+    if (!onset_run(&thread, argv[arg], argv[arg + 1], caption_hash, &offset, false, &stats, &word_count, &seconds)) {
+        onset_thread_free(&thread);
+        return 1;
+    }
+
+    printf("words:  %u, %u moved by %+.1fms on average\n", word_count, stats.moved,
+           stats.moved ? stats.shift_sum * 1000.0 / stats.moved : 0.0);
+    printf("frames: %u of %u transformed\n", stats.frames, stats.all_frames);
+    printf("refined in %.1fms, written to %s%s\n", seconds * 1000.0, argv[arg + 1], ONSET_SUFFIX);
+
+    onset_thread_free(&thread);
+
+    return 0;
+}
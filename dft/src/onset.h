@@ -0,0 +1,395 @@
+#ifndef ONSET_H_
+#define ONSET_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+
+/* Snaps caption word starts to onsets in the audio. The audio gets a
+ * spectral flux curve (how much the log magnitude spectrum rose since the
+ * previous frame) at `ONSET_HOP` resolution, but only around word starts:
+ * the frames within the search window of any word are marked first and every
+ * marked frame is transformed once, however many words share it. Two frames
+ * go through one complex FFT, one as the real and one as the imaginary part.
+ *
+ * A word start moves to the flux peak closest to it within
+ * `[start - ONSET_BEFORE, start + ONSET_AFTER]`, auto captions tend to be
+ * late so the window reaches further back. Peaks later than the caption
+ * cost double. Words without a peak keep their time (blank ones always do),
+ * and refined starts never go before the previous word's refined start or
+ * past the word's end.
+ *
+ * Refined times are stored in a sidecar file next to the caption file.
+ */
+
+#define ONSET_HOP          0.005f // Seconds.
+#define ONSET_FRAME        0.025f // Seconds, rounded up to a power of two in samples.
+#define ONSET_BEFORE       0.15f
+#define ONSET_AFTER        0.05f
+#define ONSET_THRESHOLD    1.0f   // Standard deviations over the mean flux for a peak.
+#define ONSET_COMPRESSION  100.0f // `log(1 + c |X|)`.
+
+#define ONSET_SUFFIX ".onset" // Appended to the caption path.
+
+#define ONSET_MAGIC   0x31534E4F // "ONS1"
+#define ONSET_VERSION 1
+
+typedef struct
+{
+    u32 moved;      // Words that got snapped to an onset.
+    u32 frames;     // Frames transformed.
+    u32 all_frames; // Frames of the whole audio.
+    f64 shift_sum;  // Sum of the moves, seconds.
+} onset_stats_t;
+
+typedef struct
+{
+    u32 magic, version;
+    u32 word_count;
+    u32 reserved;
+    u64 caption_hash;
+} onset_header_t;
+
+// Refined start of every word of the chunk into `starts_o`, `offset` is added to the caption times first.
+void
+onset_refine(const i16 *samples, u32 frame_count, u32 channels, u32 sample_rate,
+             const vtt_data_t *data, vtt_chunk_t chunk, f32 offset, f32 *starts_o, onset_stats_t *stats_o);
+
+b32
+onset_write(const char *path, const f32 *starts, u32 word_count, u64 caption_hash);
+
+// False when the file is missing or doesn't belong to these captions.
+b32
+onset_read(const char *path, f32 *starts_o, u32 word_count, u64 caption_hash);
+
+#endif // ONSET_H_
+
+#if defined(ONSET_IMPL) && !defined(ONSET_IMPL_)
+#define ONSET_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#define FFT_IMPL
+#include "fft.h"
+
+typedef struct
+{
+    u32 hop, size, bins;
+    u32 frame_count;
+
+    const i16 *samples;
+    u32        sample_count, channels;
+
+    const f32 *window;
+    fft_plan_t plan;
+    cn_t      *data, *scratch;
+} onset_stft_t;
+
+static void
+onset_load_frame(const onset_stft_t *stft, u32 frame, b32 imaginary)
+{
+    u64 first = (u64)frame * stft->hop;
+
+    for (u32 i = 0; i < stft->size; ++i) {
+        u64 s = first + i;
+        f32 mono = 0.0f;
+
+        if (s < stft->sample_count) {
+            for (u32 c = 0; c < stft->channels; ++c) {
+                mono += stft->samples[s * stft->channels + c];
+            }
+
+            mono *= stft->window[i] / (stft->channels * 32768.0f);
+        }
+
+        if (imaginary) {
+            stft->data[i].i = mono;
+        }
+        else {
+            stft->data[i] = (cn_t) { .r = mono };
+        }
+    }
+}
+
+// Compressed magnitudes of the frames packed into `data`, the second one only when `mags_b` is given.
+static void
+onset_split(const onset_stft_t *stft, f32 *mags_a, f32 *mags_b)
+{
+    for (u32 k = 0; k < stft->bins; ++k) {
+        cn_t z  = stft->data[k];
+        cn_t zn = stft->data[(stft->size - k) & (stft->size - 1)];
+
+        f32 ar = 0.5f * (z.r + zn.r), ai = 0.5f * (z.i - zn.i);
+        mags_a[k] = logf(1.0f + ONSET_COMPRESSION * sqrtf(ar * ar + ai * ai));
+
+        if (mags_b) {
+            f32 br = 0.5f * (z.i + zn.i), bi = 0.5f * (zn.r - z.r);
+            mags_b[k] = logf(1.0f + ONSET_COMPRESSION * sqrtf(br * br + bi * bi));
+        }
+    }
+}
+
+static f32
+onset_flux(const f32 *prev, const f32 *mags, u32 bins)
+{
+    f32 flux = 0.0f;
+
+    for (u32 k = 0; k < bins; ++k) {
+        f32 rise = mags[k] - prev[k];
+        flux += rise > 0.0f ? rise : 0.0f;
+    }
+
+    return flux;
+}
+
+void
+onset_refine(const i16 *samples, u32 frame_count, u32 channels, u32 sample_rate,
+             const vtt_data_t *data, vtt_chunk_t chunk, f32 offset, f32 *starts_o, onset_stats_t *stats_o)
+{
+    onset_stft_t stft = {
+        .hop          = (u32)(sample_rate * ONSET_HOP),
+        .size         = 1,
+        .samples      = samples,
+        .sample_count = frame_count,
+        .channels     = channels,
+    };
+
+    while (stft.size < sample_rate * ONSET_FRAME) {
+        stft.size *= 2;
+    }
+
+    stft.hop         = stft.hop ? stft.hop : 1;
+    stft.bins        = stft.size / 2 + 1;
+    stft.frame_count = frame_count / stft.hop + 1;
+
+    onset_stats_t stats = { .all_frames = stft.frame_count };
+
+    // Frame times are their centers.
+    f32 frame_seconds  = stft.hop / (f32)sample_rate;
+    f32 center_seconds = stft.size * 0.5f / sample_rate;
+
+    u8  *needed = calloc(stft.frame_count + 1, 1);
+    f32 *flux   = calloc(stft.frame_count + 1, sizeof(f32));
+    f32 *window = malloc(stft.size * sizeof(f32));
+    f32 *mags   = malloc(stft.bins * 3 * sizeof(f32));
+
+    stft.data    = malloc(stft.size * sizeof(cn_t));
+    stft.scratch = malloc(stft.size * sizeof(cn_t));
+
+    if (!needed || !flux || !window || !mags || !stft.data || !stft.scratch) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < stft.size; ++i) {
+        window[i] = 0.5f - 0.5f * cosf(2.0f * M_PI * i / stft.size);
+    }
+
+    stft.window = window;
+    fft_plan_init(&stft.plan, stft.size);
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        f32 start = word.time_start + offset;
+        starts_o[i] = start;
+
+        if (vtt_word_blank(data, word))
+            continue;
+
+        f32 first = (start - ONSET_BEFORE - center_seconds) / frame_seconds;
+        f32 last  = (start + ONSET_AFTER  - center_seconds) / frame_seconds;
+
+        // One frame earlier for the flux, one later to tell peaks.
+        i64 begin = (i64)floorf(first) - 1;
+        i64 end   = (i64)ceilf(last) + 1;
+
+        for (i64 f = begin > 0 ? begin : 0; f <= end && f < stft.frame_count; ++f) {
+            needed[f] = 1;
+        }
+    }
+
+    // Runs of needed frames, two frames per FFT.
+    f32 *prev = mags, *cur_a = mags + stft.bins, *cur_b = mags + stft.bins * 2;
+    b32 has_prev = false;
+
+    for (u32 f = 0; f < stft.frame_count;) {
+        if (!needed[f]) {
+            has_prev = false;
+            ++f;
+            continue;
+        }
+
+        b32 pair = f + 1 < stft.frame_count && needed[f + 1];
+
+        onset_load_frame(&stft, f, false);
+
+        if (pair) {
+            onset_load_frame(&stft, f + 1, true);
+        }
+
+        fft_forward(&stft.plan, stft.data, stft.scratch);
+        onset_split(&stft, cur_a, pair ? cur_b : NULL);
+
+        stats.frames += pair ? 2 : 1;
+
+        flux[f] = has_prev ? onset_flux(prev, cur_a, stft.bins) : 0.0f;
+
+        if (pair) {
+            flux[f + 1] = onset_flux(cur_a, cur_b, stft.bins);
+
+            f32 *tmp = prev;
+            prev  = cur_b;
+            cur_b = tmp;
+        }
+        else {
+            f32 *tmp = prev;
+            prev  = cur_a;
+            cur_a = tmp;
+        }
+
+        has_prev = true;
+        f += pair ? 2 : 1;
+    }
+
+    f64 sum = 0.0, sum_sq = 0.0;
+
+    for (u32 f = 0; f < stft.frame_count; ++f) {
+        if (needed[f]) {
+            sum    += flux[f];
+            sum_sq += flux[f] * flux[f];
+        }
+    }
+
+    f64 mean = stats.frames ? sum / stats.frames : 0.0;
+    f64 var  = stats.frames ? sum_sq / stats.frames - mean * mean : 0.0;
+    f32 threshold = (f32)(mean + ONSET_THRESHOLD * sqrt(var > 0.0 ? var : 0.0));
+
+    f32 floor_time = 0.0f;
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        f32 start = starts_o[i];
+
+        if (vtt_word_blank(data, word))
+            continue;
+
+        f32 first = (start - ONSET_BEFORE - center_seconds) / frame_seconds;
+        f32 last  = (start + ONSET_AFTER  - center_seconds) / frame_seconds;
+
+        i64 begin = (i64)ceilf(first);
+        i64 end   = (i64)floorf(last);
+
+        f32 best_time = start;
+        f32 best_cost = INFINITY;
+
+        for (i64 f = begin > 1 ? begin : 1; f <= end && f + 1 < stft.frame_count; ++f) {
+            f32 value = flux[f];
+
+            if (value < threshold || value < flux[f - 1] || value <= flux[f + 1])
+                continue;
+
+            f32 time = f * frame_seconds + center_seconds;
+            f32 cost = time > start ? (time - start) * 2.0f : start - time;
+
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_time = time;
+            }
+        }
+
+        f32 end_time = word.time_end + offset;
+
+        if (best_time < floor_time) {
+            best_time = floor_time;
+        }
+
+        if (end_time > start && best_time > end_time) {
+            best_time = end_time;
+        }
+
+        if (best_time != start) {
+            stats.moved++;
+            stats.shift_sum += best_time - start;
+        }
+
+        starts_o[i] = best_time;
+        floor_time  = best_time;
+    }
+
+    fft_plan_free(&stft.plan);
+
+    free(needed);
+    free(flux);
+    free(window);
+    free(mags);
+    free(stft.data);
+    free(stft.scratch);
+
+    if (stats_o) {
+        *stats_o = stats;
+    }
+}
+
+b32
+onset_write(const char *path, const f32 *starts, u32 word_count, u64 caption_hash)
+{
+    onset_header_t header = {
+        .magic        = ONSET_MAGIC,
+        .version      = ONSET_VERSION,
+        .word_count   = word_count,
+        .caption_hash = caption_hash,
+    };
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    b32 ok = false;
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1
+          && (word_count == 0 || fwrite(starts, sizeof(f32), word_count, file) == word_count);
+
+        if (fclose(file) != 0) {
+            ok = false;
+        }
+
+        if (ok && rename(tmp_path, path) != 0) {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write onsets '%s': %s\n", path, strerror(errno));
+        remove(tmp_path);
+    }
+
+    return ok;
+}
+
+b32
+onset_read(const char *path, f32 *starts_o, u32 word_count, u64 caption_hash)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    onset_header_t header;
+
+    b32 ok = fread(&header, sizeof(header), 1, file) == 1
+          && header.magic == ONSET_MAGIC && header.version == ONSET_VERSION
+          && header.word_count == word_count && header.caption_hash == caption_hash
+          && (word_count == 0 || fread(starts_o, sizeof(f32), word_count, file) == word_count);
+
+    fclose(file);
+    return ok;
+}
+
+#endif // ONSET_IMPL
@@ -0,0 +1,113 @@
+#ifndef PAR_H_
+#define PAR_H_
+
+#include "core/utils.h"
+
+/* Minimal parallel for. Items are handed out one at a time from a shared
+ * counter, so uneven items (files of very different length) balance on their own.
+ */
+
+typedef void (*par_fn_t)(void *context, u32 thread, u32 item);
+
+// Number of online cores, at least one.
+u32
+par_thread_count(void);
+
+// Calls `fn` for every item in `[0, item_count)`, the calling thread works as thread 0.
+void
+par_for(u32 item_count, u32 thread_count, par_fn_t fn, void *context);
+
+#endif // PAR_H_
+
+#if defined(PAR_IMPL) && !defined(PAR_IMPL_)
+#define PAR_IMPL_
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+typedef struct
+{
+    par_fn_t    fn;
+    void       *context;
+    u32         item_count;
+    atomic_uint next;
+} par_job_t;
+
+typedef struct
+{
+    par_job_t *job;
+    u32        thread;
+} par_worker_t;
+
+static void *
+par_worker_main(void *arg)
+{
+    par_worker_t *worker = arg;
+    par_job_t *job = worker->job;
+
+    for (;;) {
+        u32 item = atomic_fetch_add(&job->next, 1);
+        if (item >= job->item_count)
+            break;
+
+        job->fn(job->context, worker->thread, item);
+    }
+
+    return NULL;
+}
+
+u32
+par_thread_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+void
+par_for(u32 item_count, u32 thread_count, par_fn_t fn, void *context)
+{
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    if (thread_count > item_count) {
+        thread_count = item_count ? item_count : 1;
+    }
+
+    par_job_t job = {
+        .fn         = fn,
+        .context    = context,
+        .item_count = item_count,
+    };
+
+    atomic_init(&job.next, 0);
+
+    pthread_t    *threads = malloc(thread_count * sizeof(pthread_t));
+    par_worker_t *workers = malloc(thread_count * sizeof(par_worker_t));
+    b32          *started = calloc(thread_count, sizeof(b32));
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        workers[t] = (par_worker_t) { .job = &job, .thread = t };
+    }
+
+    // A thread that fails to start just leaves its share to the others.
+    for (u32 t = 1; t < thread_count; ++t) {
+        started[t] = pthread_create(threads + t, NULL, par_worker_main, workers + t) == 0;
+    }
+
+    par_worker_main(workers + 0);
+
+    for (u32 t = 1; t < thread_count; ++t) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+
+    free(threads);
+    free(workers);
+    free(started);
+}
+
+#endif // PAR_IMPL
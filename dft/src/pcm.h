@@ -0,0 +1,64 @@
+#ifndef PCM_H_
+#define PCM_H_
+
+#include "core/utils.h"
+
+/* Conversions of 16 bit PCM, which is signed, for the float paths. Stereo
+ * gets mixed down as it's converted, so the float copy is half the size of
+ * the PCM instead of twice.
+ */
+
+// Mono mix of interleaved frames of `channels` samples, in `[-1, 1)`.
+void
+pcm_downmix(const i16 *frames, u32 frame_count, u32 channels, f32 *mono);
+
+#endif // PCM_H_
+
+#if defined(PCM_IMPL) && !defined(PCM_IMPL_)
+#define PCM_IMPL_
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void
+pcm_downmix(const i16 *frames, u32 frame_count, u32 channels, f32 *mono)
+{
+    u32 i = 0;
+
+    if (channels == 2) {
+#if defined(__SSE2__)
+        // `madd` with ones adds up the left and right samples of four frames into 32 bits.
+        const __m128i ones  = _mm_set1_epi16(1);
+        const __m128  scale = _mm_set1_ps(1.0f / 65536.0f);
+
+        for (; i + 8 <= frame_count; i += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(frames + i * 2));
+            __m128i b = _mm_loadu_si128((const __m128i *)(frames + i * 2 + 8));
+
+            _mm_storeu_ps(mono + i,     _mm_mul_ps(_mm_cvtepi32_ps(_mm_madd_epi16(a, ones)), scale));
+            _mm_storeu_ps(mono + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_madd_epi16(b, ones)), scale));
+        }
+#endif
+
+        for (; i < frame_count; ++i) {
+            mono[i] = (frames[i * 2] + frames[i * 2 + 1]) / 65536.0f;
+        }
+
+        return;
+    }
+
+    f32 scale = 1.0f / (32768.0f * channels);
+
+    for (; i < frame_count; ++i) {
+        i32 sum = 0;
+
+        for (u32 c = 0; c < channels; ++c) {
+            sum += frames[(u64)i * channels + c];
+        }
+
+        mono[i] = sum * scale;
+    }
+}
+
+#endif // PCM_IMPL
@@ -0,0 +1,542 @@
+#ifndef PHONETIC_H_
+#define PHONETIC_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vocab.h"
+
+/* Double-Metaphone-style phonetic keys. Every word gets a primary and an
+ * alternate key of at most `PHONETIC_KEY_LENGTH` letters, the letters are
+ * packed into a u32 in order, first letter in the lowest byte.
+ * A zero key means the word has nothing to encode (numbers and such).
+ */
+#define PHONETIC_KEY_LENGTH 4
+
+typedef struct
+{
+    u32 primary, alternate;
+} phonetic_key_t;
+
+typedef struct
+{
+    u32 key;
+    u32 offset, count;
+} phonetic_slot_t;
+
+// Key -> word ids over a vocabulary, only the distinct words get encoded.
+typedef struct
+{
+    phonetic_slot_t *slots; // Open addressing, empty slots have a zero key.
+    u32              slot_mask;
+
+    dck_stretchy_t (u32, u32) word_ids; // Sorted by id within every key.
+} phonetic_index_t;
+
+phonetic_key_t
+phonetic_encode(const u8 *text, u32 size);
+
+void
+phonetic_index_build(phonetic_index_t *index, const vocab_t *vocab);
+
+void
+phonetic_index_free(phonetic_index_t *index);
+
+const u32 *
+phonetic_index_lookup(const phonetic_index_t *index, u32 key, u32 *count_o);
+
+/* Writes the ids of all the words that share a key with `text` into `ids_o`,
+ * at most `max_ids` of them, sorted and without duplicates.
+ * Returns the number of written ids.
+ */
+u32
+phonetic_expand(const phonetic_index_t *index, const u8 *text, u32 size, u32 *ids_o, u32 max_ids);
+
+#endif // PHONETIC_H_
+
+#if defined(PHONETIC_IMPL) && !defined(PHONETIC_IMPL_)
+#define PHONETIC_IMPL_
+
+#include <string.h>
+
+#include "hash.h"
+
+#define PHONETIC_MAX_WORD 64
+
+typedef struct
+{
+    char word[PHONETIC_MAX_WORD + 8]; // Upper case, zero padded so that look ahead never runs off.
+    i32  size;
+
+    char primary[PHONETIC_KEY_LENGTH];
+    char alternate[PHONETIC_KEY_LENGTH];
+    u32  primary_size, alternate_size;
+} phonetic_coder_t;
+
+static char
+phonetic_at(const phonetic_coder_t *coder, i32 pos)
+{
+    if (pos < 0 || pos >= coder->size)
+        return 0;
+
+    return coder->word[pos];
+}
+
+static b32
+phonetic_is_vowel(char c)
+{
+    return c == 'A' || c == 'E' || c == 'I' || c == 'O' || c == 'U' || c == 'Y';
+}
+
+static b32
+phonetic_match(const phonetic_coder_t *coder, i32 pos, const char *str)
+{
+    if (pos < 0)
+        return false;
+
+    for (i32 i = 0; str[i] != 0; ++i) {
+        if (phonetic_at(coder, pos + i) != str[i])
+            return false;
+    }
+
+    return true;
+}
+
+static void
+phonetic_add(phonetic_coder_t *coder, const char *primary, const char *alternate)
+{
+    for (u32 i = 0; primary[i] != 0 && coder->primary_size < PHONETIC_KEY_LENGTH; ++i) {
+        coder->primary[coder->primary_size++] = primary[i];
+    }
+
+    for (u32 i = 0; alternate[i] != 0 && coder->alternate_size < PHONETIC_KEY_LENGTH; ++i) {
+        coder->alternate[coder->alternate_size++] = alternate[i];
+    }
+}
+
+static u32
+phonetic_pack(const char *key, u32 size)
+{
+    u32 res = 0;
+
+    for (u32 i = 0; i < size; ++i) {
+        res |= (u32)(u8)key[i] << (i * 8);
+    }
+
+    return res;
+}
+
+phonetic_key_t
+phonetic_encode(const u8 *text, u32 size)
+{
+    phonetic_coder_t coder = {0};
+
+    for (u32 i = 0; i < size && coder.size < PHONETIC_MAX_WORD; ++i) {
+        u8 c = text[i];
+
+        if (c >= 'a' && c <= 'z') {
+            coder.word[coder.size++] = c - ('a' - 'A');
+        }
+        else if (c >= 'A' && c <= 'Z') {
+            coder.word[coder.size++] = c;
+        }
+    }
+
+    i32 pos = 0;
+
+    if (phonetic_match(&coder, 0, "GN") || phonetic_match(&coder, 0, "KN")
+     || phonetic_match(&coder, 0, "PN") || phonetic_match(&coder, 0, "WR")
+     || phonetic_match(&coder, 0, "PS")) {
+        pos = 1;
+    }
+
+    if (phonetic_at(&coder, 0) == 'X') {
+        phonetic_add(&coder, "S", "S");
+        pos = 1;
+    }
+
+    while (pos < coder.size
+        && (coder.primary_size < PHONETIC_KEY_LENGTH || coder.alternate_size < PHONETIC_KEY_LENGTH)) {
+        char c    = phonetic_at(&coder, pos);
+        char prev = phonetic_at(&coder, pos - 1);
+        char next = phonetic_at(&coder, pos + 1);
+
+        switch (c) {
+            case 'A': case 'E': case 'I': case 'O': case 'U': case 'Y': {
+                if (pos == 0) {
+                    phonetic_add(&coder, "A", "A");
+                }
+                pos += 1;
+            } break;
+
+            case 'B': {
+                phonetic_add(&coder, "P", "P");
+                pos += next == 'B' ? 2 : 1;
+            } break;
+
+            case 'C': {
+                if (phonetic_match(&coder, pos, "CHR") || phonetic_match(&coder, pos, "CHL")) {
+                    phonetic_add(&coder, "K", "K");
+                    pos += 2;
+                }
+                else if (next == 'H') {
+                    if (pos == 0) {
+                        phonetic_add(&coder, "X", "K");
+                    }
+                    else {
+                        phonetic_add(&coder, "X", "X");
+                    }
+                    pos += 2;
+                }
+                else if (phonetic_match(&coder, pos, "CIA")) {
+                    phonetic_add(&coder, "X", "X");
+                    pos += 3;
+                }
+                else if (phonetic_match(&coder, pos, "CC")
+                      && (phonetic_at(&coder, pos + 2) == 'I' || phonetic_at(&coder, pos + 2) == 'E')) {
+                    phonetic_add(&coder, "KS", "KS");
+                    pos += 3;
+                }
+                else if (next == 'I' || next == 'E' || next == 'Y') {
+                    phonetic_add(&coder, "S", "S");
+                    pos += 2;
+                }
+                else {
+                    phonetic_add(&coder, "K", "K");
+                    pos += (next == 'C' || next == 'K' || next == 'Q') ? 2 : 1;
+                }
+            } break;
+
+            case 'D': {
+                char after = phonetic_at(&coder, pos + 2);
+
+                if (next == 'G' && (after == 'I' || after == 'E' || after == 'Y')) {
+                    phonetic_add(&coder, "J", "J");
+                    pos += 3;
+                }
+                else {
+                    phonetic_add(&coder, "T", "T");
+                    pos += (next == 'T' || next == 'D') ? 2 : 1;
+                }
+            } break;
+
+            case 'F': case 'K': case 'L': case 'M': case 'N': case 'R': {
+                char code[2] = { c, 0 };
+                phonetic_add(&coder, code, code);
+                pos += next == c ? 2 : 1;
+            } break;
+
+            case 'G': {
+                if (next == 'H') {
+                    if (pos == 0 || !phonetic_is_vowel(prev)) {
+                        phonetic_add(&coder, "K", "K");
+                    }
+                    else if (prev == 'U' && (phonetic_match(&coder, pos - 2, "AUGH")
+                                          || phonetic_match(&coder, pos - 2, "OUGH"))
+                          && !phonetic_match(&coder, 0, "B") && !phonetic_match(&coder, 0, "TH")) {
+                        // laugh, cough, tough but not bough or though.
+                        phonetic_add(&coder, "F", "F");
+                    }
+                    pos += 2;
+                }
+                else if (next == 'N') {
+                    phonetic_add(&coder, "N", "KN");
+                    pos += 2;
+                }
+                else if (next == 'I' || next == 'E' || next == 'Y') {
+                    phonetic_add(&coder, "J", "K");
+                    pos += 2;
+                }
+                else {
+                    phonetic_add(&coder, "K", "K");
+                    pos += next == 'G' ? 2 : 1;
+                }
+            } break;
+
+            case 'H': {
+                if ((pos == 0 || phonetic_is_vowel(prev)) && phonetic_is_vowel(next)) {
+                    phonetic_add(&coder, "H", "H");
+                    pos += 2;
+                }
+                else {
+                    pos += 1;
+                }
+            } break;
+
+            case 'J': {
+                if (phonetic_match(&coder, pos, "JOSE")) {
+                    phonetic_add(&coder, "H", "H");
+                }
+                else if (pos == 0) {
+                    phonetic_add(&coder, "J", "A");
+                }
+                else {
+                    phonetic_add(&coder, "J", "J");
+                }
+                pos += next == 'J' ? 2 : 1;
+            } break;
+
+            case 'P': {
+                if (next == 'H') {
+                    phonetic_add(&coder, "F", "F");
+                    pos += 2;
+                }
+                else {
+                    phonetic_add(&coder, "P", "P");
+                    pos += (next == 'P' || next == 'B') ? 2 : 1;
+                }
+            } break;
+
+            case 'Q': {
+                phonetic_add(&coder, "K", "K");
+                pos += next == 'Q' ? 2 : 1;
+            } break;
+
+            case 'S': {
+                char after = phonetic_at(&coder, pos + 2);
+
+                if (next == 'H') {
+                    phonetic_add(&coder, "X", "X");
+                    pos += 2;
+                }
+                else if (phonetic_match(&coder, pos, "SIO") || phonetic_match(&coder, pos, "SIA")) {
+                    phonetic_add(&coder, "X", "S");
+                    pos += 3;
+                }
+                else if (next == 'C') {
+                    if (after == 'I' || after == 'E' || after == 'Y') {
+                        phonetic_add(&coder, "S", "S");
+                    }
+                    else {
+                        phonetic_add(&coder, "SK", "SK");
+                    }
+                    pos += 3;
+                }
+                else {
+                    phonetic_add(&coder, "S", "S");
+                    pos += (next == 'S' || next == 'Z') ? 2 : 1;
+                }
+            } break;
+
+            case 'T': {
+                if (phonetic_match(&coder, pos, "TION") || phonetic_match(&coder, pos, "TIA")
+                 || phonetic_match(&coder, pos, "TCH")) {
+                    phonetic_add(&coder, "X", "X");
+                    pos += 3;
+                }
+                else if (next == 'H') {
+                    phonetic_add(&coder, "0", "T");
+                    pos += 2;
+                }
+                else {
+                    phonetic_add(&coder, "T", "T");
+                    pos += (next == 'T' || next == 'D') ? 2 : 1;
+                }
+            } break;
+
+            case 'V': {
+                phonetic_add(&coder, "F", "F");
+                pos += next == 'V' ? 2 : 1;
+            } break;
+
+            case 'W': {
+                if (next == 'R') {
+                    phonetic_add(&coder, "R", "R");
+                    pos += 2;
+                }
+                else if (pos == 0 && (phonetic_is_vowel(next) || next == 'H')) {
+                    phonetic_add(&coder, "A", "F");
+                    pos += 1;
+                }
+                else {
+                    pos += 1;
+                }
+            } break;
+
+            case 'X': {
+                // Silent at the end of french words like 'beaux'.
+                if (!(pos == coder.size - 1 && (phonetic_match(&coder, pos - 3, "IAU")
+                                             || phonetic_match(&coder, pos - 3, "EAU")))) {
+                    phonetic_add(&coder, "KS", "KS");
+                }
+                pos += (next == 'C' || next == 'X') ? 2 : 1;
+            } break;
+
+            case 'Z': {
+                if (next == 'H') {
+                    phonetic_add(&coder, "J", "J");
+                    pos += 2;
+                }
+                else {
+                    phonetic_add(&coder, "S", "TS");
+                    pos += next == 'Z' ? 2 : 1;
+                }
+            } break;
+
+            default: {
+                pos += 1;
+            } break;
+        }
+    }
+
+    return (phonetic_key_t) {
+        .primary   = phonetic_pack(coder.primary,   coder.primary_size),
+        .alternate = phonetic_pack(coder.alternate, coder.alternate_size),
+    };
+}
+
+typedef struct
+{
+    u32 key, id;
+} phonetic_pair_t;
+
+static int
+phonetic_pair_cmp(const void *a, const void *b)
+{
+    const phonetic_pair_t *pa = a;
+    const phonetic_pair_t *pb = b;
+
+    if (pa->key != pb->key)
+        return pa->key < pb->key ? -1 : 1;
+
+    return (pa->id > pb->id) - (pa->id < pb->id);
+}
+
+void
+phonetic_index_build(phonetic_index_t *index, const vocab_t *vocab)
+{
+    dck_stretchy_t (phonetic_pair_t, u32) pairs = {0};
+
+    for (u32 id = 0; id < vocab->words.count; ++id) {
+        u32 size;
+        const u8 *text = vocab_text(vocab, id, &size);
+
+        phonetic_key_t key = phonetic_encode(text, size);
+
+        if (key.primary != 0) {
+            dck_stretchy_push(pairs, (phonetic_pair_t) { key.primary, id });
+        }
+
+        if (key.alternate != 0 && key.alternate != key.primary) {
+            dck_stretchy_push(pairs, (phonetic_pair_t) { key.alternate, id });
+        }
+    }
+
+    qsort(pairs.data, pairs.count, sizeof(*pairs.data), phonetic_pair_cmp);
+
+    u32 key_count = 0;
+
+    for (u32 i = 0; i < pairs.count; ++i) {
+        if (i == 0 || pairs.data[i].key != pairs.data[i - 1].key) {
+            ++key_count;
+        }
+    }
+
+    u32 slot_count = 16;
+
+    while (slot_count < key_count * 2) {
+        slot_count *= 2;
+    }
+
+    index->slots = calloc(slot_count, sizeof(phonetic_slot_t));
+    index->slot_mask = slot_count - 1;
+
+    if (!index->slots) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    index->word_ids.count = 0;
+    dck_stretchy_reserve(index->word_ids, pairs.count);
+
+    for (u32 i = 0; i < pairs.count;) {
+        u32 key = pairs.data[i].key;
+        u32 offset = index->word_ids.count;
+
+        for (; i < pairs.count && pairs.data[i].key == key; ++i) {
+            index->word_ids.data[index->word_ids.count++] = pairs.data[i].id;
+        }
+
+        u32 slot = (u32)hash_u64(key) & index->slot_mask;
+
+        while (index->slots[slot].key != 0) {
+            slot = (slot + 1) & index->slot_mask;
+        }
+
+        index->slots[slot] = (phonetic_slot_t) {
+            .key    = key,
+            .offset = offset,
+            .count  = index->word_ids.count - offset,
+        };
+    }
+
+    free(pairs.data);
+}
+
+void
+phonetic_index_free(phonetic_index_t *index)
+{
+    free(index->slots);
+    free(index->word_ids.data);
+    *index = (phonetic_index_t) {0};
+}
+
+const u32 *
+phonetic_index_lookup(const phonetic_index_t *index, u32 key, u32 *count_o)
+{
+    *count_o = 0;
+
+    if (key == 0 || !index->slots)
+        return NULL;
+
+    u32 slot = (u32)hash_u64(key) & index->slot_mask;
+
+    while (index->slots[slot].key != 0) {
+        if (index->slots[slot].key == key) {
+            *count_o = index->slots[slot].count;
+            return index->word_ids.data + index->slots[slot].offset;
+        }
+
+        slot = (slot + 1) & index->slot_mask;
+    }
+
+    return NULL;
+}
+
+u32
+phonetic_expand(const phonetic_index_t *index, const u8 *text, u32 size, u32 *ids_o, u32 max_ids)
+{
+    phonetic_key_t key = phonetic_encode(text, size);
+
+    u32 a_count, b_count = 0;
+    const u32 *a = phonetic_index_lookup(index, key.primary, &a_count);
+    const u32 *b = NULL;
+
+    if (key.alternate != key.primary) {
+        b = phonetic_index_lookup(index, key.alternate, &b_count);
+    }
+
+    // Both lists are sorted, merge them.
+    u32 a_i = 0, b_i = 0, count = 0;
+
+    while ((a_i < a_count || b_i < b_count) && count < max_ids) {
+        u32 id;
+
+        if (b_i == b_count || (a_i < a_count && a[a_i] < b[b_i])) {
+            id = a[a_i++];
+        }
+        else if (a_i == a_count || b[b_i] < a[a_i]) {
+            id = b[b_i++];
+        }
+        else {
+            id = a[a_i++];
+            b_i++;
+        }
+
+        ids_o[count++] = id;
+    }
+
+    return count;
+}
+
+#endif // PHONETIC_IMPL
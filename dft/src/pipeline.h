@@ -0,0 +1,455 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "core/utils.h"
+
+/* Staged pipeline, every stage runs its own threads and pulls items from a
+ * bounded queue in front of it. A full queue blocks the stage feeding it, so
+ * a slow stage throttles everything before it instead of piling up items
+ * (and their memory).
+ *
+ * Items are opaque pointers handed from stage to stage. A stage function
+ * returns false to drop an item, it then has to free it itself, the items
+ * leaving the last stage are dropped as well.
+ *
+ * Every stage counts its items and busy time and every queue its occupancy
+ * and how long the threads on both of its ends were blocked on it, which is
+ * what tells which stage needs more threads.
+ */
+
+#define PIPELINE_MAX_STAGES 16
+
+typedef b32 (*pipeline_fn_t)(void *context, u32 thread, void *item);
+
+typedef struct
+{
+    void **items;
+    u32    capacity;
+    u32    head, count;
+    b32    closed;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  not_empty, not_full;
+
+    // Guarded by the mutex.
+    u64 pushes;
+    u64 occupancy_sum; // Items already waiting at every push.
+    u32 max_count;
+    u64 push_wait_ns;  // Producers blocked on a full queue.
+    u64 pop_wait_ns;   // Consumers blocked on an empty queue.
+} pipeline_queue_t;
+
+typedef struct
+{
+    const char   *name;
+    pipeline_fn_t fn;
+    u32           thread_count;
+
+    atomic_ullong items, dropped;
+    atomic_ullong busy_ns;
+    atomic_uint   running; // Threads still working, the last one closes the next queue.
+} pipeline_stage_t;
+
+typedef struct
+{
+    pipeline_stage_t stages[PIPELINE_MAX_STAGES];
+    pipeline_queue_t queues[PIPELINE_MAX_STAGES]; // The queue in front of every stage.
+    u32              stage_count;
+
+    void *context;
+
+    pthread_t *threads;
+    u32        thread_count;
+
+    u64 start_ns;
+
+    // Progress line on `report_file` every `report_seconds`, off when zero.
+    FILE           *report_file;
+    f32             report_seconds;
+    pthread_t       reporter;
+    pthread_mutex_t report_mutex;
+    pthread_cond_t  report_cond;
+    b32             done;
+} pipeline_t;
+
+void
+pipeline_init(pipeline_t *pipeline, u32 queue_capacity, void *context);
+
+// Stages run in the order they are added.
+void
+pipeline_add_stage(pipeline_t *pipeline, const char *name, pipeline_fn_t fn, u32 thread_count);
+
+void
+pipeline_start(pipeline_t *pipeline, FILE *report_file, f32 report_seconds);
+
+// Feeds an item to the first stage, blocks while its queue is full.
+void
+pipeline_push(pipeline_t *pipeline, void *item);
+
+// Ends the input and waits until every stage is done.
+void
+pipeline_finish(pipeline_t *pipeline);
+
+// Per stage totals, call after `pipeline_finish`.
+void
+pipeline_report(pipeline_t *pipeline, FILE *out);
+
+void
+pipeline_free(pipeline_t *pipeline);
+
+// Monotonic clock.
+u64
+pipeline_now_ns(void);
+
+#endif // PIPELINE_H_
+
+#if defined(PIPELINE_IMPL) && !defined(PIPELINE_IMPL_)
+#define PIPELINE_IMPL_
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct
+{
+    pipeline_t *pipeline;
+    u32         stage;
+    u32         thread;
+} pipeline_worker_t;
+
+u64
+pipeline_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+pipeline_queue_init(pipeline_queue_t *queue, u32 capacity)
+{
+    *queue = (pipeline_queue_t) {
+        .items    = malloc(capacity * sizeof(void *)),
+        .capacity = capacity,
+    };
+
+    if (!queue->items) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+static void
+pipeline_queue_free(pipeline_queue_t *queue)
+{
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+}
+
+static void
+pipeline_queue_push(pipeline_queue_t *queue, void *item)
+{
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->count == queue->capacity) {
+        u64 start = pipeline_now_ns();
+
+        while (queue->count == queue->capacity) {
+            pthread_cond_wait(&queue->not_full, &queue->mutex);
+        }
+
+        queue->push_wait_ns += pipeline_now_ns() - start;
+    }
+
+    queue->pushes++;
+    queue->occupancy_sum += queue->count;
+
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+
+    if (queue->count > queue->max_count) {
+        queue->max_count = queue->count;
+    }
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// False once the queue is closed and empty.
+static b32
+pipeline_queue_pop(pipeline_queue_t *queue, void **item_o)
+{
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->count == 0 && !queue->closed) {
+        u64 start = pipeline_now_ns();
+
+        while (queue->count == 0 && !queue->closed) {
+            pthread_cond_wait(&queue->not_empty, &queue->mutex);
+        }
+
+        queue->pop_wait_ns += pipeline_now_ns() - start;
+    }
+
+    b32 ok = queue->count != 0;
+
+    if (ok) {
+        *item_o = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+
+        pthread_cond_signal(&queue->not_full);
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+    return ok;
+}
+
+static void
+pipeline_queue_close(pipeline_queue_t *queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static void *
+pipeline_worker(void *arg)
+{
+    pipeline_worker_t *worker = arg;
+    pipeline_t *pipeline = worker->pipeline;
+
+    pipeline_stage_t *stage = pipeline->stages + worker->stage;
+    pipeline_queue_t *in    = pipeline->queues + worker->stage;
+    pipeline_queue_t *out   = worker->stage + 1 < pipeline->stage_count ? in + 1 : NULL;
+
+    void *item;
+
+    while (pipeline_queue_pop(in, &item)) {
+        u64 start = pipeline_now_ns();
+        b32 keep = stage->fn(pipeline->context, worker->thread, item);
+
+        atomic_fetch_add(&stage->busy_ns, pipeline_now_ns() - start);
+        atomic_fetch_add(&stage->items, 1);
+
+        if (!keep) {
+            atomic_fetch_add(&stage->dropped, 1);
+        }
+        else if (out) {
+            pipeline_queue_push(out, item);
+        }
+    }
+
+    if (atomic_fetch_sub(&stage->running, 1) == 1 && out) {
+        pipeline_queue_close(out);
+    }
+
+    free(worker);
+    return NULL;
+}
+
+static void
+pipeline_print_progress(pipeline_t *pipeline, FILE *out)
+{
+    f64 elapsed = (pipeline_now_ns() - pipeline->start_ns) / 1e9;
+
+    fprintf(out, "[%7.1fs]", elapsed);
+
+    for (u32 s = 0; s < pipeline->stage_count; ++s) {
+        pipeline_stage_t *stage = pipeline->stages + s;
+        pipeline_queue_t *queue = pipeline->queues + s;
+
+        pthread_mutex_lock(&queue->mutex);
+        u32 count = queue->count;
+        pthread_mutex_unlock(&queue->mutex);
+
+        fprintf(out, " %s %u/%u>"FMT_U64"", stage->name, count, queue->capacity, (u64)atomic_load(&stage->items));
+    }
+
+    fprintf(out, "\n");
+    fflush(out);
+}
+
+static void *
+pipeline_reporter(void *arg)
+{
+    pipeline_t *pipeline = arg;
+
+    pthread_mutex_lock(&pipeline->report_mutex);
+
+    while (!pipeline->done) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+
+        u64 ns = until.tv_nsec + (u64)(pipeline->report_seconds * 1e9);
+        until.tv_sec  += ns / 1000000000;
+        until.tv_nsec  = ns % 1000000000;
+
+        pthread_cond_timedwait(&pipeline->report_cond, &pipeline->report_mutex, &until);
+
+        if (!pipeline->done) {
+            pipeline_print_progress(pipeline, pipeline->report_file);
+        }
+    }
+
+    pthread_mutex_unlock(&pipeline->report_mutex);
+    return NULL;
+}
+
+void
+pipeline_init(pipeline_t *pipeline, u32 queue_capacity, void *context)
+{
+    memset(pipeline, 0, sizeof(*pipeline));
+
+    pipeline->context = context;
+
+    for (u32 s = 0; s < PIPELINE_MAX_STAGES; ++s) {
+        pipeline_queue_init(pipeline->queues + s, queue_capacity ? queue_capacity : 1);
+    }
+
+    pthread_mutex_init(&pipeline->report_mutex, NULL);
+    pthread_cond_init(&pipeline->report_cond, NULL);
+}
+
+void
+pipeline_add_stage(pipeline_t *pipeline, const char *name, pipeline_fn_t fn, u32 thread_count)
+{
+    if (pipeline->stage_count == PIPELINE_MAX_STAGES) {
+        fprintf(stderr, "%s:%d: too many pipeline stages! exiting...\n", __FILE__, __LINE__);
+        exit(1);
+    }
+
+    pipeline_stage_t *stage = pipeline->stages + pipeline->stage_count++;
+
+    stage->name         = name;
+    stage->fn           = fn;
+    stage->thread_count = thread_count ? thread_count : 1;
+}
+
+void
+pipeline_start(pipeline_t *pipeline, FILE *report_file, f32 report_seconds)
+{
+    for (u32 s = 0; s < pipeline->stage_count; ++s) {
+        pipeline->thread_count += pipeline->stages[s].thread_count;
+    }
+
+    pipeline->threads  = malloc(pipeline->thread_count * sizeof(pthread_t));
+    pipeline->start_ns = pipeline_now_ns();
+
+    if (!pipeline->threads) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    u32 thread = 0;
+
+    for (u32 s = 0; s < pipeline->stage_count; ++s) {
+        pipeline_stage_t *stage = pipeline->stages + s;
+        atomic_store(&stage->running, stage->thread_count);
+
+        for (u32 t = 0; t < stage->thread_count; ++t) {
+            pipeline_worker_t *worker = malloc(sizeof(pipeline_worker_t));
+
+            if (!worker) {
+                fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+                exit(666);
+            }
+
+            *worker = (pipeline_worker_t) {
+                .pipeline = pipeline,
+                .stage    = s,
+                .thread   = t,
+            };
+
+            pthread_create(pipeline->threads + thread++, NULL, pipeline_worker, worker);
+        }
+    }
+
+    pipeline->report_file    = report_file;
+    pipeline->report_seconds = report_seconds;
+
+    if (report_file && report_seconds > 0.0f) {
+        pthread_create(&pipeline->reporter, NULL, pipeline_reporter, pipeline);
+    }
+}
+
+void
+pipeline_push(pipeline_t *pipeline, void *item)
+{
+    pipeline_queue_push(pipeline->queues + 0, item);
+}
+
+void
+pipeline_finish(pipeline_t *pipeline)
+{
+    pipeline_queue_close(pipeline->queues + 0);
+
+    for (u32 t = 0; t < pipeline->thread_count; ++t) {
+        pthread_join(pipeline->threads[t], NULL);
+    }
+
+    if (pipeline->report_file && pipeline->report_seconds > 0.0f) {
+        pthread_mutex_lock(&pipeline->report_mutex);
+        pipeline->done = true;
+        pthread_cond_signal(&pipeline->report_cond);
+        pthread_mutex_unlock(&pipeline->report_mutex);
+
+        pthread_join(pipeline->reporter, NULL);
+    }
+}
+
+void
+pipeline_report(pipeline_t *pipeline, FILE *out)
+{
+    f64 elapsed = (pipeline_now_ns() - pipeline->start_ns) / 1e9;
+
+    fprintf(out, "%-12s %7s %8s %8s %9s %6s | %-12s %8s %9s %9s\n",
+            "stage", "threads", "items", "dropped", "items/s", "busy", "queue", "avg/max", "full(s)", "empty(s)");
+
+    for (u32 s = 0; s < pipeline->stage_count; ++s) {
+        pipeline_stage_t *stage = pipeline->stages + s;
+        pipeline_queue_t *queue = pipeline->queues + s;
+
+        u64 items = atomic_load(&stage->items);
+        f64 busy  = atomic_load(&stage->busy_ns) / 1e9;
+
+        // Busy time over the time all of the stage's threads had.
+        f64 utilization = elapsed > 0.0 ? busy / (elapsed * stage->thread_count) : 0.0;
+        f64 average     = queue->pushes ? queue->occupancy_sum / (f64)queue->pushes : 0.0;
+
+        char occupancy[32];
+        snprintf(occupancy, sizeof(occupancy), "%.1f/%u", average, queue->max_count);
+
+        fprintf(out, "%-12s %7u %8llu %8llu %9.2f %5.0f%% | cap %-8u %8s %9.2f %9.2f\n",
+                stage->name, stage->thread_count, (unsigned long long)items, (unsigned long long)atomic_load(&stage->dropped),
+                elapsed > 0.0 ? items / elapsed : 0.0, utilization * 100.0,
+                queue->capacity, occupancy, queue->push_wait_ns / 1e9, queue->pop_wait_ns / 1e9);
+    }
+
+    fprintf(out, "%.2fs total\n", elapsed);
+}
+
+void
+pipeline_free(pipeline_t *pipeline)
+{
+    for (u32 s = 0; s < PIPELINE_MAX_STAGES; ++s) {
+        pipeline_queue_free(pipeline->queues + s);
+    }
+
+    pthread_mutex_destroy(&pipeline->report_mutex);
+    pthread_cond_destroy(&pipeline->report_cond);
+    free(pipeline->threads);
+}
+
+#endif // PIPELINE_IMPL
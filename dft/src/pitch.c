@@ -0,0 +1,243 @@
+#include <raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define CATALOG_IMPL
+#include "catalog.h"
+
+#define PITCH_IMPL
+#include "pitch.h"
+
+// cc src/pitch.c ../raylib/lib/libraylib.a -o pitch.exe -I. -I../raylib/include -O2 -lm -ldl -lpthread && ./pitch.exe build ../corpus.cat ../corpus.pit
+
+typedef struct
+{
+    pitch_t    pitch; // For the sample rate of the last file.
+    vtt_data_t vtt;
+    f64        audio_seconds;
+} pitch_thread_t;
+
+typedef struct
+{
+    catalog_t      catalog;
+    pitch_thread_t *threads;
+
+    u32          *entry_words;
+    pitch_word_t *words;
+} pitch_batch_t;
+
+static f64
+pitch_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+pitch_batch_entry(void *context, u32 thread_index, u32 item)
+{
+    pitch_batch_t *batch = context;
+    pitch_thread_t *thread = batch->threads + thread_index;
+    catalog_entry_t entry = catalog_entry(&batch->catalog, item);
+
+    if (!entry.audio_path)
+        return;
+
+    Wave wave = LoadWave(entry.audio_path);
+
+    if (!IsWaveReady(wave) || wave.frameCount == 0) {
+        fprintf(stderr, "Failed to decode '%s'!\n", entry.audio_path);
+        return;
+    }
+
+    if (wave.sampleSize != 16) {
+        WaveFormat(&wave, wave.sampleRate, 16, wave.channels);
+    }
+
+    if (thread->pitch.sample_rate != wave.sampleRate) {
+        if (thread->pitch.sample_rate) {
+            pitch_free(&thread->pitch);
+        }
+
+        if (!pitch_init(&thread->pitch, wave.sampleRate)) {
+            fprintf(stderr, "Sample rate of '%s' is too low!\n", entry.audio_path);
+            UnloadWave(wave);
+            return;
+        }
+    }
+
+    thread->vtt.text.count  = 0;
+    thread->vtt.words.count = 0;
+
+    vtt_chunk_t chunk = vtt_parse_file(&thread->vtt, entry.caption_path);
+
+    u32 first = batch->entry_words[item];
+    u32 count = batch->entry_words[item + 1] - first;
+
+    u32 words = pitch_words(&thread->pitch, wave.data, wave.frameCount, wave.channels,
+                           &thread->vtt, chunk, batch->words, first, count);
+
+    if (words != count) {
+        fprintf(stderr, "'%s' has %u words instead of %u, rescan the catalog!\n", entry.caption_path, words, count);
+    }
+
+    thread->audio_seconds += wave.frameCount / (f64)wave.sampleRate;
+
+    UnloadWave(wave);
+}
+
+static i32
+pitch_tool_build(const char *catalog_path, i32 argc, char **argv)
+{
+    u32 thread_count = par_thread_count();
+
+    i32 arg = 0;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-t") == 0) {
+        thread_count = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+
+    if (arg + 1 != argc) {
+        fprintf(stderr, "Expected one output file!\n");
+        return 1;
+    }
+
+    pitch_batch_t batch = {0};
+
+    if (!catalog_open(&batch.catalog, catalog_path))
+        return 1;
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    batch.threads     = calloc(thread_count, sizeof(pitch_thread_t));
+    batch.entry_words = malloc((batch.catalog.count + 1) * sizeof(u32));
+
+    if (!batch.threads || !batch.entry_words) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    u32 word_count = 0;
+
+    for (u32 i = 0; i < batch.catalog.count; ++i) {
+        batch.entry_words[i] = word_count;
+        word_count += batch.catalog.word_count[i];
+    }
+
+    batch.entry_words[batch.catalog.count] = word_count;
+
+    // Words of entries without audio keep zero frames.
+    batch.words = calloc(word_count + 1, sizeof(pitch_word_t));
+
+    if (!batch.words) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    f64 start = pitch_seconds();
+
+    par_for(batch.catalog.count, thread_count, pitch_batch_entry, &batch);
+
+    f64 seconds = pitch_seconds() - start;
+    f64 audio_seconds = 0.0;
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        audio_seconds += batch.threads[t].audio_seconds;
+
+        if (batch.threads[t].pitch.sample_rate) {
+            pitch_free(&batch.threads[t].pitch);
+        }
+
+        free(batch.threads[t].vtt.text.data);
+        free(batch.threads[t].vtt.words.data);
+    }
+
+    b32 ok = pitch_store_write(argv[arg], batch.entry_words, batch.catalog.count, batch.words);
+
+    printf("%u words of %u entries, %.1fs of audio in %.1fs (%.0fx real time)\n", word_count, batch.catalog.count,
+           audio_seconds, seconds, seconds > 0.0 ? audio_seconds / seconds : 0.0);
+
+    free(batch.words);
+    free(batch.entry_words);
+    free(batch.threads);
+    catalog_close(&batch.catalog);
+
+    return ok ? 0 : 1;
+}
+
+static i32
+pitch_tool_show(const char *store_path, i32 argc, char **argv)
+{
+    if (argc != 1 && argc != 2) {
+        fprintf(stderr, "Expected a word id and optionally a word count!\n");
+        return 1;
+    }
+
+    pitch_store_t store;
+
+    if (!pitch_store_open(&store, store_path))
+        return 1;
+
+    u32 id    = (u32)strtoul(argv[0], NULL, 10);
+    u32 count = argc == 2 ? (u32)strtoul(argv[1], NULL, 10) : 1;
+
+    if (id >= store.word_count) {
+        fprintf(stderr, "Only %u words!\n", store.word_count);
+        pitch_store_close(&store);
+        return 1;
+    }
+
+    count = count < store.word_count - id ? count : store.word_count - id;
+
+    printf("     word  median     10%%     90%%  st/s  voiced  frames\n");
+
+    for (u32 i = id; i < id + count; ++i) {
+        pitch_word_t word = store.words[i];
+
+        printf("%9u %6.1fHz %6.1fHz %6.1fHz %5.1f %6.0f%% %7u\n", i, pitch_hz(word.median), pitch_hz(word.low),
+               pitch_hz(word.high), word.slope / PITCH_STEPS, word.voiced * 100.0f / 255.0f, word.frames);
+    }
+
+    pitch_store_close(&store);
+    return 0;
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s build <catalog.cat> [-t threads] <out.pit>\n", program);
+    fprintf(stderr, "       %s show <pitch.pit> <word id> [word count]\n", program);
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "build") == 0)
+        return pitch_tool_build(argv[2], argc - 3, argv + 3);
+
+    if (strcmp(argv[1], "show") == 0)
+        return pitch_tool_show(argv[2], argc - 3, argv + 3);
+
+    print_usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,563 @@
+#ifndef PITCH_H_
+#define PITCH_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+#include "fft.h"
+
+/* Fundamental frequency of every caption word, and a store for the per word
+ * statistics indexed by global word id (the same ids as the MFCC store).
+ *
+ * F0 comes from YIN on `PITCH_FRAME` long frames every `PITCH_HOP` of the
+ * mono mix. The difference function of a lag is the energy of the two
+ * overlapping parts minus twice the autocorrelation, and the autocorrelation
+ * of every lag comes from the FFT: two frames go through one complex FFT, and
+ * their power spectra through a second one as its real and imaginary parts
+ * (the transform of a real even sequence is real, so both autocorrelations
+ * come out separated). The cumulative mean normalized difference picks the
+ * first dip under `PITCH_THRESHOLD`, refined with a parabola. Quiet frames
+ * and frames without a dip are unvoiced.
+ *
+ * As for the MFCCs, frames are marked by the words that need them first, so
+ * each is computed once however many words overlap it. A word owns the frames
+ * whose centers fall in its span.
+ *
+ * Pitch is stored in sixteenths of a semitone over `PITCH_REFERENCE_HZ`,
+ * zero for unvoiced: median, 10% and 90% quantiles over the voiced frames,
+ * the slope of a least squares line through them and the voiced fraction.
+ */
+
+#define PITCH_FRAME        0.040f // Seconds, at least two periods of the lowest pitch.
+#define PITCH_HOP          0.010f // Seconds.
+#define PITCH_MIN_HZ       60.0f
+#define PITCH_MAX_HZ       500.0f
+#define PITCH_THRESHOLD    0.15f
+#define PITCH_SILENCE      1e-3f  // RMS under which a frame is unvoiced.
+#define PITCH_REFERENCE_HZ 27.5f
+#define PITCH_STEPS        16.0f  // Per semitone.
+
+#define PITCH_MAGIC   0x31544950 // "PIT1"
+#define PITCH_VERSION 1
+
+typedef struct
+{
+    u16 median, low, high; // Sixteenths of a semitone over `PITCH_REFERENCE_HZ`, zero when unvoiced.
+    i16 slope;             // Sixteenths of a semitone per second.
+    u8  voiced;            // Fraction of the frames, out of 255.
+    u8  frames;            // Up to 255, zero when the audio was missing.
+} pitch_word_t;
+
+typedef struct
+{
+    u32 sample_rate;
+    u32 size;   // FFT size, room for the frame and the longest lag without wrapping around.
+    u32 length; // Samples per frame.
+    u32 hop;    // Samples between frames.
+    u32 lag_min, lag_max;
+
+    fft_plan_t plan;
+    cn_t      *data, *scratch;
+    f64       *energy[2]; // Running sums of squares of the two frames in `data`.
+    f32       *cmnd;
+
+    dck_stretchy_t (u8,  u32) needed;
+    dck_stretchy_t (f32, u32) semitones; // Per frame, valid for the needed ones, zero when unvoiced.
+    dck_stretchy_t (f32, u32) voiced;    // Of the current word.
+} pitch_t;
+
+typedef struct
+{
+    u32 magic, version;
+
+    u32 entry_count;
+    u32 word_count;
+
+    f32 frame_seconds, hop_seconds;
+
+    u64 entry_words_offset; // First word id of every entry, plus the word count at the end.
+    u64 words_offset;       // `pitch_word_t` of every word.
+    u64 size;
+} pitch_store_header_t;
+
+typedef struct
+{
+    u8 *base;
+    u64 size;
+
+    const pitch_store_header_t *header;
+    u32 entry_count;
+    u32 word_count;
+
+    const u32          *entry_words;
+    const pitch_word_t *words;
+} pitch_store_t;
+
+// False when the sample rate is too low for the pitch range.
+b32
+pitch_init(pitch_t *pitch, u32 sample_rate);
+
+void
+pitch_free(pitch_t *pitch);
+
+/* Pitch of the non-blank words of the chunk, word `i` goes to `words[first_word + i]`.
+ * Stops after `word_capacity` words and returns how many non-blank words there were.
+ */
+u32
+pitch_words(pitch_t *pitch, const i16 *samples, u32 frame_count, u32 channels,
+            const vtt_data_t *data, vtt_chunk_t chunk, pitch_word_t *words, u32 first_word, u32 word_capacity);
+
+// Hertz of a stored pitch, zero for unvoiced.
+f32
+pitch_hz(u16 pitch);
+
+// `entry_words` has `entry_count + 1` values, the last one is the word count.
+b32
+pitch_store_write(const char *path, const u32 *entry_words, u32 entry_count, const pitch_word_t *words);
+
+b32
+pitch_store_open(pitch_store_t *store, const char *path);
+
+void
+pitch_store_close(pitch_store_t *store);
+
+#endif // PITCH_H_
+
+#if defined(PITCH_IMPL) && !defined(PITCH_IMPL_)
+#define PITCH_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FFT_IMPL
+#include "fft.h"
+
+b32
+pitch_init(pitch_t *pitch, u32 sample_rate)
+{
+    *pitch = (pitch_t) {0};
+
+    if (sample_rate < PITCH_MAX_HZ * 4.0f)
+        return false;
+
+    pitch->sample_rate = sample_rate;
+    pitch->length      = (u32)(sample_rate * PITCH_FRAME);
+    pitch->hop         = (u32)(sample_rate * PITCH_HOP);
+    pitch->lag_min     = (u32)(sample_rate / PITCH_MAX_HZ);
+    pitch->lag_max     = (u32)ceilf(sample_rate / PITCH_MIN_HZ);
+    pitch->size        = 1;
+
+    while (pitch->size < pitch->length + pitch->lag_max) {
+        pitch->size *= 2;
+    }
+
+    fft_plan_init(&pitch->plan, pitch->size);
+
+    pitch->data      = malloc(pitch->size * sizeof(cn_t));
+    pitch->scratch   = malloc(pitch->size * sizeof(cn_t));
+    pitch->energy[0] = malloc((pitch->length + 1) * sizeof(f64));
+    pitch->energy[1] = malloc((pitch->length + 1) * sizeof(f64));
+    pitch->cmnd      = malloc((pitch->lag_max + 2) * sizeof(f32));
+
+    if (!pitch->data || !pitch->scratch || !pitch->energy[0] || !pitch->energy[1] || !pitch->cmnd) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    return true;
+}
+
+void
+pitch_free(pitch_t *pitch)
+{
+    fft_plan_free(&pitch->plan);
+
+    free(pitch->data);
+    free(pitch->scratch);
+    free(pitch->energy[0]);
+    free(pitch->energy[1]);
+    free(pitch->cmnd);
+    free(pitch->needed.data);
+    free(pitch->semitones.data);
+    free(pitch->voiced.data);
+
+    *pitch = (pitch_t) {0};
+}
+
+static void
+pitch_load_frame(pitch_t *pitch, const i16 *samples, u32 sample_count, u32 channels, u32 frame, b32 imaginary)
+{
+    u64 first = (u64)frame * pitch->hop;
+    f64 *energy = pitch->energy[imaginary ? 1 : 0];
+
+    energy[0] = 0.0;
+
+    for (u32 i = 0; i < pitch->size; ++i) {
+        u64 s = first + i;
+        f32 value = 0.0f;
+
+        if (i < pitch->length && s < sample_count) {
+            for (u32 c = 0; c < channels; ++c) {
+                value += samples[s * channels + c];
+            }
+
+            value /= channels * 32768.0f;
+        }
+
+        if (i < pitch->length) {
+            energy[i + 1] = energy[i] + (f64)value * value;
+        }
+
+        if (imaginary) {
+            pitch->data[i].i = value;
+        }
+        else {
+            pitch->data[i] = (cn_t) { .r = value };
+        }
+    }
+}
+
+// Semitones over `PITCH_REFERENCE_HZ` of a frame from its autocorrelation, zero when unvoiced.
+static f32
+pitch_yin(pitch_t *pitch, const f64 *energy, u32 component)
+{
+    u32 length = pitch->length;
+    f64 total  = energy[length];
+
+    if (total < (f64)PITCH_SILENCE * PITCH_SILENCE * length)
+        return 0.0f;
+
+    // The second FFT isn't normalized.
+    f64 scale = 1.0 / pitch->size;
+    f64 sum   = 0.0;
+
+    pitch->cmnd[0] = 1.0f;
+
+    for (u32 lag = 1; lag <= pitch->lag_max + 1; ++lag) {
+        f64 r = (component ? pitch->data[lag].i : pitch->data[lag].r) * scale;
+
+        // Squares of `x[0, length - lag)` and of `x[lag, length)`.
+        f64 d = energy[length - lag] + (total - energy[lag]) - 2.0 * r;
+        d = d > 0.0 ? d : 0.0;
+
+        sum += d;
+        pitch->cmnd[lag] = sum > 0.0 ? (f32)(d * lag / sum) : 1.0f;
+    }
+
+    u32 lag = pitch->lag_min;
+
+    while (lag <= pitch->lag_max && pitch->cmnd[lag] >= PITCH_THRESHOLD) {
+        ++lag;
+    }
+
+    if (lag > pitch->lag_max)
+        return 0.0f;
+
+    while (lag < pitch->lag_max && pitch->cmnd[lag + 1] < pitch->cmnd[lag]) {
+        ++lag;
+    }
+
+    f32 a = pitch->cmnd[lag - 1], b = pitch->cmnd[lag], c = pitch->cmnd[lag + 1];
+    f32 curve = a - 2.0f * b + c;
+    f32 shift = curve > 0.0f ? 0.5f * (a - c) / curve : 0.0f;
+
+    f32 hz = pitch->sample_rate / (lag + shift);
+
+    return 12.0f * log2f(hz / PITCH_REFERENCE_HZ);
+}
+
+static int
+pitch_f32_cmp(const void *a, const void *b)
+{
+    f32 fa = *(const f32 *)a;
+    f32 fb = *(const f32 *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static u16
+pitch_quantize(f32 semitones)
+{
+    f32 steps = roundf(semitones * PITCH_STEPS);
+    return steps < 1.0f ? 1 : steps > 65535.0f ? 65535 : (u16)steps;
+}
+
+u32
+pitch_words(pitch_t *pitch, const i16 *samples, u32 frame_count, u32 channels,
+            const vtt_data_t *data, vtt_chunk_t chunk, pitch_word_t *words, u32 first_word, u32 word_capacity)
+{
+    u32 stft_count = frame_count / pitch->hop + 1;
+
+    pitch->needed.count = 0;
+    dck_stretchy_reserve(pitch->needed, stft_count);
+    pitch->needed.count = stft_count;
+    memset(pitch->needed.data, 0, stft_count);
+
+    pitch->semitones.count = 0;
+    dck_stretchy_reserve(pitch->semitones, stft_count);
+    pitch->semitones.count = stft_count;
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        if (vtt_word_blank(data, word))
+            continue;
+
+        u32 first, last;
+        vtt_word_frames(word, pitch->sample_rate, pitch->length, pitch->hop, stft_count, &first, &last);
+
+        memset(pitch->needed.data + first, 1, last - first + 1);
+    }
+
+    for (u32 f = 0; f < stft_count;) {
+        if (!pitch->needed.data[f]) {
+            ++f;
+            continue;
+        }
+
+        b32 pair = f + 1 < stft_count && pitch->needed.data[f + 1];
+
+        pitch_load_frame(pitch, samples, frame_count, channels, f, false);
+
+        if (pair) {
+            pitch_load_frame(pitch, samples, frame_count, channels, f + 1, true);
+        }
+
+        fft_forward(&pitch->plan, pitch->data, pitch->scratch);
+
+        // Power spectra of both frames as one complex sequence, transformed again into both autocorrelations.
+        for (u32 k = 0; k <= pitch->size / 2; ++k) {
+            cn_t z  = pitch->data[k];
+            cn_t zn = pitch->data[(pitch->size - k) & (pitch->size - 1)];
+
+            f32 ar = 0.5f * (z.r + zn.r), ai = 0.5f * (z.i - zn.i);
+            f32 br = 0.5f * (z.i + zn.i), bi = 0.5f * (zn.r - z.r);
+
+            cn_t power = { .r = ar * ar + ai * ai, .i = br * br + bi * bi };
+
+            pitch->data[k] = power;
+            pitch->data[(pitch->size - k) & (pitch->size - 1)] = power;
+        }
+
+        fft_forward(&pitch->plan, pitch->data, pitch->scratch);
+
+        pitch->semitones.data[f] = pitch_yin(pitch, pitch->energy[0], 0);
+
+        if (pair) {
+            pitch->semitones.data[f + 1] = pitch_yin(pitch, pitch->energy[1], 1);
+        }
+
+        f += pair ? 2 : 1;
+    }
+
+    u32 count = 0;
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        if (vtt_word_blank(data, word))
+            continue;
+
+        if (count < word_capacity) {
+            u32 first, last;
+            vtt_word_frames(word, pitch->sample_rate, pitch->length, pitch->hop, stft_count, &first, &last);
+
+            u32 n = last - first + 1;
+            pitch_word_t result = { .frames = n < 0xFF ? n : 0xFF };
+
+            // Least squares line through the voiced frames, time in frames.
+            f64 st = 0.0, sy = 0.0, stt = 0.0, sty = 0.0;
+
+            pitch->voiced.count = 0;
+
+            for (u32 f = first; f <= last; ++f) {
+                f32 semitones = pitch->semitones.data[f];
+
+                if (semitones > 0.0f) {
+                    f64 t = f - first;
+
+                    st  += t;
+                    sy  += semitones;
+                    stt += t * t;
+                    sty += t * semitones;
+
+                    dck_stretchy_push(pitch->voiced, semitones);
+                }
+            }
+
+            u32 voiced = pitch->voiced.count;
+
+            if (voiced) {
+                f32 *values = pitch->voiced.data;
+                qsort(values, voiced, sizeof(f32), pitch_f32_cmp);
+
+                result.median = pitch_quantize(values[voiced / 2]);
+                result.low    = pitch_quantize(values[(u32)(0.1f * (voiced - 1) + 0.5f)]);
+                result.high   = pitch_quantize(values[(u32)(0.9f * (voiced - 1) + 0.5f)]);
+                result.voiced = (u8)((255 * voiced + n / 2) / n);
+
+                f64 denominator = voiced * stt - st * st;
+
+                if (voiced >= 2 && denominator > 0.0) {
+                    f64 per_frame = (voiced * sty - st * sy) / denominator;
+                    f64 slope = round(per_frame / PITCH_HOP * PITCH_STEPS);
+
+                    result.slope = slope < -32767.0 ? -32767 : slope > 32767.0 ? 32767 : (i16)slope;
+                }
+            }
+
+            words[first_word + count] = result;
+        }
+
+        ++count;
+    }
+
+    return count;
+}
+
+f32
+pitch_hz(u16 pitch)
+{
+    return pitch ? PITCH_REFERENCE_HZ * exp2f(pitch / (PITCH_STEPS * 12.0f)) : 0.0f;
+}
+
+static u64
+pitch_align(u64 offset)
+{
+    return (offset + 7) & ~(u64)7;
+}
+
+static b32
+pitch_write_section(FILE *file, u64 *offset, const void *data, u64 size)
+{
+    static const u8 zeros[8] = {0};
+
+    u64 aligned = pitch_align(*offset);
+
+    if (aligned != *offset && fwrite(zeros, 1, aligned - *offset, file) != aligned - *offset)
+        return false;
+
+    if (size != 0 && fwrite(data, 1, size, file) != size)
+        return false;
+
+    *offset = aligned + size;
+    return true;
+}
+
+b32
+pitch_store_write(const char *path, const u32 *entry_words, u32 entry_count, const pitch_word_t *words)
+{
+    u32 word_count = entry_words[entry_count];
+
+    pitch_store_header_t header = {
+        .magic         = PITCH_MAGIC,
+        .version       = PITCH_VERSION,
+        .entry_count   = entry_count,
+        .word_count    = word_count,
+        .frame_seconds = PITCH_FRAME,
+        .hop_seconds   = PITCH_HOP,
+    };
+
+    u64 entry_words_size = (entry_count + 1) * sizeof(u32);
+    u64 words_size       = word_count * sizeof(pitch_word_t);
+
+    u64 offset = sizeof(header);
+
+    offset = pitch_align(offset); header.entry_words_offset = offset; offset += entry_words_size;
+    offset = pitch_align(offset); header.words_offset       = offset; offset += words_size;
+
+    header.size = offset;
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    b32 ok = false;
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file) {
+        offset = 0;
+
+        ok = pitch_write_section(file, &offset, &header, sizeof(header))
+          && pitch_write_section(file, &offset, entry_words, entry_words_size)
+          && pitch_write_section(file, &offset, words, words_size);
+
+        if (fclose(file) != 0) {
+            ok = false;
+        }
+
+        if (ok && rename(tmp_path, path) != 0) {
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write pitch '%s': %s\n", path, strerror(errno));
+        remove(tmp_path);
+    }
+
+    return ok;
+}
+
+b32
+pitch_store_open(pitch_store_t *store, const char *path)
+{
+    *store = (pitch_store_t) {0};
+
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open pitch '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(pitch_store_header_t)) {
+        fprintf(stderr, "Pitch '%s' is truncated!\n", path);
+        close(fd);
+        return false;
+    }
+
+    u8 *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map pitch '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    const pitch_store_header_t *header = (const pitch_store_header_t *)base;
+
+    if (header->magic != PITCH_MAGIC || header->version != PITCH_VERSION || header->size != (u64)st.st_size) {
+        fprintf(stderr, "Pitch '%s' is corrupted!\n", path);
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    store->base        = base;
+    store->size        = st.st_size;
+    store->header      = header;
+    store->entry_count = header->entry_count;
+    store->word_count  = header->word_count;
+    store->entry_words = (const u32 *)(base + header->entry_words_offset);
+    store->words       = (const pitch_word_t *)(base + header->words_offset);
+
+    return true;
+}
+
+void
+pitch_store_close(pitch_store_t *store)
+{
+    if (store->base) {
+        munmap(store->base, store->size);
+    }
+
+    *store = (pitch_store_t) {0};
+}
+
+#endif // PITCH_IMPL
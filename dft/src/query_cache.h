@@ -0,0 +1,362 @@
+#ifndef QUERY_CACHE_H_
+#define QUERY_CACHE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+/* Thread safe result cache keyed by a normalized query. Every entry belongs
+ * to a corpus generation, the first lookup or insert with a newer generation
+ * drops everything, so ingesting a file invalidates the cache on its own.
+ * Entries are evicted least recently used first once their total size goes
+ * over the byte budget.
+ */
+
+typedef struct query_cache_entry_t query_cache_entry_t;
+
+struct query_cache_entry_t
+{
+    query_cache_entry_t *chain;      // Next entry in the same slot.
+    query_cache_entry_t *prev, *next; // LRU list, `prev` is more recent.
+
+    u64 hash;
+    u32 key_size, value_size;
+
+    // Followed by the key and the value.
+};
+
+typedef struct
+{
+    pthread_mutex_t lock;
+
+    query_cache_entry_t **slots;
+    u32                   slot_mask;
+    u32                   count;
+
+    query_cache_entry_t *newest, *oldest;
+
+    u64 bytes, budget;
+    u64 generation;
+
+    atomic_uint_fast64_t hits, misses, evictions, invalidations;
+} query_cache_t;
+
+typedef dck_stretchy_t (u8, u32) query_cache_bytes_t;
+
+typedef struct
+{
+    u64 hits, misses, evictions, invalidations;
+    u64 bytes, budget;
+    u32 count;
+} query_cache_stats_t;
+
+void
+query_cache_init(query_cache_t *cache, u64 budget);
+
+void
+query_cache_free(query_cache_t *cache);
+
+// Appends the cached value to `out` on a hit.
+b32
+query_cache_get(query_cache_t *cache, u64 generation, const void *key, u32 key_size,
+                query_cache_bytes_t *out);
+
+void
+query_cache_put(query_cache_t *cache, u64 generation, const void *key, u32 key_size,
+                const void *value, u32 value_size);
+
+query_cache_stats_t
+query_cache_stats(query_cache_t *cache);
+
+#endif // QUERY_CACHE_H_
+
+#if defined(QUERY_CACHE_IMPL) && !defined(QUERY_CACHE_IMPL_)
+#define QUERY_CACHE_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hash.h"
+
+// Values bigger than this part of the budget are not worth pushing everything else out.
+#define QUERY_CACHE_MAX_ENTRY_SHARE 8
+
+static u8 *
+query_cache_key(query_cache_entry_t *entry)
+{
+    return (u8 *)(entry + 1);
+}
+
+static u8 *
+query_cache_value(query_cache_entry_t *entry)
+{
+    return (u8 *)(entry + 1) + entry->key_size;
+}
+
+static u64
+query_cache_entry_bytes(const query_cache_entry_t *entry)
+{
+    return sizeof(query_cache_entry_t) + entry->key_size + entry->value_size;
+}
+
+void
+query_cache_init(query_cache_t *cache, u64 budget)
+{
+    *cache = (query_cache_t) {
+        .slots     = calloc(1024, sizeof(query_cache_entry_t *)),
+        .slot_mask = 1023,
+        .budget    = budget,
+    };
+
+    if (!cache->slots) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+static void
+query_cache_unlink(query_cache_t *cache, query_cache_entry_t *entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    }
+    else {
+        cache->newest = entry->next;
+    }
+
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    }
+    else {
+        cache->oldest = entry->prev;
+    }
+
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void
+query_cache_link_newest(query_cache_t *cache, query_cache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->newest;
+
+    if (cache->newest) {
+        cache->newest->prev = entry;
+    }
+    else {
+        cache->oldest = entry;
+    }
+
+    cache->newest = entry;
+}
+
+static void
+query_cache_remove(query_cache_t *cache, query_cache_entry_t *entry)
+{
+    query_cache_entry_t **link = cache->slots + (entry->hash & cache->slot_mask);
+
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+
+    *link = entry->chain;
+
+    query_cache_unlink(cache, entry);
+
+    cache->bytes -= query_cache_entry_bytes(entry);
+    cache->count--;
+
+    free(entry);
+}
+
+static void
+query_cache_clear(query_cache_t *cache)
+{
+    while (cache->oldest) {
+        query_cache_remove(cache, cache->oldest);
+    }
+}
+
+// Returns false when `generation` is older than what the cache holds, must be called locked.
+static b32
+query_cache_sync_generation(query_cache_t *cache, u64 generation)
+{
+    if (generation < cache->generation)
+        return false;
+
+    if (generation > cache->generation) {
+        if (cache->count != 0) {
+            atomic_fetch_add_explicit(&cache->invalidations, 1, memory_order_relaxed);
+        }
+
+        query_cache_clear(cache);
+        cache->generation = generation;
+    }
+
+    return true;
+}
+
+static query_cache_entry_t *
+query_cache_lookup(query_cache_t *cache, u64 hash, const void *key, u32 key_size)
+{
+    for (query_cache_entry_t *entry = cache->slots[hash & cache->slot_mask]; entry; entry = entry->chain) {
+        if (entry->hash == hash && entry->key_size == key_size
+         && memcmp(query_cache_key(entry), key, key_size) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void
+query_cache_grow(query_cache_t *cache)
+{
+    u32 slot_count = (cache->slot_mask + 1) * 2;
+    query_cache_entry_t **slots = calloc(slot_count, sizeof(query_cache_entry_t *));
+
+    if (!slots)
+        return; // Longer chains are fine.
+
+    for (u32 i = 0; i <= cache->slot_mask; ++i) {
+        query_cache_entry_t *entry = cache->slots[i];
+
+        while (entry) {
+            query_cache_entry_t *chain = entry->chain;
+            u32 slot = entry->hash & (slot_count - 1);
+
+            entry->chain = slots[slot];
+            slots[slot] = entry;
+
+            entry = chain;
+        }
+    }
+
+    free(cache->slots);
+    cache->slots = slots;
+    cache->slot_mask = slot_count - 1;
+}
+
+b32
+query_cache_get(query_cache_t *cache, u64 generation, const void *key, u32 key_size,
+                query_cache_bytes_t *out)
+{
+    u64 hash = hash_bytes(key, key_size);
+    b32 hit = false;
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (query_cache_sync_generation(cache, generation)) {
+        query_cache_entry_t *entry = query_cache_lookup(cache, hash, key, key_size);
+
+        if (entry) {
+            dck_stretchy_reserve(*out, entry->value_size);
+            memcpy(out->data + out->count, query_cache_value(entry), entry->value_size);
+            out->count += entry->value_size;
+            hit = true;
+
+            query_cache_unlink(cache, entry);
+            query_cache_link_newest(cache, entry);
+        }
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    atomic_fetch_add_explicit(hit ? &cache->hits : &cache->misses, 1, memory_order_relaxed);
+
+    return hit;
+}
+
+void
+query_cache_put(query_cache_t *cache, u64 generation, const void *key, u32 key_size,
+                const void *value, u32 value_size)
+{
+    u64 bytes = sizeof(query_cache_entry_t) + key_size + value_size;
+
+    if (bytes > cache->budget / QUERY_CACHE_MAX_ENTRY_SHARE)
+        return;
+
+    u64 hash = hash_bytes(key, key_size);
+
+    // Build the entry outside of the lock.
+    query_cache_entry_t *entry = malloc(bytes);
+    if (!entry)
+        return;
+
+    *entry = (query_cache_entry_t) {
+        .hash       = hash,
+        .key_size   = key_size,
+        .value_size = value_size,
+    };
+
+    memcpy(query_cache_key(entry), key, key_size);
+    memcpy(query_cache_value(entry), value, value_size);
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (!query_cache_sync_generation(cache, generation)) {
+        pthread_mutex_unlock(&cache->lock);
+        free(entry);
+        return;
+    }
+
+    query_cache_entry_t *existing = query_cache_lookup(cache, hash, key, key_size);
+    if (existing) {
+        query_cache_remove(cache, existing);
+    }
+
+    while (cache->oldest && cache->bytes + bytes > cache->budget) {
+        query_cache_remove(cache, cache->oldest);
+        atomic_fetch_add_explicit(&cache->evictions, 1, memory_order_relaxed);
+    }
+
+    if (cache->count >= cache->slot_mask + 1) {
+        query_cache_grow(cache);
+    }
+
+    u32 slot = hash & cache->slot_mask;
+    entry->chain = cache->slots[slot];
+    cache->slots[slot] = entry;
+
+    query_cache_link_newest(cache, entry);
+
+    cache->bytes += bytes;
+    cache->count++;
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+query_cache_stats_t
+query_cache_stats(query_cache_t *cache)
+{
+    pthread_mutex_lock(&cache->lock);
+
+    query_cache_stats_t stats = {
+        .hits          = atomic_load(&cache->hits),
+        .misses        = atomic_load(&cache->misses),
+        .evictions     = atomic_load(&cache->evictions),
+        .invalidations = atomic_load(&cache->invalidations),
+        .bytes         = cache->bytes,
+        .budget        = cache->budget,
+        .count         = cache->count,
+    };
+
+    pthread_mutex_unlock(&cache->lock);
+
+    return stats;
+}
+
+void
+query_cache_free(query_cache_t *cache)
+{
+    query_cache_clear(cache);
+    free(cache->slots);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+#endif // QUERY_CACHE_IMPL
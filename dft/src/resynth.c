@@ -0,0 +1,201 @@
+#include <raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "core/utils.h"
+
+#define WOLA_IMPL
+#include "wola.h"
+
+// cc src/resynth.c ../raylib/lib/libraylib.a -o resynth.exe -I. -I../raylib/include -O2 -lm -ldl -lpthread && ./resynth.exe -g -60 audio.ogg gated.wav
+
+#define RESYNTH_SIZE 1024
+
+typedef struct
+{
+    f32 sample_rate;
+    u32 size;
+
+    b32 gate;
+    f32 gate_power; // Per bin, of a full scale sine.
+
+    b32 band;
+    f32 low, high;
+} resynth_edit_t;
+
+static f64
+resynth_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+resynth_edit(void *context, cn_t *bins, u32 bin_count, u32 frame)
+{
+    const resynth_edit_t *edit = context;
+    (void)frame;
+
+    for (u32 k = 0; k < bin_count; ++k) {
+        f32 hz = k * edit->sample_rate / edit->size;
+        b32 keep = true;
+
+        if (edit->band && (hz < edit->low || hz > edit->high)) {
+            keep = false;
+        }
+
+        if (edit->gate && bins[k].r * bins[k].r + bins[k].i * bins[k].i < edit->gate_power) {
+            keep = false;
+        }
+
+        if (!keep) {
+            bins[k] = (cn_t) {0};
+        }
+    }
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-n size] [-o hop] [-g gate_db] [-v low,high] <audio> <out.wav>\n", program);
+    fprintf(stderr, "  -g  drops bins quieter than this, dB of a full scale sine\n");
+    fprintf(stderr, "  -v  drops bins outside of the band\n");
+    fprintf(stderr, "  without edits, reports how far the output is from the input\n");
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    u32 size = RESYNTH_SIZE;
+    u32 hop  = 0;
+
+    resynth_edit_t edit = {0};
+    f32 gate_db = 0.0f;
+
+    i32 arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'n': size = atoi(argv[arg + 1]); break;
+            case 'o': hop  = atoi(argv[arg + 1]); break;
+
+            case 'g': {
+                gate_db   = atof(argv[arg + 1]);
+                edit.gate = true;
+            } break;
+
+            case 'v': {
+                if (sscanf(argv[arg + 1], "%f,%f", &edit.low, &edit.high) != 2 || edit.low >= edit.high) {
+                    fprintf(stderr, "Expected the band as 'low,high'!\n");
+                    return 1;
+                }
+
+                edit.band = true;
+            } break;
+
+            default: {
+                fprintf(stderr, "Unknown option '%s'!\n", argv[arg]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg + 2 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    hop = hop ? hop : size / 4;
+
+    wola_t wola;
+
+    if (!wola_init(&wola, size, hop)) {
+        fprintf(stderr, "The size has to be even and the hop a divisor of up to half of it!\n");
+        return 1;
+    }
+
+    Wave wave = LoadWave(argv[arg]);
+
+    if (!IsWaveReady(wave) || wave.frameCount == 0) {
+        fprintf(stderr, "Failed to decode '%s'!\n", argv[arg]);
+        wola_free(&wola);
+        return 1;
+    }
+
+    WaveFormat(&wave, wave.sampleRate, 32, wave.channels);
+
+    // A full scale sine peaks at half the window's sum in its bin.
+    f32 window_sum = 0.0f;
+
+    for (u32 i = 0; i < size; ++i) {
+        window_sum += wola.window[i];
+    }
+
+    f32 full_scale = 0.5f * window_sum;
+
+    edit.sample_rate = wave.sampleRate;
+    edit.size        = size;
+    edit.gate_power  = full_scale * full_scale * powf(10.0f, gate_db / 10.0f);
+
+    b32 edited = edit.gate || edit.band;
+
+    f32 *samples = wave.data;
+    f32 *in      = malloc((u64)wave.frameCount * sizeof(f32));
+    f32 *out     = malloc((u64)wave.frameCount * sizeof(f32));
+
+    if (!in || !out) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    f64 start = resynth_seconds();
+    f32 max_error = 0.0f;
+
+    for (u32 c = 0; c < wave.channels; ++c) {
+        for (u32 i = 0; i < wave.frameCount; ++i) {
+            in[i] = samples[(u64)i * wave.channels + c];
+        }
+
+        wola_process(&wola, in, wave.frameCount, out, edited ? resynth_edit : NULL, &edit);
+
+        for (u32 i = 0; i < wave.frameCount; ++i) {
+            f32 error = fabsf(out[i] - in[i]);
+            max_error = error > max_error ? error : max_error;
+
+            samples[(u64)i * wave.channels + c] = out[i];
+        }
+    }
+
+    f64 seconds = resynth_seconds() - start;
+    f64 audio_seconds = wave.frameCount / (f64)wave.sampleRate;
+
+    WaveFormat(&wave, wave.sampleRate, 16, wave.channels);
+
+    b32 ok = ExportWave(wave, argv[arg + 1]);
+
+    if (ok) {
+        printf("%.1fs of audio, %u channels, frames of %u every %u, in %.3fs (%.0fx real time)\n", audio_seconds,
+               wave.channels, size, hop, seconds, seconds > 0.0 ? audio_seconds / seconds : 0.0);
+
+        if (!edited) {
+            printf("largest difference to the input: %g\n", max_error);
+        }
+    }
+    else {
+        fprintf(stderr, "Failed to write '%s'!\n", argv[arg + 1]);
+    }
+
+    free(in);
+    free(out);
+    UnloadWave(wave);
+    wola_free(&wola);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,1396 @@
+#ifndef RX_H_
+#define RX_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+/* Regular expressions over caption text, matched by a lazily built DFA.
+ *
+ * Syntax: literals, `.`, `[...]` and `[^...]` classes, `\d \w \s` and their
+ * negations, `\b \B`, `^ $` (start and end of the text), groups `(...)` and
+ * `(?:...)`, alternation and the `* + ? {m} {m,} {m,n}` repeats. Matching is
+ * on bytes, bytes over 0x7F count as word characters so `\b` works around
+ * UTF-8 words. Matches are leftmost-longest.
+ *
+ * The pattern is compiled into a Thompson NFA, a forward and a reversed one.
+ * DFA states (sets of NFA states) get built on demand while scanning and are
+ * kept in a bounded cache that is simply flushed when it fills up. `\b` is
+ * handled by keeping whether the previous byte was a word byte in the state
+ * and resolving assertions once the next byte is known. The forward DFA
+ * finds where the leftmost-longest match ends, the reverse DFA scans back
+ * from there for its start. To stay leftmost the forward states keep their
+ * NFA states in groups ordered by start position, once a group matches the
+ * later ones are dropped and no new ones are started.
+ *
+ * Literals every match has to contain or start with are pulled out of the
+ * pattern, `rx_prefilter` rules out texts without them and the forward scan
+ * jumps between occurrences of the prefix with `rx_memmem` (SSE2).
+ */
+
+#define RX_LITERAL_MAX  64
+#define RX_CACHE_STATES 4096
+#define RX_MAX_INSTS    (1 << 16)
+#define RX_REPEAT_MAX   1000
+
+typedef struct
+{
+    u64 bits[4];
+} rx_set_t;
+
+typedef enum
+{
+    rx_op_Match,
+    rx_op_Set,
+    rx_op_Split,
+    rx_op_Assert,
+} rx_op_t;
+
+typedef enum
+{
+    rx_assert_WordBoundary,
+    rx_assert_NotWordBoundary,
+    rx_assert_Begin, // Start of the text in scan direction.
+    rx_assert_End,
+} rx_assert_t;
+
+typedef struct
+{
+    u32 op;
+    u32 arg; // Set index or assertion.
+    u32 out, out1;
+} rx_inst_t;
+
+typedef struct
+{
+    dck_stretchy_t (rx_inst_t, u32) insts;
+    u32 start;
+} rx_prog_t;
+
+typedef struct
+{
+    dck_stretchy_t (rx_set_t, u32) sets;
+
+    rx_prog_t forward, reverse;
+
+    u8  byte_class[256];
+    u8  class_byte[256]; // A byte of every class.
+    u32 class_count;
+
+    u8  prefix[RX_LITERAL_MAX];   // Every match starts with it.
+    u32 prefix_size;
+    u8  required[RX_LITERAL_MAX]; // Every match contains it.
+    u32 required_size;
+} rx_t;
+
+typedef struct
+{
+    u32 list_offset, list_size;
+    u32 flags;
+    u32 hash;
+} rx_state_t;
+
+typedef struct
+{
+    u32 *sparse, *dense;
+    u32  count;
+} rx_sparse_t;
+
+typedef struct
+{
+    const rx_t      *rx;
+    const rx_prog_t *prog;
+
+    dck_stretchy_t (rx_state_t, u32) states;
+    dck_stretchy_t (u32,        u32) lists; // NFA states of every DFA state, groups split by `RX_MARK`.
+
+    u32 *transitions; // `class_count + 1` per state, the last one is the end of the text.
+    u32 *slots;       // Open addressing over the states, holds index + 1.
+    u32  starts[8];   // Start state for every combination of flags.
+
+    rx_sparse_t seen, visited;
+
+    dck_stretchy_t (u32, u32) stack;
+    dck_stretchy_t (u32, u32) current;
+    dck_stretchy_t (u32, u32) follow;
+    dck_stretchy_t (u32, u32) next;
+
+    u64 flushes;
+} rx_dfa_t;
+
+// Mutable matching state, one per thread.
+typedef struct
+{
+    rx_dfa_t forward, reverse;
+} rx_cache_t;
+
+typedef struct
+{
+    u32 start, end;
+} rx_match_t;
+
+// Returns false and writes a message to `error` when the pattern is malformed.
+b32
+rx_compile(rx_t *rx, const char *pattern, b32 ignore_case, char *error, u32 error_size);
+
+void
+rx_free(rx_t *rx);
+
+void
+rx_cache_init(rx_cache_t *cache, const rx_t *rx);
+
+void
+rx_cache_free(rx_cache_t *cache);
+
+// False when `text` can't contain a match.
+b32
+rx_prefilter(const rx_t *rx, const u8 *text, u32 size);
+
+// Leftmost-longest match starting at or after `from`, the bytes before `from` still count for `\b`.
+b32
+rx_search(const rx_t *rx, rx_cache_t *cache, const u8 *text, u32 size, u32 from, rx_match_t *match_o);
+
+const u8 *
+rx_memmem(const u8 *haystack, u32 size, const u8 *needle, u32 needle_size);
+
+#endif // RX_H_
+
+#if defined(RX_IMPL) && !defined(RX_IMPL_)
+#define RX_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hash.h"
+
+#define RX_NONE     0xFFFFFFFF
+#define RX_MARK     0xFFFFFFFF
+#define RX_UNKNOWN  0xFFFFFFFF
+#define RX_INF      0xFFFFFFFF
+#define RX_MAX_DEPTH 256
+
+#define RX_FLAG_WORD       1 // The previous byte in scan direction is a word byte.
+#define RX_FLAG_EDGE       2 // At the start of the text in scan direction.
+#define RX_FLAG_NO_RESTART 4 // A match was seen, don't start new threads.
+
+static b32
+rx_is_word(u8 c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static void
+rx_set_add(rx_set_t *set, u8 c)
+{
+    set->bits[c >> 6] |= 1ull << (c & 63);
+}
+
+static b32
+rx_set_has(const rx_set_t *set, u8 c)
+{
+    return (set->bits[c >> 6] >> (c & 63)) & 1;
+}
+
+static void
+rx_set_add_range(rx_set_t *set, u8 lo, u8 hi)
+{
+    for (u32 c = lo; c <= hi; ++c) {
+        rx_set_add(set, (u8)c);
+    }
+}
+
+static void
+rx_set_invert(rx_set_t *set)
+{
+    for (u32 i = 0; i < 4; ++i) {
+        set->bits[i] = ~set->bits[i];
+    }
+}
+
+static void
+rx_set_fold_case(rx_set_t *set)
+{
+    for (u8 c = 'a'; c <= 'z'; ++c) {
+        if (rx_set_has(set, c) || rx_set_has(set, c - 'a' + 'A')) {
+            rx_set_add(set, c);
+            rx_set_add(set, c - 'a' + 'A');
+        }
+    }
+}
+
+// Single member of the set or `RX_NONE`.
+static u32
+rx_set_single(const rx_set_t *set)
+{
+    u32 count = 0, member = RX_NONE;
+
+    for (u32 i = 0; i < 4; ++i) {
+        u64 bits = set->bits[i];
+
+        count += __builtin_popcountll(bits);
+
+        if (bits) {
+            member = i * 64 + __builtin_ctzll(bits);
+        }
+    }
+
+    return count == 1 ? member : RX_NONE;
+}
+
+/* Parsing */
+
+typedef enum
+{
+    rx_node_Empty,
+    rx_node_Set,
+    rx_node_Assert,
+    rx_node_Concat,
+    rx_node_Alt,
+    rx_node_Repeat,
+} rx_node_kind_t;
+
+typedef struct
+{
+    u32 kind;
+    u32 a, b;     // Children, set index or assertion.
+    u32 min, max; // Repeats.
+} rx_node_t;
+
+typedef struct
+{
+    rx_t *rx;
+
+    const u8 *src;
+    u32 pos, size;
+    u32 depth;
+    b32 ignore_case;
+
+    dck_stretchy_t (rx_node_t, u32) nodes;
+
+    char *error;
+    u32   error_size;
+    b32   failed;
+} rx_parser_t;
+
+static void
+rx_fail(rx_parser_t *parser, const char *message)
+{
+    if (!parser->failed) {
+        snprintf(parser->error, parser->error_size, "%s at offset %u", message, parser->pos);
+        parser->failed = true;
+    }
+}
+
+static u32
+rx_node(rx_parser_t *parser, rx_node_t node)
+{
+    dck_stretchy_push(parser->nodes, node);
+    return parser->nodes.count - 1;
+}
+
+static u32
+rx_set_node(rx_parser_t *parser, rx_set_t set)
+{
+    if (parser->ignore_case) {
+        rx_set_fold_case(&set);
+    }
+
+    dck_stretchy_push(parser->rx->sets, set);
+
+    return rx_node(parser, (rx_node_t) { .kind = rx_node_Set, .a = parser->rx->sets.count - 1 });
+}
+
+// Sets of `\d \w \s` and their capitals, false for any other escape.
+static b32
+rx_class_escape(u8 c, rx_set_t *set)
+{
+    rx_set_t class = {0};
+
+    switch (c | 0x20) {
+        case 'd': rx_set_add_range(&class, '0', '9'); break;
+        case 'w': {
+            rx_set_add_range(&class, 'a', 'z');
+            rx_set_add_range(&class, 'A', 'Z');
+            rx_set_add_range(&class, '0', '9');
+            rx_set_add(&class, '_');
+        } break;
+        case 's': {
+            rx_set_add(&class, ' ');
+            rx_set_add_range(&class, '\t', '\r');
+        } break;
+        default: return false;
+    }
+
+    if (c >= 'A' && c <= 'Z') {
+        rx_set_invert(&class);
+    }
+
+    for (u32 i = 0; i < 4; ++i) {
+        set->bits[i] |= class.bits[i];
+    }
+
+    return true;
+}
+
+static u8
+rx_escape_byte(rx_parser_t *parser, u8 c)
+{
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case 'x': {
+            u32 value = 0;
+
+            for (u32 i = 0; i < 2; ++i) {
+                u8 h = parser->pos < parser->size ? parser->src[parser->pos] : 0;
+
+                if      (h >= '0' && h <= '9') value = value * 16 + (h - '0');
+                else if (h >= 'a' && h <= 'f') value = value * 16 + (h - 'a' + 10);
+                else if (h >= 'A' && h <= 'F') value = value * 16 + (h - 'A' + 10);
+                else {
+                    rx_fail(parser, "bad hex escape");
+                    return 0;
+                }
+
+                parser->pos++;
+            }
+
+            return (u8)value;
+        }
+        default: return c;
+    }
+}
+
+static u32
+rx_parse_class(rx_parser_t *parser)
+{
+    rx_set_t set = {0};
+    b32 negate = false;
+
+    if (parser->pos < parser->size && parser->src[parser->pos] == '^') {
+        negate = true;
+        parser->pos++;
+    }
+
+    b32 first = true;
+
+    for (;;) {
+        if (parser->pos >= parser->size) {
+            rx_fail(parser, "missing ]");
+            break;
+        }
+
+        u8 c = parser->src[parser->pos++];
+
+        if (c == ']' && !first)
+            break;
+
+        first = false;
+
+        if (c == '\\') {
+            if (parser->pos >= parser->size) {
+                rx_fail(parser, "trailing \\");
+                break;
+            }
+
+            c = parser->src[parser->pos++];
+
+            if (rx_class_escape(c, &set))
+                continue;
+
+            c = rx_escape_byte(parser, c);
+        }
+
+        u8 hi = c;
+
+        if (parser->pos + 1 < parser->size && parser->src[parser->pos] == '-' && parser->src[parser->pos + 1] != ']') {
+            parser->pos++;
+            hi = parser->src[parser->pos++];
+
+            if (hi == '\\' && parser->pos < parser->size) {
+                hi = rx_escape_byte(parser, parser->src[parser->pos++]);
+            }
+
+            if (hi < c) {
+                rx_fail(parser, "bad class range");
+                break;
+            }
+        }
+
+        rx_set_add_range(&set, c, hi);
+    }
+
+    if (parser->ignore_case) {
+        rx_set_fold_case(&set);
+    }
+
+    if (negate) {
+        rx_set_invert(&set);
+    }
+
+    dck_stretchy_push(parser->rx->sets, set);
+
+    return rx_node(parser, (rx_node_t) { .kind = rx_node_Set, .a = parser->rx->sets.count - 1 });
+}
+
+static u32 rx_parse_alt(rx_parser_t *parser);
+
+static u32
+rx_parse_atom(rx_parser_t *parser)
+{
+    u8 c = parser->src[parser->pos++];
+
+    switch (c) {
+        case '(': {
+            if (++parser->depth > RX_MAX_DEPTH) {
+                rx_fail(parser, "nested too deep");
+                return rx_node(parser, (rx_node_t) { .kind = rx_node_Empty });
+            }
+
+            if (parser->pos + 1 < parser->size && parser->src[parser->pos] == '?' && parser->src[parser->pos + 1] == ':') {
+                parser->pos += 2;
+            }
+
+            u32 node = rx_parse_alt(parser);
+
+            if (parser->pos >= parser->size || parser->src[parser->pos] != ')') {
+                rx_fail(parser, "missing )");
+            }
+            else {
+                parser->pos++;
+            }
+
+            parser->depth--;
+            return node;
+        }
+        case '[': return rx_parse_class(parser);
+        case '.': {
+            rx_set_t set = {0};
+            rx_set_invert(&set);
+            set.bits['\n' >> 6] &= ~(1ull << ('\n' & 63));
+            return rx_set_node(parser, set);
+        }
+        case '^': return rx_node(parser, (rx_node_t) { .kind = rx_node_Assert, .a = rx_assert_Begin });
+        case '$': return rx_node(parser, (rx_node_t) { .kind = rx_node_Assert, .a = rx_assert_End });
+        case '*': case '+': case '?': case '{': {
+            rx_fail(parser, "nothing to repeat");
+            return rx_node(parser, (rx_node_t) { .kind = rx_node_Empty });
+        }
+        case '\\': {
+            if (parser->pos >= parser->size) {
+                rx_fail(parser, "trailing \\");
+                return rx_node(parser, (rx_node_t) { .kind = rx_node_Empty });
+            }
+
+            c = parser->src[parser->pos++];
+
+            if (c == 'b') return rx_node(parser, (rx_node_t) { .kind = rx_node_Assert, .a = rx_assert_WordBoundary });
+            if (c == 'B') return rx_node(parser, (rx_node_t) { .kind = rx_node_Assert, .a = rx_assert_NotWordBoundary });
+
+            rx_set_t set = {0};
+
+            if (!rx_class_escape(c, &set)) {
+                rx_set_add(&set, rx_escape_byte(parser, c));
+            }
+
+            return rx_set_node(parser, set);
+        }
+        default: {
+            rx_set_t set = {0};
+            rx_set_add(&set, c);
+            return rx_set_node(parser, set);
+        }
+    }
+}
+
+static b32
+rx_parse_number(rx_parser_t *parser, u32 *value_o)
+{
+    u32 value = 0;
+    u32 digits = 0;
+
+    while (parser->pos < parser->size && parser->src[parser->pos] >= '0' && parser->src[parser->pos] <= '9') {
+        value = value * 10 + (parser->src[parser->pos++] - '0');
+        ++digits;
+
+        if (value > RX_REPEAT_MAX)
+            return false;
+    }
+
+    *value_o = value;
+    return digits != 0;
+}
+
+static u32
+rx_parse_repeat(rx_parser_t *parser)
+{
+    u32 node = rx_parse_atom(parser);
+
+    while (parser->pos < parser->size && !parser->failed) {
+        u8 c = parser->src[parser->pos];
+        u32 min, max;
+
+        if      (c == '*') { min = 0; max = RX_INF; }
+        else if (c == '+') { min = 1; max = RX_INF; }
+        else if (c == '?') { min = 0; max = 1; }
+        else if (c == '{') {
+            parser->pos++;
+
+            if (!rx_parse_number(parser, &min)) {
+                rx_fail(parser, "bad repeat count");
+                break;
+            }
+
+            max = min;
+
+            if (parser->pos < parser->size && parser->src[parser->pos] == ',') {
+                parser->pos++;
+                max = RX_INF;
+
+                if (parser->pos < parser->size && parser->src[parser->pos] != '}' && (!rx_parse_number(parser, &max) || max < min)) {
+                    rx_fail(parser, "bad repeat count");
+                    break;
+                }
+            }
+
+            if (parser->pos >= parser->size || parser->src[parser->pos] != '}') {
+                rx_fail(parser, "missing }");
+                break;
+            }
+        }
+        else {
+            break;
+        }
+
+        parser->pos++;
+
+        node = rx_node(parser, (rx_node_t) {
+            .kind = rx_node_Repeat,
+            .a    = node,
+            .min  = min,
+            .max  = max,
+        });
+    }
+
+    return node;
+}
+
+static u32
+rx_parse_concat(rx_parser_t *parser)
+{
+    u32 node = RX_NONE;
+
+    while (parser->pos < parser->size && !parser->failed) {
+        u8 c = parser->src[parser->pos];
+
+        if (c == '|' || c == ')')
+            break;
+
+        u32 next = rx_parse_repeat(parser);
+
+        node = node == RX_NONE ? next : rx_node(parser, (rx_node_t) { .kind = rx_node_Concat, .a = node, .b = next });
+    }
+
+    return node != RX_NONE ? node : rx_node(parser, (rx_node_t) { .kind = rx_node_Empty });
+}
+
+static u32
+rx_parse_alt(rx_parser_t *parser)
+{
+    u32 node = rx_parse_concat(parser);
+
+    while (parser->pos < parser->size && parser->src[parser->pos] == '|' && !parser->failed) {
+        parser->pos++;
+
+        u32 next = rx_parse_concat(parser);
+        node = rx_node(parser, (rx_node_t) { .kind = rx_node_Alt, .a = node, .b = next });
+    }
+
+    return node;
+}
+
+/* Literals */
+
+typedef struct
+{
+    u8  prefix[RX_LITERAL_MAX], suffix[RX_LITERAL_MAX], required[RX_LITERAL_MAX];
+    u32 prefix_size, suffix_size, required_size;
+    b32 exact; // The node matches exactly `prefix`, which then equals `suffix`.
+} rx_literal_t;
+
+static void
+rx_literal_keep_longest(rx_literal_t *literal, const u8 *text, u32 size)
+{
+    if (size > literal->required_size) {
+        memcpy(literal->required, text, size);
+        literal->required_size = size;
+    }
+}
+
+static rx_literal_t
+rx_literals(const rx_parser_t *parser, u32 index)
+{
+    rx_node_t node = parser->nodes.data[index];
+    rx_literal_t literal = {0};
+
+    switch (node.kind) {
+        case rx_node_Empty:
+        case rx_node_Assert: {
+            literal.exact = true;
+        } break;
+        case rx_node_Set: {
+            u32 c = rx_set_single(parser->rx->sets.data + node.a);
+
+            if (c != RX_NONE) {
+                literal.prefix[0] = literal.suffix[0] = literal.required[0] = (u8)c;
+                literal.prefix_size = literal.suffix_size = literal.required_size = 1;
+                literal.exact = true;
+            }
+        } break;
+        case rx_node_Concat: {
+            rx_literal_t a = rx_literals(parser, node.a);
+            rx_literal_t b = rx_literals(parser, node.b);
+
+            literal.exact = a.exact && b.exact && a.prefix_size + b.prefix_size <= RX_LITERAL_MAX;
+
+            literal.prefix_size = a.prefix_size;
+            memcpy(literal.prefix, a.prefix, a.prefix_size);
+
+            if (a.exact) {
+                u32 size = b.prefix_size < RX_LITERAL_MAX - a.prefix_size ? b.prefix_size : RX_LITERAL_MAX - a.prefix_size;
+                memcpy(literal.prefix + a.prefix_size, b.prefix, size);
+                literal.prefix_size += size;
+            }
+
+            literal.suffix_size = b.suffix_size;
+            memcpy(literal.suffix, b.suffix, b.suffix_size);
+
+            if (b.exact) {
+                // Keep the end of `a.suffix + b.suffix`.
+                u32 size = a.suffix_size < RX_LITERAL_MAX - b.suffix_size ? a.suffix_size : RX_LITERAL_MAX - b.suffix_size;
+                memmove(literal.suffix + size, literal.suffix, b.suffix_size);
+                memcpy(literal.suffix, a.suffix + a.suffix_size - size, size);
+                literal.suffix_size += size;
+            }
+
+            rx_literal_keep_longest(&literal, a.required, a.required_size);
+            rx_literal_keep_longest(&literal, b.required, b.required_size);
+
+            u8  joined[RX_LITERAL_MAX * 2];
+            u32 joined_size = a.suffix_size + b.prefix_size;
+
+            memcpy(joined, a.suffix, a.suffix_size);
+            memcpy(joined + a.suffix_size, b.prefix, b.prefix_size);
+
+            rx_literal_keep_longest(&literal, joined, joined_size < RX_LITERAL_MAX ? joined_size : RX_LITERAL_MAX);
+        } break;
+        case rx_node_Alt: break;
+        case rx_node_Repeat: {
+            if (node.min == 0)
+                break;
+
+            literal = rx_literals(parser, node.a);
+            literal.exact = literal.exact && node.min == 1 && node.max == 1;
+        } break;
+    }
+
+    return literal;
+}
+
+/* Compiling */
+
+static u32
+rx_emit(rx_prog_t *prog, rx_inst_t inst)
+{
+    dck_stretchy_push(prog->insts, inst);
+    return prog->insts.count - 1;
+}
+
+// Compiles the node so that it continues at `next`, returns its first instruction.
+static u32
+rx_compile_node(const rx_parser_t *parser, rx_prog_t *prog, u32 index, u32 next, b32 reverse)
+{
+    if (prog->insts.count > RX_MAX_INSTS)
+        return next;
+
+    rx_node_t node = parser->nodes.data[index];
+
+    switch (node.kind) {
+        case rx_node_Empty: return next;
+        case rx_node_Set: return rx_emit(prog, (rx_inst_t) { .op = rx_op_Set, .arg = node.a, .out = next });
+        case rx_node_Assert: {
+            u32 kind = node.a;
+
+            // Scanning backwards the start of the text is the end.
+            if (reverse && kind == rx_assert_Begin) {
+                kind = rx_assert_End;
+            }
+            else if (reverse && kind == rx_assert_End) {
+                kind = rx_assert_Begin;
+            }
+
+            return rx_emit(prog, (rx_inst_t) { .op = rx_op_Assert, .arg = kind, .out = next });
+        }
+        case rx_node_Concat: {
+            if (reverse)
+                return rx_compile_node(parser, prog, node.b, rx_compile_node(parser, prog, node.a, next, reverse), reverse);
+
+            return rx_compile_node(parser, prog, node.a, rx_compile_node(parser, prog, node.b, next, reverse), reverse);
+        }
+        case rx_node_Alt: {
+            u32 a = rx_compile_node(parser, prog, node.a, next, reverse);
+            u32 b = rx_compile_node(parser, prog, node.b, next, reverse);
+            return rx_emit(prog, (rx_inst_t) { .op = rx_op_Split, .out = a, .out1 = b });
+        }
+        case rx_node_Repeat: {
+            u32 tail = next;
+
+            if (node.max == RX_INF) {
+                u32 loop = rx_emit(prog, (rx_inst_t) { .op = rx_op_Split, .out1 = next });
+                u32 body = rx_compile_node(parser, prog, node.a, loop, reverse);
+                prog->insts.data[loop].out = body;
+                tail = loop;
+            }
+            else {
+                for (u32 i = node.min; i < node.max; ++i) {
+                    u32 body = rx_compile_node(parser, prog, node.a, tail, reverse);
+                    tail = rx_emit(prog, (rx_inst_t) { .op = rx_op_Split, .out = body, .out1 = next });
+                }
+            }
+
+            for (u32 i = 0; i < node.min; ++i) {
+                tail = rx_compile_node(parser, prog, node.a, tail, reverse);
+            }
+
+            return tail;
+        }
+    }
+
+    return next;
+}
+
+static void
+rx_build_classes(rx_t *rx)
+{
+    b32 boundary[256] = {0};
+
+    for (u32 c = 1; c < 256; ++c) {
+        boundary[c] = rx_is_word((u8)c) != rx_is_word((u8)(c - 1));
+    }
+
+    for (u32 s = 0; s < rx->sets.count; ++s) {
+        const rx_set_t *set = rx->sets.data + s;
+
+        for (u32 c = 1; c < 256; ++c) {
+            boundary[c] |= rx_set_has(set, (u8)c) != rx_set_has(set, (u8)(c - 1));
+        }
+    }
+
+    rx->class_count = 0;
+
+    for (u32 c = 0; c < 256; ++c) {
+        if (c == 0 || boundary[c]) {
+            rx->class_byte[rx->class_count++] = (u8)c;
+        }
+
+        rx->byte_class[c] = (u8)(rx->class_count - 1);
+    }
+}
+
+b32
+rx_compile(rx_t *rx, const char *pattern, b32 ignore_case, char *error, u32 error_size)
+{
+    *rx = (rx_t) {0};
+
+    rx_parser_t parser = {
+        .rx          = rx,
+        .src         = (const u8 *)pattern,
+        .size        = strlen(pattern),
+        .ignore_case = ignore_case,
+        .error       = error,
+        .error_size  = error_size,
+    };
+
+    u32 root = rx_parse_alt(&parser);
+
+    if (parser.pos < parser.size) {
+        rx_fail(&parser, "unmatched )");
+    }
+
+    if (!parser.failed) {
+        rx_prog_t *progs[2] = { &rx->forward, &rx->reverse };
+
+        for (u32 p = 0; p < 2; ++p) {
+            rx_emit(progs[p], (rx_inst_t) { .op = rx_op_Match });
+            progs[p]->start = rx_compile_node(&parser, progs[p], root, 0, p == 1);
+
+            if (progs[p]->insts.count > RX_MAX_INSTS) {
+                rx_fail(&parser, "pattern too big");
+            }
+        }
+    }
+
+    if (!parser.failed && !ignore_case) {
+        rx_literal_t literal = rx_literals(&parser, root);
+
+        memcpy(rx->prefix, literal.prefix, literal.prefix_size);
+        rx->prefix_size = literal.prefix_size;
+
+        memcpy(rx->required, literal.required, literal.required_size);
+        rx->required_size = literal.required_size;
+    }
+
+    free(parser.nodes.data);
+
+    if (parser.failed) {
+        rx_free(rx);
+        return false;
+    }
+
+    rx_build_classes(rx);
+
+    return true;
+}
+
+void
+rx_free(rx_t *rx)
+{
+    free(rx->sets.data);
+    free(rx->forward.insts.data);
+    free(rx->reverse.insts.data);
+    *rx = (rx_t) {0};
+}
+
+/* Lazy DFA */
+
+static void
+rx_sparse_init(rx_sparse_t *set, u32 capacity)
+{
+    set->sparse = malloc(capacity * sizeof(u32) + 1);
+    set->dense  = malloc(capacity * sizeof(u32) + 1);
+    set->count  = 0;
+
+    if (!set->sparse || !set->dense) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+}
+
+// Works on uninitialized memory, membership is checked both ways.
+static b32
+rx_sparse_insert(rx_sparse_t *set, u32 value)
+{
+    u32 i = set->sparse[value];
+
+    if (i < set->count && set->dense[i] == value)
+        return false;
+
+    set->sparse[value] = set->count;
+    set->dense[set->count++] = value;
+    return true;
+}
+
+static void
+rx_dfa_flush(rx_dfa_t *dfa)
+{
+    dfa->states.count = 0;
+    dfa->lists.count  = 0;
+
+    memset(dfa->transitions, 0xFF, RX_CACHE_STATES * (dfa->rx->class_count + 1) * sizeof(u32));
+    memset(dfa->slots, 0, RX_CACHE_STATES * 2 * sizeof(u32));
+    memset(dfa->starts, 0xFF, sizeof(dfa->starts));
+
+    dfa->flushes++;
+}
+
+static void
+rx_dfa_init(rx_dfa_t *dfa, const rx_t *rx, const rx_prog_t *prog)
+{
+    *dfa = (rx_dfa_t) {
+        .rx          = rx,
+        .prog        = prog,
+        .transitions = malloc(RX_CACHE_STATES * (rx->class_count + 1) * sizeof(u32)),
+        .slots       = malloc(RX_CACHE_STATES * 2 * sizeof(u32)),
+    };
+
+    if (!dfa->transitions || !dfa->slots) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    rx_sparse_init(&dfa->seen, prog->insts.count);
+    rx_sparse_init(&dfa->visited, prog->insts.count);
+
+    rx_dfa_flush(dfa);
+    dfa->flushes = 0;
+}
+
+static void
+rx_dfa_free(rx_dfa_t *dfa)
+{
+    free(dfa->states.data);
+    free(dfa->lists.data);
+    free(dfa->transitions);
+    free(dfa->slots);
+    free(dfa->seen.sparse);
+    free(dfa->seen.dense);
+    free(dfa->visited.sparse);
+    free(dfa->visited.dense);
+    free(dfa->stack.data);
+    free(dfa->current.data);
+    free(dfa->follow.data);
+    free(dfa->next.data);
+}
+
+static u32
+rx_dfa_intern(rx_dfa_t *dfa, const u32 *list, u32 size, u32 flags)
+{
+    u32 hash = (u32)hash_combine(hash_bytes(list, size * sizeof(u32)), flags);
+    u32 mask = RX_CACHE_STATES * 2 - 1;
+
+    for (u32 slot = hash & mask; dfa->slots[slot] != 0; slot = (slot + 1) & mask) {
+        u32 index = dfa->slots[slot] - 1;
+        rx_state_t state = dfa->states.data[index];
+
+        if (state.hash == hash && state.flags == flags && state.list_size == size
+         && memcmp(dfa->lists.data + state.list_offset, list, size * sizeof(u32)) == 0)
+            return index;
+    }
+
+    if (dfa->states.count == RX_CACHE_STATES) {
+        rx_dfa_flush(dfa);
+    }
+
+    u32 index = dfa->states.count;
+
+    dck_stretchy_push(dfa->states, (rx_state_t) {
+        .list_offset = dfa->lists.count,
+        .list_size   = size,
+        .flags       = flags,
+        .hash        = hash,
+    });
+
+    dck_stretchy_reserve(dfa->lists, size);
+    memcpy(dfa->lists.data + dfa->lists.count, list, size * sizeof(u32));
+    dfa->lists.count += size;
+
+    u32 slot = hash & mask;
+
+    while (dfa->slots[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+
+    dfa->slots[slot] = index + 1;
+
+    return index;
+}
+
+static int
+rx_u32_cmp(const void *a, const void *b)
+{
+    u32 ua = *(const u32 *)a;
+    u32 ub = *(const u32 *)b;
+    return (ua > ub) - (ua < ub);
+}
+
+// Adds what `inst` reaches without consuming a byte to `next`, assertions are kept unresolved.
+static void
+rx_dfa_closure(rx_dfa_t *dfa, u32 inst)
+{
+    dfa->stack.count = 0;
+    dck_stretchy_push(dfa->stack, inst);
+
+    while (dfa->stack.count) {
+        u32 i = dfa->stack.data[--dfa->stack.count];
+
+        if (!rx_sparse_insert(&dfa->seen, i))
+            continue;
+
+        rx_inst_t in = dfa->prog->insts.data[i];
+
+        if (in.op == rx_op_Split) {
+            dck_stretchy_push(dfa->stack, in.out1);
+            dck_stretchy_push(dfa->stack, in.out);
+        }
+        else {
+            dck_stretchy_push(dfa->next, i);
+        }
+    }
+}
+
+// Starts a group in `next`, returns where it begins.
+static u32
+rx_dfa_group_begin(rx_dfa_t *dfa)
+{
+    if (dfa->next.count != 0) {
+        dck_stretchy_push(dfa->next, RX_MARK);
+    }
+
+    return dfa->next.count;
+}
+
+static void
+rx_dfa_group_end(rx_dfa_t *dfa, u32 begin)
+{
+    if (begin == dfa->next.count) {
+        // Drop the mark of an empty group.
+        dfa->next.count = begin != 0 ? begin - 1 : 0;
+        return;
+    }
+
+    qsort(dfa->next.data + begin, dfa->next.count - begin, sizeof(u32), rx_u32_cmp);
+}
+
+static b32
+rx_assert_holds(u32 kind, u32 flags, b32 next_word, b32 at_end)
+{
+    b32 prev_word = (flags & RX_FLAG_WORD) != 0;
+
+    switch (kind) {
+        case rx_assert_WordBoundary:    return prev_word != next_word;
+        case rx_assert_NotWordBoundary: return prev_word == next_word;
+        case rx_assert_Begin:           return (flags & RX_FLAG_EDGE) != 0;
+        case rx_assert_End:             return at_end;
+    }
+
+    return false;
+}
+
+// Resolves the assertions of one group now that the next byte is known, into `follow`.
+static b32
+rx_dfa_follow(rx_dfa_t *dfa, const u32 *group, u32 size, u32 flags, b32 next_word, b32 at_end)
+{
+    b32 matched = false;
+
+    dfa->visited.count = 0;
+    dfa->follow.count  = 0;
+    dfa->stack.count   = 0;
+
+    for (u32 g = size; g > 0; --g) {
+        dck_stretchy_push(dfa->stack, group[g - 1]);
+    }
+
+    while (dfa->stack.count) {
+        u32 i = dfa->stack.data[--dfa->stack.count];
+
+        if (!rx_sparse_insert(&dfa->visited, i))
+            continue;
+
+        rx_inst_t in = dfa->prog->insts.data[i];
+
+        switch (in.op) {
+            case rx_op_Match: matched = true; break;
+            case rx_op_Set:   dck_stretchy_push(dfa->follow, i); break;
+            case rx_op_Split: {
+                dck_stretchy_push(dfa->stack, in.out1);
+                dck_stretchy_push(dfa->stack, in.out);
+            } break;
+            case rx_op_Assert: {
+                if (rx_assert_holds(in.arg, flags, next_word, at_end)) {
+                    dck_stretchy_push(dfa->stack, in.out);
+                }
+            } break;
+        }
+    }
+
+    return matched;
+}
+
+// Transition of `state` on byte class `cls`, `(next << 1) | matched`, just `matched` at the end of the text.
+static u32
+rx_dfa_compute(rx_dfa_t *dfa, u32 state, u32 cls)
+{
+    rx_state_t from = dfa->states.data[state];
+
+    // The state lists may move when the new state gets added.
+    dfa->current.count = 0;
+    dck_stretchy_reserve(dfa->current, from.list_size);
+    memcpy(dfa->current.data, dfa->lists.data + from.list_offset, from.list_size * sizeof(u32));
+    dfa->current.count = from.list_size;
+
+    b32 at_end    = cls == dfa->rx->class_count;
+    u8  c         = at_end ? 0 : dfa->rx->class_byte[cls];
+    b32 next_word = !at_end && rx_is_word(c);
+
+    b32 matched = false;
+
+    dfa->seen.count = 0;
+    dfa->next.count = 0;
+
+    u32 g = 0;
+
+    while (g < dfa->current.count && !matched) {
+        u32 end = g;
+
+        while (end < dfa->current.count && dfa->current.data[end] != RX_MARK) {
+            ++end;
+        }
+
+        matched = rx_dfa_follow(dfa, dfa->current.data + g, end - g, from.flags, next_word, at_end);
+
+        if (!at_end) {
+            u32 begin = rx_dfa_group_begin(dfa);
+
+            for (u32 f = 0; f < dfa->follow.count; ++f) {
+                rx_inst_t in = dfa->prog->insts.data[dfa->follow.data[f]];
+
+                if (rx_set_has(dfa->rx->sets.data + in.arg, c)) {
+                    rx_dfa_closure(dfa, in.out);
+                }
+            }
+
+            rx_dfa_group_end(dfa, begin);
+        }
+
+        // Groups after a matching one started later, they can only lose.
+        g = end + 1;
+    }
+
+    if (at_end)
+        return matched;
+
+    u32 flags = (next_word ? RX_FLAG_WORD : 0) | (from.flags & RX_FLAG_NO_RESTART) | (matched ? RX_FLAG_NO_RESTART : 0);
+
+    if (!(flags & RX_FLAG_NO_RESTART)) {
+        u32 begin = rx_dfa_group_begin(dfa);
+        rx_dfa_closure(dfa, dfa->prog->start);
+        rx_dfa_group_end(dfa, begin);
+    }
+
+    u32 next = rx_dfa_intern(dfa, dfa->next.data, dfa->next.count, flags);
+
+    return (next << 1) | matched;
+}
+
+static inline u32
+rx_dfa_next(rx_dfa_t *dfa, u32 state, u32 cls)
+{
+    u32 *transition = dfa->transitions + state * (dfa->rx->class_count + 1) + cls;
+
+    if (*transition != RX_UNKNOWN)
+        return *transition;
+
+    u64 flushes = dfa->flushes;
+    u32 result = rx_dfa_compute(dfa, state, cls);
+
+    // After a flush `state` is gone.
+    if (flushes == dfa->flushes) {
+        *transition = result;
+    }
+
+    return result;
+}
+
+static u32
+rx_dfa_start(rx_dfa_t *dfa, u32 flags)
+{
+    if (dfa->starts[flags] != RX_UNKNOWN)
+        return dfa->starts[flags];
+
+    dfa->seen.count = 0;
+    dfa->next.count = 0;
+
+    rx_dfa_closure(dfa, dfa->prog->start);
+    rx_dfa_group_end(dfa, 0);
+
+    u32 start = rx_dfa_intern(dfa, dfa->next.data, dfa->next.count, flags);
+    dfa->starts[flags] = start;
+
+    return start;
+}
+
+static inline b32
+rx_dfa_dead(const rx_dfa_t *dfa, u32 state)
+{
+    rx_state_t s = dfa->states.data[state];
+    return s.list_size == 0 && (s.flags & RX_FLAG_NO_RESTART);
+}
+
+void
+rx_cache_init(rx_cache_t *cache, const rx_t *rx)
+{
+    rx_dfa_init(&cache->forward, rx, &rx->forward);
+    rx_dfa_init(&cache->reverse, rx, &rx->reverse);
+}
+
+void
+rx_cache_free(rx_cache_t *cache)
+{
+    rx_dfa_free(&cache->forward);
+    rx_dfa_free(&cache->reverse);
+}
+
+/* Searching */
+
+const u8 *
+rx_memmem(const u8 *haystack, u32 size, const u8 *needle, u32 needle_size)
+{
+    if (needle_size == 0)
+        return haystack;
+
+    if (needle_size > size)
+        return NULL;
+
+    u32 i = 0;
+    u32 last = needle_size - 1;
+
+#if defined(__SSE2__)
+    // Compare the first and the last byte of 16 candidates at once, check the rest only for hits.
+    const __m128i first_byte = _mm_set1_epi8((char)needle[0]);
+    const __m128i last_byte  = _mm_set1_epi8((char)needle[last]);
+
+    for (; i + last + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(haystack + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(haystack + i + last));
+
+        u32 mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first_byte), _mm_cmpeq_epi8(b, last_byte)));
+
+        while (mask) {
+            u32 at = i + __builtin_ctz(mask);
+
+            if (memcmp(haystack + at + 1, needle + 1, needle_size > 1 ? needle_size - 2 : 0) == 0)
+                return haystack + at;
+
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i + needle_size <= size; ++i) {
+        if (haystack[i] == needle[0] && memcmp(haystack + i, needle, needle_size) == 0)
+            return haystack + i;
+    }
+
+    return NULL;
+}
+
+b32
+rx_prefilter(const rx_t *rx, const u8 *text, u32 size)
+{
+    return rx_memmem(text, size, rx->required, rx->required_size) != NULL;
+}
+
+static u32
+rx_flags_before(const u8 *text, u32 pos)
+{
+    if (pos == 0)
+        return RX_FLAG_EDGE;
+
+    return rx_is_word(text[pos - 1]) ? RX_FLAG_WORD : 0;
+}
+
+// End of the leftmost-longest match starting at or after `from`.
+static b32
+rx_scan_forward(const rx_t *rx, rx_dfa_t *dfa, const u8 *text, u32 size, u32 from, u32 *end_o)
+{
+    u32 pos = from;
+    b32 found = false;
+
+    if (rx->prefix_size != 0) {
+        const u8 *at = rx_memmem(text + pos, size - pos, rx->prefix, rx->prefix_size);
+        if (!at)
+            return false;
+
+        pos = at - text;
+    }
+
+    u32 state = rx_dfa_start(dfa, rx_flags_before(text, pos));
+
+    for (; pos < size; ++pos) {
+        // Nothing is in flight, so no match starts before the next prefix.
+        if (rx->prefix_size != 0 && state == dfa->starts[dfa->states.data[state].flags]) {
+            const u8 *at = rx_memmem(text + pos, size - pos, rx->prefix, rx->prefix_size);
+            if (!at)
+                return found;
+
+            if (at != text + pos) {
+                pos = at - text;
+                state = rx_dfa_start(dfa, rx_flags_before(text, pos));
+            }
+        }
+
+        u32 transition = rx_dfa_next(dfa, state, rx->byte_class[text[pos]]);
+
+        if (transition & 1) {
+            found = true;
+            *end_o = pos;
+        }
+
+        state = transition >> 1;
+
+        if (rx_dfa_dead(dfa, state))
+            return found;
+    }
+
+    if (rx_dfa_next(dfa, state, rx->class_count) & 1) {
+        found = true;
+        *end_o = size;
+    }
+
+    return found;
+}
+
+// Start of the longest match that ends at `end` and starts at or after `from`.
+static u32
+rx_scan_reverse(const rx_t *rx, rx_dfa_t *dfa, const u8 *text, u32 size, u32 end, u32 from)
+{
+    u32 flags = RX_FLAG_NO_RESTART;
+
+    if (end == size) {
+        flags |= RX_FLAG_EDGE;
+    }
+    else if (rx_is_word(text[end])) {
+        flags |= RX_FLAG_WORD;
+    }
+
+    u32 state = rx_dfa_start(dfa, flags);
+    u32 start = end;
+
+    for (u32 pos = end; pos > from; --pos) {
+        u32 transition = rx_dfa_next(dfa, state, rx->byte_class[text[pos - 1]]);
+
+        if (transition & 1) {
+            start = pos;
+        }
+
+        state = transition >> 1;
+
+        if (rx_dfa_dead(dfa, state))
+            return start;
+    }
+
+    // Only whether a match ends at `from` matters, the byte before it just resolves the assertions.
+    u32 cls = from == 0 ? rx->class_count : rx->byte_class[text[from - 1]];
+
+    if (rx_dfa_next(dfa, state, cls) & 1) {
+        start = from;
+    }
+
+    return start;
+}
+
+b32
+rx_search(const rx_t *rx, rx_cache_t *cache, const u8 *text, u32 size, u32 from, rx_match_t *match_o)
+{
+    if (from > size)
+        return false;
+
+    u32 end;
+
+    if (!rx_scan_forward(rx, &cache->forward, text, size, from, &end))
+        return false;
+
+    match_o->start = rx_scan_reverse(rx, &cache->reverse, text, size, end, from);
+    match_o->end   = end;
+
+    return true;
+}
+
+#endif // RX_IMPL
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+#include "core/sv.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define VOCAB_IMPL
+#include "vocab.h"
+
+#define PHONETIC_IMPL
+#include "phonetic.h"
+
+#define TOKEN_STREAM_IMPL
+#include "token_stream.h"
+
+// cc src/search.c -o search.exe -I. -O2 && ./search.exe -p witch ../oneyplays/witch_hunt_test/*.vtt
+
+#define SEARCH_MAX_TERMS 256
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-p] <word> <file.vtt>...\n", program);
+    fprintf(stderr, "  -p  also match words that sound alike\n");
+}
+
+static u32
+find_stream(const u32 *stream_offsets, u32 stream_count, u32 word_index)
+{
+    u32 lo = 0, hi = stream_count;
+
+    while (hi - lo > 1) {
+        u32 mid = (lo + hi) / 2;
+
+        if (stream_offsets[mid] <= word_index) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    b32 phonetic = false;
+    i32 arg = 1;
+
+    if (arg < argc && strcmp(argv[arg], "-p") == 0) {
+        phonetic = true;
+        ++arg;
+    }
+
+    if (argc - arg < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *query = argv[arg++];
+
+    // Only the token streams are kept, the parsed text is reused for the next file.
+    vtt_data_t vtt_data = {0};
+    vocab_t dict = {0};
+    token_terms_t dict_terms = {0};
+    vocab_index_t index = {0};
+
+    dck_stretchy_t (token_stream_t, u32) streams = {0};
+    dck_stretchy_t (u32,            u32) stream_offsets = {0};
+    u32 token_count = 0;
+
+    for (; arg < argc; ++arg) {
+        vtt_data.text.count  = 0;
+        vtt_data.words.count = 0;
+
+        vtt_chunk_t chunk = vtt_parse_file(&vtt_data, argv[arg]);
+
+        token_stream_t stream;
+        token_stream_encode(&stream, &dict, &vtt_data, chunk);
+        token_stream_index(&stream, &dict, &index, &dict_terms);
+
+        dck_stretchy_push(streams, stream);
+        dck_stretchy_push(stream_offsets, token_count);
+        token_count += stream.count;
+    }
+
+    free(vtt_data.text.data);
+    free(vtt_data.words.data);
+
+    vocab_index_finish(&index);
+
+    u8 query_norm[256];
+    u32 query_size = strlen(query) < sizeof(query_norm) ? strlen(query) : sizeof(query_norm);
+    query_size = vocab_normalize((const u8 *)query, query_size, query_norm);
+
+    u32 terms[SEARCH_MAX_TERMS];
+    u32 term_count = 0;
+
+    u32 exact = vocab_find(&index.vocab, query_norm, query_size);
+    if (exact != VOCAB_NONE) {
+        terms[term_count++] = exact;
+    }
+
+    if (phonetic) {
+        phonetic_index_t phonetic_index = {0};
+        phonetic_index_build(&phonetic_index, &index.vocab);
+
+        u32 alike[SEARCH_MAX_TERMS];
+        u32 alike_count = phonetic_expand(&phonetic_index, query_norm, query_size, alike, SEARCH_MAX_TERMS - 1);
+
+        for (u32 i = 0; i < alike_count; ++i) {
+            if (alike[i] != exact) {
+                terms[term_count++] = alike[i];
+            }
+        }
+
+        phonetic_index_free(&phonetic_index);
+    }
+
+    u32 hit_count = 0;
+
+    for (u32 t = 0; t < term_count; ++t) {
+        u32 term_size;
+        const u8 *term_text = vocab_text(&index.vocab, terms[t], &term_size);
+
+        u32 posting_count;
+        const u32 *postings = vocab_index_postings(&index, terms[t], &posting_count);
+
+        printf("'"SV_FMT"': %u\n", (int)term_size, term_text, posting_count);
+
+        for (u32 p = 0; p < posting_count; ++p) {
+            u32 stream_i = find_stream(stream_offsets.data, stream_offsets.count, postings[p]);
+            token_time_t time = streams.data[stream_i].times.data[postings[p] - stream_offsets.data[stream_i]];
+
+            u32 ms = (u32)(time.time_start * 1000.0f);
+
+            printf("    %s %02u:%02u:%02u.%03u\n", argv[argc - streams.count + stream_i],
+                   ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000);
+        }
+
+        hit_count += posting_count;
+    }
+
+    printf("%u occurrences of %u words\n", hit_count, term_count);
+
+    for (u32 i = 0; i < streams.count; ++i) {
+        token_stream_free(streams.data + i);
+    }
+
+    vocab_index_free(&index);
+    vocab_free(&dict);
+    free(dict_terms.data);
+    free(streams.data);
+    free(stream_offsets.data);
+
+    return 0;
+}
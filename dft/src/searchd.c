@@ -0,0 +1,792 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+#include "core/sv.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define SEGMENT_IMPL
+#include "segment.h"
+
+#define QUERY_CACHE_IMPL
+#include "query_cache.h"
+
+// cc src/searchd.c -o searchd.exe -I. -O2 -lpthread && ./searchd.exe ../index /tmp/dft.sock
+
+/* Line protocol, one request per line, every response starts with `OK <count>`
+ * followed by `<count>` lines, or with a single `ERR <message>` line. Hit lists
+ * are capped at `SEARCHD_MAX_HITS` and report the full count after `<count>`.
+ *
+ *   word <word>                   -> <video> <start> <end>
+ *   phrase <word> <word>...       -> <video> <start> <end>
+ *   range <video> <start> <end>   -> <start> <end> <word>
+ *   name <video>                  -> <name>
+ *   ingest <file.vtt>             -> <video>
+ *   stats                         -> latency histograms and cache counters
+ *
+ * Requests that arrive together get answered with a single write. Responses
+ * are cached by their normalized request, ingesting a file invalidates them.
+ *
+ * The main thread polls every open connection and queues only the ones with
+ * input for the workers, which answer what arrived and hand the connection
+ * back. Idle clients don't hold a worker, and get closed after
+ * `SEARCHD_IDLE_MS` without a request.
+ */
+
+#define SEARCHD_DEFAULT_WORKERS 4
+#define SEARCHD_QUEUE_SIZE      64
+#define SEARCHD_LINE_MAX        (64 * 1024)
+#define SEARCHD_MAX_HITS        1000
+#define SEARCHD_POLL_MS         200
+#define SEARCHD_KEY_MAX         1024
+#define SEARCHD_DEFAULT_CACHE   64 // MiB
+#define SEARCHD_MAX_CONNECTIONS 256
+#define SEARCHD_IDLE_MS         (60 * 1000)
+
+// Bucket `b` counts queries that took less than `2^b` microseconds.
+#define SEARCHD_LATENCY_BUCKETS 32
+
+typedef enum
+{
+    searchd_query_Word,
+    searchd_query_Phrase,
+    searchd_query_Range,
+    searchd_query_Name,
+
+    searchd_query_Count,
+} searchd_query_t;
+
+static const char *searchd_query_names[searchd_query_Count] = {
+    "word",
+    "phrase",
+    "range",
+    "name",
+};
+
+typedef query_cache_bytes_t searchd_buffer_t;
+
+typedef struct
+{
+    i32   fd;
+    char *input; // `SEARCHD_LINE_MAX` bytes, the start of an incomplete line.
+    u32   input_size;
+    u64   last_active_us;
+    b32   busy;   // With a worker, not polled.
+    b32   closing; // Set by the worker when the client is gone or misbehaved.
+} searchd_conn_t;
+
+typedef struct
+{
+    searchd_conn_t *conns[SEARCHD_QUEUE_SIZE];
+    u32 head, count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+} searchd_queue_t;
+
+typedef struct
+{
+    segment_set_t   set;
+    searchd_queue_t queue;
+    query_cache_t   cache;
+
+    i32 returned[2]; // Pipe the workers write finished connections to, wakes up the main thread.
+
+    atomic_uint_fast64_t latency[searchd_query_Count][SEARCHD_LATENCY_BUCKETS];
+} searchd_t;
+
+static volatile sig_atomic_t searchd_running = 1;
+
+static void
+searchd_signal(int signal)
+{
+    (void)signal;
+    searchd_running = 0;
+}
+
+static void
+searchd_queue_push(searchd_queue_t *queue, searchd_conn_t *conn)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->count == SEARCHD_QUEUE_SIZE) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+
+    queue->conns[(queue->head + queue->count) % SEARCHD_QUEUE_SIZE] = conn;
+    queue->count++;
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static searchd_conn_t *
+searchd_queue_pop(searchd_queue_t *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->count == 0) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+
+    searchd_conn_t *conn = queue->conns[queue->head];
+    queue->head = (queue->head + 1) % SEARCHD_QUEUE_SIZE;
+    queue->count--;
+
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+
+    return conn;
+}
+
+static void
+searchd_printf(searchd_buffer_t *out, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    i32 size = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    dck_stretchy_reserve(*out, (u32)size + 1);
+
+    va_start(args, fmt);
+    vsnprintf((char *)out->data + out->count, size + 1, fmt, args);
+    va_end(args);
+
+    out->count += size;
+}
+
+static u64
+searchd_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+searchd_record(searchd_t *daemon, searchd_query_t query, u64 micros)
+{
+    u32 bucket = 0;
+
+    while (bucket + 1 < SEARCHD_LATENCY_BUCKETS && (1ull << bucket) <= micros) {
+        ++bucket;
+    }
+
+    atomic_fetch_add_explicit(&daemon->latency[query][bucket], 1, memory_order_relaxed);
+}
+
+// Splits off the next space separated argument, returns its size.
+static u32
+searchd_next_arg(char **line, char **arg_o)
+{
+    char *at = *line;
+
+    while (*at == ' ' || *at == '\t') {
+        ++at;
+    }
+
+    *arg_o = at;
+
+    while (*at != 0 && *at != ' ' && *at != '\t') {
+        ++at;
+    }
+
+    u32 size = at - *arg_o;
+    *line = at;
+
+    return size;
+}
+
+static void
+searchd_write_hits(searchd_buffer_t *out, const segment_hits_t *hits)
+{
+    u32 shown = hits->count < SEARCHD_MAX_HITS ? hits->count : SEARCHD_MAX_HITS;
+
+    searchd_printf(out, "OK %u %u\n", shown, hits->count);
+
+    for (u32 i = 0; i < shown; ++i) {
+        segment_hit_t hit = hits->data[i];
+        searchd_printf(out, "%u %.3f %.3f\n", hit.video_id, hit.time_start, hit.time_end);
+    }
+}
+
+static void
+searchd_write_stats(searchd_t *daemon, searchd_buffer_t *out)
+{
+    query_cache_stats_t cache = query_cache_stats(&daemon->cache);
+
+    searchd_printf(out, "OK %u\n", (u32)searchd_query_Count + 1);
+    searchd_printf(out, "cache entries=%u bytes="FMT_U64"/"FMT_U64" hits="FMT_U64" misses="FMT_U64
+                        " evictions="FMT_U64" invalidations="FMT_U64"\n",
+                   cache.count, cache.bytes, cache.budget, cache.hits, cache.misses,
+                   cache.evictions, cache.invalidations);
+
+    for (u32 q = 0; q < searchd_query_Count; ++q) {
+        u64 counts[SEARCHD_LATENCY_BUCKETS];
+        u64 total = 0;
+
+        for (u32 b = 0; b < SEARCHD_LATENCY_BUCKETS; ++b) {
+            counts[b] = atomic_load_explicit(&daemon->latency[q][b], memory_order_relaxed);
+            total += counts[b];
+        }
+
+        // Percentiles are upper bounds of the buckets they fall into.
+        u64 p50 = 0, p99 = 0, seen = 0;
+
+        for (u32 b = 0; b < SEARCHD_LATENCY_BUCKETS && total != 0; ++b) {
+            seen += counts[b];
+
+            if (p50 == 0 && seen * 2 >= total) {
+                p50 = 1ull << b;
+            }
+
+            if (p99 == 0 && seen * 100 >= total * 99) {
+                p99 = 1ull << b;
+            }
+        }
+
+        searchd_printf(out, "%s count="FMT_U64" p50<"FMT_U64"us p99<"FMT_U64"us buckets=",
+                       searchd_query_names[q], total, p50, p99);
+
+        for (u32 b = 0; b < SEARCHD_LATENCY_BUCKETS; ++b) {
+            searchd_printf(out, b ? ","FMT_U64 : FMT_U64, counts[b]);
+        }
+
+        searchd_printf(out, "\n");
+    }
+}
+
+typedef struct
+{
+    searchd_query_t query;
+
+    u8        norm[SEGMENT_PHRASE_MAX][256];
+    const u8 *terms[SEGMENT_PHRASE_MAX];
+    u32       sizes[SEGMENT_PHRASE_MAX];
+    u32       term_count;
+
+    u32 video_id;
+    f32 time_start, time_end;
+
+    // The request type with its normalized arguments, identifies the response in the cache.
+    char key[SEARCHD_KEY_MAX];
+    u32  key_size;
+    b32  uncacheable; // The key didn't fit, a cut off one could be another request's.
+} searchd_request_t;
+
+static void
+searchd_key_append(searchd_request_t *request, const void *data, u32 size)
+{
+    if (request->key_size + size > SEARCHD_KEY_MAX) {
+        request->uncacheable = true;
+        return;
+    }
+
+    memcpy(request->key + request->key_size, data, size);
+    request->key_size += size;
+}
+
+// Returns an error message or NULL.
+static const char *
+searchd_parse_request(searchd_request_t *request, const char *command, u32 command_size, char *line)
+{
+    #define COMMAND_IS(m_name) (command_size == sizeof(m_name) - 1 && memcmp(command, m_name, command_size) == 0)
+
+    if (COMMAND_IS("word") || COMMAND_IS("phrase")) {
+        request->query = COMMAND_IS("word") ? searchd_query_Word : searchd_query_Phrase;
+        searchd_key_append(request, command, command_size);
+
+        u32 max_terms = request->query == searchd_query_Word ? 1 : SEGMENT_PHRASE_MAX;
+
+        char *arg;
+        u32 arg_size;
+
+        while ((arg_size = searchd_next_arg(&line, &arg)) != 0 && request->term_count < max_terms) {
+            u32 t = request->term_count;
+
+            if (arg_size > sizeof(request->norm[t])) {
+                arg_size = sizeof(request->norm[t]);
+            }
+
+            request->sizes[t] = vocab_normalize((const u8 *)arg, arg_size, request->norm[t]);
+            request->terms[t] = request->norm[t];
+
+            if (request->sizes[t] != 0) {
+                searchd_key_append(request, " ", 1);
+                searchd_key_append(request, request->terms[t], request->sizes[t]);
+                ++request->term_count;
+            }
+        }
+
+        return request->term_count ? NULL : "missing word";
+    }
+
+    if (COMMAND_IS("range")) {
+        request->query = searchd_query_Range;
+
+        if (sscanf(line, "%u %f %f", &request->video_id, &request->time_start, &request->time_end) != 3)
+            return "usage: range <video> <start> <end>";
+
+        // The times go in as they are, any printed precision would let close ranges share a response.
+        searchd_key_append(request, command, command_size);
+        searchd_key_append(request, &request->video_id, sizeof(request->video_id));
+        searchd_key_append(request, &request->time_start, sizeof(request->time_start));
+        searchd_key_append(request, &request->time_end, sizeof(request->time_end));
+        return NULL;
+    }
+
+    if (COMMAND_IS("name")) {
+        request->query = searchd_query_Name;
+
+        if (sscanf(line, "%u", &request->video_id) != 1)
+            return "usage: name <video>";
+
+        searchd_key_append(request, command, command_size);
+        searchd_key_append(request, &request->video_id, sizeof(request->video_id));
+        return NULL;
+    }
+
+    #undef COMMAND_IS
+
+    return "unknown request";
+}
+
+static void
+searchd_execute(searchd_t *daemon, const searchd_request_t *request, searchd_buffer_t *out,
+                segment_hits_t *hits, segment_words_t *words)
+{
+    segment_snapshot_t snapshot = segment_set_snapshot(&daemon->set);
+
+    hits->count  = 0;
+    words->count = 0;
+
+    switch (request->query) {
+        case searchd_query_Word: {
+            segment_snapshot_find(&snapshot, request->terms[0], request->sizes[0], hits);
+            searchd_write_hits(out, hits);
+        } break;
+
+        case searchd_query_Phrase: {
+            segment_snapshot_find_phrase(&snapshot, request->terms, request->sizes, request->term_count, hits);
+            searchd_write_hits(out, hits);
+        } break;
+
+        case searchd_query_Range: {
+            segment_snapshot_range(&snapshot, request->video_id, request->time_start, request->time_end, words);
+
+            searchd_printf(out, "OK %u\n", words->count);
+
+            for (u32 i = 0; i < words->count; ++i) {
+                segment_word_t word = words->data[i];
+                searchd_printf(out, "%.3f %.3f "SV_FMT"\n", word.time_start, word.time_end, (int)word.size, word.text);
+            }
+        } break;
+
+        case searchd_query_Name: {
+            u32 name_size;
+            const u8 *name = segment_snapshot_video_name(&snapshot, request->video_id, &name_size);
+
+            if (name) {
+                searchd_printf(out, "OK 1\n"SV_FMT"\n", (int)name_size, name);
+            }
+            else {
+                searchd_printf(out, "ERR unknown video\n");
+            }
+        } break;
+
+        default: UNREACHABLE();
+    }
+
+    segment_snapshot_release(&snapshot);
+}
+
+static void
+searchd_ingest(searchd_t *daemon, char *line, searchd_buffer_t *out)
+{
+    char *path;
+    u32 path_size = searchd_next_arg(&line, &path);
+
+    if (path_size == 0) {
+        searchd_printf(out, "ERR usage: ingest <file.vtt>\n");
+        return;
+    }
+
+    path[path_size] = 0;
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        searchd_printf(out, "ERR can't open '%s'\n", path);
+        return;
+    }
+
+    fclose(file);
+
+    vtt_data_t vtt_data = {0};
+    vtt_chunk_t chunk = vtt_parse_file(&vtt_data, path);
+
+    // Bumps the generation, that drops the cached results.
+    u32 video_id = segment_set_add_video(&daemon->set, path, &vtt_data, chunk);
+
+    free(vtt_data.text.data);
+    free(vtt_data.words.data);
+
+    if (video_id == SEGMENT_NONE) {
+        searchd_printf(out, "ERR failed to index '%s'\n", path);
+        return;
+    }
+
+    searchd_printf(out, "OK 1\n%u\n", video_id);
+}
+
+static void
+searchd_handle_line(searchd_t *daemon, char *line, searchd_buffer_t *out, segment_hits_t *hits, segment_words_t *words)
+{
+    char *command;
+    u32 command_size = searchd_next_arg(&line, &command);
+
+    if (command_size == 5 && memcmp(command, "stats", 5) == 0) {
+        searchd_write_stats(daemon, out);
+        return;
+    }
+
+    if (command_size == 6 && memcmp(command, "ingest", 6) == 0) {
+        searchd_ingest(daemon, line, out);
+        return;
+    }
+
+    u64 start = searchd_now_us();
+
+    searchd_request_t request = {0};
+    const char *error = searchd_parse_request(&request, command, command_size, line);
+
+    if (error) {
+        searchd_printf(out, "ERR %s\n", error);
+        return;
+    }
+
+    // Read before the snapshot is taken, an ingest in between only makes the entry stale, never wrong.
+    u64 generation = segment_set_generation(&daemon->set);
+
+    if (request.uncacheable) {
+        searchd_execute(daemon, &request, out, hits, words);
+    } else if (!query_cache_get(&daemon->cache, generation, request.key, request.key_size, out)) {
+        u32 response_start = out->count;
+
+        searchd_execute(daemon, &request, out, hits, words);
+
+        query_cache_put(&daemon->cache, generation, request.key, request.key_size,
+                        out->data + response_start, out->count - response_start);
+    }
+
+    searchd_record(daemon, request.query, searchd_now_us() - start);
+}
+
+static b32
+searchd_write_all(i32 fd, const u8 *data, u32 size)
+{
+    while (size != 0) {
+        ssize_t written = write(fd, data, size);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+// Answers the complete lines of what the client sent, one read's worth since the connection polled readable.
+static void
+searchd_serve(searchd_t *daemon, searchd_conn_t *conn, searchd_buffer_t *out, segment_hits_t *hits, segment_words_t *words)
+{
+    char *input = conn->input;
+
+    ssize_t got = read(conn->fd, input + conn->input_size, SEARCHD_LINE_MAX - conn->input_size);
+
+    if (got < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+
+    if (got <= 0) {
+        conn->closing = true;
+        return;
+    }
+
+    conn->input_size += got;
+
+    // Answer every complete line of this read in one batch.
+    out->count = 0;
+    u32 line_start = 0;
+
+    for (u32 i = 0; i < conn->input_size; ++i) {
+        if (input[i] != '\n')
+            continue;
+
+        input[i] = 0;
+
+        if (i > line_start && input[i - 1] == '\r') {
+            input[i - 1] = 0;
+        }
+
+        searchd_handle_line(daemon, input + line_start, out, hits, words);
+        line_start = i + 1;
+    }
+
+    memmove(input, input + line_start, conn->input_size - line_start);
+    conn->input_size -= line_start;
+
+    if (conn->input_size == SEARCHD_LINE_MAX) {
+        searchd_printf(out, "ERR request too long\n");
+        conn->closing = true;
+    }
+
+    if (out->count != 0 && !searchd_write_all(conn->fd, out->data, out->count)) {
+        conn->closing = true;
+    }
+}
+
+static void *
+searchd_worker(void *arg)
+{
+    searchd_t *daemon = arg;
+
+    searchd_buffer_t out   = {0};
+    segment_hits_t   hits  = {0};
+    segment_words_t  words = {0};
+
+    for (;;) {
+        searchd_conn_t *conn = searchd_queue_pop(&daemon->queue);
+        if (!conn)
+            break;
+
+        searchd_serve(daemon, conn, &out, &hits, &words);
+
+        // A pointer is less than `PIPE_BUF`, so the write is atomic.
+        while (write(daemon->returned[1], &conn, sizeof(conn)) < 0 && errno == EINTR) {}
+    }
+
+    free(out.data);
+    free(hits.data);
+    free(words.data);
+
+    return NULL;
+}
+
+static void
+searchd_conn_close(searchd_conn_t *conn)
+{
+    close(conn->fd);
+    free(conn->input);
+    free(conn);
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <index dir> <socket path> [workers] [cache MiB]\n", argv[0]);
+        return 1;
+    }
+
+    const char *socket_path = argv[2];
+    u32 worker_count = argc > 3 ? (u32)atoi(argv[3]) : SEARCHD_DEFAULT_WORKERS;
+
+    u64 cache_budget = argc > 4 ? (u64)atoi(argv[4]) : SEARCHD_DEFAULT_CACHE;
+
+    if (worker_count == 0) {
+        worker_count = SEARCHD_DEFAULT_WORKERS;
+    }
+
+    static searchd_t daemon;
+
+    if (pipe(daemon.returned) != 0) {
+        fprintf(stderr, "Failed to create a pipe: %s\n", strerror(errno));
+        return 1;
+    }
+
+    pthread_mutex_init(&daemon.queue.lock, NULL);
+    pthread_cond_init(&daemon.queue.not_empty, NULL);
+    pthread_cond_init(&daemon.queue.not_full, NULL);
+
+    // The segments get mapped once here, requests only ever do lookups.
+    if (!segment_set_open(&daemon.set, argv[1]))
+        return 1;
+
+    segment_set_start_merger(&daemon.set);
+    query_cache_init(&daemon.cache, cache_budget * 1024 * 1024);
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path '%s' is too long!\n", socket_path);
+        return 1;
+    }
+
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+
+    i32 listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listen_fd < 0
+     || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+     || listen(listen_fd, SEARCHD_QUEUE_SIZE) != 0) {
+        fprintf(stderr, "Failed to listen on '%s': %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT,  searchd_signal);
+    signal(SIGTERM, searchd_signal);
+
+    pthread_t *workers = malloc(worker_count * sizeof(pthread_t));
+
+    for (u32 i = 0; i < worker_count; ++i) {
+        pthread_create(workers + i, NULL, searchd_worker, &daemon);
+    }
+
+    printf("Serving '%s' on '%s' with %u workers.\n", argv[1], socket_path, worker_count);
+
+    // The listening socket and the returned connections pipe come first, then the idle connections.
+    searchd_conn_t *conns[SEARCHD_MAX_CONNECTIONS];
+    struct pollfd   pfds[SEARCHD_MAX_CONNECTIONS + 2];
+    searchd_conn_t *polled[SEARCHD_MAX_CONNECTIONS];
+    u32 conn_count = 0;
+
+    while (searchd_running) {
+        pfds[0] = (struct pollfd) { .fd = listen_fd,           .events = POLLIN };
+        pfds[1] = (struct pollfd) { .fd = daemon.returned[0], .events = POLLIN };
+
+        u32 pfd_count = 2;
+        u64 now = searchd_now_us();
+
+        for (u32 c = 0; c < conn_count;) {
+            searchd_conn_t *conn = conns[c];
+
+            if (!conn->busy && now - conn->last_active_us > (u64)SEARCHD_IDLE_MS * 1000) {
+                searchd_conn_close(conn);
+                conns[c] = conns[--conn_count];
+                continue;
+            }
+
+            if (!conn->busy) {
+                polled[pfd_count - 2] = conn;
+                pfds[pfd_count++] = (struct pollfd) { .fd = conn->fd, .events = POLLIN };
+            }
+
+            ++c;
+        }
+
+        if (poll(pfds, pfd_count, SEARCHD_POLL_MS) <= 0)
+            continue;
+
+        for (u32 p = 2; p < pfd_count; ++p) {
+            if (pfds[p].revents != 0) {
+                polled[p - 2]->busy = true;
+                searchd_queue_push(&daemon.queue, polled[p - 2]);
+            }
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            searchd_conn_t *returned[64];
+            ssize_t got = read(daemon.returned[0], returned, sizeof(returned));
+
+            for (ssize_t r = 0; r < got / (ssize_t)sizeof(searchd_conn_t *); ++r) {
+                searchd_conn_t *conn = returned[r];
+
+                conn->busy = false;
+                conn->last_active_us = searchd_now_us();
+
+                if (conn->closing) {
+                    for (u32 c = 0; c < conn_count; ++c) {
+                        if (conns[c] == conn) {
+                            conns[c] = conns[--conn_count];
+                            break;
+                        }
+                    }
+
+                    searchd_conn_close(conn);
+                }
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            i32 fd = accept(listen_fd, NULL, NULL);
+
+            if (fd < 0)
+                continue;
+
+            if (conn_count == SEARCHD_MAX_CONNECTIONS) {
+                static const char busy[] = "ERR too many connections\n";
+                searchd_write_all(fd, (const u8 *)busy, sizeof(busy) - 1);
+                close(fd);
+                continue;
+            }
+
+            searchd_conn_t *conn = calloc(1, sizeof(searchd_conn_t));
+            char *input = malloc(SEARCHD_LINE_MAX);
+
+            if (!conn || !input) {
+                fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+                exit(666);
+            }
+
+            conn->fd             = fd;
+            conn->input          = input;
+            conn->last_active_us = searchd_now_us();
+
+            conns[conn_count++] = conn;
+        }
+    }
+
+    for (u32 i = 0; i < worker_count; ++i) {
+        searchd_queue_push(&daemon.queue, NULL);
+    }
+
+    for (u32 i = 0; i < worker_count; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    // Every connection is back with the main thread once the workers are gone.
+    for (u32 c = 0; c < conn_count; ++c) {
+        searchd_conn_close(conns[c]);
+    }
+
+    close(daemon.returned[0]);
+    close(daemon.returned[1]);
+
+    close(listen_fd);
+    unlink(socket_path);
+
+    searchd_buffer_t stats = {0};
+    searchd_write_stats(&daemon, &stats);
+    printf("%.*s", (int)stats.count, stats.data);
+    free(stats.data);
+
+    free(workers);
+    query_cache_free(&daemon.cache);
+    segment_set_close(&daemon.set);
+
+    return 0;
+}
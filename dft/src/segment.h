@@ -0,0 +1,1241 @@
+#ifndef SEGMENT_H_
+#define SEGMENT_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+
+/* Caption index split into immutable segment files. Every added video gets
+ * flushed into its own small segment, a background merger combines segments
+ * of similar size into bigger ones (tiered, `SEGMENT_MERGE_FACTOR` at a time),
+ * so adding a video costs time proportional to that video and every token is
+ * rewritten only a logarithmic number of times.
+ *
+ * The live segments are listed in the `MANIFEST` file in the index directory,
+ * it gets replaced atomically so a crash never leaves a half written index.
+ * Segment files are mapped straight into memory.
+ */
+
+#define SEGMENT_MAGIC   0x31474553 // "SEG1"
+#define SEGMENT_VERSION 1
+
+#define SEGMENT_MERGE_FACTOR 4
+#define SEGMENT_BASE_TOKENS  (1 << 14)
+
+#define SEGMENT_PATH_MAX 512
+#define SEGMENT_PHRASE_MAX 16
+
+typedef struct
+{
+    u32 magic, version;
+
+    u32 video_count, term_count, posting_count, token_count;
+    u32 term_text_size, name_text_size;
+
+    u64 videos_offset;
+    u64 terms_offset;
+    u64 term_text_offset;
+    u64 postings_offset;
+    u64 tokens_offset;
+    u64 name_text_offset;
+    u64 size;
+} segment_header_t;
+
+typedef struct
+{
+    u32 video_id;
+    u32 token_offset, token_count;
+    u32 name_offset, name_size;
+} segment_video_t;
+
+// Terms are sorted bytewise so that lookups are a binary search and merging is a linear pass.
+typedef struct
+{
+    u32 text_offset, text_size;
+    u32 posting_offset, posting_count;
+} segment_term_t;
+
+// Sorted by video and position, videos within a segment are sorted by id.
+typedef struct
+{
+    u32 video;    // Index into the segment videos.
+    u32 position; // Token index within the video.
+} segment_posting_t;
+
+typedef struct
+{
+    u32 term; // Index into the segment terms.
+    f32 time_start, time_end;
+} segment_token_t;
+
+typedef struct
+{
+    u8 *base;
+    u64 size;
+
+    const segment_header_t  *header;
+    const segment_video_t   *videos;
+    const segment_term_t    *terms;
+    const u8                *term_text;
+    const segment_posting_t *postings;
+    const segment_token_t   *tokens;
+    const u8                *name_text;
+
+    u32 id;
+    atomic_uint refs;
+    b32 merging;
+} segment_t;
+
+typedef struct
+{
+    char dir[SEGMENT_PATH_MAX - 32];
+
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    pthread_t       merger;
+    b32             merger_running;
+    b32             closing;
+
+    dck_stretchy_t (segment_t *, u32) segments;
+
+    u32 next_segment_id;
+    u32 next_video_id;
+
+    // Bumped on every added video, merges don't change what queries see.
+    atomic_uint_fast64_t generation;
+} segment_set_t;
+
+// Referenced segments, stays valid while merges replace the live set.
+typedef struct
+{
+    segment_t **segments;
+    u32 count;
+} segment_snapshot_t;
+
+typedef struct
+{
+    u32 video_id;
+    u32 position;
+    f32 time_start, time_end;
+} segment_hit_t;
+
+typedef dck_stretchy_t (segment_hit_t, u32) segment_hits_t;
+
+#define SEGMENT_NONE 0xFFFFFFFF
+
+// Opens the index in `dir`, creates it if it doesn't exist.
+b32
+segment_set_open(segment_set_t *set, const char *dir);
+
+void
+segment_set_close(segment_set_t *set);
+
+/* Flushes the words of `chunk` into a new segment as one video.
+ * Returns the id of the video or `SEGMENT_NONE` on failure.
+ */
+u32
+segment_set_add_video(segment_set_t *set, const char *name, const vtt_data_t *data, vtt_chunk_t chunk);
+
+static inline u64
+segment_set_generation(segment_set_t *set)
+{
+    return atomic_load(&set->generation);
+}
+
+// Performs one merge if the merge policy asks for one, returns whether it did.
+b32
+segment_set_merge_step(segment_set_t *set);
+
+void
+segment_set_start_merger(segment_set_t *set);
+
+segment_snapshot_t
+segment_set_snapshot(segment_set_t *set);
+
+void
+segment_snapshot_release(segment_snapshot_t *snapshot);
+
+// Appends the hits of a normalized term over all segments, sorted by video and position.
+void
+segment_snapshot_find(const segment_snapshot_t *snapshot, const u8 *term, u32 size,
+                      segment_hits_t *hits);
+
+/* Appends the hits of a phrase of normalized terms, every hit points at the
+ * first word and spans the time of the whole phrase. Only the first
+ * `SEGMENT_PHRASE_MAX` terms are matched.
+ */
+void
+segment_snapshot_find_phrase(const segment_snapshot_t *snapshot, const u8 *const *terms, const u32 *sizes, u32 term_count,
+                             segment_hits_t *hits);
+
+typedef struct
+{
+    const u8 *text;
+    u32 size;
+    f32 time_start, time_end;
+} segment_word_t;
+
+typedef dck_stretchy_t (segment_word_t, u32) segment_words_t;
+
+// Appends the words of a video that start within `[time_start, time_end]`, the text points into the segment.
+void
+segment_snapshot_range(const segment_snapshot_t *snapshot, u32 video_id, f32 time_start, f32 time_end,
+                       segment_words_t *words);
+
+// Returns the name of a video, NULL if no segment holds it.
+const u8 *
+segment_snapshot_video_name(const segment_snapshot_t *snapshot, u32 video_id, u32 *size_o);
+
+#endif // SEGMENT_H_
+
+#if defined(SEGMENT_IMPL) && !defined(SEGMENT_IMPL_)
+#define SEGMENT_IMPL_
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define VOCAB_IMPL
+#include "vocab.h"
+
+typedef struct
+{
+    dck_stretchy_t (segment_video_t,   u32) videos;
+    dck_stretchy_t (segment_term_t,    u32) terms;
+    dck_stretchy_t (u8,                u32) term_text;
+    dck_stretchy_t (segment_posting_t, u32) postings;
+    dck_stretchy_t (segment_token_t,   u32) tokens;
+    dck_stretchy_t (u8,                u32) name_text;
+} segment_builder_t;
+
+static void
+segment_builder_free(segment_builder_t *builder)
+{
+    free(builder->videos.data);
+    free(builder->terms.data);
+    free(builder->term_text.data);
+    free(builder->postings.data);
+    free(builder->tokens.data);
+    free(builder->name_text.data);
+}
+
+static i32
+segment_text_cmp(const u8 *a, u32 a_size, const u8 *b, u32 b_size)
+{
+    i32 res = memcmp(a, b, a_size < b_size ? a_size : b_size);
+    if (res != 0)
+        return res;
+
+    return (a_size > b_size) - (a_size < b_size);
+}
+
+static void
+segment_builder_push_term(segment_builder_t *builder, const u8 *text, u32 size)
+{
+    dck_stretchy_push(builder->terms, (segment_term_t) {
+        .text_offset = builder->term_text.count,
+        .text_size   = size,
+    });
+
+    dck_stretchy_reserve(builder->term_text, size);
+    memcpy(builder->term_text.data + builder->term_text.count, text, size);
+    builder->term_text.count += size;
+}
+
+static void
+segment_builder_push_video(segment_builder_t *builder, u32 video_id, const u8 *name, u32 name_size)
+{
+    dck_stretchy_push(builder->videos, (segment_video_t) {
+        .video_id     = video_id,
+        .token_offset = builder->tokens.count,
+        .name_offset  = builder->name_text.count,
+        .name_size    = name_size,
+    });
+
+    dck_stretchy_reserve(builder->name_text, name_size);
+    memcpy(builder->name_text.data + builder->name_text.count, name, name_size);
+    builder->name_text.count += name_size;
+}
+
+// Derives the postings from the tokens with a counting sort, they come out sorted by video and position.
+static void
+segment_builder_finish_postings(segment_builder_t *builder)
+{
+    for (u32 t = 0; t < builder->terms.count; ++t) {
+        builder->terms.data[t].posting_count = 0;
+    }
+
+    for (u32 i = 0; i < builder->tokens.count; ++i) {
+        builder->terms.data[builder->tokens.data[i].term].posting_count++;
+    }
+
+    u32 offset = 0;
+
+    for (u32 t = 0; t < builder->terms.count; ++t) {
+        builder->terms.data[t].posting_offset = offset;
+        offset += builder->terms.data[t].posting_count;
+        builder->terms.data[t].posting_count = 0;
+    }
+
+    builder->postings.count = 0;
+    dck_stretchy_reserve(builder->postings, builder->tokens.count);
+    builder->postings.count = builder->tokens.count;
+
+    for (u32 v = 0; v < builder->videos.count; ++v) {
+        segment_video_t video = builder->videos.data[v];
+
+        for (u32 p = 0; p < video.token_count; ++p) {
+            segment_term_t *term = builder->terms.data + builder->tokens.data[video.token_offset + p].term;
+
+            builder->postings.data[term->posting_offset + term->posting_count++] = (segment_posting_t) {
+                .video    = v,
+                .position = p,
+            };
+        }
+    }
+}
+
+static u64
+segment_align(u64 offset)
+{
+    return (offset + 7) & ~(u64)7;
+}
+
+static b32
+segment_write_section(FILE *file, u64 *offset, const void *data, u64 size)
+{
+    static const u8 zeros[8] = {0};
+
+    u64 aligned = segment_align(*offset);
+
+    if (aligned != *offset && fwrite(zeros, 1, aligned - *offset, file) != aligned - *offset)
+        return false;
+
+    if (size != 0 && fwrite(data, 1, size, file) != size)
+        return false;
+
+    *offset = aligned + size;
+    return true;
+}
+
+static b32
+segment_builder_write(const segment_builder_t *builder, const char *path)
+{
+    segment_header_t header = {
+        .magic          = SEGMENT_MAGIC,
+        .version        = SEGMENT_VERSION,
+        .video_count    = builder->videos.count,
+        .term_count     = builder->terms.count,
+        .posting_count  = builder->postings.count,
+        .token_count    = builder->tokens.count,
+        .term_text_size = builder->term_text.count,
+        .name_text_size = builder->name_text.count,
+    };
+
+    u64 offset = sizeof(header);
+
+    offset = segment_align(offset); header.videos_offset    = offset; offset += builder->videos.count   * sizeof(segment_video_t);
+    offset = segment_align(offset); header.terms_offset     = offset; offset += builder->terms.count    * sizeof(segment_term_t);
+    offset = segment_align(offset); header.term_text_offset = offset; offset += builder->term_text.count;
+    offset = segment_align(offset); header.postings_offset  = offset; offset += builder->postings.count * sizeof(segment_posting_t);
+    offset = segment_align(offset); header.tokens_offset    = offset; offset += builder->tokens.count   * sizeof(segment_token_t);
+    offset = segment_align(offset); header.name_text_offset = offset; offset += builder->name_text.count;
+
+    header.size = offset;
+
+    char tmp_path[SEGMENT_PATH_MAX + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open '%s' for writing: %s\n", tmp_path, strerror(errno));
+        return false;
+    }
+
+    offset = 0;
+
+    b32 ok = segment_write_section(file, &offset, &header, sizeof(header))
+          && segment_write_section(file, &offset, builder->videos.data,    builder->videos.count   * sizeof(segment_video_t))
+          && segment_write_section(file, &offset, builder->terms.data,     builder->terms.count    * sizeof(segment_term_t))
+          && segment_write_section(file, &offset, builder->term_text.data, builder->term_text.count)
+          && segment_write_section(file, &offset, builder->postings.data,  builder->postings.count * sizeof(segment_posting_t))
+          && segment_write_section(file, &offset, builder->tokens.data,    builder->tokens.count   * sizeof(segment_token_t))
+          && segment_write_section(file, &offset, builder->name_text.data, builder->name_text.count);
+
+    // On disk before a manifest can name it.
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Failed to write segment '%s'!\n", path);
+        remove(tmp_path);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+segment_path(const segment_set_t *set, u32 id, char *path_o)
+{
+    snprintf(path_o, SEGMENT_PATH_MAX, "%s/%08u.seg", set->dir, id);
+}
+
+static segment_t *
+segment_load(const char *path, u32 id)
+{
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open segment '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(segment_header_t)) {
+        fprintf(stderr, "Segment '%s' is truncated!\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    u8 *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map segment '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    const segment_header_t *header = (const segment_header_t *)base;
+
+    if (header->magic != SEGMENT_MAGIC || header->version != SEGMENT_VERSION || header->size != (u64)st.st_size) {
+        fprintf(stderr, "Segment '%s' is corrupted!\n", path);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    segment_t *segment = calloc(1, sizeof(segment_t));
+    if (!segment) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    segment->base      = base;
+    segment->size      = st.st_size;
+    segment->header    = header;
+    segment->videos    = (const segment_video_t   *)(base + header->videos_offset);
+    segment->terms     = (const segment_term_t    *)(base + header->terms_offset);
+    segment->term_text =                             base + header->term_text_offset;
+    segment->postings  = (const segment_posting_t *)(base + header->postings_offset);
+    segment->tokens    = (const segment_token_t   *)(base + header->tokens_offset);
+    segment->name_text =                             base + header->name_text_offset;
+    segment->id        = id;
+
+    atomic_init(&segment->refs, 1);
+
+    return segment;
+}
+
+static void
+segment_unref(segment_t *segment)
+{
+    if (atomic_fetch_sub(&segment->refs, 1) == 1) {
+        munmap(segment->base, segment->size);
+        free(segment);
+    }
+}
+
+// Makes the files created and renamed in `dir` durable.
+static b32
+segment_sync_dir(const char *dir)
+{
+    i32 fd = open(dir, O_RDONLY | O_DIRECTORY);
+
+    if (fd < 0)
+        return false;
+
+    b32 ok = fsync(fd) == 0;
+    close(fd);
+
+    return ok;
+}
+
+// Only returns once the new manifest is durable, so the segments it dropped can go. Takes the `generation` to record
+// so it can be published after the write succeeds.
+static b32
+segment_set_write_manifest(const segment_set_t *set, u64 generation)
+{
+    char path[SEGMENT_PATH_MAX + 16];
+    char tmp_path[SEGMENT_PATH_MAX + 16];
+    snprintf(path,     sizeof(path),     "%s/MANIFEST",     set->dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/MANIFEST.tmp", set->dir);
+
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) {
+        fprintf(stderr, "Failed to open '%s' for writing: %s\n", tmp_path, strerror(errno));
+        return false;
+    }
+
+    fprintf(file, "next_video %u\n",   set->next_video_id);
+    fprintf(file, "next_segment %u\n", set->next_segment_id);
+    fprintf(file, "generation "FMT_U64"\n", generation);
+
+    for (u32 i = 0; i < set->segments.count; ++i) {
+        fprintf(file, "segment %u\n", set->segments.data[i]->id);
+    }
+
+    b32 ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+
+    ok = ok && segment_sync_dir(set->dir) && rename(tmp_path, path) == 0 && segment_sync_dir(set->dir);
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write '%s'!\n", path);
+        remove(tmp_path);
+        return false;
+    }
+
+    return true;
+}
+
+b32
+segment_set_open(segment_set_t *set, const char *dir)
+{
+    *set = (segment_set_t) {0};
+
+    snprintf(set->dir, sizeof(set->dir), "%s", dir);
+    pthread_mutex_init(&set->lock, NULL);
+    pthread_cond_init(&set->wake, NULL);
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create index directory '%s': %s\n", dir, strerror(errno));
+        return false;
+    }
+
+    char path[SEGMENT_PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/MANIFEST", dir);
+
+    FILE *file = fopen(path, "r");
+    if (!file) // A fresh index.
+        return segment_set_write_manifest(set, 0);
+
+    b32 ok = fscanf(file, " next_video %u",   &set->next_video_id)   == 1
+          && fscanf(file, " next_segment %u", &set->next_segment_id) == 1;
+
+    u64 generation;
+    if (ok && fscanf(file, " generation "FMT_U64, &generation) == 1) {
+        atomic_store(&set->generation, generation);
+    }
+
+    u32 id;
+    while (ok && fscanf(file, " segment %u", &id) == 1) {
+        char segment_file[SEGMENT_PATH_MAX];
+        segment_path(set, id, segment_file);
+
+        segment_t *segment = segment_load(segment_file, id);
+        if (!segment) {
+            ok = false;
+            break;
+        }
+
+        dck_stretchy_push(set->segments, segment);
+    }
+
+    fclose(file);
+
+    if (!ok) {
+        fprintf(stderr, "Failed to read the index manifest '%s'!\n", path);
+    }
+
+    return ok;
+}
+
+void
+segment_set_close(segment_set_t *set)
+{
+    pthread_mutex_lock(&set->lock);
+    set->closing = true;
+    pthread_cond_broadcast(&set->wake);
+    pthread_mutex_unlock(&set->lock);
+
+    if (set->merger_running) {
+        pthread_join(set->merger, NULL);
+    }
+
+    for (u32 i = 0; i < set->segments.count; ++i) {
+        segment_unref(set->segments.data[i]);
+    }
+
+    free(set->segments.data);
+    pthread_cond_destroy(&set->wake);
+    pthread_mutex_destroy(&set->lock);
+}
+
+typedef struct
+{
+    const u8 *text;
+    u32 size;
+    u32 id;
+} segment_sort_term_t;
+
+static int
+segment_sort_term_cmp(const void *a, const void *b)
+{
+    const segment_sort_term_t *ta = a;
+    const segment_sort_term_t *tb = b;
+    return segment_text_cmp(ta->text, ta->size, tb->text, tb->size);
+}
+
+// Adds the new segment to the live set and the manifest, takes ownership of `segment`. When the manifest can't be
+// written the set stays as it was and the new segment is dropped, the old manifest still names the replaced ones.
+static b32
+segment_set_install(segment_set_t *set, segment_t *segment, segment_t **replaced, u32 replaced_count)
+{
+    pthread_mutex_lock(&set->lock);
+
+    u32 previous_count = set->segments.count;
+    segment_t **previous = malloc(previous_count * sizeof(segment_t *) + 1);
+
+    if (!previous) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    memcpy(previous, set->segments.data, previous_count * sizeof(segment_t *));
+
+    u32 kept = 0;
+
+    for (u32 i = 0; i < set->segments.count; ++i) {
+        segment_t *live = set->segments.data[i];
+        b32 is_replaced = false;
+
+        for (u32 r = 0; r < replaced_count; ++r) {
+            is_replaced |= live == replaced[r];
+        }
+
+        if (!is_replaced) {
+            set->segments.data[kept++] = live;
+        }
+    }
+
+    set->segments.count = kept;
+    dck_stretchy_push(set->segments, segment);
+
+    // Merges don't change results. The generation never moves back, a failed install leaves it alone.
+    u64 generation = atomic_load(&set->generation) + (replaced_count == 0);
+
+    b32 ok = segment_set_write_manifest(set, generation);
+
+    if (ok) {
+        atomic_store(&set->generation, generation);
+    }
+    else {
+        memcpy(set->segments.data, previous, previous_count * sizeof(segment_t *));
+        set->segments.count = previous_count;
+    }
+
+    pthread_cond_broadcast(&set->wake);
+
+    pthread_mutex_unlock(&set->lock);
+
+    free(previous);
+
+    if (!ok) {
+        char path[SEGMENT_PATH_MAX];
+        segment_path(set, segment->id, path);
+        remove(path);
+        segment_unref(segment);
+
+        return false;
+    }
+
+    // The manifest no longer points at them, the mappings go away with the last snapshot.
+    for (u32 r = 0; r < replaced_count; ++r) {
+        char path[SEGMENT_PATH_MAX];
+        segment_path(set, replaced[r]->id, path);
+        remove(path);
+        segment_unref(replaced[r]);
+    }
+
+    return ok;
+}
+
+static u32
+segment_set_reserve_id(segment_set_t *set, u32 *video_id_o)
+{
+    pthread_mutex_lock(&set->lock);
+    u32 id = set->next_segment_id++;
+
+    if (video_id_o) {
+        *video_id_o = set->next_video_id++;
+    }
+
+    pthread_mutex_unlock(&set->lock);
+    return id;
+}
+
+u32
+segment_set_add_video(segment_set_t *set, const char *name, const vtt_data_t *data, vtt_chunk_t chunk)
+{
+    segment_builder_t builder = {0};
+    vocab_t vocab = {0};
+
+    dck_stretchy_reserve(builder.tokens, chunk.word_count);
+
+    normalize_batch_t batch = {0};
+    normalize_batch(&batch, data, chunk);
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        u32 size;
+        const u8 *text = normalize_batch_word(&batch, i, &size);
+        if (size == 0)
+            continue;
+
+        builder.tokens.data[builder.tokens.count++] = (segment_token_t) {
+            .term       = vocab_intern(&vocab, text, size),
+            .time_start = word.time_start,
+            .time_end   = word.time_end,
+        };
+    }
+
+    normalize_batch_free(&batch);
+
+    segment_sort_term_t *sorted = malloc(vocab.words.count * sizeof(segment_sort_term_t) + 1);
+    u32 *remap = malloc(vocab.words.count * sizeof(u32) + 1);
+
+    for (u32 id = 0; id < vocab.words.count; ++id) {
+        sorted[id].text = vocab_text(&vocab, id, &sorted[id].size);
+        sorted[id].id   = id;
+    }
+
+    qsort(sorted, vocab.words.count, sizeof(*sorted), segment_sort_term_cmp);
+
+    for (u32 t = 0; t < vocab.words.count; ++t) {
+        segment_builder_push_term(&builder, sorted[t].text, sorted[t].size);
+        remap[sorted[t].id] = t;
+    }
+
+    for (u32 i = 0; i < builder.tokens.count; ++i) {
+        builder.tokens.data[i].term = remap[builder.tokens.data[i].term];
+    }
+
+    u32 video_id;
+    u32 segment_id = segment_set_reserve_id(set, &video_id);
+
+    u32 token_count = builder.tokens.count;
+    builder.tokens.count = 0;
+    segment_builder_push_video(&builder, video_id, (const u8 *)name, strlen(name));
+    builder.tokens.count = token_count;
+    builder.videos.data[0].token_count = token_count;
+
+    segment_builder_finish_postings(&builder);
+
+    char path[SEGMENT_PATH_MAX];
+    segment_path(set, segment_id, path);
+
+    b32 ok = segment_builder_write(&builder, path);
+
+    free(sorted);
+    free(remap);
+    vocab_free(&vocab);
+    segment_builder_free(&builder);
+
+    segment_t *segment = ok ? segment_load(path, segment_id) : NULL;
+
+    if (!segment || !segment_set_install(set, segment, NULL, 0))
+        return SEGMENT_NONE;
+
+    return video_id;
+}
+
+typedef struct
+{
+    u32 video_id;
+    u32 source, video;
+} segment_merge_video_t;
+
+static int
+segment_merge_video_cmp(const void *a, const void *b)
+{
+    const segment_merge_video_t *va = a;
+    const segment_merge_video_t *vb = b;
+    return (va->video_id > vb->video_id) - (va->video_id < vb->video_id);
+}
+
+static b32
+segment_merge(segment_set_t *set, segment_t **sources, u32 source_count)
+{
+    segment_builder_t builder = {0};
+
+    // Union of the sorted term dictionaries, remembering where every source term went.
+    u32 *term_maps[SEGMENT_MERGE_FACTOR];
+    u32  cursors[SEGMENT_MERGE_FACTOR] = {0};
+
+    for (u32 s = 0; s < source_count; ++s) {
+        term_maps[s] = malloc(sources[s]->header->term_count * sizeof(u32) + 1);
+    }
+
+    for (;;) {
+        const u8 *min_text = NULL;
+        u32 min_size = 0;
+
+        for (u32 s = 0; s < source_count; ++s) {
+            if (cursors[s] == sources[s]->header->term_count)
+                continue;
+
+            segment_term_t term = sources[s]->terms[cursors[s]];
+            const u8 *text = sources[s]->term_text + term.text_offset;
+
+            if (!min_text || segment_text_cmp(text, term.text_size, min_text, min_size) < 0) {
+                min_text = text;
+                min_size = term.text_size;
+            }
+        }
+
+        if (!min_text)
+            break;
+
+        u32 new_term = builder.terms.count;
+        segment_builder_push_term(&builder, min_text, min_size);
+
+        for (u32 s = 0; s < source_count; ++s) {
+            if (cursors[s] == sources[s]->header->term_count)
+                continue;
+
+            segment_term_t term = sources[s]->terms[cursors[s]];
+
+            if (segment_text_cmp(sources[s]->term_text + term.text_offset, term.text_size, min_text, min_size) == 0) {
+                term_maps[s][cursors[s]++] = new_term;
+            }
+        }
+    }
+
+    dck_stretchy_t (segment_merge_video_t, u32) videos = {0};
+
+    for (u32 s = 0; s < source_count; ++s) {
+        for (u32 v = 0; v < sources[s]->header->video_count; ++v) {
+            dck_stretchy_push(videos, (segment_merge_video_t) {
+                .video_id = sources[s]->videos[v].video_id,
+                .source   = s,
+                .video    = v,
+            });
+        }
+    }
+
+    qsort(videos.data, videos.count, sizeof(*videos.data), segment_merge_video_cmp);
+
+    for (u32 i = 0; i < videos.count; ++i) {
+        const segment_t *source = sources[videos.data[i].source];
+        segment_video_t video = source->videos[videos.data[i].video];
+
+        segment_builder_push_video(&builder, video.video_id, source->name_text + video.name_offset, video.name_size);
+        builder.videos.data[builder.videos.count - 1].token_count = video.token_count;
+
+        dck_stretchy_reserve(builder.tokens, video.token_count);
+
+        const u32 *term_map = term_maps[videos.data[i].source];
+
+        for (u32 p = 0; p < video.token_count; ++p) {
+            segment_token_t token = source->tokens[video.token_offset + p];
+            token.term = term_map[token.term];
+            builder.tokens.data[builder.tokens.count++] = token;
+        }
+    }
+
+    segment_builder_finish_postings(&builder);
+
+    u32 segment_id = segment_set_reserve_id(set, NULL);
+
+    char path[SEGMENT_PATH_MAX];
+    segment_path(set, segment_id, path);
+
+    b32 ok = segment_builder_write(&builder, path);
+
+    for (u32 s = 0; s < source_count; ++s) {
+        free(term_maps[s]);
+    }
+
+    free(videos.data);
+    segment_builder_free(&builder);
+
+    segment_t *segment = ok ? segment_load(path, segment_id) : NULL;
+
+    return segment && segment_set_install(set, segment, sources, source_count);
+}
+
+static u32
+segment_tier(const segment_t *segment)
+{
+    u32 tier = 0;
+
+    for (u64 size = SEGMENT_BASE_TOKENS; segment->header->token_count >= size; size *= SEGMENT_MERGE_FACTOR) {
+        ++tier;
+    }
+
+    return tier;
+}
+
+// Picks `SEGMENT_MERGE_FACTOR` segments of the lowest full tier, must be called locked.
+static b32
+segment_set_pick_merge(segment_set_t *set, segment_t **sources_o)
+{
+    for (u32 tier = 0; tier < 32; ++tier) {
+        u32 count = 0;
+
+        for (u32 i = 0; i < set->segments.count && count < SEGMENT_MERGE_FACTOR; ++i) {
+            segment_t *segment = set->segments.data[i];
+
+            if (!segment->merging && segment_tier(segment) == tier) {
+                sources_o[count++] = segment;
+            }
+        }
+
+        if (count == SEGMENT_MERGE_FACTOR)
+            return true;
+    }
+
+    return false;
+}
+
+b32
+segment_set_merge_step(segment_set_t *set)
+{
+    segment_t *sources[SEGMENT_MERGE_FACTOR];
+
+    pthread_mutex_lock(&set->lock);
+
+    b32 picked = segment_set_pick_merge(set, sources);
+
+    if (picked) {
+        for (u32 s = 0; s < SEGMENT_MERGE_FACTOR; ++s) {
+            sources[s]->merging = true;
+        }
+    }
+
+    pthread_mutex_unlock(&set->lock);
+
+    if (!picked)
+        return false;
+
+    // The sources stay marked on failure, they keep serving queries but aren't retried.
+    if (!segment_merge(set, sources, SEGMENT_MERGE_FACTOR)) {
+        fprintf(stderr, "Failed to merge segments in '%s'!\n", set->dir);
+        return false;
+    }
+
+    return true;
+}
+
+static void *
+segment_merger_main(void *arg)
+{
+    segment_set_t *set = arg;
+
+    for (;;) {
+        while (segment_set_merge_step(set))
+            ;;
+
+        pthread_mutex_lock(&set->lock);
+
+        segment_t *sources[SEGMENT_MERGE_FACTOR];
+
+        while (!set->closing && !segment_set_pick_merge(set, sources)) {
+            pthread_cond_wait(&set->wake, &set->lock);
+        }
+
+        b32 closing = set->closing;
+        pthread_mutex_unlock(&set->lock);
+
+        if (closing)
+            break;
+    }
+
+    return NULL;
+}
+
+void
+segment_set_start_merger(segment_set_t *set)
+{
+    if (set->merger_running)
+        return;
+
+    set->merger_running = pthread_create(&set->merger, NULL, segment_merger_main, set) == 0;
+}
+
+segment_snapshot_t
+segment_set_snapshot(segment_set_t *set)
+{
+    pthread_mutex_lock(&set->lock);
+
+    segment_snapshot_t snapshot = {
+        .segments = malloc(set->segments.count * sizeof(segment_t *) + 1),
+        .count    = set->segments.count,
+    };
+
+    for (u32 i = 0; i < set->segments.count; ++i) {
+        snapshot.segments[i] = set->segments.data[i];
+        atomic_fetch_add(&snapshot.segments[i]->refs, 1);
+    }
+
+    pthread_mutex_unlock(&set->lock);
+
+    return snapshot;
+}
+
+void
+segment_snapshot_release(segment_snapshot_t *snapshot)
+{
+    for (u32 i = 0; i < snapshot->count; ++i) {
+        segment_unref(snapshot->segments[i]);
+    }
+
+    free(snapshot->segments);
+    *snapshot = (segment_snapshot_t) {0};
+}
+
+static const segment_term_t *
+segment_find_term(const segment_t *segment, const u8 *text, u32 size)
+{
+    u32 lo = 0, hi = segment->header->term_count;
+
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        const segment_term_t *term = segment->terms + mid;
+
+        i32 cmp = segment_text_cmp(segment->term_text + term->text_offset, term->text_size, text, size);
+
+        if (cmp == 0)
+            return term;
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+static int
+segment_hit_cmp(const void *a, const void *b)
+{
+    const segment_hit_t *ha = a;
+    const segment_hit_t *hb = b;
+
+    if (ha->video_id != hb->video_id)
+        return ha->video_id < hb->video_id ? -1 : 1;
+
+    return (ha->position > hb->position) - (ha->position < hb->position);
+}
+
+void
+segment_snapshot_find(const segment_snapshot_t *snapshot, const u8 *term, u32 size,
+                      segment_hits_t *hits)
+{
+    u32 first = hits->count;
+    u32 runs  = 0;
+
+    for (u32 s = 0; s < snapshot->count; ++s) {
+        const segment_t *segment = snapshot->segments[s];
+        const segment_term_t *found = segment_find_term(segment, term, size);
+
+        if (!found)
+            continue;
+
+        dck_stretchy_reserve(*hits, found->posting_count);
+
+        for (u32 p = 0; p < found->posting_count; ++p) {
+            segment_posting_t posting = segment->postings[found->posting_offset + p];
+            segment_video_t video = segment->videos[posting.video];
+            segment_token_t token = segment->tokens[video.token_offset + posting.position];
+
+            hits->data[hits->count++] = (segment_hit_t) {
+                .video_id   = video.video_id,
+                .position   = posting.position,
+                .time_start = token.time_start,
+                .time_end   = token.time_end,
+            };
+        }
+
+        ++runs;
+    }
+
+    // Every run is sorted on its own, segments hold disjoint videos.
+    if (runs > 1) {
+        qsort(hits->data + first, hits->count - first, sizeof(segment_hit_t), segment_hit_cmp);
+    }
+}
+
+void
+segment_snapshot_find_phrase(const segment_snapshot_t *snapshot, const u8 *const *terms, const u32 *sizes, u32 term_count,
+                             segment_hits_t *hits)
+{
+    if (term_count == 0)
+        return;
+
+    if (term_count > SEGMENT_PHRASE_MAX) {
+        term_count = SEGMENT_PHRASE_MAX;
+    }
+
+    u32 first = hits->count;
+    u32 runs  = 0;
+
+    for (u32 s = 0; s < snapshot->count; ++s) {
+        const segment_t *segment = snapshot->segments[s];
+
+        u32 local_terms[SEGMENT_PHRASE_MAX];
+        u32 rarest = 0;
+        b32 found_all = true;
+
+        for (u32 t = 0; t < term_count; ++t) {
+            const segment_term_t *found = segment_find_term(segment, terms[t], sizes[t]);
+
+            if (!found) {
+                found_all = false;
+                break;
+            }
+
+            local_terms[t] = found - segment->terms;
+
+            if (found->posting_count < segment->terms[local_terms[rarest]].posting_count) {
+                rarest = t;
+            }
+        }
+
+        if (!found_all)
+            continue;
+
+        // Drive the matching from the rarest term and check the neighbours in the token stream.
+        segment_term_t driver = segment->terms[local_terms[rarest]];
+
+        for (u32 p = 0; p < driver.posting_count; ++p) {
+            segment_posting_t posting = segment->postings[driver.posting_offset + p];
+            segment_video_t video = segment->videos[posting.video];
+
+            if (posting.position < rarest || posting.position - rarest + term_count > video.token_count)
+                continue;
+
+            const segment_token_t *tokens = segment->tokens + video.token_offset + posting.position - rarest;
+            b32 match = true;
+
+            for (u32 t = 0; t < term_count && match; ++t) {
+                match = tokens[t].term == local_terms[t];
+            }
+
+            if (!match)
+                continue;
+
+            dck_stretchy_push(*hits, (segment_hit_t) {
+                .video_id   = video.video_id,
+                .position   = posting.position - rarest,
+                .time_start = tokens[0].time_start,
+                .time_end   = tokens[term_count - 1].time_end,
+            });
+        }
+
+        ++runs;
+    }
+
+    if (runs > 1) {
+        qsort(hits->data + first, hits->count - first, sizeof(segment_hit_t), segment_hit_cmp);
+    }
+}
+
+static const segment_t *
+segment_snapshot_find_video(const segment_snapshot_t *snapshot, u32 video_id, segment_video_t *video_o)
+{
+    for (u32 s = 0; s < snapshot->count; ++s) {
+        const segment_t *segment = snapshot->segments[s];
+        u32 lo = 0, hi = segment->header->video_count;
+
+        while (lo < hi) {
+            u32 mid = (lo + hi) / 2;
+            segment_video_t video = segment->videos[mid];
+
+            if (video.video_id == video_id) {
+                *video_o = video;
+                return segment;
+            }
+
+            if (video.video_id < video_id) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void
+segment_snapshot_range(const segment_snapshot_t *snapshot, u32 video_id, f32 time_start, f32 time_end,
+                       segment_words_t *words)
+{
+    segment_video_t video;
+    const segment_t *segment = segment_snapshot_find_video(snapshot, video_id, &video);
+
+    if (!segment)
+        return;
+
+    const segment_token_t *tokens = segment->tokens + video.token_offset;
+
+    // Caption words come in time order.
+    u32 lo = 0, hi = video.token_count;
+
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+
+        if (tokens[mid].time_start < time_start) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    for (u32 p = lo; p < video.token_count && tokens[p].time_start <= time_end; ++p) {
+        segment_term_t term = segment->terms[tokens[p].term];
+
+        dck_stretchy_push(*words, (segment_word_t) {
+            .text       = segment->term_text + term.text_offset,
+            .size       = term.text_size,
+            .time_start = tokens[p].time_start,
+            .time_end   = tokens[p].time_end,
+        });
+    }
+}
+
+const u8 *
+segment_snapshot_video_name(const segment_snapshot_t *snapshot, u32 video_id, u32 *size_o)
+{
+    segment_video_t video;
+    const segment_t *segment = segment_snapshot_find_video(snapshot, video_id, &video);
+
+    if (!segment) {
+        *size_o = 0;
+        return NULL;
+    }
+
+    *size_o = video.name_size;
+    return segment->name_text + video.name_offset;
+}
+
+#endif // SEGMENT_IMPL
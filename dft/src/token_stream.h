@@ -0,0 +1,294 @@
+#ifndef TOKEN_STREAM_H_
+#define TOKEN_STREAM_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+#include "vocab.h"
+
+/* Captions of a video as a stream of word ids instead of raw text. The words
+ * are interned exactly as they appear (no normalization) into a dictionary
+ * shared by all of the streams, so the text can always be rebuilt.
+ *
+ * Ids are stored with the fixed width the biggest id of the stream needs
+ * (1, 2 or 4 bytes) or as LEB128 varints, whichever is smaller. Varint streams
+ * keep the byte offset of every `TOKEN_SKIP_INTERVAL`th token so random access
+ * only decodes a few ids.
+ */
+
+#define TOKEN_VARINT        0
+#define TOKEN_SKIP_INTERVAL 64
+#define TOKEN_TERM_UNSET    0xFFFFFFFE
+
+typedef struct
+{
+    f32 time_start, time_end;
+} token_time_t;
+
+typedef struct
+{
+    u32 count; // Number of tokens.
+    u32 width; // Bytes per id, `TOKEN_VARINT` for varints.
+
+    dck_stretchy_t (u8,           u32) bytes;
+    dck_stretchy_t (u32,          u32) skips; // Varint streams only.
+    dck_stretchy_t (token_time_t, u32) times;
+} token_stream_t;
+
+typedef struct
+{
+    const token_stream_t *stream;
+    u32 index, byte;
+} token_reader_t;
+
+// Normalized term of every dictionary word, filled in as words show up.
+typedef dck_stretchy_t (u32, u32) token_terms_t;
+
+void
+token_stream_encode(token_stream_t *stream, vocab_t *dict, const vtt_data_t *data, vtt_chunk_t chunk);
+
+// Appends the words of the stream to `data` and returns their chunk.
+vtt_chunk_t
+token_stream_decode(const token_stream_t *stream, const vocab_t *dict, vtt_data_t *data);
+
+u32
+token_stream_at(const token_stream_t *stream, u32 index);
+
+// Adds the stream to `index` like `vocab_index_add`, normalizing every distinct word only once.
+void
+token_stream_index(const token_stream_t *stream, const vocab_t *dict, vocab_index_t *index, token_terms_t *terms);
+
+void
+token_stream_free(token_stream_t *stream);
+
+static inline token_reader_t
+token_reader(const token_stream_t *stream)
+{
+    return (token_reader_t) { .stream = stream };
+}
+
+static inline b32
+token_reader_next(token_reader_t *reader, u32 *id_o)
+{
+    const token_stream_t *stream = reader->stream;
+
+    if (reader->index >= stream->count)
+        return false;
+
+    const u8 *bytes = stream->bytes.data;
+
+    switch (stream->width) {
+        case 1: *id_o = bytes[reader->index]; break;
+        case 2: *id_o = ((const u16 *)bytes)[reader->index]; break;
+        case 4: *id_o = ((const u32 *)bytes)[reader->index]; break;
+        default: {
+            u32 id = 0;
+            u32 shift = 0;
+            u8 byte;
+
+            do {
+                byte = bytes[reader->byte++];
+                id |= (u32)(byte & 0x7F) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+
+            *id_o = id;
+        } break;
+    }
+
+    reader->index++;
+    return true;
+}
+
+#endif // TOKEN_STREAM_H_
+
+#if defined(TOKEN_STREAM_IMPL) && !defined(TOKEN_STREAM_IMPL_)
+#define TOKEN_STREAM_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static u32
+token_varint_size(u32 id)
+{
+    u32 size = 1;
+
+    while (id >= 0x80) {
+        id >>= 7;
+        ++size;
+    }
+
+    return size;
+}
+
+void
+token_stream_encode(token_stream_t *stream, vocab_t *dict, const vtt_data_t *data, vtt_chunk_t chunk)
+{
+    *stream = (token_stream_t) { .count = chunk.word_count };
+
+    u32 *ids = malloc(chunk.word_count * sizeof(u32) + 1);
+
+    if (!ids) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    dck_stretchy_reserve(stream->times, chunk.word_count);
+    stream->times.count = chunk.word_count;
+
+    u32 max_id = 0;
+    u64 varint_size = 0;
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        vtt_word_t word = data->words.data[chunk.word_offset + i];
+
+        ids[i] = vocab_intern(dict, data->text.data + word.text_offset, word.text_size);
+        max_id = ids[i] > max_id ? ids[i] : max_id;
+        varint_size += token_varint_size(ids[i]);
+
+        stream->times.data[i] = (token_time_t) {
+            .time_start = word.time_start,
+            .time_end   = word.time_end,
+        };
+    }
+
+    u32 width = max_id <= 0xFF ? 1 : max_id <= 0xFFFF ? 2 : 4;
+
+    if (varint_size < (u64)width * chunk.word_count) {
+        width = TOKEN_VARINT;
+    }
+
+    stream->width = width;
+
+    if (width != TOKEN_VARINT) {
+        dck_stretchy_reserve(stream->bytes, width * chunk.word_count);
+        stream->bytes.count = width * chunk.word_count;
+
+        for (u32 i = 0; i < chunk.word_count; ++i) {
+            switch (width) {
+                case 1: stream->bytes.data[i] = (u8)ids[i]; break;
+                case 2: ((u16 *)stream->bytes.data)[i] = (u16)ids[i]; break;
+                case 4: ((u32 *)stream->bytes.data)[i] = ids[i]; break;
+            }
+        }
+    }
+    else {
+        dck_stretchy_reserve(stream->bytes, varint_size);
+
+        for (u32 i = 0; i < chunk.word_count; ++i) {
+            if (i % TOKEN_SKIP_INTERVAL == 0) {
+                dck_stretchy_push(stream->skips, stream->bytes.count);
+            }
+
+            u32 id = ids[i];
+
+            while (id >= 0x80) {
+                stream->bytes.data[stream->bytes.count++] = (u8)(id | 0x80);
+                id >>= 7;
+            }
+
+            stream->bytes.data[stream->bytes.count++] = (u8)id;
+        }
+    }
+
+    free(ids);
+}
+
+u32
+token_stream_at(const token_stream_t *stream, u32 index)
+{
+    token_reader_t reader = token_reader(stream);
+
+    if (stream->width == TOKEN_VARINT) {
+        reader.index = index - index % TOKEN_SKIP_INTERVAL;
+        reader.byte  = stream->skips.data[index / TOKEN_SKIP_INTERVAL];
+    }
+    else {
+        reader.index = index;
+    }
+
+    u32 id = VOCAB_NONE;
+
+    while (reader.index <= index && token_reader_next(&reader, &id))
+        ;;
+
+    return id;
+}
+
+vtt_chunk_t
+token_stream_decode(const token_stream_t *stream, const vocab_t *dict, vtt_data_t *data)
+{
+    vtt_chunk_t chunk = {
+        .word_offset = data->words.count,
+        .word_count  = stream->count,
+    };
+
+    dck_stretchy_reserve(data->words, stream->count);
+
+    token_reader_t reader = token_reader(stream);
+    u32 id;
+
+    while (token_reader_next(&reader, &id)) {
+        u32 size;
+        const u8 *text = vocab_text(dict, id, &size);
+
+        token_time_t time = stream->times.data[reader.index - 1];
+
+        data->words.data[data->words.count++] = (vtt_word_t) {
+            .text_offset = data->text.count,
+            .text_size   = size,
+            .time_start  = time.time_start,
+            .time_end    = time.time_end,
+        };
+
+        dck_stretchy_reserve(data->text, size);
+        memcpy(data->text.data + data->text.count, text, size);
+        data->text.count += size;
+    }
+
+    return chunk;
+}
+
+void
+token_stream_index(const token_stream_t *stream, const vocab_t *dict, vocab_index_t *index, token_terms_t *terms)
+{
+    while (terms->count < dict->words.count) {
+        dck_stretchy_push(*terms, TOKEN_TERM_UNSET);
+    }
+
+    dck_stretchy_reserve(index->word_ids, stream->count);
+
+    token_reader_t reader = token_reader(stream);
+    u32 id;
+
+    u8 buffer[256];
+
+    while (token_reader_next(&reader, &id)) {
+        u32 term = terms->data[id];
+
+        if (term == TOKEN_TERM_UNSET) {
+            u32 size;
+            const u8 *text = vocab_text(dict, id, &size);
+
+            size = vocab_normalize(text, size < sizeof(buffer) ? size : sizeof(buffer), buffer);
+            term = size ? vocab_intern(&index->vocab, buffer, size) : VOCAB_NONE;
+
+            terms->data[id] = term;
+        }
+
+        index->word_ids.data[index->word_ids.count++] = term;
+    }
+}
+
+void
+token_stream_free(token_stream_t *stream)
+{
+    free(stream->bytes.data);
+    free(stream->skips.data);
+    free(stream->times.data);
+    *stream = (token_stream_t) {0};
+}
+
+#endif // TOKEN_STREAM_IMPL
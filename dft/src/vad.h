@@ -0,0 +1,240 @@
+#ifndef VAD_H_
+#define VAD_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+/* Speech and silence intervals of an audio track. The loudness comes from
+ * the first level of the amplitude pyramid (mean absolute sample of every
+ * block), averaged into `VAD_FRAME` long frames and taken in dB over the
+ * noise floor, the `VAD_FLOOR_RANK` quantile of all frames.
+ *
+ * Frames quieter than `VAD_OFF_DB` over the floor are silence without
+ * looking further. The others get the spectral flatness of their speech band
+ * (geometric over arithmetic mean of the power spectrum): voices are peaky,
+ * hiss and hum are flat or narrow enough to fall out of the band.
+ *
+ * Hysteresis between the two thresholds: speech starts on a frame over
+ * `VAD_ON_DB` that isn't flat and only ends after `VAD_HANGOVER` seconds
+ * without one over `VAD_OFF_DB`. Intervals shorter than `VAD_MIN_SPEECH`
+ * are clicks and get dropped.
+ */
+
+#define VAD_FRAME        0.02f // Seconds.
+#define VAD_ON_DB        12.0f // Over the noise floor, starts speech.
+#define VAD_OFF_DB       6.0f  // Over the noise floor, keeps speech going.
+#define VAD_FLOOR_RANK   0.1f
+#define VAD_FLATNESS     0.35f // Flatter than this isn't a voice, white noise is around 0.56.
+#define VAD_BAND_LOW     300.0f
+#define VAD_BAND_HIGH    4000.0f
+#define VAD_HANGOVER     0.3f  // Seconds.
+#define VAD_MIN_SPEECH   0.1f  // Seconds.
+
+typedef struct
+{
+    f32 start, end; // Seconds.
+} vad_interval_t;
+
+typedef dck_stretchy_t (vad_interval_t, u32) vad_intervals_t;
+
+typedef struct
+{
+    u32 frames;      // Frames of the track.
+    u32 transformed; // Frames loud enough to need an FFT.
+    f32 speech;      // Seconds of speech.
+} vad_stats_t;
+
+// `levels` holds the mean absolute sample of every `block` samples of mono `samples`.
+void
+vad_detect(vad_intervals_t *intervals, const f32 *samples, u32 sample_count, u32 sample_rate,
+           const f32 *levels, u32 level_count, u32 block, vad_stats_t *stats_o);
+
+// Whether `[start, end)` overlaps speech. For ascending queries, `cursor` starts at 0 and is kept between calls.
+b32
+vad_overlaps(const vad_intervals_t *intervals, u32 *cursor, f32 start, f32 end);
+
+#endif // VAD_H_
+
+#if defined(VAD_IMPL) && !defined(VAD_IMPL_)
+#define VAD_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define FFT_IMPL
+#include "fft.h"
+
+static int
+vad_f32_cmp(const void *a, const void *b)
+{
+    f32 fa = *(const f32 *)a;
+    f32 fb = *(const f32 *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static void
+vad_push(vad_intervals_t *intervals, f32 start, f32 end)
+{
+    if (end - start >= VAD_MIN_SPEECH) {
+        dck_stretchy_push(*intervals, ((vad_interval_t) { .start = start, .end = end }));
+    }
+}
+
+void
+vad_detect(vad_intervals_t *intervals, const f32 *samples, u32 sample_count, u32 sample_rate,
+           const f32 *levels, u32 level_count, u32 block, vad_stats_t *stats_o)
+{
+    intervals->count = 0;
+
+    u32 frame_blocks = (u32)(VAD_FRAME * sample_rate / block + 0.5f);
+    frame_blocks = frame_blocks ? frame_blocks : 1;
+
+    u32 frame_samples = frame_blocks * block;
+    u32 frame_count   = level_count / frame_blocks;
+
+    vad_stats_t stats = { .frames = frame_count };
+
+    if (frame_count == 0) {
+        if (stats_o) {
+            *stats_o = stats;
+        }
+
+        return;
+    }
+
+    f32 *db     = malloc(frame_count * sizeof(f32));
+    f32 *sorted = malloc(frame_count * sizeof(f32));
+
+    if (!db || !sorted) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 f = 0; f < frame_count; ++f) {
+        f32 sum = 0.0f;
+
+        for (u32 b = 0; b < frame_blocks; ++b) {
+            sum += levels[f * frame_blocks + b];
+        }
+
+        db[f] = 20.0f * log10f(sum / frame_blocks + 1e-6f);
+    }
+
+    memcpy(sorted, db, frame_count * sizeof(f32));
+    qsort(sorted, frame_count, sizeof(f32), vad_f32_cmp);
+
+    f32 floor_db = sorted[(u32)(VAD_FLOOR_RANK * (frame_count - 1))];
+    free(sorted);
+
+    u32 size = 1;
+
+    while (size < frame_samples) {
+        size *= 2;
+    }
+
+    fft_plan_t plan;
+    fft_plan_init(&plan, size);
+
+    cn_t *data    = malloc(size * sizeof(cn_t));
+    cn_t *scratch = malloc(size * sizeof(cn_t));
+    f32  *window  = malloc(frame_samples * sizeof(f32));
+
+    if (!data || !scratch || !window) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < frame_samples; ++i) {
+        window[i] = 0.5f - 0.5f * cosf(2.0f * M_PI * (i + 0.5f) / frame_samples);
+    }
+
+    u32 bin_low  = (u32)(VAD_BAND_LOW  * size / sample_rate);
+    u32 bin_high = (u32)(VAD_BAND_HIGH * size / sample_rate);
+
+    bin_low  = bin_low ? bin_low : 1;
+    bin_high = bin_high < size / 2 ? bin_high : size / 2;
+
+    f32 frame_seconds = frame_samples / (f32)sample_rate;
+    u32 hangover      = (u32)(VAD_HANGOVER / frame_seconds + 0.5f);
+
+    b32 speech = false;
+    u32 start = 0, last_loud = 0;
+
+    for (u32 f = 0; f < frame_count; ++f) {
+        f32 level = db[f] - floor_db;
+        b32 loud  = false;
+
+        if (level >= VAD_OFF_DB) {
+            u64 first = (u64)f * frame_samples;
+            const f32 *frame = samples + first;
+
+            // Zero padded up to the FFT size.
+            memset(data, 0, size * sizeof(cn_t));
+
+            for (u32 s = 0; s < frame_samples && first + s < sample_count; ++s) {
+                data[s].r = frame[s] * window[s];
+            }
+
+            fft_forward(&plan, data, scratch);
+            stats.transformed++;
+
+            f64 log_sum = 0.0, sum = 0.0;
+
+            for (u32 k = bin_low; k < bin_high; ++k) {
+                f64 power = data[k].r * data[k].r + data[k].i * data[k].i + 1e-12;
+                log_sum += log(power);
+                sum     += power;
+            }
+
+            u32 bins = bin_high > bin_low ? bin_high - bin_low : 1;
+            f64 flatness = sum > 0.0 ? exp(log_sum / bins) / (sum / bins) : 1.0;
+
+            loud = flatness < VAD_FLATNESS && (speech || level >= VAD_ON_DB);
+        }
+
+        if (loud) {
+            if (!speech) {
+                speech = true;
+                start  = f;
+            }
+
+            last_loud = f;
+        }
+        else if (speech && f - last_loud > hangover) {
+            speech = false;
+            vad_push(intervals, start * frame_seconds, (last_loud + 1) * frame_seconds);
+        }
+    }
+
+    if (speech) {
+        vad_push(intervals, start * frame_seconds, (last_loud + 1) * frame_seconds);
+    }
+
+    for (u32 i = 0; i < intervals->count; ++i) {
+        stats.speech += intervals->data[i].end - intervals->data[i].start;
+    }
+
+    free(db);
+    free(data);
+    free(scratch);
+    free(window);
+    fft_plan_free(&plan);
+
+    if (stats_o) {
+        *stats_o = stats;
+    }
+}
+
+b32
+vad_overlaps(const vad_intervals_t *intervals, u32 *cursor, f32 start, f32 end)
+{
+    while (*cursor < intervals->count && intervals->data[*cursor].end <= start) {
+        ++*cursor;
+    }
+
+    return *cursor < intervals->count && intervals->data[*cursor].start < end;
+}
+
+#endif // VAD_IMPL
@@ -0,0 +1,277 @@
+#ifndef VOCAB_H_
+#define VOCAB_H_
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#include "vtt_parser.h"
+#include "normalize.h"
+
+#define VOCAB_NONE 0xFFFFFFFF
+
+typedef struct
+{
+    u32 text_offset;
+    u32 text_size;
+    u32 hash;
+} vocab_word_t;
+
+// Interned set of distinct words. Ids are dense and assigned in insertion order.
+typedef struct
+{
+    dck_stretchy_t (u8,           u32) text;
+    dck_stretchy_t (vocab_word_t, u32) words;
+
+    u32 *slots; // Open addressing, holds `id + 1`, zero is an empty slot.
+    u32  slot_mask;
+} vocab_t;
+
+// Vocabulary of normalized caption words together with the postings of every
+// word, i.e. the indices into `vtt_data_t.words` where it occurs.
+typedef struct
+{
+    vocab_t vocab;
+
+    dck_stretchy_t (u32, u32) word_ids; // Term id of every `vtt_word_t`, `VOCAB_NONE` if it is empty after normalization.
+
+    dck_stretchy_t (u32, u32) posting_offsets; // `vocab.words.count + 1` entries after `vocab_index_finish`.
+    dck_stretchy_t (u32, u32) postings;
+} vocab_index_t;
+
+u32
+vocab_intern(vocab_t *vocab, const u8 *text, u32 size);
+
+u32
+vocab_find(const vocab_t *vocab, const u8 *text, u32 size);
+
+void
+vocab_free(vocab_t *vocab);
+
+static inline const u8 *
+vocab_text(const vocab_t *vocab, u32 id, u32 *size_o)
+{
+    vocab_word_t word = vocab->words.data[id];
+    *size_o = word.text_size;
+    return vocab->text.data + word.text_offset;
+}
+
+/* Lowercases and drops whitespace and punctuation, apostrophes inside of a
+ * word are kept, see `normalize_word`. `dst` must have room for `size` bytes,
+ * returns the normalized size.
+ */
+u32
+vocab_normalize(const u8 *src, u32 size, u8 *dst);
+
+void
+vocab_index_add(vocab_index_t *index, const vtt_data_t *data, vtt_chunk_t chunk);
+
+// Builds the postings, call once after all of the chunks were added.
+void
+vocab_index_finish(vocab_index_t *index);
+
+void
+vocab_index_free(vocab_index_t *index);
+
+static inline const u32 *
+vocab_index_postings(const vocab_index_t *index, u32 term, u32 *count_o)
+{
+    u32 begin = index->posting_offsets.data[term];
+    *count_o = index->posting_offsets.data[term + 1] - begin;
+    return index->postings.data + begin;
+}
+
+#endif // VOCAB_H_
+
+#if defined(VOCAB_IMPL) && !defined(VOCAB_IMPL_)
+#define VOCAB_IMPL_
+
+#include <string.h>
+
+#include "hash.h"
+
+#define NORMALIZE_IMPL
+#include "normalize.h"
+
+static b32
+vocab_word_eq(const vocab_t *vocab, u32 id, const u8 *text, u32 size)
+{
+    vocab_word_t word = vocab->words.data[id];
+    return word.text_size == size
+        && memcmp(vocab->text.data + word.text_offset, text, size) == 0;
+}
+
+static void
+vocab_grow(vocab_t *vocab)
+{
+    u32 slot_count = vocab->slots ? (vocab->slot_mask + 1) * 2 : 1024;
+
+    free(vocab->slots);
+    vocab->slots = calloc(slot_count, sizeof(u32));
+    vocab->slot_mask = slot_count - 1;
+
+    if (!vocab->slots) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 id = 0; id < vocab->words.count; ++id) {
+        u32 slot = vocab->words.data[id].hash & vocab->slot_mask;
+
+        while (vocab->slots[slot] != 0) {
+            slot = (slot + 1) & vocab->slot_mask;
+        }
+
+        vocab->slots[slot] = id + 1;
+    }
+}
+
+u32
+vocab_find(const vocab_t *vocab, const u8 *text, u32 size)
+{
+    if (!vocab->slots)
+        return VOCAB_NONE;
+
+    u32 hash = (u32)hash_bytes(text, size);
+    u32 slot = hash & vocab->slot_mask;
+
+    while (vocab->slots[slot] != 0) {
+        u32 id = vocab->slots[slot] - 1;
+
+        if (vocab->words.data[id].hash == hash && vocab_word_eq(vocab, id, text, size))
+            return id;
+
+        slot = (slot + 1) & vocab->slot_mask;
+    }
+
+    return VOCAB_NONE;
+}
+
+u32
+vocab_intern(vocab_t *vocab, const u8 *text, u32 size)
+{
+    // Keep the load factor under one half.
+    if (!vocab->slots || (vocab->words.count + 1) * 2 > vocab->slot_mask + 1) {
+        vocab_grow(vocab);
+    }
+
+    u32 hash = (u32)hash_bytes(text, size);
+    u32 slot = hash & vocab->slot_mask;
+
+    while (vocab->slots[slot] != 0) {
+        u32 id = vocab->slots[slot] - 1;
+
+        if (vocab->words.data[id].hash == hash && vocab_word_eq(vocab, id, text, size))
+            return id;
+
+        slot = (slot + 1) & vocab->slot_mask;
+    }
+
+    u32 id = vocab->words.count;
+
+    dck_stretchy_push(vocab->words, (vocab_word_t) {
+        .text_offset = vocab->text.count,
+        .text_size   = size,
+        .hash        = hash,
+    });
+
+    dck_stretchy_reserve(vocab->text, size);
+    memcpy(vocab->text.data + vocab->text.count, text, size);
+    vocab->text.count += size;
+
+    vocab->slots[slot] = id + 1;
+
+    return id;
+}
+
+void
+vocab_free(vocab_t *vocab)
+{
+    free(vocab->text.data);
+    free(vocab->words.data);
+    free(vocab->slots);
+    *vocab = (vocab_t) {0};
+}
+
+u32
+vocab_normalize(const u8 *src, u32 size, u8 *dst)
+{
+    return normalize_word(src, size, dst);
+}
+
+void
+vocab_index_add(vocab_index_t *index, const vtt_data_t *data, vtt_chunk_t chunk)
+{
+    // Word ids are parallel to `data->words`, chunks have to come in order.
+    ASSERT(index->word_ids.count == chunk.word_offset);
+
+    dck_stretchy_reserve(index->word_ids, chunk.word_count);
+
+    normalize_batch_t batch = {0};
+    normalize_batch(&batch, data, chunk);
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        u32 size;
+        const u8 *text = normalize_batch_word(&batch, i, &size);
+
+        u32 id = size ? vocab_intern(&index->vocab, text, size) : VOCAB_NONE;
+        index->word_ids.data[index->word_ids.count++] = id;
+    }
+
+    normalize_batch_free(&batch);
+}
+
+void
+vocab_index_finish(vocab_index_t *index)
+{
+    u32 term_count = index->vocab.words.count;
+
+    index->posting_offsets.count = 0;
+    dck_stretchy_reserve(index->posting_offsets, term_count + 1);
+    memset(index->posting_offsets.data, 0, (term_count + 1) * sizeof(u32));
+    index->posting_offsets.count = term_count + 1;
+
+    u32 *offsets = index->posting_offsets.data;
+
+    for (u32 i = 0; i < index->word_ids.count; ++i) {
+        u32 id = index->word_ids.data[i];
+
+        if (id != VOCAB_NONE) {
+            offsets[id + 1]++;
+        }
+    }
+
+    for (u32 id = 0; id < term_count; ++id) {
+        offsets[id + 1] += offsets[id];
+    }
+
+    index->postings.count = 0;
+    dck_stretchy_reserve(index->postings, offsets[term_count]);
+    index->postings.count = offsets[term_count];
+
+    // Fill using the offsets as cursors, then shift them back.
+    for (u32 i = 0; i < index->word_ids.count; ++i) {
+        u32 id = index->word_ids.data[i];
+
+        if (id != VOCAB_NONE) {
+            index->postings.data[offsets[id]++] = i;
+        }
+    }
+
+    for (u32 id = term_count; id > 0; --id) {
+        offsets[id] = offsets[id - 1];
+    }
+
+    offsets[0] = 0;
+}
+
+void
+vocab_index_free(vocab_index_t *index)
+{
+    vocab_free(&index->vocab);
+    free(index->word_ids.data);
+    free(index->posting_offsets.data);
+    free(index->postings.data);
+    *index = (vocab_index_t) {0};
+}
+
+#endif // VOCAB_IMPL
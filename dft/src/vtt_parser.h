@@ -1,6 +1,8 @@
 #ifndef VTT_PARSER_H_
 #define VTT_PARSER_H_
 
+#include <math.h>
+
 #include "core/utils.h"
 #include "core/dck.h"
 
@@ -26,9 +28,45 @@ typedef struct
 vtt_chunk_t
 vtt_parse_file(vtt_data_t *data, const char *file_path);
 
+// Words of only spaces and line breaks. They aren't counted and get no word id, so everything keyed by word id skips them.
+static inline b32
+vtt_word_blank(const vtt_data_t *data, vtt_word_t word)
+{
+    const u8 *text = data->text.data + word.text_offset;
+
+    for (u32 c = 0; c < word.text_size; ++c) {
+        if (text[c] != ' ' && text[c] != '\n')
+            return false;
+    }
+
+    return true;
+}
+
+// Analysis frames `[first, last]` of the word, for `frame_count` frames of `length` samples every `hop` at
+// `sample_rate`. Frames whose center falls inside the word, or the nearest one when none does, clamped to the audio.
+static inline void
+vtt_word_frames(vtt_word_t word, u32 sample_rate, u32 length, u32 hop, u32 frame_count, u32 *first_o, u32 *last_o)
+{
+    f32 center = length * 0.5f;
+
+    f32 first = ceilf((word.time_start * sample_rate - center) / hop);
+    f32 last  = ceilf((word.time_end   * sample_rate - center) / hop) - 1.0f;
+
+    if (last < first) {
+        first = last = roundf((word.time_start * sample_rate - center) / hop);
+    }
+
+    first = first > 0.0f ? first : 0.0f;
+    last  = last  > 0.0f ? last  : 0.0f;
+
+    *first_o = first < frame_count ? (u32)first : frame_count - 1;
+    *last_o  = last  < frame_count ? (u32)last  : frame_count - 1;
+}
+
 #endif // VTT_PARSER_H_
 
-#ifdef VTT_PARSER_IMPL
+#if defined(VTT_PARSER_IMPL) && !defined(VTT_PARSER_IMPL_)
+#define VTT_PARSER_IMPL_
 
 #include <string.h>
 
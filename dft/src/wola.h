@@ -0,0 +1,213 @@
+#ifndef WOLA_H_
+#define WOLA_H_
+
+#include "core/utils.h"
+
+#include "fft.h"
+
+/* Short time Fourier analysis and weighted overlap-add resynthesis, for
+ * editing audio in the spectral domain. Frames of `size` samples every `hop`
+ * get the square root of a periodic Hann window before the real FFT and
+ * again after the inverse one, so a frame that wasn't edited adds back
+ * exactly what the window took out of it. The squared windows of all frames
+ * over a sample don't always sum to one (the hop can be any divisor of the
+ * size), so the output is divided by that sum, which repeats every hop.
+ * Edits get smoothed over the overlapping frames instead of leaving steps at
+ * frame borders.
+ *
+ * Synthesis outputs the `hop` samples no later frame overlaps, so streamed
+ * output lags input by `size - hop` samples. `wola_process` takes care of
+ * that for a whole signal.
+ */
+
+typedef struct
+{
+    u32 size, hop;
+    u32 bins; // `size / 2 + 1`.
+
+    fft_real_plan_t plan;
+
+    f32  *window;
+    f32  *norm;   // Inverse of the summed squared windows at every offset into a hop.
+    f32  *frame;
+    f32  *sum;    // Overlap-add of the frames so far.
+    cn_t *scratch;
+} wola_t;
+
+// Edits the bins of frame `frame` in place.
+typedef void (*wola_edit_t)(void *context, cn_t *bins, u32 bin_count, u32 frame);
+
+// False when `size` is odd or `hop` isn't a divisor of it up to half of it.
+b32
+wola_init(wola_t *wola, u32 size, u32 hop);
+
+void
+wola_free(wola_t *wola);
+
+void
+wola_reset(wola_t *wola);
+
+// Windowed spectrum of `size` samples into `wola->bins` bins.
+void
+wola_analyze(wola_t *wola, const f32 *samples, cn_t *bins);
+
+// Adds the frame of `bins` (overwritten) to the output and writes out the next `hop` samples.
+void
+wola_synthesize(wola_t *wola, cn_t *bins, f32 *out);
+
+// Analysis, `edit` (or none) and synthesis of `count` samples, `out[n]` lines up with `in[n]`.
+void
+wola_process(wola_t *wola, const f32 *in, u32 count, f32 *out, wola_edit_t edit, void *context);
+
+#endif // WOLA_H_
+
+#if defined(WOLA_IMPL) && !defined(WOLA_IMPL_)
+#define WOLA_IMPL_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define FFT_IMPL
+#include "fft.h"
+
+b32
+wola_init(wola_t *wola, u32 size, u32 hop)
+{
+    *wola = (wola_t) {0};
+
+    if (hop == 0 || hop > size / 2 || size % hop != 0 || !fft_real_plan_init(&wola->plan, size))
+        return false;
+
+    wola->size = size;
+    wola->hop  = hop;
+    wola->bins = size / 2 + 1;
+
+    wola->window  = malloc(size * sizeof(f32));
+    wola->norm    = malloc(hop * sizeof(f32));
+    wola->frame   = malloc(size * sizeof(f32));
+    wola->sum     = calloc(size, sizeof(f32));
+    wola->scratch = malloc(wola->plan.half.scratch_size * sizeof(cn_t));
+
+    if (!wola->window || !wola->norm || !wola->frame || !wola->sum || !wola->scratch) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < size; ++i) {
+        wola->window[i] = sqrtf(0.5f - 0.5f * cosf(2.0f * M_PI * i / size));
+    }
+
+    for (u32 j = 0; j < hop; ++j) {
+        f32 total = 0.0f;
+
+        for (u32 i = j; i < size; i += hop) {
+            total += wola->window[i] * wola->window[i];
+        }
+
+        wola->norm[j] = total > 0.0f ? 1.0f / total : 0.0f;
+    }
+
+    return true;
+}
+
+void
+wola_free(wola_t *wola)
+{
+    fft_real_plan_free(&wola->plan);
+
+    free(wola->window);
+    free(wola->norm);
+    free(wola->frame);
+    free(wola->sum);
+    free(wola->scratch);
+
+    *wola = (wola_t) {0};
+}
+
+void
+wola_reset(wola_t *wola)
+{
+    memset(wola->sum, 0, wola->size * sizeof(f32));
+}
+
+void
+wola_analyze(wola_t *wola, const f32 *samples, cn_t *bins)
+{
+    for (u32 i = 0; i < wola->size; ++i) {
+        wola->frame[i] = samples[i] * wola->window[i];
+    }
+
+    fft_real_forward(&wola->plan, wola->frame, bins, wola->scratch);
+}
+
+void
+wola_synthesize(wola_t *wola, cn_t *bins, f32 *out)
+{
+    u32 size = wola->size, hop = wola->hop;
+
+    fft_real_inverse(&wola->plan, bins, wola->frame, wola->scratch);
+
+    for (u32 i = 0; i < size; ++i) {
+        wola->sum[i] += wola->frame[i] * wola->window[i];
+    }
+
+    for (u32 j = 0; j < hop; ++j) {
+        out[j] = wola->sum[j] * wola->norm[j];
+    }
+
+    memmove(wola->sum, wola->sum + hop, (size - hop) * sizeof(f32));
+    memset(wola->sum + size - hop, 0, hop * sizeof(f32));
+}
+
+void
+wola_process(wola_t *wola, const f32 *in, u32 count, f32 *out, wola_edit_t edit, void *context)
+{
+    u32 size = wola->size, hop = wola->hop;
+
+    f32  *frame = malloc(size * sizeof(f32));
+    f32  *block = malloc(hop * sizeof(f32));
+    cn_t *bins  = malloc(wola->bins * sizeof(cn_t));
+
+    if (!frame || !block || !bins) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    wola_reset(wola);
+
+    // Frames start early enough that the first hop of output is sample zero, zeros outside the signal.
+    i64 lead = size - hop;
+
+    for (u32 m = 0; (i64)m * hop - lead < count; ++m) {
+        i64 start = (i64)m * hop - lead;
+
+        for (u32 i = 0; i < size; ++i) {
+            i64 s = start + i;
+            frame[i] = s >= 0 && s < count ? in[s] : 0.0f;
+        }
+
+        wola_analyze(wola, frame, bins);
+
+        if (edit) {
+            edit(context, bins, wola->bins, m);
+        }
+
+        wola_synthesize(wola, bins, block);
+
+        for (u32 j = 0; j < hop; ++j) {
+            i64 s = start + j;
+
+            if (s >= 0 && s < count) {
+                out[s] = block[j];
+            }
+        }
+    }
+
+    free(frame);
+    free(block);
+    free(bins);
+}
+
+#endif // WOLA_IMPL
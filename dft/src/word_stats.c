@@ -0,0 +1,970 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "core/utils.h"
+#include "core/dck.h"
+
+#define VTT_PARSER_IMPL
+#include "vtt_parser.h"
+
+#define VOCAB_IMPL
+#include "vocab.h"
+
+#define PAR_IMPL
+#include "par.h"
+
+#include "hash.h"
+
+// cc src/word_stats.c -o word_stats.exe -I. -O2 -lm -lpthread && ./word_stats.exe ../oneyplays/witch_hunt_test/*.vtt
+
+/* Unigram and bigram counts over many caption files. Every thread counts its
+ * files into a thread local table, a table that grows over its share of the
+ * memory budget gets spilled to disk as a sorted run. At the end the runs are
+ * merged `STATS_MERGE_FAN_IN` at a time until few enough are left, and those
+ * and the remaining tables are k-way merged into the global counts.
+ *
+ * Bigrams are keyed as the two words joined by a space, normalized words
+ * never contain one.
+ */
+
+#define STATS_WORD_MAX      NORMALIZE_WORD_MAX
+#define STATS_KEY_MAX       (STATS_WORD_MAX * 2 + 1)
+#define STATS_DEFAULT_TOP   20
+#define STATS_DEFAULT_MEM   1024 // MiB
+#define STATS_VIDEO_MIN_PMI 3
+#define STATS_GLOBAL_MIN_PMI 10
+#define STATS_MERGE_FAN_IN   16 // Run files open at once.
+
+typedef dck_stretchy_t (u8, u32) stats_buffer_t;
+
+typedef struct
+{
+    u64 hash;
+    u64 count;
+    u32 key_offset;
+    u32 key_size; // Zero for an empty slot.
+} stats_slot_t;
+
+typedef struct
+{
+    stats_slot_t *slots;
+    u32           slot_mask;
+    u32           count;
+
+    dck_stretchy_t (u8, u32) keys;
+} stats_table_t;
+
+typedef struct
+{
+    const u8 *key;
+    u32       size;
+    u64       count;
+} stats_item_t;
+
+typedef struct
+{
+    f64 score;
+    u64 count;
+    u32 size;
+    u8  key[STATS_KEY_MAX];
+} stats_top_entry_t;
+
+// Min heap on the score, keeps the best `capacity` entries.
+typedef struct
+{
+    stats_top_entry_t *entries;
+    u32 count, capacity;
+} stats_top_t;
+
+typedef struct
+{
+    FILE *file; // NULL for a run that lives in memory.
+
+    stats_item_t *items;
+    u32           item_count, item_index;
+
+    u8  key[STATS_KEY_MAX];
+    u32 size;
+    u64 count;
+} stats_run_t;
+
+typedef struct
+{
+    stats_table_t  table;
+    stats_table_t  video;
+    vtt_data_t     vtt;
+
+    normalize_batch_t normalized;
+
+    u64 tokens;
+    u32 spill_count;
+
+    dck_stretchy_t (char *, u32) run_paths;
+} stats_thread_t;
+
+typedef struct
+{
+    char **files;
+    u32    file_count;
+
+    u32         top_count;
+    u64         table_budget; // Per thread.
+    const char *tmp_dir;
+
+    stats_thread_t *threads;
+    char          **reports;
+} stats_t;
+
+static void
+stats_printf(stats_buffer_t *out, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    i32 size = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    dck_stretchy_reserve(*out, (u32)size + 1);
+
+    va_start(args, fmt);
+    vsnprintf((char *)out->data + out->count, size + 1, fmt, args);
+    va_end(args);
+
+    out->count += size;
+}
+
+static void
+stats_table_grow(stats_table_t *table)
+{
+    u32 old_count = table->slots ? table->slot_mask + 1 : 0;
+    u32 new_count = old_count ? old_count * 2 : 4096;
+
+    stats_slot_t *slots = calloc(new_count, sizeof(stats_slot_t));
+    if (!slots) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 i = 0; i < old_count; ++i) {
+        stats_slot_t slot = table->slots[i];
+        if (slot.key_size == 0)
+            continue;
+
+        u32 index = slot.hash & (new_count - 1);
+
+        while (slots[index].key_size != 0) {
+            index = (index + 1) & (new_count - 1);
+        }
+
+        slots[index] = slot;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slot_mask = new_count - 1;
+}
+
+static stats_slot_t *
+stats_table_find(const stats_table_t *table, const u8 *key, u32 size, u64 hash)
+{
+    if (!table->slots)
+        return NULL;
+
+    u32 index = hash & table->slot_mask;
+
+    for (;;) {
+        stats_slot_t *slot = table->slots + index;
+
+        if (slot->key_size == 0)
+            return slot;
+
+        if (slot->hash == hash && slot->key_size == size
+         && memcmp(table->keys.data + slot->key_offset, key, size) == 0)
+            return slot;
+
+        index = (index + 1) & table->slot_mask;
+    }
+}
+
+static void
+stats_table_add(stats_table_t *table, const u8 *key, u32 size, u64 count)
+{
+    if (!table->slots || (table->count + 1) * 2 > table->slot_mask + 1) {
+        stats_table_grow(table);
+    }
+
+    u64 hash = hash_bytes(key, size);
+    stats_slot_t *slot = stats_table_find(table, key, size, hash);
+
+    if (slot->key_size != 0) {
+        slot->count += count;
+        return;
+    }
+
+    *slot = (stats_slot_t) {
+        .hash       = hash,
+        .count      = count,
+        .key_offset = table->keys.count,
+        .key_size   = size,
+    };
+
+    dck_stretchy_reserve(table->keys, size);
+    memcpy(table->keys.data + table->keys.count, key, size);
+    table->keys.count += size;
+
+    table->count++;
+}
+
+static u64
+stats_table_get(const stats_table_t *table, const u8 *key, u32 size)
+{
+    stats_slot_t *slot = stats_table_find(table, key, size, hash_bytes(key, size));
+    return slot && slot->key_size != 0 ? slot->count : 0;
+}
+
+// What the live entries take, the slots they need at the maximum load and their keys. Capacity stays
+// around after a reset, so it can't tell when to spill.
+static u64
+stats_table_bytes(const stats_table_t *table)
+{
+    return (u64)table->count * 2 * sizeof(stats_slot_t) + table->keys.count;
+}
+
+// Keeps the memory around for the next round.
+static void
+stats_table_reset(stats_table_t *table)
+{
+    if (table->slots) {
+        memset(table->slots, 0, (table->slot_mask + 1) * sizeof(stats_slot_t));
+    }
+
+    table->count = 0;
+    table->keys.count = 0;
+}
+
+static void
+stats_table_free(stats_table_t *table)
+{
+    free(table->slots);
+    free(table->keys.data);
+    *table = (stats_table_t) {0};
+}
+
+static i32
+stats_key_cmp(const u8 *a, u32 a_size, const u8 *b, u32 b_size)
+{
+    i32 res = memcmp(a, b, a_size < b_size ? a_size : b_size);
+    if (res != 0)
+        return res;
+
+    return (a_size > b_size) - (a_size < b_size);
+}
+
+static int
+stats_item_cmp(const void *a, const void *b)
+{
+    const stats_item_t *ia = a;
+    const stats_item_t *ib = b;
+    return stats_key_cmp(ia->key, ia->size, ib->key, ib->size);
+}
+
+static stats_item_t *
+stats_table_sorted(const stats_table_t *table)
+{
+    stats_item_t *items = malloc(table->count * sizeof(stats_item_t) + 1);
+    u32 count = 0;
+
+    for (u32 i = 0; table->slots && i <= table->slot_mask; ++i) {
+        stats_slot_t slot = table->slots[i];
+
+        if (slot.key_size != 0) {
+            items[count++] = (stats_item_t) {
+                .key   = table->keys.data + slot.key_offset,
+                .size  = slot.key_size,
+                .count = slot.count,
+            };
+        }
+    }
+
+    qsort(items, count, sizeof(stats_item_t), stats_item_cmp);
+    return items;
+}
+
+static b32
+stats_is_bigram(const u8 *key, u32 size)
+{
+    return memchr(key, ' ', size) != NULL;
+}
+
+static void
+stats_top_offer(stats_top_t *top, f64 score, const u8 *key, u32 size, u64 count)
+{
+    if (top->capacity == 0)
+        return;
+
+    if (top->count == top->capacity && score <= top->entries[0].score)
+        return;
+
+    u32 index;
+
+    if (top->count < top->capacity) {
+        // Sift up from the end.
+        index = top->count++;
+
+        while (index > 0) {
+            u32 parent = (index - 1) / 2;
+
+            if (top->entries[parent].score <= score)
+                break;
+
+            top->entries[index] = top->entries[parent];
+            index = parent;
+        }
+    }
+    else {
+        // Replace the worst one and sift down.
+        index = 0;
+
+        for (;;) {
+            u32 child = index * 2 + 1;
+            if (child >= top->count)
+                break;
+
+            if (child + 1 < top->count && top->entries[child + 1].score < top->entries[child].score) {
+                ++child;
+            }
+
+            if (top->entries[child].score >= score)
+                break;
+
+            top->entries[index] = top->entries[child];
+            index = child;
+        }
+    }
+
+    stats_top_entry_t *entry = top->entries + index;
+
+    entry->score = score;
+    entry->count = count;
+    entry->size  = size;
+    memcpy(entry->key, key, size);
+}
+
+static int
+stats_top_cmp(const void *a, const void *b)
+{
+    const stats_top_entry_t *ea = a;
+    const stats_top_entry_t *eb = b;
+    return (ea->score < eb->score) - (ea->score > eb->score);
+}
+
+static void
+stats_top_print(stats_top_t *top, stats_buffer_t *out, const char *title, b32 show_score)
+{
+    qsort(top->entries, top->count, sizeof(stats_top_entry_t), stats_top_cmp);
+
+    stats_printf(out, "  %s:\n", title);
+
+    for (u32 i = 0; i < top->count; ++i) {
+        stats_top_entry_t *entry = top->entries + i;
+
+        if (show_score) {
+            stats_printf(out, "    %-32.*s %8.3f "FMT_U64"\n", (int)entry->size, entry->key, entry->score, entry->count);
+        }
+        else {
+            stats_printf(out, "    %-32.*s "FMT_U64"\n", (int)entry->size, entry->key, entry->count);
+        }
+    }
+}
+
+static stats_top_t
+stats_top_make(u32 capacity)
+{
+    return (stats_top_t) {
+        .entries  = malloc(capacity * sizeof(stats_top_entry_t) + 1),
+        .capacity = capacity,
+    };
+}
+
+static f64
+stats_pmi(u64 pair, u64 first, u64 second, u64 tokens)
+{
+    if (first == 0 || second == 0)
+        return 0.0;
+
+    return log2((f64)pair * (f64)tokens / ((f64)first * (f64)second));
+}
+
+// PMI needs the counts of both of the words of a bigram.
+static f64
+stats_table_pmi(const stats_table_t *table, const u8 *key, u32 size, u64 count, u64 tokens)
+{
+    const u8 *space = memchr(key, ' ', size);
+    u32 first_size = space - key;
+
+    u64 first  = stats_table_get(table, key, first_size);
+    u64 second = stats_table_get(table, space + 1, size - first_size - 1);
+
+    return stats_pmi(count, first, second, tokens);
+}
+
+static void
+stats_report_video(stats_t *stats, stats_thread_t *thread, u32 file, u64 tokens)
+{
+    stats_table_t *video = &thread->video;
+
+    stats_top_t words   = stats_top_make(stats->top_count);
+    stats_top_t bigrams = stats_top_make(stats->top_count);
+    stats_top_t pmis    = stats_top_make(stats->top_count);
+
+    u32 distinct = 0;
+
+    for (u32 i = 0; video->slots && i <= video->slot_mask; ++i) {
+        stats_slot_t slot = video->slots[i];
+        if (slot.key_size == 0)
+            continue;
+
+        const u8 *key = video->keys.data + slot.key_offset;
+
+        if (!stats_is_bigram(key, slot.key_size)) {
+            stats_top_offer(&words, slot.count, key, slot.key_size, slot.count);
+            ++distinct;
+            continue;
+        }
+
+        stats_top_offer(&bigrams, slot.count, key, slot.key_size, slot.count);
+
+        if (slot.count >= STATS_VIDEO_MIN_PMI) {
+            f64 pmi = stats_table_pmi(video, key, slot.key_size, slot.count, tokens);
+            stats_top_offer(&pmis, pmi, key, slot.key_size, slot.count);
+        }
+    }
+
+    stats_buffer_t out = {0};
+
+    stats_printf(&out, "== %s: "FMT_U64" tokens, %u distinct words\n", stats->files[file], tokens, distinct);
+    stats_top_print(&words,   &out, "top words",    false);
+    stats_top_print(&bigrams, &out, "top bigrams",  false);
+    stats_top_print(&pmis,    &out, "collocations", true);
+    stats_printf(&out, "%c", 0);
+
+    stats->reports[file] = (char *)out.data;
+
+    free(words.entries);
+    free(bigrams.entries);
+    free(pmis.entries);
+}
+
+static b32
+stats_write_run(FILE *file, const stats_item_t *items, u32 count)
+{
+    for (u32 i = 0; i < count; ++i) {
+        if (fwrite(&items[i].size,  sizeof(u32), 1, file) != 1
+         || fwrite(items[i].key,    1, items[i].size, file) != items[i].size
+         || fwrite(&items[i].count, sizeof(u64), 1, file) != 1)
+            return false;
+    }
+
+    return true;
+}
+
+static void
+stats_spill(stats_t *stats, stats_thread_t *thread, u32 thread_index)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/word_stats_%d_%u_%u.run", stats->tmp_dir, (int)getpid(), thread_index, thread->spill_count++);
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open spill file '%s'!\n", path);
+        exit(1);
+    }
+
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    stats_item_t *items = stats_table_sorted(&thread->table);
+    b32 ok = stats_write_run(file, items, thread->table.count);
+    free(items);
+
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "Failed to write spill file '%s'!\n", path);
+        exit(1);
+    }
+
+    dck_stretchy_push(thread->run_paths, strdup(path));
+    stats_table_reset(&thread->table);
+}
+
+static void
+stats_count_file(void *context, u32 thread_index, u32 file)
+{
+    stats_t *stats = context;
+    stats_thread_t *thread = stats->threads + thread_index;
+
+    thread->vtt.text.count  = 0;
+    thread->vtt.words.count = 0;
+
+    vtt_chunk_t chunk = vtt_parse_file(&thread->vtt, stats->files[file]);
+
+    normalize_batch(&thread->normalized, &thread->vtt, chunk);
+
+    u8  key[STATS_KEY_MAX];
+    u32 prev_size = 0;
+    u64 tokens = 0;
+
+    for (u32 i = 0; i < chunk.word_count; ++i) {
+        u32 size;
+        const u8 *text = normalize_batch_word(&thread->normalized, i, &size);
+        if (size == 0)
+            continue;
+
+        // The key buffer holds `prev word`, the current word goes right behind the space.
+        u8 *current = key + prev_size + 1;
+        memcpy(current, text, size);
+
+        stats_table_add(&thread->video, current, size, 1);
+
+        if (prev_size != 0) {
+            key[prev_size] = ' ';
+            stats_table_add(&thread->video, key, prev_size + 1 + size, 1);
+        }
+
+        memmove(key, current, size);
+        prev_size = size;
+        ++tokens;
+    }
+
+    stats_report_video(stats, thread, file, tokens);
+
+    // Fold the video into the thread table, one add per distinct key.
+    stats_table_t *video = &thread->video;
+
+    for (u32 i = 0; video->slots && i <= video->slot_mask; ++i) {
+        stats_slot_t slot = video->slots[i];
+
+        if (slot.key_size != 0) {
+            stats_table_add(&thread->table, video->keys.data + slot.key_offset, slot.key_size, slot.count);
+        }
+    }
+
+    stats_table_reset(video);
+    thread->tokens += tokens;
+
+    if (stats_table_bytes(&thread->table) > stats->table_budget) {
+        stats_spill(stats, thread, thread_index);
+    }
+}
+
+static b32
+stats_run_next(stats_run_t *run)
+{
+    if (!run->file) {
+        if (run->item_index == run->item_count)
+            return false;
+
+        stats_item_t item = run->items[run->item_index++];
+        memcpy(run->key, item.key, item.size);
+        run->size  = item.size;
+        run->count = item.count;
+        return true;
+    }
+
+    if (fread(&run->size, sizeof(u32), 1, run->file) != 1)
+        return false;
+
+    if (run->size > STATS_KEY_MAX
+     || fread(run->key, 1, run->size, run->file) != run->size
+     || fread(&run->count, sizeof(u64), 1, run->file) != 1) {
+        fprintf(stderr, "A spill file is corrupted!\n");
+        exit(1);
+    }
+
+    return true;
+}
+
+static b32
+stats_run_less(const stats_run_t *a, const stats_run_t *b)
+{
+    return stats_key_cmp(a->key, a->size, b->key, b->size) < 0;
+}
+
+static void
+stats_heap_down(stats_run_t **heap, u32 count, u32 index)
+{
+    for (;;) {
+        u32 child = index * 2 + 1;
+        if (child >= count)
+            break;
+
+        if (child + 1 < count && stats_run_less(heap[child + 1], heap[child])) {
+            ++child;
+        }
+
+        if (!stats_run_less(heap[child], heap[index]))
+            break;
+
+        stats_run_t *tmp = heap[child];
+        heap[child] = heap[index];
+        heap[index] = tmp;
+        index = child;
+    }
+}
+
+static FILE *
+stats_open_run(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open spill file '%s'!\n", path);
+        exit(1);
+    }
+
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    return file;
+}
+
+// Merges the run files `paths` into one, summing the counts of equal keys, and removes them.
+static char *
+stats_merge_files(stats_t *stats, char **paths, u32 count, u32 merge_index)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/word_stats_%d_merge_%u.run", stats->tmp_dir, (int)getpid(), merge_index);
+
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "Failed to open spill file '%s'!\n", path);
+        exit(1);
+    }
+
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    stats_run_t  *runs = calloc(count, sizeof(stats_run_t));
+    stats_run_t **heap = malloc(count * sizeof(stats_run_t *));
+    u32 heap_count = 0;
+
+    if (!runs || !heap) {
+        fprintf(stderr, "%s:%d: malloc failure! exiting...\n", __FILE__, __LINE__);
+        exit(666);
+    }
+
+    for (u32 r = 0; r < count; ++r) {
+        runs[r].file = stats_open_run(paths[r]);
+
+        if (stats_run_next(runs + r)) {
+            heap[heap_count++] = runs + r;
+        }
+    }
+
+    for (u32 i = heap_count; i-- > 0;) {
+        stats_heap_down(heap, heap_count, i);
+    }
+
+    stats_item_t item = {0};
+    u8 key[STATS_KEY_MAX];
+    b32 ok = true;
+
+    while (heap_count != 0) {
+        stats_run_t *run = heap[0];
+
+        if (item.size != 0 && stats_key_cmp(run->key, run->size, key, item.size) != 0) {
+            ok = ok && stats_write_run(out, &item, 1);
+            item.size = 0;
+        }
+
+        if (item.size == 0) {
+            memcpy(key, run->key, run->size);
+            item = (stats_item_t) { .key = key, .size = run->size };
+        }
+
+        item.count += run->count;
+
+        if (!stats_run_next(run)) {
+            heap[0] = heap[--heap_count];
+        }
+
+        stats_heap_down(heap, heap_count, 0);
+    }
+
+    if (item.size != 0) {
+        ok = ok && stats_write_run(out, &item, 1);
+    }
+
+    if (fclose(out) != 0 || !ok) {
+        fprintf(stderr, "Failed to write spill file '%s'!\n", path);
+        exit(1);
+    }
+
+    for (u32 r = 0; r < count; ++r) {
+        fclose(runs[r].file);
+        remove(paths[r]);
+        free(paths[r]);
+    }
+
+    free(runs);
+    free(heap);
+
+    return strdup(path);
+}
+
+static void
+stats_report_global(stats_t *stats, u32 thread_count)
+{
+    dck_stretchy_t (stats_run_t, u32) runs = {0};
+    dck_stretchy_t (stats_item_t *, u32) memory_runs = {0};
+    dck_stretchy_t (char *, u32) paths = {0};
+
+    u64 tokens = 0;
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        stats_thread_t *thread = stats->threads + t;
+
+        for (u32 r = 0; r < thread->run_paths.count; ++r) {
+            dck_stretchy_push(paths, thread->run_paths.data[r]);
+        }
+
+        thread->run_paths.count = 0;
+    }
+
+    // Merge passes keep the number of files open at once bounded, the oldest runs first.
+    u32 first = 0;
+
+    for (u32 merges = 0; paths.count - first > STATS_MERGE_FAN_IN; first += STATS_MERGE_FAN_IN) {
+        char *merged = stats_merge_files(stats, paths.data + first, STATS_MERGE_FAN_IN, merges++);
+        dck_stretchy_push(paths, merged);
+    }
+
+    memmove(paths.data, paths.data + first, (paths.count - first) * sizeof(char *));
+    paths.count -= first;
+
+    for (u32 r = 0; r < paths.count; ++r) {
+        dck_stretchy_push(runs, (stats_run_t) { .file = stats_open_run(paths.data[r]) });
+    }
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        stats_thread_t *thread = stats->threads + t;
+        tokens += thread->tokens;
+
+        if (thread->table.count != 0) {
+            stats_item_t *items = stats_table_sorted(&thread->table);
+            dck_stretchy_push(memory_runs, items);
+            dck_stretchy_push(runs, (stats_run_t) { .items = items, .item_count = thread->table.count });
+        }
+    }
+
+    stats_run_t **heap = malloc(runs.count * sizeof(stats_run_t *) + 1);
+    u32 heap_count = 0;
+
+    for (u32 r = 0; r < runs.count; ++r) {
+        if (stats_run_next(runs.data + r)) {
+            heap[heap_count++] = runs.data + r;
+        }
+    }
+
+    for (u32 i = heap_count; i-- > 0;) {
+        stats_heap_down(heap, heap_count, i);
+    }
+
+    // The vocabulary stays in memory, bigrams frequent enough for PMI go to a file for the second pass.
+    stats_table_t unigrams = {0};
+
+    char candidates_path[1024];
+    snprintf(candidates_path, sizeof(candidates_path), "%s/word_stats_%d.pmi", stats->tmp_dir, (int)getpid());
+
+    FILE *candidates = fopen(candidates_path, "w+b");
+    if (!candidates) {
+        fprintf(stderr, "Failed to open '%s'!\n", candidates_path);
+        exit(1);
+    }
+
+    stats_top_t words   = stats_top_make(stats->top_count);
+    stats_top_t bigrams = stats_top_make(stats->top_count);
+
+    u64 distinct_bigrams = 0;
+
+    u8  key[STATS_KEY_MAX];
+    u32 size = 0;
+    u64 count = 0;
+    b32 have_key = false;
+
+    for (;;) {
+        stats_run_t *run = heap_count ? heap[0] : NULL;
+
+        if (have_key && (!run || stats_key_cmp(run->key, run->size, key, size) != 0)) {
+            if (stats_is_bigram(key, size)) {
+                stats_top_offer(&bigrams, count, key, size, count);
+                ++distinct_bigrams;
+
+                if (count >= STATS_GLOBAL_MIN_PMI) {
+                    stats_item_t item = { .key = key, .size = size, .count = count };
+                    if (!stats_write_run(candidates, &item, 1)) {
+                        fprintf(stderr, "Failed to write '%s'!\n", candidates_path);
+                        exit(1);
+                    }
+                }
+            }
+            else {
+                stats_top_offer(&words, count, key, size, count);
+                stats_table_add(&unigrams, key, size, count);
+            }
+
+            have_key = false;
+        }
+
+        if (!run)
+            break;
+
+        if (!have_key) {
+            memcpy(key, run->key, run->size);
+            size = run->size;
+            count = 0;
+            have_key = true;
+        }
+
+        count += run->count;
+
+        if (stats_run_next(run)) {
+            stats_heap_down(heap, heap_count, 0);
+        }
+        else {
+            heap[0] = heap[--heap_count];
+            stats_heap_down(heap, heap_count, 0);
+        }
+    }
+
+    stats_top_t pmis = stats_top_make(stats->top_count);
+    stats_run_t candidate = { .file = candidates };
+
+    rewind(candidates);
+
+    while (stats_run_next(&candidate)) {
+        f64 pmi = stats_table_pmi(&unigrams, candidate.key, candidate.size, candidate.count, tokens);
+        stats_top_offer(&pmis, pmi, candidate.key, candidate.size, candidate.count);
+    }
+
+    fclose(candidates);
+    remove(candidates_path);
+
+    stats_buffer_t out = {0};
+
+    stats_printf(&out, "== global: "FMT_U64" tokens, %u distinct words, "FMT_U64" distinct bigrams\n",
+                 tokens, unigrams.count, distinct_bigrams);
+    stats_top_print(&words,   &out, "top words",    false);
+    stats_top_print(&bigrams, &out, "top bigrams",  false);
+    stats_top_print(&pmis,    &out, "collocations", true);
+
+    fwrite(out.data, 1, out.count, stdout);
+
+    for (u32 r = 0; r < runs.count; ++r) {
+        if (runs.data[r].file) {
+            fclose(runs.data[r].file);
+        }
+    }
+
+    for (u32 r = 0; r < paths.count; ++r) {
+        remove(paths.data[r]);
+        free(paths.data[r]);
+    }
+
+    free(paths.data);
+
+    for (u32 r = 0; r < memory_runs.count; ++r) {
+        free(memory_runs.data[r]);
+    }
+
+    free(out.data);
+    free(heap);
+    free(runs.data);
+    free(memory_runs.data);
+    free(words.entries);
+    free(bigrams.entries);
+    free(pmis.entries);
+    stats_table_free(&unigrams);
+}
+
+static void
+print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-n top] [-t threads] [-m MiB] [-d tmp dir] <file.vtt>...\n", program);
+}
+
+i32
+main(i32 argc, char *argv[])
+{
+    stats_t stats = {
+        .top_count = STATS_DEFAULT_TOP,
+        .tmp_dir   = "/tmp",
+    };
+
+    u32 thread_count = par_thread_count();
+    u64 memory = STATS_DEFAULT_MEM;
+
+    i32 arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        switch (argv[arg][1]) {
+            case 'n': stats.top_count = atoi(argv[arg + 1]); break;
+            case 't': thread_count    = atoi(argv[arg + 1]); break;
+            case 'm': memory          = atoi(argv[arg + 1]); break;
+            case 'd': stats.tmp_dir   = argv[arg + 1];       break;
+
+            default: {
+                print_usage(argv[0]);
+                return 1;
+            } break;
+        }
+    }
+
+    if (arg == argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    stats.files      = argv + arg;
+    stats.file_count = argc - arg;
+
+    // `vtt_parse_file` expects the files to be there.
+    for (u32 i = 0; i < stats.file_count; ++i) {
+        if (access(stats.files[i], R_OK) != 0) {
+            fprintf(stderr, "Can't read '%s'!\n", stats.files[i]);
+            return 1;
+        }
+    }
+
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    stats.table_budget = memory * 1024 * 1024 / thread_count;
+    stats.threads = calloc(thread_count, sizeof(stats_thread_t));
+    stats.reports = calloc(stats.file_count, sizeof(char *));
+
+    par_for(stats.file_count, thread_count, stats_count_file, &stats);
+
+    for (u32 i = 0; i < stats.file_count; ++i) {
+        fputs(stats.reports[i], stdout);
+        free(stats.reports[i]);
+    }
+
+    stats_report_global(&stats, thread_count);
+
+    for (u32 t = 0; t < thread_count; ++t) {
+        stats_thread_t *thread = stats.threads + t;
+
+        stats_table_free(&thread->table);
+        stats_table_free(&thread->video);
+        free(thread->vtt.text.data);
+        free(thread->vtt.words.data);
+        free(thread->run_paths.data);
+        normalize_batch_free(&thread->normalized);
+    }
+
+    free(stats.threads);
+    free(stats.reports);
+
+    return 0;
+}